@@ -48,3 +48,15 @@
 #define WTH_MAX_PRIO_QUEUE_SIZE                    32
 #define WTH_KB_QUEUE_SIZE                          32
 #define WTH_SERIAL_QUEUE_SIZE                      32
+#define WTH_ZERO_POOL_QUEUE_SIZE                    4
+
+/* Pre-zeroed pages kept ready by the zero pool (see zero_pool.c) */
+#define ZERO_POOL_PAGES                 (TINY_KERNEL ? 8 : 64)
+#define ZERO_POOL_REFILL_BATCH                      8
+
+/*
+ * The page-frame allocator gets its memory from kmalloc, in chunks of
+ * 2^PAGE_ALLOC_MAX_ORDER pages. That's also the max order of an allocation.
+ */
+#define PAGE_ALLOC_MAX_ORDER             (TINY_KERNEL ? 6 : 8)
+#define PAGE_ALLOC_MAX_FREE_CHUNKS                  1
@@ -11,6 +11,7 @@
 /* ------ Value-based config variables -------- */
 
 #define USER_STACK_PAGES       @USER_STACK_PAGES@
+#define TLB_FLUSH_ALL_THR      @TLB_FLUSH_ALL_THR@
 
 /* --------- Boolean config variables --------- */
 
@@ -35,6 +36,7 @@
 
 
 #define USER_VDSO_VADDR  (LINEAR_MAPPING_END)
+#define USER_VVAR_VADDR  (USER_VDSO_VADDR + 0x1000) /* see vdso.h */
 
 #define USERMODE_VADDR_END   (KERNEL_BASE_VA) /* biggest user vaddr + 1 */
 #define MAX_BRK                  (0x40000000) /* +1 GB (virtual memory) */
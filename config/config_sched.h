@@ -12,6 +12,7 @@
 
 /* --------- Boolean config variables --------- */
 #cmakedefine01 KRN_RESCHED_ENABLE_PREEMPT
+#cmakedefine01 KRN_NO_HZ_IDLE
 
 /*
  * --------------------------------------------------------------------------
@@ -229,6 +229,20 @@ static ALWAYS_INLINE void disable_interrupts_forced(void)
 #endif
 }
 
+/*
+ * Enable the interrupts and halt the CPU. Because `sti` takes effect only after
+ * the next instruction, no IRQ can be serviced between the two: therefore, an
+ * IRQ that happens after the caller checked for work to do with interrupts
+ * disabled will always wake up the CPU.
+ */
+static ALWAYS_INLINE void enable_interrupts_and_halt(void)
+{
+#ifndef UNIT_TEST_ENVIRONMENT
+   asmVolatile("sti\n\t"
+               "hlt");
+#endif
+}
+
 static ALWAYS_INLINE bool are_interrupts_enabled(void)
 {
    return !!(get_eflags() & EFLAGS_IF);
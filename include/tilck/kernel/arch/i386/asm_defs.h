@@ -24,6 +24,18 @@
 #define REGS_FL_SYSENTER        1
 #define REGS_FL_FPU_ENABLED     8
 
+/* See struct vdso_data */
+#define VVAR_SEQ_OFF            0
+#define VVAR_CLOCK_MODE_OFF     4
+#define VVAR_BASE_CYCLES_OFF    8
+#define VVAR_MAX_CYCLES_OFF    16
+#define VVAR_MULT_OFF          24
+#define VVAR_SHIFT_OFF         28
+#define VVAR_BASE_SEC_OFF      32
+#define VVAR_BASE_NSEC_OFF     40
+#define VVAR_COARSE_NSEC_OFF   44
+#define VVAR_COARSE_SEC_OFF    48
+
 #define X86_KERNEL_CODE_SEL  0x08
 #define X86_KERNEL_DATA_SEL  0x10
 #define X86_USER_CODE_SEL    0x1b
@@ -64,6 +64,23 @@ bintree_find_internal(void *root_obj,
                       cmpfun_ptr objval_cmpfun,   // cmp(root_obj, value_ptr)
                       long bintree_offset);
 
+/*
+ * Like bintree_find_internal(), but when there's no object equal to the given
+ * value, bintree_find_le_internal() returns the biggest object smaller than
+ * it, while bintree_find_ge_internal() returns the smallest object bigger than
+ * it. Both return NULL when such an object does not exist.
+ */
+void *
+bintree_find_le_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,   // cmp(root_obj, value_ptr)
+                         long bintree_offset);
+
+void *
+bintree_find_ge_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,   // cmp(root_obj, value_ptr)
+                         long bintree_offset);
 
 /*
  * returns a pointer to the removed object (if found) or NULL.
@@ -109,6 +126,16 @@ bintree_find_ptr_internal(void *root_obj,
                           long bintree_offset,
                           long field_off);
 void *
+bintree_find_le_ptr_internal(void *root_obj,
+                             const void *value_ptr,
+                             long bintree_offset,
+                             long field_off);
+void *
+bintree_find_ge_ptr_internal(void *root_obj,
+                             const void *value_ptr,
+                             long bintree_offset,
+                             long field_off);
+void *
 bintree_remove_ptr_internal(void **root_obj_ref,
                             void *value_ptr,
                             long bintree_offset,
@@ -151,6 +178,32 @@ bintree_remove_ptr_internal(void **root_obj_ref,
                              OFFSET_OF(struct_type, elem_name),               \
                              OFFSET_OF(struct_type, field_name))
 
+#define bintree_find_le(root_obj, value, objval_cmpfun, struct_type, elem_name)\
+   bintree_find_le_internal((void*)(root_obj),                                \
+                            (value), (objval_cmpfun),                         \
+                            OFFSET_OF(struct_type, elem_name))
+
+#define bintree_find_ge(root_obj, value, objval_cmpfun, struct_type, elem_name)\
+   bintree_find_ge_internal((void*)(root_obj),                                \
+                            (value), (objval_cmpfun),                         \
+                            OFFSET_OF(struct_type, elem_name))
+
+/*
+ * Like bintree_find_ptr(), but return respectively the biggest object <= value
+ * and the smallest object >= value, or NULL.
+ */
+#define bintree_find_le_ptr(root_obj, value, struct_type, elem_name, field)   \
+   bintree_find_le_ptr_internal((void*)(root_obj),                            \
+                                TO_PTR(value),                                \
+                                OFFSET_OF(struct_type, elem_name),            \
+                                OFFSET_OF(struct_type, field))
+
+#define bintree_find_ge_ptr(root_obj, value, struct_type, elem_name, field)   \
+   bintree_find_ge_ptr_internal((void*)(root_obj),                            \
+                                TO_PTR(value),                                \
+                                OFFSET_OF(struct_type, elem_name),            \
+                                OFFSET_OF(struct_type, field))
+
 #define bintree_remove(rootref, value, objval_cmpfun, struct_type, elem_name) \
    bintree_remove_internal((void**)(rootref),                                 \
                            (value), (objval_cmpfun),                          \
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * A free-running hardware counter (e.g. the TSC), used to interpolate the
+ * system time between two ticks with nanosecond resolution. The conversion
+ * from counter cycles to nanoseconds is: ns = (cycles * mult) >> shift.
+ */
+struct clocksource {
+
+   const char *name;
+   u64 (*read)(void);
+   u32 mult;
+   u32 shift;
+   u32 vdso_mode;             /* VDSO_CLOCK_*: how the vDSO can read it */
+};
+
+/* Snapshot of the system time, taken at the last clocksource update */
+struct clocksource_base {
+
+   struct clocksource *cs;
+   u64 base_ns;
+   u64 base_cycles;
+   u64 max_cycles;         /* max delta that can be converted w/o overflow */
+   u32 mult;               /* the clocksource's mult, adjusted to tick_ns */
+   u32 shift;
+};
+
+static ALWAYS_INLINE u64
+clocksource_cyc2ns(u64 cycles, u32 mult, u32 shift)
+{
+   return (cycles * mult) >> shift;
+}
+
+/*
+ * Calculate `mult` and `shift` for the given clocksource, given that it
+ * counted `cycles` cycles in `ns` nanoseconds.
+ */
+void clocksource_calibrate(struct clocksource *cs, u64 cycles, u64 ns);
+
+/*
+ * Use the given (calibrated) clocksource, starting from the next tick. With
+ * NULL, stop using any clocksource.
+ */
+void clocksource_select(struct clocksource *cs);
+
+/*
+ * Called by the timer code after each tick (or group of ticks).
+ *
+ *    now:           the system time, as measured by the tick-based clock
+ *    tick_ns:       how much the system time will advance at the next tick
+ *    real_tick_ns:  the real duration of a tick
+ *
+ * The two tick durations differ while the clock drift is being compensated:
+ * in that case, the interpolation speed is adjusted accordingly.
+ */
+void clocksource_update(u64 now, u32 tick_ns, u32 real_tick_ns);
+
+/*
+ * Read the interpolated system time, in nanoseconds. Returns false if no
+ * clocksource is in use. It never goes backwards and it doesn't need the
+ * interrupts to be disabled.
+ */
+bool clocksource_get_ns(u64 *ns);
+
+/* Get the current snapshot. Expects interrupts to be disabled. */
+void clocksource_get_base(struct clocksource_base *b);
+
+/* Name of the clocksource in use, or NULL if none */
+const char *clocksource_get_name(void);
+
+/* Implemented by the arch code: returns NULL if there's no usable counter */
+struct clocksource *hw_get_clocksource(void);
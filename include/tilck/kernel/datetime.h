@@ -29,6 +29,7 @@ static inline bool is_leap_year(u32 year)
 }
 
 u64 get_sys_time(void);
+u64 get_sys_time_hr(void);
 s64 get_timestamp(void);
 void init_system_time(void);
 int clock_get_second_drift(void);
@@ -36,6 +37,7 @@ bool clock_in_resync(void);
 bool clock_in_full_resync(void);
 void ticks_to_timespec(u64 ticks, struct k_timespec64 *tp);
 u64 timespec_to_ticks(const struct k_timespec64 *tp);
+void sys_time_to_timespec(u64 t, struct k_timespec64 *tp);
 void real_time_get_timespec(struct k_timespec64 *tp);
 void monotonic_time_get_timespec(struct k_timespec64 *tp);
 void clock_get_resync_stats(struct clock_resync_stats *s);
@@ -59,6 +59,12 @@ int get_int_num(regs_t *context);
 void on_first_pdir_update(void);
 void hw_read_clock(struct datetime *out);
 u32 hw_timer_setup(u32 hz);
+u32 hw_timer_max_oneshot_ticks(void);
+bool hw_timer_is_oneshot(void);
+void hw_timer_setup_oneshot(u32 ns);
+u32 hw_timer_stop_oneshot(void);
+u32 hw_timer_ack_irq(void);
+u32 hw_timer_get_elapsed_ns(void);
 
 bool allocate_fpu_regs(arch_task_members_t *arch_fields);
 void copy_main_tss_on_regs(regs_t *ctx);
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+
+struct hrtimer;
+typedef void (*hrtimer_func)(struct hrtimer *t);
+
+/*
+ * High-resolution timer, with nanosecond granularity (in practice, bounded by
+ * the hardware timer's resolution). Unlike ktimers, hrtimers are kept in a
+ * sorted list and they're meant for short or precise timeouts.
+ *
+ * The callback is called by the timer IRQ handler, with interrupts disabled:
+ * it must be short and it cannot sleep. It's allowed to re-arm the timer.
+ */
+struct hrtimer {
+
+   struct list_node node;     /* node in the sorted list of active timers */
+   u64 expires;               /* absolute expire time, see get_sys_time_hr() */
+   hrtimer_func func;
+   void *arg;
+};
+
+void hrtimer_init(struct hrtimer *t, hrtimer_func func, void *arg);
+
+/* (Re-)arm the timer to expire after `ns` nanoseconds */
+void hrtimer_start(struct hrtimer *t, u64 ns);
+
+/* Cancel the timer: returns the ns it had before expiring, 0 if none */
+u64 hrtimer_cancel(struct hrtimer *t);
+
+static ALWAYS_INLINE bool hrtimer_is_active(struct hrtimer *t)
+{
+   return !list_node_is_empty(&t->node);
+}
+
+/* Used by the timer subsystem */
+void hrtimer_run_expired(void);
+u64 hrtimer_get_next_delta(void);
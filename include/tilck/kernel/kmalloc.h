@@ -79,6 +79,14 @@ kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t sz);
 void *
 per_heap_kmalloc(struct kmalloc_heap *h, size_t *size, u32 flags);
 
+/*
+ * Allocate exactly the `size` bytes at `ptr` in the heap `h`, if they're all
+ * free. Supports only KMALLOC_FL_NO_ACTUAL_ALLOC and the sub-block size among
+ * the flags: the allocation is always multi-step and must be freed as such.
+ */
+void *
+per_heap_kmalloc_at(struct kmalloc_heap *h, void *ptr, size_t size, u32 flags);
+
 void
 per_heap_kfree(struct kmalloc_heap *h, void *ptr, size_t *size, u32 flags);
 
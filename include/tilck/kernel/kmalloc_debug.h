@@ -60,3 +60,41 @@ void debug_kmalloc_stop_leak_detector(bool show_leaks);
 
 void debug_kmalloc_start_log(void);
 void debug_kmalloc_stop_log(void);
+
+/*
+ * Call-site profiler (KMALLOC_CALLSITE_PROFILER): kmalloc's memory usage
+ * broken down by the return address of the kmalloc() calls.
+ */
+
+struct kmalloc_site_stats {
+
+   ulong caller;              /* return address of the kmalloc() call */
+   size_t live_bytes;         /* bytes currently allocated */
+   size_t peak_bytes;         /* max value of `live_bytes` */
+   ulong live_allocs;         /* allocations not freed yet */
+   ulong tot_allocs;          /* lifetime allocations */
+};
+
+struct kmalloc_prof_info {
+
+   u32 sites;                 /* distinct call sites seen */
+   u32 max_sites;             /* call sites after which all go to "other" */
+   u32 tracked;               /* live allocations tracked */
+   u32 max_tracked;
+   ulong untracked;           /* allocs not tracked: the live table was full */
+};
+
+void
+debug_kmalloc_prof_get_info(struct kmalloc_prof_info *info);
+
+/*
+ * Copy the stats of up to `max_count` call sites in `buf` and return the
+ * number of sites copied. The "other" site, the one accounting the calls made
+ * when the site table is full, has caller = 0.
+ */
+u32
+debug_kmalloc_prof_get_sites(struct kmalloc_site_stats *buf, u32 max_count);
+
+/* Write in `buf` the call site as "symbol+offset", if symbols are available */
+void
+debug_kmalloc_prof_site_name(ulong caller, char *buf, size_t buf_sz);
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+
+/*
+ * Slab caches for hot, fixed-size kernel objects. Each cache gets from
+ * kmalloc() whole "slabs", aligned at their (power of 2) size and with a small
+ * header at the beginning, and carves its objects out of them. Allocating or
+ * freeing an object is O(1): no metadata trees to walk, just a per-slab free
+ * list. Slabs are kept in three lists: partial, full and free (empty). The
+ * empty ones are returned to kmalloc, except for KMEM_CACHE_MAX_FREE_SLABS.
+ *
+ * Caches are defined statically with DEFINE_KMEM_CACHE() and set up lazily at
+ * the first allocation, or at runtime with kmem_cache_init(). Like kmalloc(),
+ * they must not be used in IRQ context.
+ */
+
+#define KMEM_CACHE_MAX_FREE_SLABS           1
+#define KMEM_SLAB_MIN_OBJS                  8
+
+/*
+ * Optional constructor: when a cache has one, it's called once for each object
+ * when its slab is created, not at every allocation. Therefore, objects must
+ * be returned to the cache in their constructed state.
+ */
+typedef void (*kmem_cache_ctor)(void *obj);
+
+struct kmem_cache_stats {
+
+   ulong slabs;               /* slabs currently allocated */
+   ulong active_objs;         /* objects currently allocated */
+   ulong peak_active_objs;    /* max value of `active_objs` */
+   ulong allocs;              /* lifetime object allocations */
+   ulong frees;               /* lifetime object frees */
+   ulong slab_allocs;         /* lifetime slab allocations (kmalloc calls) */
+};
+
+struct kmem_cache {
+
+   const char *name;
+   u32 obj_size;              /* size requested by the user */
+   u32 obj_stride;            /* distance between two objects in a slab */
+   u32 slab_size;             /* power of 2, <= KMALLOC_MAX_ALIGN */
+   u32 objs_per_slab;
+   bool initialized;
+   kmem_cache_ctor ctor;
+
+   struct list partial_slabs;
+   struct list full_slabs;
+   struct list free_slabs;
+   ulong free_slabs_count;
+
+   struct list_node node;     /* in the list of all the caches */
+   struct kmem_cache_stats stats;
+};
+
+#define KMEM_CACHE_INIT(var, name_str, size, ctor_func) {               \
+   .name = (name_str),                                                 \
+   .obj_size = (size),                                                 \
+   .ctor = (ctor_func),                                                \
+   .partial_slabs = STATIC_LIST_INIT((var).partial_slabs),             \
+   .full_slabs = STATIC_LIST_INIT((var).full_slabs),                   \
+   .free_slabs = STATIC_LIST_INIT((var).free_slabs),                   \
+   .node = STATIC_LIST_NODE_INIT((var).node),                          \
+}
+
+#define DEFINE_KMEM_CACHE(var, name_str, size, ctor_func)               \
+   struct kmem_cache var = KMEM_CACHE_INIT(var, name_str, size, ctor_func)
+
+void
+kmem_cache_init(struct kmem_cache *c,
+                const char *name,
+                u32 obj_size,
+                kmem_cache_ctor ctor);
+
+/*
+ * Free all the slabs of `c` and unregister it. All of its objects must have
+ * been freed.
+ */
+void
+kmem_cache_destroy(struct kmem_cache *c);
+
+/* Returns NULL in case of OOM */
+void *
+kmem_cache_alloc(struct kmem_cache *c);
+
+/* Like kmem_cache_alloc(), but zeroes the object. Not for caches with a ctor */
+void *
+kmem_cache_zalloc(struct kmem_cache *c);
+
+void
+kmem_cache_free(struct kmem_cache *c, void *obj);
+
+/*
+ * Call `cb` for each registered cache, with preemption disabled. Stops at the
+ * first non-zero value returned by `cb` and returns it.
+ */
+int
+for_each_kmem_cache(int (*cb)(struct kmem_cache *, void *), void *arg);
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+
+struct ktimer;
+typedef void (*ktimer_func)(struct ktimer *t);
+
+/*
+ * Generic kernel timer, living in a hierarchical timer wheel.
+ *
+ * The callback is called by the timer IRQ handler, with interrupts disabled:
+ * it must be short and it cannot sleep. It's allowed to re-arm the timer.
+ */
+struct ktimer {
+
+   struct list_node node;     /* node in a wheel slot */
+   u64 expires;               /* absolute expire time, in wheel ticks */
+   ktimer_func func;
+   void *arg;
+};
+
+void ktimer_init(struct ktimer *t, ktimer_func func, void *arg);
+
+/* (Re-)arm the timer to expire after `ticks` ticks (> 0) */
+void ktimer_start(struct ktimer *t, u32 ticks);
+
+/* Cancel the timer: returns the ticks it had before expiring, 0 if none */
+u32 ktimer_cancel(struct ktimer *t);
+
+/* Ticks before the timer expires, or 0 if not active */
+u32 ktimer_get_remaining(struct ktimer *t);
+
+static ALWAYS_INLINE bool ktimer_is_active(struct ktimer *t)
+{
+   return !list_node_is_empty(&t->node);
+}
+
+/* Used by the timer subsystem */
+void init_ktimers(void);
+void ktimer_tick(u32 n);
+u32 ktimer_get_next_expiry(u32 max_ticks);
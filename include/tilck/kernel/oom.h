@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Out-of-memory killer: when a page fault cannot be handled because there's
+ * no memory left, kill the process using the most memory, instead of the one
+ * that happened to fault, and reclaim its anonymous memory right away.
+ */
+
+struct oom_stats {
+
+   ulong kills;            /* processes killed by the OOM killer */
+   ulong reclaimed_pages;  /* pages reclaimed from the victims */
+};
+
+/*
+ * Called by the page fault handlers when they fail to allocate memory, with
+ * preemption disabled. Returns true when the fault has to be retried, false
+ * when there's nothing that could be done.
+ */
+bool oom_handle_page_fault(void);
+
+const struct oom_stats *oom_get_stats(void);
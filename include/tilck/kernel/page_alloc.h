@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Page-frame allocator (buddy system), used for page-granular allocations
+ * like user pages, page tables and ramfs blocks. Sub-page objects still have
+ * to use kmalloc().
+ */
+
+struct page_alloc_stats {
+
+   ulong chunks;              /* chunks of memory taken from kmalloc */
+   ulong free_pages;          /* free pages in those chunks */
+   ulong allocs;              /* pages allocated with alloc_page() */
+   ulong fallback_allocs;     /* ... of which, allocated by kmalloc */
+};
+
+void init_page_alloc(ulong phys_mem_lim);
+
+/*
+ * Allocate 2^order physically-contiguous pages. Returns their (linear-mapped)
+ * kernel vaddr or NULL in case of OOM.
+ */
+void *pfa_alloc(u32 order);
+
+/* Free pages allocated with pfa_alloc(), with the same order */
+void pfa_free(void *vaddr, u32 order);
+
+/* Check if the page at `vaddr` belongs to the page-frame allocator */
+bool pfa_owns_page(void *vaddr);
+
+/*
+ * Allocate a single page, falling back to kmalloc() if the page-frame
+ * allocator cannot get more memory.
+ */
+void *alloc_page(void);
+
+/*
+ * Free a page allocated with alloc_page(). It's fine to use it also for pages
+ * allocated directly with kmalloc(PAGE_SIZE) or as part of bigger kmalloc
+ * allocations (e.g. user_valloc_and_map()), as it happens when user pages are
+ * unmapped: this function checks where the page comes from.
+ */
+void free_page(void *vaddr);
+
+/*
+ * Allocate `size` bytes (a power of 2) of physically-contiguous memory, aligned
+ * at `size`, directly from kmalloc. Used for the big (4 MB) user pages. Such a
+ * block can be freed all together with free_aligned_pages() or page by page
+ * with free_page(), in any order.
+ */
+void *alloc_aligned_pages(size_t size);
+void free_aligned_pages(void *vaddr, size_t size);
+
+void page_alloc_get_stats(struct page_alloc_stats *stats);
@@ -40,6 +40,7 @@ extern char zero_page[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
 void early_init_paging();
 bool handle_potential_cow(void *r);
+bool handle_potential_demand_zero(void *r);
 
 /*
  * Map a pageframe at `paddr` at the virtual address `vaddr` in the page
@@ -84,12 +85,28 @@ void unmap_page(pdir_t *pdir, void *vaddr, bool do_free);
 int unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool do_free);
 void unmap_pages(pdir_t *pdir, void *vaddr, size_t count, bool do_free);
 size_t unmap_pages_permissive(pdir_t *pd, void *va, size_t count, bool do_free);
+
+/*
+ * Like unmap_pages(), but without invalidating the TLB: the caller has to do
+ * that later with invalidate_pages() or invalidate_all_pages(), before the
+ * virtual range can be re-used.
+ */
+void
+unmap_pages_noflush(pdir_t *pdir, void *vaddr, size_t count, bool do_free);
+int remap_pages(pdir_t *pdir, void *src, void *dst, size_t page_count);
+int protect_pages(pdir_t *pdir, void *vaddr, size_t count, u32 pg_flags);
+size_t reclaim_user_pages(pdir_t *pdir,
+                          void *vaddr,
+                          size_t page_count,
+                          size_t *unmapped);
 ulong get_mapping(pdir_t *pdir, void *vaddr);
 int get_mapping2(pdir_t *pdir, void *vaddrp, ulong *pa_ref);
 pdir_t *pdir_clone(pdir_t *pdir);
 pdir_t *pdir_deep_clone(pdir_t *pdir);
 void pdir_destroy(pdir_t *pdir);
 void invalidate_page(ulong vaddr);
+void invalidate_pages(pdir_t *pdir, void *vaddr, size_t page_count);
+void invalidate_all_pages(void);
 void set_page_rw(pdir_t *pdir, void *vaddr, bool rw);
 void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
 void release_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+struct task;
+struct process;
+struct list;
+
+/*
+ * PID table: a two-level (radix) table indexed by tid, plus a bitmap of the
+ * free IDs, for both user PIDs [0, MAX_PID] and kernel TIDs [KERNEL_TID_START,
+ * KERNEL_TID_START + KERNEL_MAX_TID].
+ *
+ * A user ID is considered in use when there's a task with that tid OR when
+ * at least one process has it as pgid or sid (see below). That guarantees that
+ * a new process cannot accidentally become the leader of an orphaned group or
+ * session.
+ *
+ * All the functions here require preemption to be disabled.
+ */
+
+int pid_table_alloc_pid(void);
+int pid_table_alloc_kernel_tid(void);
+
+void pid_table_add_task(struct task *ti);
+void pid_table_remove_task(struct task *ti);
+struct task *pid_table_get_task(int tid);
+
+/*
+ * Per-group and per-session membership: each user ID has the list of the
+ * processes having it as pgid (`pgrp_node`) and the list of the ones having it
+ * as sid (`session_node`). The get functions return NULL for empty lists.
+ */
+void pid_table_add_process(struct process *pi);
+void pid_table_remove_process(struct process *pi);
+struct list *pid_table_get_pgrp_members(int pgid);
+struct list *pid_table_get_session_members(int sid);
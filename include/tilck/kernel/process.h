@@ -30,7 +30,7 @@ struct mappings_info {
 
    struct kmalloc_heap *mmap_heap;
    size_t mmap_heap_size;
-   struct list mappings;
+   struct user_mapping *mappings;   /* AVL tree of user mappings, by vaddr */
 };
 
 struct process {
@@ -47,13 +47,19 @@ struct process {
    void *initial_brk;
    struct mappings_info *mi;
 
+   u32 anon_faults;                  /* demand-zero page faults handled */
+   u32 anon_pages;                   /* demand-zero pages currently mapped */
+
    struct list children;
+   struct list_node pgrp_node;       /* node in the pgid's members list */
+   struct list_node session_node;    /* node in the sid's members list */
 
    void *proc_tty;
    bool did_call_execve;
    bool automatic_reaping;       /* the parent explicitly ignored SIGCHLD */
    bool vforked;                 /* after vfork(), before execve() */
    bool inherited_mmap_heap;
+   bool oom_killed;              /* killed by the OOM killer, see oom.c */
    bool did_set_tty_medium_raw;
 
    int *set_child_tid;                    /* NOTE: this is an user pointer */
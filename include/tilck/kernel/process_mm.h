@@ -5,10 +5,11 @@
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/list.h>
+#include <tilck/kernel/bintree.h>
 
 struct user_mapping {
 
-   struct list_node pi_node;
+   struct bintree_node pi_node;
    struct list_node inode_node;
    struct process *pi;
 
@@ -22,6 +23,7 @@ struct user_mapping {
    };
 
    int prot;
+   int flags;        /* mmap() flags: only MAP_HUGETLB is recorded */
 
 };
 
@@ -32,16 +34,20 @@ void full_remove_user_mapping(struct process *pi, struct user_mapping *um);
 void remove_all_mappings_of_handle(struct process *pi, fs_handle h);
 void remove_all_user_zero_mem_mappings(struct process *pi);
 struct user_mapping *process_get_user_mapping(void *vaddr);
+struct user_mapping *process_get_next_user_mapping(void *vaddr);
 void remove_all_file_mappings(struct process *pi);
 struct mappings_info *
 duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi);
+bool is_demand_zero_vaddr(void *vaddr, bool rw, bool *writable);
+bool is_big_demand_zero_range(void *vaddr, size_t len);
+void user_unmap_demand_zero_pages(struct process *pi,
+                                  void *vaddr,
+                                  size_t page_count);
 
 
 /* Internal functions */
 bool user_valloc_and_map(ulong user_vaddr, size_t page_count);
 void user_vfree_and_unmap(ulong user_vaddr, size_t page_count);
-void user_unmap_zero_page(ulong user_vaddr, size_t page_count);
-bool user_map_zero_page(ulong user_vaddr, size_t page_count);
 int generic_fs_munmap(struct user_mapping *um, void *vaddrp, size_t len);
 
 /* Special one-time funcs */
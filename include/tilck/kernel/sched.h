@@ -10,11 +10,20 @@
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/signal.h>
+#include <tilck/kernel/ktimer.h>
+#include <tilck/kernel/hrtimer.h>
 
 #include <tilck_gen_headers/config_sched.h>
 
 #define TIME_SLICE_TICKS (TIMER_HZ / 25)
 
+#define RR_TIME_SLICE_TICKS (TIMER_HZ / 10)
+
+#define MAX_RT_PRIO               99
+#define MIN_NICE                 -20
+#define MAX_NICE                  19
+#define NICE_WIDTH               (MAX_NICE - MIN_NICE + 1)
+
 enum task_state {
    TASK_STATE_INVALID   = 0,
    TASK_STATE_RUNNABLE  = 1,
@@ -77,14 +86,20 @@ struct task {
    void *worker_thread;                      /* only for worker threads */
 
    struct bintree_node tree_by_tid_node;
-   struct list_node runnable_node;
-   struct list_node wakeup_timer_node;
+   struct bintree_node runnable_node; /* node in the vruntime-ordered rq */
+   struct list_node rt_node;          /* node in the RT queue of `rt_prio` */
    struct list_node siblings_node;    /* nodes in parent's pi's children list */
 
    struct list tasks_waiting_list;    /* tasks waiting this task to end */
 
    s32 wstatus;                       /* waitpid's wstatus  */
    struct sched_ticks ticks;          /* scheduler counters */
+   int nice;                          /* in [MIN_NICE, MAX_NICE] */
+   int rt_prio;                       /* in [1, MAX_RT_PRIO], 0 if not RT */
+   u8 policy;                         /* SCHED_OTHER, SCHED_FIFO, SCHED_RR */
+
+   /* Preempted RT task: re-queue it at the head of its queue */
+   bool rt_preempted;
 
    void *kernel_stack;
    void *args_copybuf;
@@ -95,7 +110,11 @@ struct task {
    };
 
    struct wait_obj wobj;
-   u32 ticks_before_wake_up;
+   struct ktimer wakeup_timer;
+   struct hrtimer wakeup_hrtimer;
+
+   /* Absolute deadline of a ns-based wake-up timer, 0 if none */
+   u64 wakeup_deadline;
 
    /* List of callbacks to call on exit */
    struct list on_exit;
@@ -112,6 +131,9 @@ struct task {
    /* The task was sleeping on a timer and has just been woken up */
    bool timer_ready;
 
+   /* Value of `timer_ready` when the task was inserted in the run queue */
+   bool rq_timer_ready;
+
    /* The current sa_mask has been altered by sigsuspend() */
    bool in_sigsuspend;
 
@@ -141,7 +163,6 @@ extern struct task *kernel_process;
 extern struct process *kernel_process_pi;
 extern struct task *idle_task;
 
-extern struct list runnable_tasks_list;
 extern const char *const task_state_str[5];
 
 #define KTH_ALLOC_BUFS                       (1 << 0)
@@ -385,7 +406,7 @@ bool pending_signals(void);
 int get_curr_tid(void);
 int get_curr_pid(void);
 void save_current_task_state(regs_t *);
-void sched_account_ticks(void);
+void sched_account_ticks(u32 n);
 int create_new_pid(void);
 int create_new_kernel_tid(void);
 void task_info_reset_kernel_stack(struct task *ti);
@@ -399,7 +420,10 @@ void kthread_exit(void);
 int kthread_join(int tid, bool ignore_signals);
 int kthread_join_all(const int *tids, size_t n, bool ignore_signals);
 
+void task_init_wakeup_timer(struct task *ti);
 void task_set_wakeup_timer(struct task *task, u32 ticks);
+void task_set_wakeup_timer_ns(struct task *ti, u64 ns);
+u64 task_cancel_wakeup_timer_ns(struct task *ti);
 void task_update_wakeup_timer_if_any(struct task *ti, u32 new_ticks);
 u32 task_cancel_wakeup_timer(struct task *ti);
 
@@ -416,6 +440,10 @@ NODISCARD int kthread_create2(kthread_func_ptr func,
 int iterate_over_tasks(bintree_visit_cb func, void *arg);
 int sched_count_proc_in_group(int pgid);
 int sched_get_session_of_group(int pgid);
+void sched_change_pgid_sid(struct process *pi, int pgid, int sid);
+void sched_set_task_nice(struct task *ti, int nice);
+void sched_set_task_policy(struct task *ti, int policy, int rt_prio);
+u32 sched_nice_to_weight(int nice);
 
 struct process *task_get_pi_opaque(struct task *ti);
 void process_set_tty(struct process *pi, void *t);
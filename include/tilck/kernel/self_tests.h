@@ -52,6 +52,8 @@ void se_regular_end(void);
 void se_interrupted_end(void);
 void simple_test_kthread(void *arg);
 void selftest_kmalloc_perf(void);
+void selftest_page_alloc_perf(void);
+void selftest_munmap_perf(void);
 
 /* Deadlock detection functions */
 void debug_reset_no_deadlock_set(void);
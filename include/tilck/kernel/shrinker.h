@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+
+/*
+ * Memory-pressure shrinkers. Kernel caches keeping memory that could be given
+ * back on demand (empty small heaps, free slabs, spare page chunks, pools of
+ * pre-zeroed pages etc.) register a shrinker. When kmalloc() is about to fail,
+ * or a page fault cannot get a page, the shrinkers are asked to release their
+ * memory and the allocation is retried.
+ *
+ * Both the callbacks are called with preemption disabled, possibly in the
+ * middle of a kmalloc() call: they must not sleep and must not allocate
+ * memory, but they can free it. Shrinkers run in the reverse order of
+ * registration: caches built on top of other caches (e.g. the zero pool, on
+ * top of the page allocator) must be registered after them, so that the
+ * memory they release can be released by the lower levels as well.
+ */
+
+struct shrinker;
+
+/* Return the number of bytes the shrinker could release right now */
+typedef size_t (*shrinker_count_func)(struct shrinker *s);
+
+/* Try to release at least `bytes` bytes. Return the bytes actually released */
+typedef size_t (*shrinker_scan_func)(struct shrinker *s, size_t bytes);
+
+struct shrinker_stats {
+
+   ulong scans;               /* calls to scan() */
+   ulong released;            /* lifetime bytes released */
+};
+
+struct shrinker {
+
+   const char *name;
+   shrinker_count_func count;
+   shrinker_scan_func scan;
+
+   struct list_node node;     /* in the list of all the shrinkers */
+   struct shrinker_stats stats;
+};
+
+#define SHRINKER_INIT(var, name_str, count_func, scan_func) {           \
+   .name = (name_str),                                                 \
+   .count = (count_func),                                              \
+   .scan = (scan_func),                                                \
+   .node = STATIC_LIST_NODE_INIT((var).node),                          \
+}
+
+#define DEFINE_SHRINKER(var, name_str, count_func, scan_func)           \
+   struct shrinker var = SHRINKER_INIT(var, name_str, count_func, scan_func)
+
+void
+register_shrinker(struct shrinker *s);
+
+void
+unregister_shrinker(struct shrinker *s);
+
+/* Sum of the count() of all the shrinkers */
+size_t
+shrinkers_count(void);
+
+/*
+ * Ask the shrinkers to release at least `bytes` bytes, stopping as soon as
+ * that's done. Pass (size_t)-1 to release everything possible. Returns the
+ * bytes released. Calls made while shrinking (e.g. from a scan() callback)
+ * or in IRQ context just return 0: reclaim is task-context only.
+ */
+size_t
+shrink_caches(size_t bytes);
+
+/*
+ * Call `cb` for each registered shrinker, with preemption disabled. Stops at
+ * the first non-zero value returned by `cb` and returns it.
+ */
+int
+for_each_shrinker(int (*cb)(struct shrinker *, void *), void *arg);
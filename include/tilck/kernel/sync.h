@@ -204,4 +204,5 @@ void kcond_destory(struct kcond *c);
 void kcond_signal_one(struct kcond *c);
 void kcond_signal_all(struct kcond *c);
 bool kcond_wait(struct kcond *c, struct kmutex *m, u32 timeout_ticks);
+bool kcond_wait_ns(struct kcond *c, struct kmutex *m, u64 timeout_ns);
 bool kcond_is_anyone_waiting(struct kcond *c);
@@ -23,6 +23,8 @@
 #include <sys/utsname.h>  // system header
 #include <sys/stat.h>     // system header
 #include <fcntl.h>        // system header
+#include <sys/resource.h> // system header
+#include <sched.h>        // system header
 
 #define MAX_SYSCALLS 500
 
@@ -115,6 +117,15 @@ struct k_timespec64 {
    long tv_nsec;
 };
 
+/*
+ * The kernel's sched_param struct: unlike the libc ones, it has no reserved
+ * fields after `sched_priority`.
+ */
+struct k_sched_param {
+
+   int sched_priority;
+};
+
 #ifdef BITS32
 
 /*
@@ -81,7 +81,7 @@ int sys_pause(void);
 int sys_utime32(const char *u_path, const struct k_utimbuf *u_times);
 int sys_access(const char *u_path, mode_t mode);
 
-CREATE_STUB_SYSCALL_IMPL(sys_nice)
+int sys_nice(int inc);
 
 int sys_sync(void);
 int sys_kill(int pid, int sig);
@@ -158,6 +158,7 @@ CREATE_STUB_SYSCALL_IMPL(sys_old_readdir)
 CREATE_STUB_SYSCALL_IMPL(sys_old_mmap)
 
 int sys_munmap(void *vaddr, size_t len);
+long sys_mremap(void *old_addr, size_t old_len, size_t new_len, int flags);
 
 CREATE_STUB_SYSCALL_IMPL(sys_truncate)
 CREATE_STUB_SYSCALL_IMPL(sys_ftruncate)
@@ -165,8 +166,10 @@ CREATE_STUB_SYSCALL_IMPL(sys_ftruncate)
 int sys_fchmod(int fd, mode_t mode);
 
 CREATE_STUB_SYSCALL_IMPL(sys_fchown16)
-CREATE_STUB_SYSCALL_IMPL(sys_getpriority)
-CREATE_STUB_SYSCALL_IMPL(sys_setpriority)
+
+int sys_getpriority(int which, int who);
+int sys_setpriority(int which, int who, int prio);
+
 CREATE_STUB_SYSCALL_IMPL(sys_statfs)
 CREATE_STUB_SYSCALL_IMPL(sys_fstatfs)
 CREATE_STUB_SYSCALL_IMPL(sys_ioperm)
@@ -200,7 +203,7 @@ int sys_newuname(struct utsname *buf);
 
 CREATE_STUB_SYSCALL_IMPL(sys_modify_ldt)
 CREATE_STUB_SYSCALL_IMPL(sys_adjtimex_time32)
-CREATE_STUB_SYSCALL_IMPL(sys_mprotect)
+int sys_mprotect(void *addr, size_t len, int prot);
 
 int sys_sigprocmask(ulong a1, ulong a2, ulong a3); // deprecated interface
 
@@ -237,21 +240,23 @@ CREATE_STUB_SYSCALL_IMPL(sys_mlock)
 CREATE_STUB_SYSCALL_IMPL(sys_munlock)
 CREATE_STUB_SYSCALL_IMPL(sys_mlockall)
 CREATE_STUB_SYSCALL_IMPL(sys_munlockall)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_setparam)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_getparam)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_setscheduler)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_getscheduler)
+
+int sys_sched_setparam(int pid, const struct k_sched_param *u_param);
+int sys_sched_getparam(int pid, struct k_sched_param *u_param);
+int sys_sched_setscheduler(int pid,
+                           int policy,
+                           const struct k_sched_param *u_param);
+int sys_sched_getscheduler(int pid);
 
 int sys_sched_yield(void);
 
-CREATE_STUB_SYSCALL_IMPL(sys_sched_get_priority_max)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_set_priority_min)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_rr_get_interval_time32)
+int sys_sched_get_priority_max(int policy);
+int sys_sched_get_priority_min(int policy);
+int sys_sched_rr_get_interval_time32(int pid, struct k_timespec32 *u_interval);
 
 int sys_nanosleep_time32(const struct k_timespec32 *req,
                          struct k_timespec32 *rem);
 
-CREATE_STUB_SYSCALL_IMPL(sys_mremap)
 CREATE_STUB_SYSCALL_IMPL(sys_setresuid16)
 CREATE_STUB_SYSCALL_IMPL(sys_getresuid16)
 CREATE_STUB_SYSCALL_IMPL(sys_vm86)
@@ -332,8 +337,8 @@ int sys_setgid(ulong gid);
 CREATE_STUB_SYSCALL_IMPL(sys_setfsuid)
 CREATE_STUB_SYSCALL_IMPL(sys_setfsgid)
 CREATE_STUB_SYSCALL_IMPL(sys_pivot_root)
-CREATE_STUB_SYSCALL_IMPL(sys_mincore)
 
+int sys_mincore(void *addr, size_t len, u8 *u_vec);
 int sys_madvise(void *addr, size_t len, int advice);
 int sys_getdents64(int fd, struct linux_dirent64 *dirp, u32 buf_size);
 int sys_fcntl64(int fd, int cmd, int arg);
@@ -556,7 +561,9 @@ CREATE_STUB_SYSCALL_IMPL(sys_mq_timedreceive)
 CREATE_STUB_SYSCALL_IMPL(sys_semtimedop)
 CREATE_STUB_SYSCALL_IMPL(sys_rt_sigtimedwait)
 CREATE_STUB_SYSCALL_IMPL(sys_futex)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_rr_get_interval)
+
+int sys_sched_rr_get_interval(int pid, struct k_timespec64 *u_interval);
+
 CREATE_STUB_SYSCALL_IMPL(sys_pidfd_send_signal)
 CREATE_STUB_SYSCALL_IMPL(sys_io_uring_setup)
 CREATE_STUB_SYSCALL_IMPL(sys_io_uring_enter)
@@ -10,4 +10,6 @@ extern struct kmalloc_heap first_heap_struct;
 extern struct kmalloc_heap *heaps[KMALLOC_HEAPS_COUNT];
 extern int used_heaps;
 extern size_t max_tot_heap_mem_free;
+extern u32 main_heaps_free_summary[];
+extern u32 main_heaps_dma_mask;
 #endif
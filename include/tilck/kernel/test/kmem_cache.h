@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/kmem_cache.h>
+
+#ifdef UNIT_TEST_ENVIRONMENT
+extern struct list kmem_caches_list;
+void kmem_caches_reset(void);
+#endif
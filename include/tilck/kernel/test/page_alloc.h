@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/config_kernel.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/list.h>
+
+#ifdef UNIT_TEST_ENVIRONMENT
+struct pfa_chunk;
+extern struct list pfa_free_lists[PAGE_ALLOC_MAX_ORDER + 1];
+extern struct pfa_chunk **pfa_chunks_table;
+extern ulong pfa_chunks_table_size;
+extern u32 pfa_free_chunks;
+extern struct page_alloc_stats pfa_stats;
+#endif
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/shrinker.h>
+
+#ifdef UNIT_TEST_ENVIRONMENT
+extern struct list shrinkers_list;
+void shrinkers_reset(void);
+#endif
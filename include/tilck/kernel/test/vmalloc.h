@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/vmalloc.h>
+
+void vmalloc_init_area(ulong va, size_t size);
+
+#ifdef UNIT_TEST_ENVIRONMENT
+extern ulong vmalloc_start;
+extern ulong vmalloc_end;
+#endif
@@ -6,6 +6,7 @@
 
 void kernel_sleep(u64 ticks);  /* sleep for `ticks` timer ticks (jiffies) */
 void kernel_sleep_ms(u64 ms);  /* sleep for `ms` milliseconds */
+void kernel_sleep_ns(u64 ns);  /* sleep for `ns` nanoseconds */
 void delay_us(u32 us);         /* busy-wait for `us` microseconds */
 
 static ALWAYS_INLINE u64
@@ -16,3 +17,15 @@ ms_to_ticks(u64 ms)
 
 u64 get_ticks(void);
 void init_timer(void);
+
+struct idle_stats {
+
+   u64 halts;           /* times the idle task halted the CPU */
+   u64 nohz_halts;      /* halts with the periodic tick stopped */
+   u64 nohz_ticks;      /* ticks elapsed with the periodic tick stopped */
+   u64 nohz_expired;    /* one-shot timer expirations */
+};
+
+void timer_idle_halt(bool stop_tick);
+void timer_update_next_event(void);
+void timer_get_idle_stats(struct idle_stats *stats);
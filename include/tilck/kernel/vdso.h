@@ -1,6 +1,12 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
 #pragma once
+
+#define VDSO_CLOCK_NONE                   0
+#define VDSO_CLOCK_TSC                    1
+
+#ifndef ASM_FILE
+
 #include <tilck/common/basic_defs.h>
 
 extern const ulong vdso_begin;
@@ -8,3 +14,30 @@ extern const ulong vdso_end;
 extern const ulong sysexit_user_code_user_vaddr;
 extern const ulong post_sig_handler_user_vaddr;
 extern const ulong pause_trampoline_user_vaddr;
+
+/*
+ * Data shared with the vDSO code through the "vvar" page, mapped read-only
+ * at USER_VVAR_VADDR. It's updated by the timer IRQ handler under a sequence
+ * counter (odd while the update is in progress): the vDSO functions have to
+ * retry reading it if `seq` changed in the meanwhile.
+ *
+ * NOTE: the vDSO code is in assembly: keep the VVAR_*_OFF constants in sync.
+ */
+struct vdso_data {
+
+   u32 seq;
+   u32 clock_mode;         /* VDSO_CLOCK_*: how to read the clocksource */
+   u64 base_cycles;        /* clocksource's counter at the last update */
+   u64 max_cycles;         /* max cycles delta convertible to ns */
+   u32 mult;
+   u32 shift;
+   s64 base_sec;           /* realtime at `base_cycles` */
+   u32 base_nsec;
+   u32 coarse_nsec;
+   s64 coarse_sec;         /* realtime at the last tick */
+};
+
+void vdso_update_time(void);
+void *vdso_get_vvar_page(void);
+
+#endif // #ifndef ASM_FILE
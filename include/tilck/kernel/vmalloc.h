@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Virtually-contiguous allocator for big kernel buffers (see vmalloc() in
+ * kmalloc.h). Its memory is made of single pages, mapped one after the other
+ * in a dedicated area of the hi virtual memory: it does not need physically
+ * contiguous memory and it does not use the linear heaps of kmalloc.
+ * Therefore, it's NOT suitable for DMA buffers.
+ *
+ * Buffers smaller than VMALLOC_MIN_SIZE are just allocated by kmalloc():
+ * with them, wasting a part of a page and a TLB entry would be worse than
+ * the fragmentation of the heaps.
+ */
+
+#define VMALLOC_MIN_SIZE                   (4 * PAGE_SIZE)
+
+struct vmalloc_stats {
+
+   ulong area_size;           /* size of the vmalloc area */
+   ulong used_size;           /* virtual memory reserved, guard pages incl. */
+   ulong peak_used_size;      /* max value of `used_size` */
+   ulong mapped_pages;        /* pages currently mapped */
+   ulong areas;               /* live allocations */
+   ulong gaps;                /* free ranges in the area */
+   ulong lazy_pages;          /* unmapped pages with a stale TLB entry */
+   ulong allocs;              /* lifetime allocations */
+   ulong failed_allocs;       /* lifetime failed allocations */
+   ulong purges;              /* lifetime lazy purges (batched TLB flushes) */
+   ulong full_flushes;        /* ... of which, done flushing the whole TLB */
+};
+
+void init_vmalloc(void);
+
+/* Returns true if the vmalloc area has been initialized */
+bool vmalloc_avail(void);
+
+/* Returns true if `ptr` belongs to the vmalloc area */
+bool is_vmalloc_addr(void *ptr);
+
+/*
+ * Allocate `size` bytes (rounded up to PAGE_SIZE) in the vmalloc area. Returns
+ * NULL if there's no memory or no virtual space big enough. Not IRQ-safe.
+ */
+void *vmalloc_pages(size_t size);
+
+/* Counter-part of vmalloc_pages(). `size` must be the same */
+void vfree_pages(void *ptr, size_t size);
+
+/*
+ * Flush the TLB entries of the areas freed lazily and make their virtual
+ * space available again. It's done automatically when needed.
+ */
+void vmalloc_purge_lazy(void);
+
+void vmalloc_get_stats(struct vmalloc_stats *stats);
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Pool of pre-zeroed pages, refilled by a low-priority worker thread while
+ * the system is idle. The pages come from alloc_page() and they must be freed
+ * with free_page().
+ */
+
+struct zero_pool_stats {
+
+   ulong depth;         /* zeroed pages currently in the pool */
+   ulong capacity;      /* max number of pages in the pool */
+   ulong hits;          /* allocations served by the pool */
+   ulong misses;        /* allocations zeroed synchronously */
+   ulong refilled;      /* pages zeroed in background */
+};
+
+void init_zero_pool(void);
+
+/*
+ * Get a zeroed page: in O(1) if the pool is not empty, otherwise falls back
+ * to alloc_page() + bzero(). Returns NULL in case of OOM.
+ */
+void *zero_pool_alloc_page(void);
+
+/* Called by the idle task: schedules a refill, if needed */
+void zero_pool_on_idle(void);
+
+const struct zero_pool_stats *zero_pool_get_stats(void);
@@ -85,7 +85,7 @@ static void fault_in_panic(regs_t *r)
 void handle_fault(regs_t *r)
 {
    const int int_num = r->int_num;
-   bool cow = false;
+   bool handled = false;
 
    ASSERT(is_fault(int_num));
 
@@ -93,10 +93,10 @@ void handle_fault(regs_t *r)
       return fault_in_panic(r);
 
    if (LIKELY(int_num == FAULT_PAGE_FAULT)) {
-      cow = handle_potential_cow(r);
+      handled = handle_potential_cow(r) || handle_potential_demand_zero(r);
    }
 
-   if (!cow) {
+   if (!handled) {
 
       if (is_fault_resumable(int_num))
          return handle_resumable_fault(r);
@@ -14,6 +14,8 @@
 #include <tilck/kernel/system_mmap.h>
 #include <tilck/kernel/vdso.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/vmalloc.h>
 
 #include "paging_generic_x86.h"
 
@@ -62,6 +64,63 @@ void invalidate_page(ulong vaddr)
    invalidate_page_hw(vaddr);
 }
 
+/*
+ * Invalidate the TLB entries of `page_count` pages at `vaddr`, after they've
+ * been unmapped or remapped in `pdir`.
+ *
+ * User pages are never global, so their entries get flushed anyway when we
+ * switch to another pdir: if `pdir` is not the current one, there's nothing to
+ * do. Otherwise, above TLB_FLUSH_ALL_THR pages a single CR3 reload is cheaper
+ * than a long series of INVLPG and it keeps the global (kernel) entries intact.
+ * Kernel pages, instead, are global and shared by all the pdirs: they always
+ * have to be invalidated one by one.
+ */
+void invalidate_pages(pdir_t *pdir, void *vaddrp, size_t page_count)
+{
+   const ulong vaddr = (ulong)vaddrp;
+
+   const bool user_range =
+      vaddr < KERNEL_BASE_VA &&
+      page_count <= ((KERNEL_BASE_VA - vaddr) >> PAGE_SHIFT);
+
+   if (user_range) {
+
+      if (pdir != get_curr_pdir())
+         return;
+
+      if (page_count > TLB_FLUSH_ALL_THR) {
+         set_curr_pdir(pdir);
+         return;
+      }
+   }
+
+   for (size_t i = 0; i < page_count; i++)
+      invalidate_page_hw(vaddr + (i << PAGE_SHIFT));
+}
+
+/*
+ * Invalidate the whole TLB, including the global entries of the kernel pages,
+ * which survive CR3 reloads: clearing and setting back CR4.PGE flushes them
+ * too. Cheaper than invalidating a big number of kernel pages one by one.
+ */
+void invalidate_all_pages(void)
+{
+   ulong var, cr4;
+
+   disable_interrupts(&var);
+   {
+      cr4 = read_cr4();
+
+      if (cr4 & CR4_PGE) {
+         write_cr4(cr4 & ~CR4_PGE);
+         write_cr4(cr4);
+      } else {
+         write_cr3(read_cr3());
+      }
+   }
+   enable_interrupts(&var);
+}
+
 void init_paging(void)
 {
    int rc;
@@ -91,21 +150,27 @@ void init_paging(void)
 
    pf_ref_count_inc(KERNEL_VA_TO_PA(zero_page));
 
+   /* Page-granular allocations don't use kmalloc directly */
+   init_page_alloc(phys_mem_lim);
+
    /* Initialize the kmalloc heap used for the "hi virtual mem" area */
    init_hi_vmem_heap();
 
    /*
-    * Now use the just-created hi vmem heap to reserve a page for the user
-    * vdso-like page and expect it to be == USER_VDSO_VADDR.
+    * Now use the just-created hi vmem heap to reserve two pages for the user
+    * vdso page and the vvar page following it and expect them to be at
+    * USER_VDSO_VADDR.
     */
-   user_vdso_vaddr = hi_vmem_reserve(PAGE_SIZE);
+   user_vdso_vaddr = hi_vmem_reserve(2 * PAGE_SIZE);
 
    if (user_vdso_vaddr != (void *)USER_VDSO_VADDR)
       panic("user_vdso_vaddr != USER_VDSO_VADDR");
 
    /*
-    * Map a special vdso-like page used for the sysenter interface.
-    * This is the only user-mapped page with a vaddr in the kernel space.
+    * Map the vdso page, used for the sysenter interface, the signal handlers
+    * and the time functions, plus the read-only vvar page, containing the
+    * data used by the vdso time functions. These are the only user-mapped
+    * pages with a vaddr in the kernel space.
     */
    rc = map_page(get_kernel_pdir(),
                  user_vdso_vaddr,
@@ -113,7 +178,18 @@ void init_paging(void)
                  PAGING_FL_US);
 
    if (rc < 0)
-      panic("Unable to map the vdso-like page");
+      panic("Unable to map the vdso page");
+
+   rc = map_page(get_kernel_pdir(),
+                 (void *)USER_VVAR_VADDR,
+                 KERNEL_VA_TO_PA(vdso_get_vvar_page()),
+                 PAGING_FL_US);
+
+   if (rc < 0)
+      panic("Unable to map the vvar page");
+
+   /* After the vdso pages: they must be at the beginning of the hi vmem */
+   init_vmalloc();
 }
 
 void *
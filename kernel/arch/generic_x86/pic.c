@@ -222,6 +222,21 @@ bool irq_is_masked(int irq)
    return res;
 }
 
+/* Check the IRR (Interrupt Request Register): expects interrupts disabled */
+bool pic_is_irq_pending(int irq)
+{
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(IN_RANGE_INC(irq, 0, 16));
+
+   if (irq < 8) {
+      outb(PIC1_COMMAND, PIC_READ_IRR);
+      return inb(PIC1_COMMAND) & (1 << irq);
+   }
+
+   outb(PIC2_COMMAND, PIC_READ_IRR);
+   return inb(PIC2_COMMAND) & (1 << (irq - 8));
+}
+
 bool pic_is_spur_irq(int irq)
 {
    ASSERT(!are_interrupts_enabled());
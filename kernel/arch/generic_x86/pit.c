@@ -1,10 +1,13 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
 #include <tilck/common/basic_defs.h>
+#include <tilck/common/utils.h>
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/datetime.h>
 
+#include "pic.h"
+
 #define PIT_FREQ           1193182
 
 #define PIT_CMD_PORT          0x43
@@ -31,6 +34,25 @@
 #define PIT_CH2         0b10000000   // select channel 2
 
 #define PIT_READ_BACK   0b11000000   // read-back command (8254 only)
+#define PIT_RB_CH0      0b00000010   // read-back: select channel 0
+#define PIT_RB_NO_COUNT 0b00100000   // read-back: don't latch the count
+
+#define PIT_ST_OUT      0b10000000   // status byte: state of the OUT pin
+#define PIT_ST_NULL     0b01000000   // status byte: count not loaded yet
+
+#define PIT_MAX_COUNT      0xffffu
+
+static u32 pit_divisor;       /* counts per tick, in periodic mode */
+static u32 oneshot_count;     /* initial count of the current one-shot */
+static u32 pit_rem;           /* counts elapsed but not accounted yet */
+static bool stale_irq;        /* the pending timer IRQ has been accounted */
+
+static void pit_set_mode_and_count(u8 mode, u32 count)
+{
+   outb(PIT_CMD_PORT, PIT_MODE_BIN | mode | PIT_ACC_LOHI | PIT_CH0);
+   outb(PIT_CH0_PORT, count & 0xff);              /* Set low byte of count */
+   outb(PIT_CH0_PORT, (count >> 8) & 0xff);       /* Set high byte of count */
+}
 
 /*
  * Set the time between ticks to be `interval`, where 1 means 1/TS_SCALE sec.
@@ -78,9 +100,160 @@ u32 hw_timer_setup(u32 interval)
    actual_interval /= PIT_FREQ;
    ASSERT(actual_interval < UINT32_MAX);
 
-   outb(PIT_CMD_PORT, PIT_MODE_BIN | PIT_MODE_2 | PIT_ACC_LOHI | PIT_CH0);
-   outb(PIT_CH0_PORT, divisor & 0xff);            /* Set low byte of divisor */
-   outb(PIT_CH0_PORT, (divisor >> 8) & 0xff);     /* Set high byte of divisor */
-
+   pit_divisor = divisor;
+   pit_set_mode_and_count(PIT_MODE_2, divisor);
    return (u32)actual_interval;
 }
+
+/*
+ * Max number of ticks a single one-shot can last: the PIT's counter is 16-bit,
+ * so that's always < 55 ms.
+ */
+u32 hw_timer_max_oneshot_ticks(void)
+{
+   return PIT_MAX_COUNT / pit_divisor;
+}
+
+bool hw_timer_is_oneshot(void)
+{
+   return oneshot_count > 0;
+}
+
+/*
+ * Return the counts elapsed in the current mode and not accounted yet,
+ * including a periodic tick whose IRQ has not been serviced yet.
+ */
+static u32 pit_get_elapsed(void)
+{
+   u32 count, elapsed;
+   u8 status;
+
+   /* Latch both the status and the count of channel 0 */
+   outb(PIT_CMD_PORT, PIT_READ_BACK | PIT_RB_CH0);
+   status = inb(PIT_CH0_PORT);
+   count = inb(PIT_CH0_PORT);
+   count |= (u32)inb(PIT_CH0_PORT) << 8;
+
+   if (status & PIT_ST_NULL)
+      return 0;      /* The PIT has just been re-programmed */
+
+   if (oneshot_count) {
+
+      /*
+       * In mode 0, OUT goes high when the counter reaches 0 and stays high
+       * until the PIT is re-programmed, while the counter just wraps around.
+       */
+      if (status & PIT_ST_OUT)
+         return oneshot_count;
+
+      return oneshot_count - MIN(count, oneshot_count);
+   }
+
+   /* In mode 2, the counter goes from `pit_divisor` down to 1 */
+   elapsed = pit_divisor - MIN(count, pit_divisor);
+
+   if (!stale_irq && pic_is_irq_pending(X86_PC_TIMER_IRQ))
+      elapsed += pit_divisor;
+
+   return elapsed;
+}
+
+/*
+ * Move the counts elapsed in the current mode to `pit_rem`, before changing
+ * mode. After that, a pending timer IRQ (tick or expired one-shot) is stale,
+ * because its time has been accounted here.
+ */
+static void pit_save_elapsed(void)
+{
+   pit_rem += pit_get_elapsed();
+
+   if (pic_is_irq_pending(X86_PC_TIMER_IRQ))
+      stale_irq = true;
+}
+
+static u32 pit_take_ticks(void)
+{
+   const u32 ticks = pit_rem / pit_divisor;
+   pit_rem %= pit_divisor;
+   return ticks;
+}
+
+/*
+ * Stop the periodic tick (or cancel the current one-shot) and program the
+ * timer to fire once, after `ns` nanoseconds, clamped to the hardware limits.
+ * Expects interrupts to be disabled.
+ */
+void hw_timer_setup_oneshot(u32 ns)
+{
+   /* Round up, so that a one-shot of N ticks lasts exactly N * divisor */
+   u32 count = (u32)div_round_up64((u64)ns * PIT_FREQ, TS_SCALE);
+
+   ASSERT(!are_interrupts_enabled());
+
+   count = CLAMP(count, 1u, PIT_MAX_COUNT);
+   pit_save_elapsed();
+   pit_set_mode_and_count(PIT_MODE_0, count);
+   oneshot_count = count;
+}
+
+/*
+ * Cancel the current one-shot (if it didn't expire yet) and restore the
+ * periodic tick. Returns the number of whole ticks elapsed and not accounted
+ * yet: the sub-tick remainder is carried over, in order to not lose time.
+ *
+ * Expects interrupts to be disabled.
+ */
+u32 hw_timer_stop_oneshot(void)
+{
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(oneshot_count > 0);
+
+   pit_save_elapsed();
+   pit_set_mode_and_count(PIT_MODE_2, pit_divisor);
+   oneshot_count = 0;
+   return pit_take_ticks();
+}
+
+/*
+ * Called by the timer IRQ handler, with interrupts disabled: returns the
+ * number of ticks to account for this IRQ.
+ */
+u32 hw_timer_ack_irq(void)
+{
+   u8 status;
+   ASSERT(!are_interrupts_enabled());
+
+   if (stale_irq) {
+
+      /* The time of this IRQ has been already accounted in `pit_rem` */
+      stale_irq = false;
+
+      if (!oneshot_count)
+         return 0;
+
+      /* Check if the current one-shot expired as well in the meanwhile */
+      outb(PIT_CMD_PORT, PIT_READ_BACK | PIT_RB_CH0 | PIT_RB_NO_COUNT);
+      status = inb(PIT_CH0_PORT);
+
+      if (!(status & PIT_ST_OUT))
+         return 0;
+   }
+
+   if (!oneshot_count)
+      return 1;      /* Regular periodic tick */
+
+   /* The one-shot expired */
+   return hw_timer_stop_oneshot();
+}
+
+/*
+ * Return the nanoseconds elapsed since the last tick accounted by the timer
+ * IRQ handler. Expects interrupts to be disabled.
+ */
+u32 hw_timer_get_elapsed_ns(void)
+{
+   const u64 counts = pit_rem + pit_get_elapsed();
+   ASSERT(!are_interrupts_enabled());
+
+   return (u32)(counts * TS_SCALE / PIT_FREQ);
+}
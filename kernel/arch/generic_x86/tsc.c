@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/clocksource.h>
+#include <tilck/kernel/vdso.h>
+
+static u64 tsc_read(void)
+{
+   return RDTSC();
+}
+
+static struct clocksource tsc_clocksource = {
+   .name = "tsc",
+   .read = &tsc_read,
+   .vdso_mode = VDSO_CLOCK_TSC,
+};
+
+/*
+ * The TSC can be used as a clocksource only when it's invariant: otherwise,
+ * its frequency might change because of the power management and it might
+ * even stop while the CPU is halted.
+ */
+struct clocksource *hw_get_clocksource(void)
+{
+   if (!x86_cpu_features.edx1.tsc || !x86_cpu_features.invariant_TSC)
+      return NULL;
+
+   return &tsc_clocksource;
+}
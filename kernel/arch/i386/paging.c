@@ -23,6 +23,10 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/vdso.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/oom.h>
+#include <tilck/kernel/fault_resumable.h>
 
 #include <tilck/mods/tracing.h>
 
@@ -40,6 +44,140 @@ pdir_get_page_table(pdir_t *pdir, u32 i)
    return KERNEL_PA_TO_VA(pdir->entries[i].ptaddr << PAGE_SHIFT);
 }
 
+/*
+ * Copy `orig_pt` into `new_pt`, marking all the non-shared pages as CoW in both
+ * the tables, as they will be referenced by both.
+ */
+static void pt_cow_copy(page_table_t *new_pt, page_table_t *orig_pt)
+{
+   for (u32 j = 0; j < 1024; j++) {
+
+      page_t *const p = &orig_pt->pages[j];
+
+      if (!p->present)
+         continue;
+
+      const ulong orig_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+
+      /* Sanity-check: a mapped page MUST have ref-count > 0 */
+      ASSERT(pf_ref_count_get(orig_paddr) > 0);
+
+      if (!(p->avail & PAGE_SHARED)) {
+
+         if (p->rw)
+            p->avail |= PAGE_COW_ORIG_RW;
+
+         p->rw = false;
+      }
+
+      pf_ref_count_inc(orig_paddr);
+   }
+
+   memcpy32(new_pt, orig_pt, sizeof(page_table_t) / 4);
+}
+
+/*
+ * Replace the big (4 MB) user page of the i-th entry of `pdir` with a private
+ * page table mapping the same pageframes with 4 KB pages, in order to allow
+ * changing them one by one. Returns false in the out-of-memory case.
+ */
+static bool pdir_split_big_page(pdir_t *pdir, u32 i)
+{
+   page_dir_entry_t *e = &pdir->entries[i];
+   const u32 flags = e->raw & (PG_PRESENT_BIT | PG_RW_BIT | PG_US_BIT);
+   const ulong paddr = (ulong)e->big_4mb_page.paddr << BIG_PAGE_SHIFT;
+   page_table_t *pt;
+
+   ASSERT(e->psize);
+   ASSERT(i < KERNEL_BASE_PD_IDX);
+
+   if (!(pt = alloc_page()))
+      return false;
+
+   ASSERT(IS_PAGE_ALIGNED(pt));
+
+   /* The ref-count of each pageframe doesn't change: it's still mapped once */
+   for (u32 j = 0; j < 1024; j++)
+      pt->pages[j].raw = flags | (paddr + (j << PAGE_SHIFT));
+
+   e->raw = flags | KERNEL_VA_TO_PA(pt);
+
+   if (pdir == get_curr_pdir())
+      invalidate_page_hw(i << BIG_PAGE_SHIFT);
+
+   return true;
+}
+
+/*
+ * Make the page table of the i-th entry of `pdir` private (see PDE_PT_COW),
+ * before changing it. Big pages get split (see pdir_split_big_page()). Returns
+ * false in the out-of-memory case.
+ */
+static bool pdir_unshare_page_table(pdir_t *pdir, u32 i)
+{
+   page_dir_entry_t *e = &pdir->entries[i];
+   page_table_t *orig_pt, *new_pt;
+   ulong orig_pt_paddr;
+
+   if (UNLIKELY(e->psize))
+      return pdir_split_big_page(pdir, i);
+
+   if (LIKELY(!(e->avail & PDE_PT_COW)))
+      return true;
+
+   orig_pt = pdir_get_page_table(pdir, i);
+   orig_pt_paddr = KERNEL_VA_TO_PA(orig_pt);
+
+   if (pf_ref_count_dec(orig_pt_paddr) > 0) {
+
+      /* Other page directories are still using it: copy the table */
+      if (!(new_pt = alloc_page())) {
+         pf_ref_count_inc(orig_pt_paddr);
+         return false;
+      }
+
+      ASSERT(IS_PAGE_ALIGNED(new_pt));
+      pt_cow_copy(new_pt, orig_pt);
+      e->ptaddr = SHR_BITS(KERNEL_VA_TO_PA(new_pt), PAGE_SHIFT, u32);
+   }
+
+   /* Otherwise, we were the last user of the page table: just take it */
+   e->rw = true;
+   e->avail &= ~PDE_PT_COW;
+
+   /* Flush the TLB: the whole 4 MB region is affected */
+   if (pdir == get_curr_pdir())
+      set_curr_pdir(pdir);
+
+   return true;
+}
+
+/*
+ * Like pdir_unshare_page_table(), but for the cases where we cannot fail.
+ */
+static void pdir_unshare_page_table_or_panic(pdir_t *pdir, u32 i)
+{
+   if (UNLIKELY(!pdir_unshare_page_table(pdir, i)))
+      panic("Out-of-memory: can't copy a shared page table");
+}
+
+/*
+ * Out-of-memory case while handling a page fault. Let the OOM killer free some
+ * memory and return true to retry. If nothing can be done and the fault
+ * happened in a resumable kernel context (e.g. copy_to_user()), return false
+ * and let the kernel code fail with -EFAULT.
+ */
+static bool page_fault_oom(const char *what)
+{
+   if (oom_handle_page_fault())
+      return true;
+
+   if (!is_fault_resumable(FAULT_PAGE_FAULT))
+      panic("Out-of-memory: can't %s [pid %d]", what, get_curr_pid());
+
+   return false;
+}
+
 bool handle_potential_cow(void *context)
 {
    regs_t *r = context;
@@ -53,7 +191,24 @@ bool handle_potential_cow(void *context)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
    const void *const page_vaddr = (void *)(vaddr & PAGE_MASK);
-   page_table_t *pt = pdir_get_page_table(get_curr_pdir(), pd_index);
+   pdir_t *pdir = get_curr_pdir();
+
+   if (pdir->entries[pd_index].avail & PDE_PT_COW) {
+
+      /*
+       * The whole page table is shared: copy it and just retry. If the page
+       * itself is a CoW one, we'll get here again.
+       */
+      if (pdir_unshare_page_table(pdir, pd_index))
+         return true;
+
+      return page_fault_oom("copy a shared page table");
+   }
+
+   if (pdir->entries[pd_index].psize)
+      return false; /* Big pages are always private and writable */
+
+   page_table_t *pt = pdir_get_page_table(pdir, pd_index);
 
    if (!(pt->pages[pt_index].avail & PAGE_COW_ORIG_RW))
       return false; /* Not a COW page */
@@ -78,34 +233,23 @@ bool handle_potential_cow(void *context)
       return true;
    }
 
-   // Allocate a new page.
-   void *new_page_vaddr = kmalloc(PAGE_SIZE);
-
-   if (!new_page_vaddr) {
-
-      // Out-of-memory case
-      struct task *curr = get_curr_task();
-
-      if (!curr->running_in_kernel) {
-
-         // The task was not running in kernel: we can safely kill it.
-         printk("Out-of-memory: killing pid %d\n", get_curr_pid());
-         send_signal(get_curr_pid(), SIGKILL, SIG_FL_PROCESS | SIG_FL_FAULT);
-         return true;
-
-      } else {
+   /*
+    * Allocate a new page. When the original page is the zero page, get an
+    * already zeroed one from the pool, instead of copying it.
+    */
+   const bool from_zero_page = orig_page_paddr == KERNEL_VA_TO_PA(&zero_page);
+   void *new_page_vaddr = from_zero_page
+      ? zero_pool_alloc_page()
+      : alloc_page();
 
-         // We cannot kill a task running in kernel during a CoW page fault
-         // In this case (but in the one above too), Linux puts the process to
-         // sleep, while the OOM killer runs and frees some memory.
-         panic("Out-of-memory: can't copy a CoW page [pid %d]", get_curr_pid());
-      }
-   }
+   if (!new_page_vaddr)
+      return page_fault_oom("copy a CoW page");
 
    ASSERT(IS_PAGE_ALIGNED(new_page_vaddr));
 
    // Copy page's contents
-   memcpy32(new_page_vaddr, page_vaddr, PAGE_SIZE / 4);
+   if (!from_zero_page)
+      memcpy32(new_page_vaddr, page_vaddr, PAGE_SIZE / 4);
 
    // Get the paddr of the new page
    const ulong paddr = KERNEL_VA_TO_PA(new_page_vaddr);
@@ -128,6 +272,86 @@ bool handle_potential_cow(void *context)
    return true;
 }
 
+/*
+ * Demand-zero fault in a MAP_HUGETLB mapping: map the whole 4 MB region around
+ * `vaddr` with a single big page, if it's entirely contained in the mapping and
+ * nothing has been mapped there yet. That saves 1023 page faults and, above
+ * all, makes a single TLB entry cover the whole region. Returns false when the
+ * regular (4 KB) path has to be used instead, including the case where there's
+ * no physically-contiguous block of 4 MB available.
+ */
+static bool handle_big_page_demand_zero(struct process *pi, ulong vaddr)
+{
+   const ulong big_vaddr = vaddr & ~(4 * MB - 1);
+   const u32 pd_index = vaddr >> BIG_PAGE_SHIFT;
+   ulong paddr;
+   void *va;
+
+   if (pi->pdir->entries[pd_index].raw)
+      return false; /* there's already a page table */
+
+   if (!is_big_demand_zero_range((void *)big_vaddr, 4 * MB))
+      return false;
+
+   if (!(va = alloc_aligned_pages(4 * MB)))
+      return false;
+
+   bzero(va, 4 * MB);
+   paddr = KERNEL_VA_TO_PA(va);
+
+   for (u32 j = 0; j < 1024; j++)
+      pf_ref_count_inc(paddr + (j << PAGE_SHIFT));
+
+   map_4mb_page_int(pi->pdir,
+                    (void *)big_vaddr,
+                    paddr,
+                    PG_PRESENT_BIT | PG_RW_BIT | PG_US_BIT | PG_4MB_BIT);
+
+   pi->anon_faults++;
+   pi->anon_pages += 1024;
+   return true;
+}
+
+bool handle_potential_demand_zero(void *context)
+{
+   regs_t *r = context;
+   struct process *pi = get_curr_proc();
+   void *page_vaddr, *new_page_vaddr;
+   bool rw, writable;
+   u32 vaddr;
+
+   if (r->err_code & PAGE_FAULT_FL_PRESENT)
+      return false;
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   if (vaddr >= USERMODE_VADDR_END)
+      return false;
+
+   page_vaddr = (void *)(vaddr & PAGE_MASK);
+   rw = !!(r->err_code & PAGE_FAULT_FL_RW);
+
+   if (!is_demand_zero_vaddr(page_vaddr, rw, &writable))
+      return false;
+
+   if (writable && handle_big_page_demand_zero(pi, vaddr))
+      return true;
+
+   if (!(new_page_vaddr = zero_pool_alloc_page()))
+      return page_fault_oom("allocate a demand-zero page");
+
+   if (map_page(pi->pdir, page_vaddr, KERNEL_VA_TO_PA(new_page_vaddr),
+                writable ? PAGING_FL_RWUS : PAGING_FL_US) != 0)
+   {
+      free_page(new_page_vaddr);
+      return page_fault_oom("map a demand-zero page");
+   }
+
+   pi->anon_faults++;
+   pi->anon_pages++;
+   return true;
+}
+
 static void kernel_page_fault_panic(regs_t *r, u32 vaddr, bool rw, bool p)
 {
    long off = 0;
@@ -154,7 +378,8 @@ void handle_page_fault_int(regs_t *r)
    if (!us) {
       /*
        * Tilck does not support kernel-space page faults caused by the kernel,
-       * while it allows user-space page faults caused by kernel (CoW pages).
+       * while it allows user-space page faults caused by kernel (CoW and
+       * demand-zero pages).
        * Therefore, such a fault is necessary caused by a bug.
        * We have to panic.
        */
@@ -163,13 +388,14 @@ void handle_page_fault_int(regs_t *r)
 
    um = process_get_user_mapping((void *)vaddr);
 
-   if (um) {
+   if (um && um->h) {
 
       /*
        * Call vfs_handle_fault() only if in first place the mapping allowed
-       * writing or if it didn't but the memory access type was a READ.
+       * writing or if it didn't but the memory access type was a READ. In any
+       * case, PROT_NONE mappings (see mprotect()) cannot be accessed.
        */
-      if (!!(um->prot & PROT_WRITE) || !rw) {
+      if ((um->prot & PROT_READ) && (!!(um->prot & PROT_WRITE) || !rw)) {
 
          if (vfs_handle_fault(um, (void *)vaddr, p, rw))
             return;
@@ -249,6 +475,7 @@ void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
 
+   pdir_unshare_page_table_or_panic(pdir, pd_index);
    pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    ASSERT(KERNEL_VA_TO_PA(pt) != 0);
    pt->pages[pt_index].rw = rw;
@@ -263,6 +490,17 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
 
+   if (UNLIKELY(pdir->entries[pd_index].psize)) {
+
+      /* Unmapping a single page of a big page: split it first */
+      if (permissive) {
+         if (!pdir_split_big_page(pdir, pd_index))
+            return -ENOMEM;
+      } else {
+         pdir_unshare_page_table_or_panic(pdir, pd_index);
+      }
+   }
+
    pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
 
    if (permissive) {
@@ -273,20 +511,25 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
       if (!pt->pages[pt_index].present)
          return -EINVAL;
 
+      if (!pdir_unshare_page_table(pdir, pd_index))
+         return -ENOMEM;
+
    } else {
       ASSERT(KERNEL_VA_TO_PA(pt) != 0);
       ASSERT(pt->pages[pt_index].present);
+      pdir_unshare_page_table_or_panic(pdir, pd_index);
    }
 
+   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
+
    const ulong paddr = (ulong)
       pt->pages[pt_index].pageAddr << PAGE_SHIFT;
 
    pt->pages[pt_index].raw = 0;
-   invalidate_page_hw(vaddr);
 
    if (!pf_ref_count_dec(paddr) && free_pageframe) {
       ASSERT(paddr != KERNEL_VA_TO_PA(zero_page));
-      kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+      free_page(KERNEL_PA_TO_VA(paddr));
    }
 
    return 0;
@@ -296,12 +539,76 @@ void
 unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
    __unmap_page(pdir, vaddrp, free_pageframe, false);
+   invalidate_page_hw((ulong)vaddrp);
 }
 
 int
 unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
-   return __unmap_page(pdir, vaddrp, free_pageframe, true);
+   int rc = __unmap_page(pdir, vaddrp, free_pageframe, true);
+
+   if (!rc)
+      invalidate_page_hw((ulong)vaddrp);
+
+   return rc;
+}
+
+/*
+ * Unmap the whole big page of the i-th entry of `pdir`. Its pageframes are
+ * never shared (see pdir_clone()), so they're freed all together. The caller
+ * has to invalidate the TLB entries with invalidate_pages().
+ */
+static void unmap_big_page(pdir_t *pdir, u32 i, bool free_pageframes)
+{
+   const ulong paddr =
+      (ulong)pdir->entries[i].big_4mb_page.paddr << BIG_PAGE_SHIFT;
+
+   ASSERT(pdir->entries[i].psize);
+   ASSERT(i < KERNEL_BASE_PD_IDX);
+
+   pdir->entries[i].raw = 0;
+
+   for (u32 j = 0; j < 1024; j++) {
+      const u32 rc = pf_ref_count_dec(paddr + (j << PAGE_SHIFT));
+      ASSERT(rc == 0);
+      (void) rc; /* prevent the "unused variable" Werror in release */
+   }
+
+   if (free_pageframes)
+      free_aligned_pages(KERNEL_PA_TO_VA(paddr), 4 * MB);
+}
+
+/*
+ * Check if the range of `page_count` pages at `vaddr` starts with a whole big
+ * page, which can be unmapped without splitting it.
+ */
+static inline bool
+starts_with_big_page(pdir_t *pdir, ulong vaddr, size_t page_count)
+{
+   if (vaddr & (4 * MB - 1) || page_count < 1024)
+      return false;
+
+   return pdir->entries[vaddr >> BIG_PAGE_SHIFT].psize;
+}
+
+void
+unmap_pages_noflush(pdir_t *pdir,
+                    void *vaddr,
+                    size_t page_count,
+                    bool do_free)
+{
+   for (size_t i = 0; i < page_count; i++) {
+
+      const ulong va = (ulong)vaddr + (i << PAGE_SHIFT);
+
+      if (starts_with_big_page(pdir, va, page_count - i)) {
+         unmap_big_page(pdir, va >> BIG_PAGE_SHIFT, do_free);
+         i += 1023;
+         continue;
+      }
+
+      __unmap_page(pdir, (void *)va, do_free, false);
+   }
 }
 
 void
@@ -310,9 +617,8 @@ unmap_pages(pdir_t *pdir,
             size_t page_count,
             bool do_free)
 {
-   for (size_t i = 0; i < page_count; i++) {
-      unmap_page(pdir, (char *)vaddr + (i << PAGE_SHIFT), do_free);
-   }
+   unmap_pages_noflush(pdir, vaddr, page_count, do_free);
+   invalidate_pages(pdir, vaddr, page_count);
 }
 
 size_t
@@ -325,17 +631,251 @@ unmap_pages_permissive(pdir_t *pdir,
    int rc;
 
    for (size_t i = 0; i < page_count; i++) {
-      rc = unmap_page_permissive(
-         pdir,
-         (char *)vaddr + (i << PAGE_SHIFT),
-         do_free
-      );
+
+      const ulong va = (ulong)vaddr + (i << PAGE_SHIFT);
+
+      if (starts_with_big_page(pdir, va, page_count - i)) {
+         unmap_big_page(pdir, va >> BIG_PAGE_SHIFT, do_free);
+         unmapped_pages += 1024;
+         i += 1023;
+         continue;
+      }
+
+      rc = __unmap_page(pdir, (void *)va, do_free, true);
       unmapped_pages += (rc == 0);
    }
 
+   if (unmapped_pages)
+      invalidate_pages(pdir, vaddr, page_count);
+
    return unmapped_pages;
 }
 
+/*
+ * Unmap and free the pages in the given range, but only the ones that can be
+ * released without allocating memory: shared page tables (see PDE_PT_COW) and
+ * big pages not fully in the range are skipped. Used by the OOM killer, which
+ * runs exactly when there's no memory to allocate.
+ *
+ * Returns the number of page frames actually freed. Pages still shared with
+ * other pdirs (e.g. CoW after fork) are unmapped, but not freed: they are only
+ * counted in `*unmapped`, together with the freed ones. The zero page is never
+ * counted.
+ */
+size_t
+reclaim_user_pages(pdir_t *pdir,
+                   void *vaddr,
+                   size_t page_count,
+                   size_t *unmapped)
+{
+   size_t freed = 0;
+   bool flush = false;
+   size_t i = 0;
+
+   while (i < page_count) {
+
+      const ulong va = (ulong)vaddr + (i << PAGE_SHIFT);
+      const u32 pd_index = va >> BIG_PAGE_SHIFT;
+      const u32 pt_index = (va >> PAGE_SHIFT) & 1023;
+      const size_t n = MIN(1024 - pt_index, page_count - i);
+      page_dir_entry_t *e = &pdir->entries[pd_index];
+      page_table_t *pt;
+
+      ASSERT(pd_index < KERNEL_BASE_PD_IDX);
+      i += n;
+
+      if (!e->present || (e->avail & PDE_PT_COW))
+         continue;
+
+      if (e->psize) {
+
+         if (starts_with_big_page(pdir, va, n)) {
+            unmap_big_page(pdir, pd_index, true);
+            freed += 1024;
+            *unmapped += 1024;
+            flush = true;
+         }
+
+         continue;
+      }
+
+      pt = KERNEL_PA_TO_VA(e->ptaddr << PAGE_SHIFT);
+
+      for (u32 j = pt_index; j < pt_index + n; j++) {
+
+         const ulong paddr = (ulong)pt->pages[j].pageAddr << PAGE_SHIFT;
+
+         if (!pt->pages[j].present)
+            continue;
+
+         if (paddr != KERNEL_VA_TO_PA(&zero_page)) {
+
+            /* Our reference is the last one: the frame will be freed */
+            if (pf_ref_count_get(paddr) == 1)
+               freed++;
+
+            (*unmapped)++;
+         }
+
+         __unmap_page(pdir, (void *)(va + ((j - pt_index) << PAGE_SHIFT)),
+                      true, true);
+         flush = true;
+      }
+   }
+
+   if (flush)
+      invalidate_pages(pdir, vaddr, page_count);
+
+   return freed;
+}
+
+/*
+ * Make the page tables covering `page_count` pages at `vaddr` ready for moving
+ * pages in or out of them: split the big pages, make the shared page tables
+ * private and, when `alloc` is true, create the missing ones.
+ */
+static int
+prepare_page_tables(pdir_t *pdir, ulong vaddr, size_t page_count, bool alloc)
+{
+   const u32 first = vaddr >> BIG_PAGE_SHIFT;
+   const u32 last = (vaddr + (page_count << PAGE_SHIFT) - 1) >> BIG_PAGE_SHIFT;
+   page_table_t *pt;
+
+   for (u32 i = first; i <= last; i++) {
+
+      page_dir_entry_t *e = &pdir->entries[i];
+
+      if (e->present) {
+
+         if (!pdir_unshare_page_table(pdir, i))
+            return -ENOMEM;
+
+         continue;
+      }
+
+      if (!alloc)
+         continue;
+
+      if (!(pt = zero_pool_alloc_page()))
+         return -ENOMEM;
+
+      ASSERT(IS_PAGE_ALIGNED(pt));
+      e->raw = PG_PRESENT_BIT | PG_RW_BIT | PG_US_BIT | KERNEL_VA_TO_PA(pt);
+   }
+
+   return 0;
+}
+
+/*
+ * Move the user pages mapped in [src, src + page_count pages) to the same
+ * offsets at `dst`, where nothing must be mapped. Only the page table entries
+ * are moved: the pageframes, their ref-counts and flags (e.g. CoW) don't
+ * change. The holes in the source range (e.g. demand-zero pages not touched
+ * yet) remain holes. On failure (-ENOMEM), nothing has been moved.
+ */
+int remap_pages(pdir_t *pdir, void *src, void *dst, size_t page_count)
+{
+   const ulong sva = (ulong)src;
+   const ulong dva = (ulong)dst;
+   const size_t len = page_count << PAGE_SHIFT;
+   page_table_t *spt, *dpt;
+   int rc;
+
+   ASSERT(IS_PAGE_ALIGNED(sva) && IS_PAGE_ALIGNED(dva));
+   ASSERT(sva + len <= KERNEL_BASE_VA && dva + len <= KERNEL_BASE_VA);
+   ASSERT(sva + len <= dva || dva + len <= sva);
+
+   if ((rc = prepare_page_tables(pdir, sva, page_count, false)))
+      return rc;
+
+   if ((rc = prepare_page_tables(pdir, dva, page_count, true)))
+      return rc;
+
+   for (size_t i = 0; i < page_count; i++) {
+
+      const ulong s = sva + (i << PAGE_SHIFT);
+      const ulong d = dva + (i << PAGE_SHIFT);
+      const u32 s_pt_index = (s >> PAGE_SHIFT) & 1023;
+      const u32 d_pt_index = (d >> PAGE_SHIFT) & 1023;
+
+      if (!pdir->entries[s >> BIG_PAGE_SHIFT].present)
+         continue;
+
+      spt = pdir_get_page_table(pdir, s >> BIG_PAGE_SHIFT);
+
+      if (!spt->pages[s_pt_index].present)
+         continue;
+
+      dpt = pdir_get_page_table(pdir, d >> BIG_PAGE_SHIFT);
+      ASSERT(!dpt->pages[d_pt_index].present);
+
+      dpt->pages[d_pt_index].raw = spt->pages[s_pt_index].raw;
+      spt->pages[s_pt_index].raw = 0;
+   }
+
+   invalidate_pages(pdir, src, page_count);
+   return 0;
+}
+
+/*
+ * Change the protection of the user pages mapped in the given range: only
+ * PAGING_FL_RW and PAGING_FL_US are considered in `pg_flags`. The private pages
+ * shared with other processes (after fork()) or the zero page don't become
+ * writable immediately: they become CoW pages instead. The holes in the range
+ * are skipped. On failure (-ENOMEM), no page has been changed.
+ */
+int protect_pages(pdir_t *pdir, void *vaddrp, size_t page_count, u32 pg_flags)
+{
+   const ulong vaddr = (ulong)vaddrp;
+   const bool rw = !!(pg_flags & PAGING_FL_RW);
+   const bool us = !!(pg_flags & PAGING_FL_US);
+   page_t *p;
+   ulong paddr;
+   int rc;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(vaddr + (page_count << PAGE_SHIFT) <= KERNEL_BASE_VA);
+
+   if ((rc = prepare_page_tables(pdir, vaddr, page_count, false)))
+      return rc;
+
+   for (size_t i = 0; i < page_count; i++) {
+
+      const ulong va = vaddr + (i << PAGE_SHIFT);
+      const u32 pd_index = va >> BIG_PAGE_SHIFT;
+      const u32 pt_index = (va >> PAGE_SHIFT) & 1023;
+
+      if (!pdir->entries[pd_index].present)
+         continue;
+
+      p = &pdir_get_page_table(pdir, pd_index)->pages[pt_index];
+
+      if (!p->present)
+         continue;
+
+      paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+
+      p->us = us;
+      p->rw = false;
+      p->avail &= ~PAGE_COW_ORIG_RW;
+
+      if (!rw)
+         continue;
+
+      if (!(p->avail & PAGE_SHARED) &&
+          (pf_ref_count_get(paddr) > 1 || paddr == KERNEL_VA_TO_PA(&zero_page)))
+      {
+         p->avail |= PAGE_COW_ORIG_RW;
+         continue;
+      }
+
+      p->rw = true;
+   }
+
+   invalidate_pages(pdir, vaddrp, page_count);
+   return 0;
+}
+
 ulong get_mapping(pdir_t *pdir, void *vaddrp)
 {
    page_table_t *pt;
@@ -353,6 +893,12 @@ ulong get_mapping(pdir_t *pdir, void *vaddrp)
 
    e.raw = pdir->entries[pd_index].raw;
    ASSERT(e.present);
+
+   if (e.psize) {
+      return ((ulong) e.big_4mb_page.paddr << BIG_PAGE_SHIFT) |
+             (vaddr & (4 * MB - 1));
+   }
+
    ASSERT(e.ptaddr != 0);
 
    pt = KERNEL_PA_TO_VA(e.ptaddr << PAGE_SHIFT);
@@ -417,13 +963,16 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, u32 hw_flags)
    ASSERT(!(vaddr & OFFSET_IN_PAGE_MASK)); // the vaddr must be page-aligned
    ASSERT(!(paddr & OFFSET_IN_PAGE_MASK)); // the paddr must be page-aligned
 
+   if (UNLIKELY(pdir->entries[pd_index].psize))
+      return -EADDRINUSE; /* the whole 4 MB region is mapped by a big page */
+
    pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    ASSERT(IS_PAGE_ALIGNED(pt));
 
    if (UNLIKELY(KERNEL_VA_TO_PA(pt) == 0)) {
 
       // we have to create a page table for mapping 'vaddr'.
-      pt = kzalloc_obj(page_table_t);
+      pt = zero_pool_alloc_page();
 
       if (UNLIKELY(!pt))
          return -ENOMEM;
@@ -435,6 +984,13 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, u32 hw_flags)
          PG_RW_BIT |
          (hw_flags & PG_US_BIT) |
          KERNEL_VA_TO_PA(pt);
+
+   } else {
+
+      if (UNLIKELY(!pdir_unshare_page_table(pdir, pd_index)))
+         return -ENOMEM;
+
+      pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    }
 
    if (pt->pages[pt_index].present)
@@ -523,7 +1079,7 @@ map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
       void *va;
       ASSERT(paddr == 0);
 
-      if (!(va = kmalloc(PAGE_SIZE)))
+      if (!(va = alloc_page()))
          return -ENOMEM;
 
       if (pg_flags & PAGING_FL_ZERO_PG)
@@ -548,7 +1104,7 @@ map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
                    /* Kernel pages are global */
 
    if (UNLIKELY(rc != 0) && (pg_flags & PAGING_FL_DO_ALLOC)) {
-      kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+      free_page(KERNEL_PA_TO_VA(paddr));
    }
 
    return rc;
@@ -606,77 +1162,55 @@ map_pages(pdir_t *pdir,
                     (u32)((!us) << PG_GLOBAL_BIT_POS));
 }
 
+/*
+ * Clone the page directory, sharing all the page tables (see PDE_PT_COW): the
+ * cost of copying the tables and marking all the pages as CoW is paid only for
+ * the 4 MB regions actually written after fork, which are typically a few,
+ * especially when the child calls execve() immediately.
+ *
+ * Big pages are never shared: they're split first and then their page tables
+ * are shared like all the others. That's done before changing anything else,
+ * in order to be able to fail without consequences.
+ */
 pdir_t *pdir_clone(pdir_t *pdir)
 {
-   pdir_t *new_pdir = kalloc_obj(pdir_t);
+   pdir_t *new_pdir = alloc_page();
 
    if (!new_pdir)
       return NULL;
 
    ASSERT(IS_PAGE_ALIGNED(new_pdir));
-   memcpy32(new_pdir, pdir, sizeof(pdir_t) / 4);
 
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
-      /* User-space cannot use 4-MB pages */
-      ASSERT(!pdir->entries[i].psize);
-
-      if (!pdir->entries[i].present)
-         continue;
-
-      page_table_t *pt = kalloc_obj(page_table_t);
-
-      if (UNLIKELY(!pt)) {
-
-         for (; i > 0; i--) {
-            if (pdir->entries[i - 1].present)
-               kfree_obj(pdir_get_page_table(pdir, i - 1), page_table_t);
-         }
-
-         kfree_obj(new_pdir, pdir_t);
+      if (pdir->entries[i].psize && !pdir_split_big_page(pdir, i)) {
+         free_page(new_pdir);
          return NULL;
       }
-
-      ASSERT(IS_PAGE_ALIGNED(pt));
-      new_pdir->entries[i].ptaddr=SHR_BITS(KERNEL_VA_TO_PA(pt),PAGE_SHIFT,u32);
    }
 
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
-      if (!pdir->entries[i].present)
-         continue;
-
-      page_table_t *orig_pt = pdir_get_page_table(pdir, i);
-      page_table_t *new_pt = pdir_get_page_table(new_pdir, i);
-
-      /* Mark all the non-shared pages in that page-table as COW. */
-      for (u32 j = 0; j < 1024; j++) {
-
-         page_t *const p = &orig_pt->pages[j];
+      page_dir_entry_t *e = &pdir->entries[i];
+      ASSERT(!e->psize);
 
-         if (!p->present)
-            continue;
-
-         const ulong orig_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
-
-         /* Sanity-check: a mapped page MUST have ref-count > 0 */
-         ASSERT(pf_ref_count_get(orig_paddr) > 0);
+      if (!e->present)
+         continue;
 
-         if (!(p->avail & PAGE_SHARED)) {
+      const ulong pt_paddr = (ulong)e->ptaddr << PAGE_SHIFT;
 
-            if (p->rw)
-               p->avail |= PAGE_COW_ORIG_RW;
+      if (!(e->avail & PDE_PT_COW)) {
 
-            p->rw = false;
-         }
-
-         pf_ref_count_inc(orig_paddr);
+         /* The page table was private: now it's used by two pdirs */
+         pf_ref_count_inc(pt_paddr);
+         e->rw = false;
+         e->avail |= PDE_PT_COW;
       }
 
-      // copy the page table
-      memcpy(new_pt, orig_pt, sizeof(page_table_t));
+      pf_ref_count_inc(pt_paddr);
    }
 
+   memcpy32(new_pdir, pdir, sizeof(pdir_t) / 4);
    return new_pdir;
 }
 
@@ -686,6 +1220,12 @@ pdir_deep_clone(pdir_t *pdir)
    STATIC_ASSERT(sizeof(pdir_t) == PAGE_SIZE);
    STATIC_ASSERT(sizeof(page_table_t) == PAGE_SIZE);
 
+   /* Big pages are copied page by page, like the regular ones */
+   for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
+      if (pdir->entries[i].psize && !pdir_split_big_page(pdir, i))
+         return NULL;
+   }
+
    struct kmalloc_acc acc;
    kmalloc_create_accelerator(&acc, PAGE_SIZE, 4);
 
@@ -699,8 +1239,6 @@ pdir_deep_clone(pdir_t *pdir)
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
       new_pdir->entries[i].raw = pdir->entries[i].raw;
-
-      /* User-space cannot use 4-MB pages */
       ASSERT(!pdir->entries[i].psize);
 
       if (!pdir->entries[i].present)
@@ -767,13 +1305,26 @@ void pdir_destroy(pdir_t *pdir)
    // Kernel's pdir cannot be destroyed!
    ASSERT(pdir != __kernel_pdir);
 
+   // Nor the current one: the caller must switch to another pdir first.
+   ASSERT(pdir != get_curr_pdir());
+
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
       if (!pdir->entries[i].present)
          continue;
 
+      if (pdir->entries[i].psize) {
+         unmap_big_page(pdir, i, true);
+         continue;
+      }
+
       page_table_t *pt = pdir_get_page_table(pdir, i);
 
+      if (pdir->entries[i].avail & PDE_PT_COW) {
+         if (pf_ref_count_dec(KERNEL_VA_TO_PA(pt)) > 0)
+            continue; /* Other pdirs are still using this page table */
+      }
+
       for (u32 j = 0; j < 1024; j++) {
 
          if (!pt->pages[j].present)
@@ -782,15 +1333,15 @@ void pdir_destroy(pdir_t *pdir)
          const ulong paddr = (ulong)pt->pages[j].pageAddr << PAGE_SHIFT;
 
          if (pf_ref_count_dec(paddr) == 0)
-            kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+            free_page(KERNEL_PA_TO_VA(paddr));
       }
 
       // We freed all the pages, now free the whole page-table.
-      kfree_obj(pt, page_table_t);
+      free_page(pt);
    }
 
    // We freed all pages and all the page-tables, now free pdir.
-   kfree_obj(pdir, pdir_t);
+   free_page(pdir);
 }
 
 
@@ -42,6 +42,17 @@
 #define PAGE_FAULT_FL_US      (1u << 2)
 
 #define PAGE_FAULT_FL_COW (PAGE_FAULT_FL_PRESENT | PAGE_FAULT_FL_RW)
+
+/*
+ * When this flag is set in the 'avail' bits of a page_dir_entry_t, it means
+ * that its page table is shared with other page directories (after fork) and
+ * that, because of that, the entry has been made read-only. On the first write
+ * attempt in its 4 MB region, the page table has to be copied (copy-on-write
+ * at the page directory level). The number of page directories sharing a page
+ * table is kept in the ref-count of its pageframe.
+ */
+#define PDE_PT_COW                                            (1 << 0)
+
 #define BIG_PAGE_SHIFT                                            22
 #define KERNEL_BASE_PD_IDX        (KERNEL_BASE_VA >> BIG_PAGE_SHIFT)
 
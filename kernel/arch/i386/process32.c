@@ -28,6 +28,15 @@
 
 void soft_interrupt_resume(void);
 
+/* Auxiliary vector entry types (see <elf.h>) */
+#ifndef AT_NULL
+   #define AT_NULL                   0
+#endif
+
+#ifndef AT_SYSINFO_EHDR
+   #define AT_SYSINFO_EHDR          33
+#endif
+
 //#define DEBUG_printk printk
 #define DEBUG_printk(...)
 
@@ -40,6 +49,17 @@ STATIC_ASSERT(
 
 STATIC_ASSERT(TOT_PROC_AND_TASK_SIZE <= 1024);
 
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, seq) == VVAR_SEQ_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, clock_mode) == VVAR_CLOCK_MODE_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, base_cycles) == VVAR_BASE_CYCLES_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, max_cycles) == VVAR_MAX_CYCLES_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, mult) == VVAR_MULT_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, shift) == VVAR_SHIFT_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, base_sec) == VVAR_BASE_SEC_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, base_nsec) == VVAR_BASE_NSEC_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, coarse_nsec) == VVAR_COARSE_NSEC_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, coarse_sec) == VVAR_COARSE_SEC_OFF);
+
 void task_info_reset_kernel_stack(struct task *ti)
 {
    ulong bottom = (ulong)ti->kernel_stack + KERNEL_STACK_SIZE - 1;
@@ -110,18 +130,19 @@ push_args_on_user_stack(regs_t *r,
       env_pointers[i] = r->useresp;
    }
 
-   // push the env array (in reverse order)
-
-   push_on_user_stack(r, 0); /*
-                              * 2nd mandatory NULL pointer: after the 'env'
-                              * pointers there could additional aux information
-                              * that some libc implementations check for.
-                              * Therefore, it is essential to add another NULL
-                              * after the env pointers to inform the libc impl
-                              * that no such information exist. For more info,
-                              * check __init_libc() in libmusl.
-                              */
+   /*
+    * Push the auxiliary vector (in reverse order): after the 'env' pointers,
+    * the libc expects a list of (type, value) pairs terminated by AT_NULL.
+    * For more info, check __init_libc() in libmusl. The only entry we pass is
+    * the address of the vDSO's ELF header, used by the libc for finding the
+    * vDSO functions, like __vdso_clock_gettime().
+    */
+   push_on_user_stack(r, 0);
+   push_on_user_stack(r, AT_NULL);
+   push_on_user_stack(r, USER_VDSO_VADDR);
+   push_on_user_stack(r, AT_SYSINFO_EHDR);
 
+   // push the env array (in reverse order)
    push_on_user_stack(r, 0); // mandatory final NULL pointer (end of 'env' ptrs)
 
    for (u32 i = envc; i > 0; i--) {
@@ -521,6 +542,10 @@ int setup_process(struct elf_program_info *pinfo,
          remove_all_file_mappings(pi);
          process_free_mappings_info(pi);
 
+         /*
+          * Not the current pdir anymore: switching CR3 already flushed its
+          * non-global TLB entries. See terminate_process().
+          */
          ASSERT(old_pdir == pi->pdir);
          pdir_destroy(pi->pdir);
 
@@ -117,6 +117,15 @@ unmap_pages(pdir_t *pdir,
    }
 }
 
+void
+unmap_pages_noflush(pdir_t *pdir,
+                    void *vaddr,
+                    size_t page_count,
+                    bool do_free)
+{
+   NOT_IMPLEMENTED();
+}
+
 size_t
 unmap_pages_permissive(pdir_t *pdir,
                        void *vaddr,
@@ -126,6 +135,25 @@ unmap_pages_permissive(pdir_t *pdir,
    NOT_IMPLEMENTED();
 }
 
+int remap_pages(pdir_t *pdir, void *src, void *dst, size_t page_count)
+{
+   NOT_IMPLEMENTED();
+}
+
+int protect_pages(pdir_t *pdir, void *vaddr, size_t count, u32 pg_flags)
+{
+   NOT_IMPLEMENTED();
+}
+
+size_t
+reclaim_user_pages(pdir_t *pdir,
+                   void *vaddr,
+                   size_t page_count,
+                   size_t *unmapped)
+{
+   NOT_IMPLEMENTED();
+}
+
 pdir_t *pdir_clone(pdir_t *pdir)
 {
    NOT_IMPLEMENTED();
@@ -146,6 +174,11 @@ bool handle_potential_cow(void *context)
    NOT_IMPLEMENTED();
 }
 
+bool handle_potential_demand_zero(void *context)
+{
+   NOT_IMPLEMENTED();
+}
+
 void init_hi_vmem_heap(void)
 {
    NOT_IMPLEMENTED();
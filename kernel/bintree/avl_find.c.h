@@ -34,4 +34,78 @@ bintree_find_internal(void *root_obj,
    return NULL;
 }
 
+#if BINTREE_PTR_FUNCS
+void *
+bintree_find_le_ptr_internal(void *root_obj,
+                             const void *value_ptr,
+                             long bintree_offset,
+                             long field_off)
+#else
+void *
+bintree_find_le_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,
+                         long bintree_offset)
+#endif
+{
+   void *res = NULL;
+   long c;
+
+   while (root_obj) {
+
+      if (!(c = CMP(root_obj, value_ptr)))
+         return root_obj;
+
+      if (c < 0) {
+
+         /* root_obj < val: it's a candidate, but look for a bigger one */
+         res = root_obj;
+         root_obj = RIGHT_OF(root_obj);
+
+      } else {
+
+         root_obj = LEFT_OF(root_obj);
+      }
+   }
+
+   return res;
+}
+
+#if BINTREE_PTR_FUNCS
+void *
+bintree_find_ge_ptr_internal(void *root_obj,
+                             const void *value_ptr,
+                             long bintree_offset,
+                             long field_off)
+#else
+void *
+bintree_find_ge_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,
+                         long bintree_offset)
+#endif
+{
+   void *res = NULL;
+   long c;
+
+   while (root_obj) {
+
+      if (!(c = CMP(root_obj, value_ptr)))
+         return root_obj;
+
+      if (c > 0) {
+
+         /* root_obj > val: it's a candidate, but look for a smaller one */
+         res = root_obj;
+         root_obj = LEFT_OF(root_obj);
+
+      } else {
+
+         root_obj = RIGHT_OF(root_obj);
+      }
+   }
+
+   return res;
+}
+
 #undef CMP
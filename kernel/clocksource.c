@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+
+#include <tilck/kernel/clocksource.h>
+#include <tilck/kernel/hal.h>
+
+/*
+ * Clocksource-based timekeeping
+ * -------------------------------
+ *
+ * At each tick, the timer code calls clocksource_update() with the current
+ * system time. We take a snapshot of it, together with the clocksource's
+ * counter, and from that moment on the time is:
+ *
+ *    base_ns + cyc2ns(read() - base_cycles)
+ *
+ * The snapshot is protected by a sequence counter: it's changed only by the
+ * timer IRQ handler, while readers just retry if it changed while they were
+ * reading it. That allows reading the time without disabling the interrupts.
+ *
+ * In order to never go backwards, the new `base_ns` is the max between the
+ * tick-based time and the interpolated one. Because of that, the calibration
+ * is biased to make the clocksource look slightly slower than it is: that
+ * way, the interpolated time cannot run ahead of the tick-based time (which
+ * is kept in sync with the hardware clock by clock_drift_adj()) for long.
+ */
+
+#define CALIBRATION_BIAS_SHIFT            13    /* ~ 1.2e-4 */
+
+static ATOMIC(u32) tk_seq;
+static struct clocksource_base tk;
+static struct clocksource *next_cs;
+
+static ALWAYS_INLINE void tk_write_begin(void)
+{
+   atomic_fetch_add_explicit(&tk_seq, 1, mo_relaxed);
+   atomic_thread_fence(mo_release);
+}
+
+static ALWAYS_INLINE void tk_write_end(void)
+{
+   atomic_thread_fence(mo_release);
+   atomic_fetch_add_explicit(&tk_seq, 1, mo_relaxed);
+}
+
+static ALWAYS_INLINE u32 tk_read_begin(void)
+{
+   return atomic_load_explicit(&tk_seq, mo_acquire);
+}
+
+static ALWAYS_INLINE bool tk_read_retry(u32 seq)
+{
+   atomic_thread_fence(mo_acquire);
+   return (seq & 1) || seq != atomic_load_explicit(&tk_seq, mo_relaxed);
+}
+
+static ALWAYS_INLINE u64 tk_get_ns(const struct clocksource_base *d, u64 cycles)
+{
+   u64 delta = cycles - d->base_cycles;
+
+   /*
+    * The counter is read at every tick, so this can happen only if the
+    * interrupts have been disabled for a very long time. Just saturate.
+    */
+   if (UNLIKELY(delta > d->max_cycles))
+      delta = d->max_cycles;
+
+   return d->base_ns + clocksource_cyc2ns(delta, d->mult, d->shift);
+}
+
+void clocksource_calibrate(struct clocksource *cs, u64 cycles, u64 ns)
+{
+   u64 mult = 0;
+   u32 shift;
+
+   ASSERT(cycles > 0);
+
+   /* Use the biggest shift (-> the best precision) that fits in 32 bits */
+   for (shift = 32; shift > 0; shift--) {
+
+      mult = (ns << shift) / cycles;
+
+      if (mult <= UINT32_MAX)
+         break;
+   }
+
+   cs->mult = (u32)(mult - (mult >> CALIBRATION_BIAS_SHIFT));
+   cs->shift = shift;
+}
+
+void clocksource_select(struct clocksource *cs)
+{
+   ulong var;
+   ASSERT(!cs || cs->mult > 0);
+
+   disable_interrupts(&var);
+   {
+      next_cs = cs;
+
+      if (!cs) {
+
+         /* Stop using the current clocksource immediately */
+         tk_write_begin();
+         {
+            tk.cs = NULL;
+         }
+         tk_write_end();
+      }
+   }
+   enable_interrupts(&var);
+}
+
+static void tk_update(struct clocksource *cs, u64 now, u64 mult)
+{
+   const u64 cycles = cs->read();
+
+   if (tk.cs == cs)
+      now = MAX(now, tk_get_ns(&tk, cycles));
+
+   mult = MIN(mult, (u64)UINT32_MAX);
+
+   tk_write_begin();
+   {
+      tk.cs = cs;
+      tk.base_ns = now;
+      tk.base_cycles = cycles;
+      tk.mult = (u32)mult;
+      tk.shift = cs->shift;
+      tk.max_cycles = UINT64_MAX / mult;
+   }
+   tk_write_end();
+}
+
+void clocksource_update(u64 now, u32 tick_ns, u32 real_tick_ns)
+{
+   struct clocksource *cs;
+   u64 mult;
+   ulong var;
+
+   disable_interrupts(&var);
+   {
+      if ((cs = next_cs)) {
+
+         mult = cs->mult;
+
+         if (tick_ns != real_tick_ns)
+            mult = mult * tick_ns / real_tick_ns;
+
+         tk_update(cs, now, mult);
+      }
+   }
+   enable_interrupts(&var);
+}
+
+bool clocksource_get_ns(u64 *ns)
+{
+   struct clocksource_base d;
+   u32 seq;
+
+   do {
+
+      seq = tk_read_begin();
+      d = tk;
+
+      if (!d.cs)
+         return false;
+
+      *ns = tk_get_ns(&d, d.cs->read());
+
+   } while (tk_read_retry(seq));
+
+   return true;
+}
+
+void clocksource_get_base(struct clocksource_base *b)
+{
+   ASSERT(!are_interrupts_enabled());
+   *b = tk;
+}
+
+const char *clocksource_get_name(void)
+{
+   struct clocksource *cs = tk.cs;
+   return cs ? cs->name : NULL;
+}
@@ -11,6 +11,7 @@
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/clocksource.h>
 
 #define FULL_RESYNC_MAX_ATTEMPTS       10
 
@@ -433,6 +434,33 @@ u64 get_sys_time(void)
    return ts;
 }
 
+/*
+ * Like get_sys_time(), but with sub-tick resolution: it reads the clocksource
+ * (see clocksource.c) or, when there's none, the hardware timer's counter.
+ */
+u64 get_sys_time_hr(void)
+{
+   static u64 last_ts;
+   u64 ts;
+   ulong var;
+
+   if (clocksource_get_ns(&ts))
+      return ts;
+
+   disable_interrupts(&var);
+   {
+      /*
+       * Because of the tick adjustments made by clock_drift_adj(), a tick
+       * might last less than its nominal duration: never go backwards.
+       */
+      ts = __time_ns + hw_timer_get_elapsed_ns();
+      ts = MAX(ts, last_ts);
+      last_ts = ts;
+   }
+   enable_interrupts(&var);
+   return ts;
+}
+
 s64 get_timestamp(void)
 {
    const u64 ts = get_sys_time();
@@ -474,10 +502,8 @@ u64 timespec_to_ticks(const struct k_timespec64 *tp)
    return ticks;
 }
 
-void real_time_get_timespec(struct k_timespec64 *tp)
+void sys_time_to_timespec(u64 t, struct k_timespec64 *tp)
 {
-   const u64 t = get_sys_time();
-
    tp->tv_sec = (s64)boot_timestamp + (s64)(t / TS_SCALE);
 
    if (TS_SCALE <= BILLION)
@@ -486,6 +512,16 @@ void real_time_get_timespec(struct k_timespec64 *tp)
       tp->tv_nsec = (t % TS_SCALE) / (TS_SCALE / BILLION);
 }
 
+void real_time_get_timespec(struct k_timespec64 *tp)
+{
+   sys_time_to_timespec(get_sys_time_hr(), tp);
+}
+
+static void real_time_get_timespec_coarse(struct k_timespec64 *tp)
+{
+   sys_time_to_timespec(get_sys_time(), tp);
+}
+
 void monotonic_time_get_timespec(struct k_timespec64 *tp)
 {
    /* Same as the real_time clock, for the moment */
@@ -538,16 +574,19 @@ do_clock_gettime(clockid_t clk_id, struct k_timespec64 *tp)
    switch (clk_id) {
 
       case CLOCK_REALTIME:
-      case CLOCK_REALTIME_COARSE:
          real_time_get_timespec(tp);
          break;
 
       case CLOCK_MONOTONIC:
-      case CLOCK_MONOTONIC_COARSE:
       case CLOCK_MONOTONIC_RAW:
          monotonic_time_get_timespec(tp);
          break;
 
+      case CLOCK_REALTIME_COARSE:
+      case CLOCK_MONOTONIC_COARSE:
+         real_time_get_timespec_coarse(tp);
+         break;
+
       case CLOCK_PROCESS_CPUTIME_ID:
       case CLOCK_THREAD_CPUTIME_ID:
          task_cpu_get_timespec(tp);
@@ -567,10 +606,19 @@ do_clock_getres(clockid_t clk_id, struct k_timespec64 *res)
    switch (clk_id) {
 
       case CLOCK_REALTIME:
-      case CLOCK_REALTIME_COARSE:
       case CLOCK_MONOTONIC:
-      case CLOCK_MONOTONIC_COARSE:
       case CLOCK_MONOTONIC_RAW:
+
+         /* Sub-tick resolution, see get_sys_time_hr() */
+         *res = (struct k_timespec64) {
+            .tv_sec = 0,
+            .tv_nsec = clocksource_get_name() ? 1 : 1000,
+         };
+
+         break;
+
+      case CLOCK_REALTIME_COARSE:
+      case CLOCK_MONOTONIC_COARSE:
       case CLOCK_PROCESS_CPUTIME_ID:
       case CLOCK_THREAD_CPUTIME_ID:
 
@@ -16,6 +16,8 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/page_alloc.h>
 
 #include <sys/mman.h>      // system header
 
@@ -64,11 +66,11 @@ load_segment_by_copy(fs_handle *elf_h,
 
       if (!is_mapped(pdir, vaddr)) {
 
-         if (!(p = kzmalloc(PAGE_SIZE)))
+         if (!(p = zero_pool_alloc_page()))
             return -ENOMEM;
 
          if ((rc = map_page(pdir, vaddr, KERNEL_VA_TO_PA(p), PAGING_FL_RWUS))) {
-            kfree2(p, PAGE_SIZE);
+            free_page(p);
             return (int)rc;
          }
 
@@ -222,7 +224,7 @@ static void free_elf_headers(struct elf_headers *eh)
    ASSERT(eh != NULL);
 
    if (eh->total_phdrs_size)
-      kfree2(eh->phdrs, eh->total_phdrs_size);
+      vfree2(eh->phdrs, eh->total_phdrs_size);
 }
 
 static int
@@ -261,7 +263,7 @@ load_elf_headers(fs_handle elf_h,
       return -ENOEXEC;
 
    eh->total_phdrs_size = eh->header->e_phnum * sizeof(Elf_Phdr);
-   eh->phdrs = kmalloc(eh->total_phdrs_size);
+   eh->phdrs = vmalloc(eh->total_phdrs_size);
 
    if (!eh->phdrs)
       return -ENOMEM;
@@ -291,7 +293,7 @@ static int
 alloc_and_map_stack_page(pdir_t *pdir, void *stack_top, u32 i)
 {
    int rc;
-   void *p = kzmalloc(PAGE_SIZE);
+   void *p = zero_pool_alloc_page();
 
    if (!p)
       return -ENOMEM;
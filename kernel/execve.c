@@ -134,6 +134,8 @@ execve_final_steps(struct task *ti,
    /* Final steps */
    pi->brk = brk;
    pi->initial_brk = brk;
+   pi->anon_faults = 0;
+   pi->anon_pages = 0;
    pi->did_call_execve = true;
    ti->timer_ready = false;
 
@@ -332,8 +332,15 @@ void terminate_process(int exit_code, int term_sig)
 
    set_curr_pdir(get_kernel_pdir());
 
-   if (!vforked)
+   if (!vforked) {
+
+      /*
+       * No TLB invalidation is needed before destroying the pdir: switching
+       * CR3 to the kernel pdir above already flushed all the non-global
+       * entries, i.e. all the user ones.
+       */
       pdir_destroy(pi->pdir);
+   }
 
    switch_stack_free_mem_and_schedule();
 }
@@ -20,6 +20,7 @@ STATIC int fork_dup_all_handles(struct process *pi)
       int rc;
       fs_handle dup_h = NULL;
       fs_handle h = pi->handles[i];
+      struct bintree_walk_ctx ctx;
       struct user_mapping *um;
 
       if (!h)
@@ -47,7 +48,13 @@ STATIC int fork_dup_all_handles(struct process *pi)
       if (!pi->mi)
          continue;
 
-      list_for_each_ro(um, &pi->mi->mappings, pi_node) {
+      bintree_in_order_visit_start(&ctx,
+                                   pi->mi->mappings,
+                                   struct user_mapping,
+                                   pi_node,
+                                   false);
+
+      while ((um = bintree_in_order_visit_next(&ctx))) {
          if (um->h == h)
             um->h = dup_h;
       }
@@ -1,16 +1,21 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+static DEFINE_KMEM_CACHE(ramfs_blocks_cache,
+                         "ramfs_block",
+                         sizeof(struct ramfs_block),
+                         NULL);
+
 static struct ramfs_block *ramfs_new_block(offt page)
 {
    struct ramfs_block *b;
 
    /* Allocate memory for the block object */
-   if (!(b = kalloc_obj(struct ramfs_block)))
+   if (!(b = kmem_cache_alloc(&ramfs_blocks_cache)))
       return NULL;
 
    /* Allocate block's data */
-   if (!(b->vaddr = kzmalloc(PAGE_SIZE))) {
-      kfree_obj(b, struct ramfs_block);
+   if (!(b->vaddr = zero_pool_alloc_page())) {
+      kmem_cache_free(&ramfs_blocks_cache, b);
       return NULL;
    }
 
@@ -29,10 +34,10 @@ static void ramfs_destroy_block(struct ramfs_block *b)
    release_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
 
    /* Free the memory pointed by this block */
-   kfree2(b->vaddr, PAGE_SIZE);
+   free_page(b->vaddr);
 
    /* Free the memory used by the block object itself */
-   kfree_obj(b, struct ramfs_block);
+   kmem_cache_free(&ramfs_blocks_cache, b);
 }
 
 static void
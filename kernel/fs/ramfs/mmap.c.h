@@ -35,7 +35,7 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
 
    pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
 
-   if ((rh->fl_flags & O_RDWR) == O_RDWR)
+   if ((rh->fl_flags & O_RDWR) == O_RDWR && (um->prot & PROT_WRITE))
       pg_flags |= PAGING_FL_RW;
 
    while ((b = bintree_in_order_visit_next(&ctx))) {
@@ -85,6 +85,8 @@ ramfs_handle_fault_int(struct process *pi,
    ulong vaddr = (ulong) vaddrp;
    ulong abs_off;
    struct ramfs_block *block;
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   void *page;
    int rc;
 
    ASSERT(um != NULL);
@@ -93,12 +95,17 @@ ramfs_handle_fault_int(struct process *pi,
 
       /*
        * The page is present, just is read-only and the user code tried to
-       * write: there's nothing we can do.
+       * write. That's fine only if the mapping became writable after the page
+       * has been mapped (see mprotect()): in that case, just drop the page and
+       * map it again below, as writable.
        */
 
       ASSERT(rw);
-      ASSERT((um->prot & PROT_WRITE) == 0);
-      return false;
+
+      if (!(um->prot & PROT_WRITE))
+         return false;
+
+      unmap_page_permissive(pi->pdir, (void *)(vaddr & PAGE_MASK), false);
    }
 
    /* The page is *not* present */
@@ -107,7 +114,13 @@ ramfs_handle_fault_int(struct process *pi,
    if (abs_off >= (ulong)rh->inode->fsize)
       return false; /* Read/write past EOF */
 
-   if (rw) {
+   block = bintree_find_ptr(rh->inode->blocks_tree_root,
+                            (offt)(abs_off & PAGE_MASK),
+                            struct ramfs_block,
+                            node,
+                            offset);
+
+   if (rw && !block) {
       /* Create and map on-the-fly a struct ramfs_block */
       if (!(block = ramfs_new_block((offt)(abs_off & PAGE_MASK))))
          panic("Out-of-memory: unable to alloc a ramfs_block. No OOM killer");
@@ -115,10 +128,26 @@ ramfs_handle_fault_int(struct process *pi,
       ramfs_append_new_block(rh->inode, block);
    }
 
+   if (block) {
+
+      page = block->vaddr;
+
+      if (um->prot & PROT_WRITE)
+         pg_flags |= PAGING_FL_RW;
+
+   } else {
+
+      /*
+       * Reading a hole in the file: map the zero page, strictly read-only.
+       * Writing there later will fault again and allocate the block.
+       */
+      page = &zero_page;
+   }
+
    rc = map_page(pi->pdir,
                  (void *)(vaddr & PAGE_MASK),
-                 KERNEL_VA_TO_PA(rw ? block->vaddr : &zero_page),
-                 PAGING_FL_US | PAGING_FL_RW | PAGING_FL_SHARED);
+                 KERNEL_VA_TO_PA(page),
+                 pg_flags);
 
    if (rc)
       panic("Out-of-memory: unable to map a ramfs_block. No OOM killer");
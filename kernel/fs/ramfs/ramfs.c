@@ -8,6 +8,9 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/fs/flock.h>
 #include <tilck/kernel/test/vfs.h>
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/kmem_cache.h>
 
 #include <sys/mman.h>      // system header
 
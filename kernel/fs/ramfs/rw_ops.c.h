@@ -155,7 +155,6 @@ static void ramfs_unmap_past_eof_mappings(struct ramfs_inode *i, size_t len)
 {
    const size_t rlen = pow2_round_up_at(len, PAGE_SIZE);
    struct user_mapping *um;
-   ulong va;
    ASSERT(!is_preemption_enabled());
 
    list_for_each_ro(um, &i->mappings_list, inode_node) {
@@ -164,12 +163,11 @@ static void ramfs_unmap_past_eof_mappings(struct ramfs_inode *i, size_t len)
          continue;
 
       const ulong voff = rlen >= um->off ? rlen - um->off : 0;
-      const ulong vend = um->vaddr + um->len;
 
-      for (va = um->vaddr + voff; va < vend; va += PAGE_SIZE) {
-         unmap_page_permissive(um->pi->pdir, (void *)va, false);
-         invalidate_page(va);
-      }
+      unmap_pages_permissive(um->pi->pdir,
+                             (void *)(um->vaddr + voff),
+                             (um->len - voff) >> PAGE_SHIFT,
+                             false);
    }
 }
 
@@ -5,6 +5,7 @@
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/fs/flock.h>
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmem_cache.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_mm.h>
@@ -993,6 +994,11 @@ panic_handles[PANIC_HANDLES][MAX_FS_HANDLE_SIZE] ALIGNED_AT(MAX_FS_HANDLE_SIZE);
 static bool
 panic_handles_used[PANIC_HANDLES];
 
+static DEFINE_KMEM_CACHE(fs_handles_cache,
+                         "fs_handle",
+                         MAX_FS_HANDLE_SIZE,
+                         NULL);
+
 fs_handle vfs_alloc_handle_raw(void)
 {
    if (UNLIKELY(in_panic())) {
@@ -1007,7 +1013,7 @@ fs_handle vfs_alloc_handle_raw(void)
       return NULL;
    }
 
-   return kmalloc(MAX_FS_HANDLE_SIZE);
+   return kmem_cache_alloc(&fs_handles_cache);
 }
 
 void vfs_free_handle(fs_handle h)
@@ -1024,7 +1030,7 @@ void vfs_free_handle(fs_handle h)
       return;
    }
 
-   kfree2(h, MAX_FS_HANDLE_SIZE);
+   kmem_cache_free(&fs_handles_cache, h);
 }
 
 fs_handle vfs_alloc_handle(void)
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/hrtimer.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/hal.h>
+
+/*
+ * Active hrtimers, sorted by expire time. A sorted list is fine here, because
+ * it's expected to be short: the ns-based task timeouts wait for their whole
+ * ticks on the ktimer wheel and get here only for the sub-tick remainder (see
+ * task_set_wakeup_timer_ns()). Therefore, it contains only the timeouts that
+ * expire within the next tick, plus a few drivers. The timer IRQ handler just
+ * needs to check the first element.
+ */
+static struct list hrtimer_list = STATIC_LIST_INIT(hrtimer_list);
+
+static ALWAYS_INLINE void hrtimer_remove(struct hrtimer *t)
+{
+   list_remove(&t->node);
+   list_node_init(&t->node);
+}
+
+static ALWAYS_INLINE u64 hrtimer_delta(struct hrtimer *t, u64 now)
+{
+   return t->expires > now ? t->expires - now : 0;
+}
+
+void hrtimer_init(struct hrtimer *t, hrtimer_func func, void *arg)
+{
+   list_node_init(&t->node);
+   t->expires = 0;
+   t->func = func;
+   t->arg = arg;
+}
+
+void hrtimer_start(struct hrtimer *t, u64 ns)
+{
+   struct hrtimer *pos;
+   ulong var;
+
+   ASSERT(t->func != NULL);
+
+   disable_interrupts(&var);
+   {
+      if (hrtimer_is_active(t))
+         hrtimer_remove(t);
+
+      t->expires = get_sys_time_hr() + ns;
+
+      list_for_each_ro(pos, &hrtimer_list, node) {
+         if (pos->expires > t->expires)
+            break;
+      }
+
+      /* NOTE: when the loop didn't break, `pos->node` is the list's head */
+      list_add_before(&pos->node, &t->node);
+
+      if (hrtimer_list.first == &t->node)
+         timer_update_next_event();
+   }
+   enable_interrupts(&var);
+}
+
+u64 hrtimer_cancel(struct hrtimer *t)
+{
+   ulong var;
+   u64 rem = 0;
+
+   disable_interrupts(&var);
+   {
+      if (hrtimer_is_active(t)) {
+         rem = hrtimer_delta(t, get_sys_time_hr());
+         hrtimer_remove(t);
+      }
+   }
+   enable_interrupts(&var);
+   return rem;
+}
+
+/* Nanoseconds before the first hrtimer expires, or UINT64_MAX if none */
+u64 hrtimer_get_next_delta(void)
+{
+   ASSERT(!are_interrupts_enabled());
+
+   if (list_is_empty(&hrtimer_list))
+      return UINT64_MAX;
+
+   return hrtimer_delta(list_first_obj(&hrtimer_list, struct hrtimer, node),
+                        get_sys_time_hr());
+}
+
+/* Called by the timer IRQ handler, with interrupts disabled */
+void hrtimer_run_expired(void)
+{
+   struct hrtimer *t;
+   u64 now;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (list_is_empty(&hrtimer_list))
+      return;
+
+   now = get_sys_time_hr();
+
+   while (!list_is_empty(&hrtimer_list)) {
+
+      t = list_first_obj(&hrtimer_list, struct hrtimer, node);
+
+      if (t->expires > now)
+         break;
+
+      hrtimer_remove(t);
+      t->func(t);
+   }
+}
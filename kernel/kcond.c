@@ -22,7 +22,12 @@ bool kcond_is_anyone_waiting(struct kcond *c)
    return ret;
 }
 
-bool kcond_wait(struct kcond *c, struct kmutex *m, u32 timeout_ticks)
+/*
+ * Wait on `c` with a timeout expressed either in ticks or, when `hr` is true,
+ * in nanoseconds. A zero timeout means no timeout.
+ */
+static bool
+kcond_wait_int(struct kcond *c, struct kmutex *m, u64 timeout, bool hr)
 {
    DEBUG_ONLY(check_not_in_irq_handler());
    ASSERT(!m || kmutex_is_curr_task_holding_lock(m));
@@ -34,8 +39,12 @@ panic_retry_hack:
    disable_preemption();
    prepare_to_wait_on(WOBJ_KCOND, c, NO_EXTRA, &c->wait_list);
 
-   if (timeout_ticks != KCOND_WAIT_FOREVER)
-      task_set_wakeup_timer(curr, timeout_ticks);
+   if (timeout != KCOND_WAIT_FOREVER) {
+      if (hr)
+         task_set_wakeup_timer_ns(curr, timeout);
+      else
+         task_set_wakeup_timer(curr, (u32)timeout);
+   }
 
    if (m) {
       kmutex_unlock(m);
@@ -100,6 +109,16 @@ panic_retry_hack:
    return ret;
 }
 
+bool kcond_wait(struct kcond *c, struct kmutex *m, u32 timeout_ticks)
+{
+   return kcond_wait_int(c, m, timeout_ticks, false);
+}
+
+bool kcond_wait_ns(struct kcond *c, struct kmutex *m, u64 timeout_ns)
+{
+   return kcond_wait_int(c, m, timeout_ns, true);
+}
+
 static void
 kcond_signal_int(struct kcond *c, struct wait_obj *wo)
 {
@@ -13,32 +13,57 @@
 
 #endif
 
+/* Index of the most significant bit set in `mask`, which must be != 0 */
+static ALWAYS_INLINE int highest_bit_index(u32 mask)
+{
+   ASSERT(mask != 0);
+
+   mask |= mask >> 1;
+   mask |= mask >> 2;
+   mask |= mask >> 4;
+   mask |= mask >> 8;
+   mask |= mask >> 16;
+
+   return (int)log2_for_power_of_2(mask - (mask >> 1));
+}
+
 static void *
 main_heaps_kmalloc(size_t *size, u32 flags)
 {
+   const bool dma = !!(flags & KMALLOC_FL_DMA);
+   const size_t rounded_size = roundup_next_power_of_2(*size);
+   u32 mask;
+
    ASSERT(kmalloc_initialized);
 
-   // Iterate in reverse-order because the first heaps are the biggest ones.
-   for (int i = used_heaps - 1; i >= 0; i--) {
+   if (UNLIKELY(rounded_size < *size))
+      return NULL; /* overflow */
 
-      ASSERT(heaps[i] != NULL);
+   if (UNLIKELY(log2_for_power_of_2(rounded_size) >= KMALLOC_SIZE_CLASSES))
+      return NULL;
 
-      void *vaddr;
-      const size_t heap_size = heaps[i]->size;
-      const size_t heap_free = heap_size - heaps[i]->mem_allocated;
+   /*
+    * The main heaps which might have a free block big enough and the right
+    * `dma` attribute. If there's none, we can fail immediately.
+    */
+   mask = main_heaps_free_summary[log2_for_power_of_2(rounded_size)];
+   mask &= dma ? main_heaps_dma_mask : ~main_heaps_dma_mask;
 
-      /*
-       * The heap is too small (unlikely but possible) or the heap has not been
-       * created yet, therefore has size = 0 or just there is not enough free
-       * space in it.
-       */
-      if (heap_size < *size || heap_free < *size)
-         continue;
+   /*
+    * Start from the highest index because the first heaps are the biggest
+    * ones: that keeps the big heaps for the big allocations.
+    */
+   while (mask) {
 
-      if (heaps[i]->dma != !!(flags & KMALLOC_FL_DMA))
-         continue;
+      const int i = highest_bit_index(mask);
+      struct kmalloc_heap *h = heaps[i];
+      void *vaddr;
+
+      ASSERT(i < used_heaps);
+      ASSERT(h != NULL);
+      ASSERT(h->dma == dma);
 
-      if ((vaddr = per_heap_kmalloc(heaps[i], size, flags))) {
+      if ((vaddr = per_heap_kmalloc(h, size, flags))) {
 
          if (KMALLOC_SUPPORT_LEAK_DETECTOR && leak_detector_enabled) {
             debug_kmalloc_register_alloc(vaddr, *size);
@@ -46,6 +71,13 @@ main_heaps_kmalloc(size_t *size, u32 flags)
 
          return vaddr;
       }
+
+      /*
+       * The allocation failed: per_heap_kmalloc() has lowered the heap's
+       * `max_free`, unless the failure was not due to fragmentation. In any
+       * case, skip the heap.
+       */
+      mask &= ~(1u << i);
    }
 
    return NULL;
@@ -91,10 +123,64 @@ main_heaps_kfree(void *ptr, size_t *size, u32 flags)
    return 0;
 }
 
+static void *
+general_kmalloc_unsafe(size_t *size, u32 flags)
+{
+   const u32 sub_block_sz = flags & KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK;
+   void *res;
+
+   if (*size <= SMALL_HEAP_MAX_ALLOC ||
+       UNLIKELY(sub_block_sz && sub_block_sz <= SMALL_HEAP_MAX_ALLOC))
+   {
+      /* Small DMA allocations are not allowed */
+      ASSERT(~flags & KMALLOC_FL_DMA);
+      return small_heaps_kmalloc(size, flags);
+   }
+
+   res = main_heaps_kmalloc(size, flags);
+
+   if (UNLIKELY(res == NULL && ~flags & KMALLOC_FL_DMA))
+      res = main_heaps_kmalloc(size, flags | KMALLOC_FL_DMA);
+
+   return res;
+}
+
+/*
+ * The allocation failed: ask the shrinkers to release some memory and retry.
+ * The first time, ask just for the size we need: that might not be enough
+ * because of fragmentation, so the next time ask for everything.
+ *
+ * Reclaim is task-context only: see general_kmalloc().
+ */
+static void *
+general_kmalloc_reclaim(size_t *size, u32 flags)
+{
+   const size_t orig_size = *size;
+   size_t target = orig_size;
+   void *res = NULL;
+
+   while (!res && shrink_caches(target)) {
+      *size = orig_size;
+      res = general_kmalloc_unsafe(size, flags);
+      target = (size_t)-1;
+   }
+
+   return res;
+}
+
 void *general_kmalloc(size_t *size, u32 flags)
 {
+   /*
+    * Reclaim only in task context, with preemption enabled at entry. In IRQ
+    * context, kmalloc fails exactly because the interrupted task is using a
+    * heap. With preemption disabled, our caller might be in the middle of
+    * changing the structures the shrinkers work on (e.g. a kmem cache adding
+    * a slab, or the page allocator adding a chunk). In both cases, running
+    * the shrinkers might corrupt their lists or free memory still in use.
+    */
+   const bool can_reclaim = !in_irq() && is_preemption_enabled();
+   void *caller = KMALLOC_CALLER();
    void *res;
-   const u32 sub_block_sz = flags & KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK;
    ASSERT(kmalloc_initialized);
    ASSERT(size != NULL);
    ASSERT(*size);
@@ -103,24 +189,29 @@ void *general_kmalloc(size_t *size, u32 flags)
    {
       const size_t orig_size = *size;
 
-      if (*size <= SMALL_HEAP_MAX_ALLOC ||
-          UNLIKELY(sub_block_sz && sub_block_sz <= SMALL_HEAP_MAX_ALLOC))
-      {
-         /* Small DMA allocations are not allowed */
-         ASSERT(~flags & KMALLOC_FL_DMA);
-         res = small_heaps_kmalloc(size, flags);
-
-      } else {
+      if (KMALLOC_CALLSITE_PROFILER && kmalloc_prof_caller) {
+         caller = kmalloc_prof_caller;
+         kmalloc_prof_caller = NULL;
+      }
 
-         res = main_heaps_kmalloc(size, flags);
+      res = general_kmalloc_unsafe(size, flags);
 
-         if (UNLIKELY(res == NULL && ~flags & KMALLOC_FL_DMA))
-            res = main_heaps_kmalloc(size, flags | KMALLOC_FL_DMA);
-      }
+      /*
+       * Internal allocations (e.g. the data of a new small heap) are not
+       * retried here: their caller is in the middle of a kmalloc() call
+       * and it will reclaim memory and retry on its own, if needed.
+       */
+      if (UNLIKELY(res == NULL) && can_reclaim)
+         if (!(flags & (KMALLOC_FL_DONT_ACCOUNT | KMALLOC_FL_NO_ACTUAL_ALLOC)))
+            res = general_kmalloc_reclaim(size, flags);
 
       if (KMALLOC_HEAVY_STATS && res != NULL)
          if (~flags & KMALLOC_FL_DONT_ACCOUNT)
             kmalloc_account_alloc(orig_size);
+
+      if (KMALLOC_CALLSITE_PROFILER && res != NULL)
+         if (~flags & KMALLOC_FL_DONT_ACCOUNT)
+            kmalloc_prof_alloc(res, *size, caller);
    }
    enable_preemption();
    return res;
@@ -163,6 +254,9 @@ void general_kfree(void *ptr, size_t *size, u32 flags)
          if (rc)
             rc = main_heaps_kfree(ptr, size, flags);
       }
+
+      if (KMALLOC_CALLSITE_PROFILER && !rc)
+         kmalloc_prof_free(ptr);
    }
    enable_preemption();
 
@@ -180,7 +274,7 @@ void general_kfree(void *ptr, size_t *size, u32 flags)
  */
 void *aligned_kmalloc(size_t size, u32 align)
 {
-   void *res = general_kmalloc(&size, 0);
+   void *res = wrapper_kmalloc(&size, 0, KMALLOC_CALLER());
 
    ASSERT(align > 0);
    ASSERT(align <= size);
@@ -12,9 +12,13 @@
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/interrupts.h>
 #include <tilck/kernel/sort.h>
 #include <tilck/kernel/errno.h>
+#include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/vmalloc.h>
 
 #include <tilck_gen_headers/config_kmalloc.h>
 
@@ -40,11 +44,90 @@ static const struct block_node s_new_node; // Just zeros.
 #define NODE_PARENT(n) (HALF(n-1))
 #define NODE_IS_LEFT(n) (((n) & 1) != 0)
 
+/* Return address of the current function, for the call-site profiler */
+#define KMALLOC_CALLER() \
+   __builtin_extract_return_addr(__builtin_return_address(0))
+
+/*
+ * Call site set by the kmalloc() wrappers in this file, like kzmalloc(), in
+ * order to make the profiler account the allocation to their caller instead.
+ * It's consumed by general_kmalloc() and it's protected by disabling
+ * preemption.
+ */
+static void *kmalloc_prof_caller;
+
+static void *
+wrapper_kmalloc(size_t *size, u32 flags, void *caller)
+{
+   void *res;
+
+   if (!KMALLOC_CALLSITE_PROFILER)
+      return general_kmalloc(size, flags);
+
+   disable_preemption();
+   {
+      kmalloc_prof_caller = caller;
+      res = general_kmalloc(size, flags);
+      kmalloc_prof_caller = NULL;
+   }
+   enable_preemption();
+   return res;
+}
+
 bool is_kmalloc_initialized(void)
 {
    return kmalloc_initialized;
 }
 
+/*
+ * Free-space summary of the main heaps: for each size class 2^c, the bitmask
+ * of the main heaps having `max_free` >= 2^c. It allows main_heaps_kmalloc()
+ * to pick in O(1) a heap that might have a free block big enough or to fail
+ * immediately, instead of walking the metadata tree of each heap in turn.
+ */
+STATIC_ASSERT(KMALLOC_HEAPS_COUNT <= 32);
+STATIC u32 main_heaps_free_summary[KMALLOC_SIZE_CLASSES];
+STATIC u32 main_heaps_dma_mask;
+
+/* Number of size classes a free block of `size` bytes can satisfy */
+static ALWAYS_INLINE u32 size_classes_count(size_t size)
+{
+   return size ? (u32)log2_for_power_of_2(size) + 1 : 0;
+}
+
+static void heap_set_max_free(struct kmalloc_heap *h, size_t new_max)
+{
+   const u32 old_n = size_classes_count(h->max_free);
+   const u32 new_n = size_classes_count(new_max);
+
+   ASSERT(roundup_next_power_of_2(new_max) == new_max);
+   ASSERT(new_max <= h->size);
+   h->max_free = new_max;
+
+   if (h->main_idx < 0)
+      return;
+
+   ASSERT(new_n <= KMALLOC_SIZE_CLASSES);
+
+   for (u32 c = old_n; c < new_n; c++)
+      main_heaps_free_summary[c] |= (1u << h->main_idx);
+
+   for (u32 c = new_n; c < old_n; c++)
+      main_heaps_free_summary[c] &= ~(1u << h->main_idx);
+}
+
+/*
+ * After an allocation, the biggest free block cannot be bigger than the free
+ * memory in the heap, rounded down to a power of 2.
+ */
+static ALWAYS_INLINE void heap_refine_max_free(struct kmalloc_heap *h)
+{
+   const size_t free_mem = h->size - h->mem_allocated;
+
+   if (h->max_free > free_mem)
+      heap_set_max_free(h, roundup_next_power_of_2(free_mem + 1) >> 1);
+}
+
 STATIC_INLINE int ptr_to_node(struct kmalloc_heap *h, void *ptr, size_t size)
 {
    const ulong size_log = log2_for_power_of_2(size);
@@ -268,26 +351,37 @@ internal_kmalloc_coalesce_block(struct kmalloc_heap *h,
 
    ASSERT(nodes[n].full || nodes[n].split);
 
+   /*
+    * Count the memory already free in the block. Only the children of split
+    * nodes are meaningful: the ones below a free node or an allocated one which
+    * was not split down to min_block_size (e.g. KMALLOC_FL_MULTI_STEP with
+    * sub-blocks of PAGE_SIZE) are always zero and must be skipped.
+    */
    for (s = block_size; s >= h->min_block_size; s >>= 1) {
 
-      if (s > h->min_block_size) {
+      for (int j = n; j < n + node_count; j++) {
 
-         if (s != h->alloc_block_size) {
-            bzero(&nodes[n], (size_t)node_count);
-         } else {
-            for (int j = n; j < n + node_count; j++)
-               nodes[j].raw &= ~(FL_NODE_SPLIT | FL_NODE_FULL);
-         }
+         if (j != block_node_num && !nodes[NODE_PARENT(j)].split)
+            continue;
 
-      } else {
+         if (is_block_node_free(nodes[j]))
+            already_free_size += s;
+      }
 
-         for (int j = n; j < n + node_count; j++) {
+      node_count <<= 1;
+      n = NODE_LEFT(n);
+   }
 
-            if (!(nodes[j].raw & (FL_NODE_SPLIT | FL_NODE_FULL)))
-               already_free_size += s;
+   n = block_node_num;
+   node_count = 1;
 
+   for (s = block_size; s >= h->min_block_size; s >>= 1) {
+
+      if (s > h->min_block_size && s != h->alloc_block_size) {
+         bzero(&nodes[n], (size_t)node_count);
+      } else {
+         for (int j = n; j < n + node_count; j++)
             nodes[j].raw &= ~(FL_NODE_SPLIT | FL_NODE_FULL);
-         }
       }
 
       node_count <<= 1;
@@ -389,8 +483,10 @@ internal_kmalloc(struct kmalloc_heap *h,
 
          DEBUG_kmalloc_end;
 
-         if (do_actual_alloc)
+         if (do_actual_alloc) {
             h->mem_allocated += node_size;
+            heap_refine_max_free(h);
+         }
 
          return vaddr;
       }
@@ -429,6 +525,14 @@ internal_kmalloc(struct kmalloc_heap *h,
       SIMULATE_RETURN_NULL();
    }
    NOREC_LOOP_END
+
+   /*
+    * We searched the whole tree without finding a free block of `size` bytes:
+    * therefore, the biggest free block is smaller than that.
+    */
+   if (start_node == 0 && h->max_free >= size)
+      heap_set_max_free(h, HALF(size));
+
    return NULL;
 }
 
@@ -452,6 +556,9 @@ per_heap_kmalloc_unsafe(struct kmalloc_heap *h, size_t *size, u32 flags)
    const size_t rounded_up_size =
       MAX(roundup_next_power_of_2(*size), h->min_block_size);
 
+   if (rounded_up_size > h->max_free)
+      return NULL; /* no free block big enough, for sure */
+
    if (!multi_step_alloc || ((rounded_up_size - *size) < h->min_block_size)) {
 
       *size = rounded_up_size;
@@ -569,6 +676,9 @@ internal_kfree(struct kmalloc_heap *h,
 
       DEBUG_free_after_coaleshe;
 
+      if (biggest_free_size > h->max_free)
+         heap_set_max_free(h, MIN(biggest_free_size, h->size));
+
       ASSERT(biggest_free_node == node || biggest_free_size != size);
 
       if (biggest_free_size < h->alloc_block_size)
@@ -619,6 +729,23 @@ internal_kfree(struct kmalloc_heap *h,
    }
 }
 
+/*
+ * Return the size of the biggest block at `vaddr` not bigger than `size`. Both
+ * `vaddr` and `size` have to be multiples of `h->min_block_size`.
+ */
+static size_t
+get_aligned_sub_block_size(struct kmalloc_heap *h, ulong vaddr, size_t size)
+{
+   const ulong off = vaddr - h->vaddr;
+   size_t s = off ? (off & -off) : h->size;
+
+   while (s > size)
+      s >>= 1;
+
+   ASSERT(s >= h->min_block_size);
+   return s;
+}
+
 static size_t calculate_block_size(struct kmalloc_heap *h, ulong vaddr)
 {
    struct block_node *nodes = h->metadata_nodes;
@@ -704,20 +831,15 @@ per_heap_kfree_unsafe(struct kmalloc_heap *h,
    ASSERT(vaddr + size - 1 <= h->heap_last_byte);
    ASSERT(pow2_round_up_at(size, h->min_block_size) == size);
 
-   size_t tot = 0;
-
-   for (int i = (int)h->heap_data_size_log2 - 1; i >= 0 && tot < size; i--) {
-
-      const size_t sub_block_size = (1 << i);
-
-      if (!(size & sub_block_size))
-         continue;
-
-      internal_kfree(h, ptr + tot, sub_block_size, allow_split, do_actual_free);
-      tot += sub_block_size;
+   /*
+    * For blocks returned by per_heap_kmalloc(), this is the same as freeing
+    * the sub-blocks in decreasing size order, but here `ptr` might be also in
+    * the middle of an allocated block (e.g. partial munmap()).
+    */
+   for (size_t tot = 0, s; tot < size; tot += s) {
+      s = get_aligned_sub_block_size(h, vaddr + tot, size - tot);
+      internal_kfree(h, ptr + tot, s, allow_split, do_actual_free);
    }
-
-   ASSERT(tot == size);
 }
 
 struct deferred_kfree_ctx {
@@ -845,57 +967,196 @@ per_heap_kfree(struct kmalloc_heap *h,
    atomic_store_explicit(&h->in_use, false, mo_relaxed);
 }
 
-void *kzmalloc(size_t size)
+/*
+ * Check if the block of `size` bytes at `vaddr` is free: none of the blocks
+ * containing it is full and the block itself is neither allocated nor split.
+ */
+static bool is_block_free_at(struct kmalloc_heap *h, ulong vaddr, size_t size)
 {
-   void *res = kmalloc(size);
+   struct block_node *nodes = h->metadata_nodes;
+   ulong va = h->vaddr;
+   size_t s = h->size;
+   int n = 0;
 
-   if (!res)
-      return NULL;
+   while (s > size) {
 
-   bzero(res, size);
-   return res;
+      if (nodes[n].full)
+         return false;
+
+      if (!nodes[n].split)
+         return true; /* a bigger free block contains ours */
+
+      s >>= 1;
+
+      if (vaddr >= va + s) {
+         va += s;
+         n = NODE_RIGHT(n);
+      } else {
+         n = NODE_LEFT(n);
+      }
+   }
+
+   return is_block_node_free(nodes[n]);
 }
 
-static
-void vfree_internal(ulong va_begin, ulong va_end)
+/*
+ * Like internal_kmalloc(), but for the specific block of `size` bytes at
+ * `vaddr`, which has to be free (see is_block_free_at()).
+ */
+static bool
+internal_kmalloc_at(struct kmalloc_heap *h,
+                    ulong vaddr,
+                    size_t size,
+                    bool do_actual_alloc)
 {
-   for (ulong va = va_begin; va < va_end; va += PAGE_SIZE)
-      unmap_kernel_page(TO_PTR(va), true);
+   struct block_node *nodes = h->metadata_nodes;
+   int path[8 * sizeof(ulong)];
+   int depth = 0;
+   ulong va = h->vaddr;
+   size_t s = h->size;
+   void *ptr;
+   int n = 0;
+   bool success;
+
+   while (s > size) {
+
+      ASSERT(!nodes[n].full);
+      nodes[n].split = true;
+      path[depth++] = n;
+      s >>= 1;
+
+      if (vaddr >= va + s) {
+         va += s;
+         n = NODE_RIGHT(n);
+      } else {
+         n = NODE_LEFT(n);
+      }
+   }
+
+   ASSERT(va == vaddr);
+   ASSERT(is_block_node_free(nodes[n]));
+
+   success = actual_allocate_node(h, size, n, &ptr, do_actual_alloc);
+
+   // Mark the parent nodes as 'full', when necessary.
+
+   for (int d = depth - 1; d >= 0; d--) {
+
+      const int nn = path[d];
+
+      if (nodes[NODE_LEFT(nn)].full && nodes[NODE_RIGHT(nn)].full)
+         nodes[nn].full = true;
+   }
+
+   if (UNLIKELY(!success)) {
+
+      /* See the same corner case in internal_kmalloc() */
+      per_heap_kfree_unsafe(h, ptr, &size, 0);
+      return false;
+   }
+
+   if (do_actual_alloc) {
+      h->mem_allocated += size;
+      heap_refine_max_free(h);
+   }
+
+   return true;
 }
 
-void *vmalloc(size_t size)
+static void *
+per_heap_kmalloc_at_unsafe(struct kmalloc_heap *h,
+                           void *ptr,
+                           size_t size,
+                           u32 flags)
 {
-   size_t actual_sz = pow2_round_up_at(size, PAGE_SIZE);
-   ulong va, va_begin, va_end;
-   void *ptr;
+   const ulong vaddr = (ulong)ptr;
+   const bool do_actual_alloc = !(flags & KMALLOC_FL_NO_ACTUAL_ALLOC);
+   const u32 sub_blocks_min_size = flags & KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK;
+   size_t tot, s;
 
-   if (!hi_vmem_avail())
-      return kmalloc(size);
+   ASSERT(size != 0);
+   ASSERT(!sub_blocks_min_size || sub_blocks_min_size >= h->min_block_size);
+   ASSERT(!is_preemption_enabled());
 
-   ptr = kmalloc(size);
+   if (vaddr < h->vaddr || size > h->size || vaddr - h->vaddr > h->size - size)
+      return NULL;
 
-   if (ptr)
-      return ptr;
+   if ((vaddr | size) & (h->min_block_size - 1))
+      return NULL;
 
-   ptr = hi_vmem_reserve(actual_sz);
+   /* First, check that the whole range is free */
+   for (tot = 0; tot < size; tot += s) {
 
-   va_begin = (ulong)ptr;
-   va_end = va_begin + actual_sz;
+      s = get_aligned_sub_block_size(h, vaddr + tot, size - tot);
 
-   for (va = va_begin; va < va_end; va += PAGE_SIZE) {
-      if (map_kernel_page(TO_PTR(va), 0, PAGING_FL_RW | PAGING_FL_DO_ALLOC))
-         goto oom_case;
+      if (!is_block_free_at(h, vaddr + tot, s))
+         return NULL;
    }
 
-   return TO_PTR(va_begin);
+   for (tot = 0; tot < size; tot += s) {
 
-oom_case:
+      s = get_aligned_sub_block_size(h, vaddr + tot, size - tot);
 
-   va_end = va;
-   vfree_internal(va_begin, va_end);
-   hi_vmem_release(TO_PTR(va_begin), actual_sz);
-   return NULL;
+      if (!internal_kmalloc_at(h, vaddr + tot, s, do_actual_alloc)) {
+
+         if (tot) {
+            per_heap_kfree_unsafe(h,
+                                  ptr,
+                                  &tot,
+                                  KFREE_FL_MULTI_STEP | KFREE_FL_ALLOW_SPLIT);
+         }
 
+         return NULL;
+      }
+
+      if (sub_blocks_min_size) {
+         internal_kmalloc_split_block(h, ptr + tot, s, sub_blocks_min_size);
+      }
+   }
+
+   return ptr;
+}
+
+void *
+per_heap_kmalloc_at(struct kmalloc_heap *h, void *ptr, size_t size, u32 flags)
+{
+   bool expected = false;
+   void *res;
+
+   if (!atomic_cas_strong(&h->in_use, &expected, true, mo_relaxed, mo_relaxed))
+      return NULL; /* heap already in use (we're in IRQ context) */
+
+   res = per_heap_kmalloc_at_unsafe(h, ptr, size, flags);
+   atomic_store_explicit(&h->in_use, false, mo_relaxed);
+   return res;
+}
+
+void *kzmalloc(size_t size)
+{
+   size_t actual_size = size;
+   void *res = wrapper_kmalloc(&actual_size, 0, KMALLOC_CALLER());
+
+   if (!res)
+      return NULL;
+
+   bzero(res, size);
+   return res;
+}
+
+/*
+ * Big buffers go in the vmalloc area, when it's available: they don't need
+ * physically contiguous memory. Everything else, or when vmalloc_pages()
+ * fails, falls back to the regular heaps.
+ */
+void *vmalloc(size_t size)
+{
+   size_t kmalloc_sz = size;
+   void *ptr;
+
+   if (size >= VMALLOC_MIN_SIZE && (ptr = vmalloc_pages(size)))
+      return ptr;
+
+   return wrapper_kmalloc(&kmalloc_sz, 0, KMALLOC_CALLER());
 }
 
 void vfree2(void *ptr, size_t size)
@@ -903,22 +1164,16 @@ void vfree2(void *ptr, size_t size)
    if (!ptr)
       return;
 
-   if ((ulong)ptr < LINEAR_MAPPING_END)
-      return kfree2(ptr, size);
-
-   size_t actual_sz = pow2_round_up_at(size, PAGE_SIZE);
-   ulong va_begin, va_end;
-
-   va_begin = (ulong)ptr;
-   va_end = va_begin + actual_sz;
+   if (is_vmalloc_addr(ptr))
+      return vfree_pages(ptr, size);
 
-   vfree_internal(va_begin, va_end);
-   hi_vmem_release(TO_PTR(va_begin), actual_sz);
+   kfree2(ptr, size);
 }
 
 /* Natural continuation of this source file. Purpose: make this file shorter. */
 #include "kmalloc_stats.c.h"
 #include "kmalloc_small_heaps.c.h"
+#include "kmalloc_prof.c.h"
 #include "kmalloc_heaps.c.h"
 #include "general_kmalloc.c.h"
 #include "kmalloc_accelerator.c.h"
@@ -5,6 +5,9 @@
 #define STACK_VAR (h->alloc_stack)
 #define KMALLOC_ALLOC_STACK_SIZE 32
 
+/* Size classes (powers of 2) tracked by the main heaps' free summary */
+#define KMALLOC_SIZE_CLASSES     32
+
 #include <tilck/common/norec.h>
 #include <tilck/common/atomics.h>
 
@@ -33,6 +36,14 @@ struct kmalloc_heap {
    bool linear_mapping;
    bool dma;
 
+   /*
+    * Upper bound for the size of the biggest free block in the heap: always
+    * a power of 2 or 0. It grows when blocks are freed and it gets refined
+    * when an allocation fails. See heap_set_max_free().
+    */
+   size_t max_free;
+   int main_idx;         /* index in heaps[], or -1 if not a main heap */
+
    /*
     * Explicit stack used by per_heap_kmalloc()
     *
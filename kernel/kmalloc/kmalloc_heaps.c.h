@@ -101,6 +101,8 @@ kmalloc_create_heap(struct kmalloc_heap *h,
 
    bzero(h->metadata_nodes, h->metadata_size);
    h->linear_mapping = linear_mapping;
+   h->max_free = size;
+   h->main_idx = -1;
    return true;
 }
 
@@ -158,6 +160,7 @@ kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t new_size)
 
    memcpy(new_heap, h, sizeof(struct kmalloc_heap));
 
+   new_heap->main_idx = -1;
    new_heap->size = new_size;
    new_heap->metadata_size =
       calculate_heap_metadata_size(new_size, new_heap->min_block_size);
@@ -177,6 +180,9 @@ kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t new_size)
    kmalloc_heap_set_pre_calculated_values(new_heap);
    bzero(new_heap->metadata_nodes, new_heap->metadata_size);
 
+   /* The expansion adds at least a free block as big as the old heap */
+   new_heap->max_free = MAX(h->max_free, h->size);
+
    struct block_node *new_nodes = new_heap->metadata_nodes;
    struct block_node *old_nodes = h->metadata_nodes;
    size_t nodes_per_row = 1;
@@ -225,6 +231,30 @@ static size_t find_biggest_heap_size(ulong vaddr, ulong limit)
    return curr_max;
 }
 
+/*
+ * Re-assign the `main_idx` of all the main heaps and rebuild from scratch the
+ * free summary: called only at init time, when heaps are added or sorted.
+ */
+static void main_heaps_rebuild_summary(void)
+{
+   bzero(main_heaps_free_summary, sizeof(main_heaps_free_summary));
+   main_heaps_dma_mask = 0;
+
+   for (int i = 0; i < used_heaps; i++) {
+
+      struct kmalloc_heap *h = heaps[i];
+      const u32 n = size_classes_count(h->max_free);
+
+      h->main_idx = i;
+
+      for (u32 c = 0; c < n; c++)
+         main_heaps_free_summary[c] |= (1u << i);
+
+      if (h->dma)
+         main_heaps_dma_mask |= (1u << i);
+   }
+}
+
 static int kmalloc_internal_add_heap(void *vaddr, size_t heap_size)
 {
    const size_t min_block_size = SMALL_HEAP_MAX_ALLOC + 1;
@@ -281,7 +311,9 @@ static int kmalloc_internal_add_heap(void *vaddr, size_t heap_size)
     */
 
    VERIFY(md_allocated == vaddr);
-   return used_heaps++;
+   used_heaps++;
+   main_heaps_rebuild_summary();
+   return used_heaps - 1;
 }
 
 static long greater_than_heap_cmp(const void *a, const void *b)
@@ -330,6 +362,7 @@ init_kmalloc_fill_region(int region, ulong vaddr, ulong limit, bool dma)
 
       heaps[heap_index]->region = region;
       heaps[heap_index]->dma = dma;
+      main_heaps_rebuild_summary();
       vaddr = heaps[heap_index]->vaddr + heaps[heap_index]->size;
    }
 }
@@ -341,9 +374,11 @@ void early_init_kmalloc(void)
    ASSERT(!kmalloc_initialized);
    list_init(&small_heaps_list);
    list_init(&avail_small_heaps_list);
+   bzero(&shs, sizeof(shs));
 
    used_heaps = 0;
    bzero(heaps, sizeof(heaps));
+   kmalloc_prof_reset();
 
    {
       size_t first_heap_size;
@@ -355,6 +390,7 @@ void early_init_kmalloc(void)
    VERIFY(heap_index == 0);
 
    kmalloc_initialized = true; /* we have at least 1 heap */
+   register_shrinker(&small_heaps_shrinker);
 
    if (KMALLOC_HEAVY_STATS) {
       kmalloc_init_heavy_stats();
@@ -396,6 +432,8 @@ void init_kmalloc(void)
                       (u32)used_heaps,
                       greater_than_heap_cmp);
 
+   main_heaps_rebuild_summary();
+
    for (int i = 0; i < KMALLOC_HEAPS_COUNT; i++) {
 
       struct kmalloc_heap *h = heaps[i];
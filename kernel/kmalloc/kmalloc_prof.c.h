@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#ifndef _KMALLOC_C_
+
+   #error This is NOT a header file and it is not meant to be included
+
+   /*
+    * The only purpose of this file is to keep kmalloc.c shorter.
+    * Yes, this file could be turned into a regular C source file, but at the
+    * price of making several static functions and variables in kmalloc.c to be
+    * just non-static. We don't want that. Code isolation is a GOOD thing.
+    */
+
+#endif
+
+void
+debug_kmalloc_prof_site_name(ulong caller, char *buf, size_t buf_sz)
+{
+   const char *sym;
+   long off;
+
+   if (!caller) {
+      snprintk(buf, buf_sz, "<other>");
+      return;
+   }
+
+   /* `caller` is a return address: look for the call instruction instead */
+   if ((sym = find_sym_at_addr(caller - 1, &off, NULL)))
+      snprintk(buf, buf_sz, "%s+0x%lx", sym, off + 1);
+   else
+      snprintk(buf, buf_sz, "%p", TO_PTR(caller));
+}
+
+#if KMALLOC_CALLSITE_PROFILER
+
+#define PROF_SITES_LOG2                    8      /* 256 slots */
+#define PROF_LIVE_LOG2                    12      /* 4096 slots */
+
+#define PROF_SITES                        (1u << PROF_SITES_LOG2)
+#define PROF_LIVE                         (1u << PROF_LIVE_LOG2)
+#define PROF_OTHER_SITE                   PROF_SITES
+
+/* Keep the load factor of both the tables below 3/4 */
+#define PROF_MAX_SITES                    (PROF_SITES / 4 * 3)
+#define PROF_MAX_LIVE                     (PROF_LIVE / 4 * 3)
+
+struct prof_live_alloc {
+
+   ulong vaddr;               /* 0 means empty slot */
+   size_t size;
+   u32 site;                  /* index in prof_sites[] */
+};
+
+/*
+ * Two fixed-size, open-addressing hash tables with linear probing:
+ *
+ *    - prof_sites[] maps each caller to its stats. Sites are never removed.
+ *      When the table is "full", new callers are accounted in the extra
+ *      slot at the end, the "other" site.
+ *
+ *    - prof_live[] maps each live allocation to its size and site, so that
+ *      kfree() can be accounted too. When it's "full", new allocations are
+ *      only counted in `tot_allocs` and in `prof_untracked`.
+ *
+ * Note: only kfree() calls on the first byte of a tracked allocation are seen.
+ * When that happens, the whole tracked size is accounted as freed, even if
+ * the allocation was multi-step and only a part of it is being freed.
+ */
+static struct kmalloc_site_stats prof_sites[PROF_SITES + 1];
+static struct prof_live_alloc prof_live[PROF_LIVE];
+static u32 prof_sites_count;
+static u32 prof_live_count;
+static ulong prof_untracked;
+
+static ALWAYS_INLINE u32 prof_hash(ulong key, u32 log2)
+{
+   /* Fibonacci hashing: keep the top `log2` bits of the product */
+   return ((u32)key * 2654435761u) >> (32 - log2);
+}
+
+static void kmalloc_prof_reset(void)
+{
+   bzero(prof_sites, sizeof(prof_sites));
+   bzero(prof_live, sizeof(prof_live));
+   prof_sites_count = 0;
+   prof_live_count = 0;
+   prof_untracked = 0;
+}
+
+static u32 prof_get_site(ulong caller)
+{
+   u32 i = prof_hash(caller, PROF_SITES_LOG2);
+
+   while (prof_sites[i].caller) {
+
+      if (prof_sites[i].caller == caller)
+         return i;
+
+      i = (i + 1) & (PROF_SITES - 1);
+   }
+
+   if (prof_sites_count == PROF_MAX_SITES)
+      return PROF_OTHER_SITE;
+
+   prof_sites[i].caller = caller;
+   prof_sites_count++;
+   return i;
+}
+
+static void prof_live_remove(u32 i)
+{
+   struct prof_live_alloc *e = &prof_live[i];
+   struct kmalloc_site_stats *s = &prof_sites[e->site];
+   u32 j = i, k;
+
+   s->live_bytes -= e->size;
+   s->live_allocs--;
+
+   /*
+    * Backward-shift deletion: move back the following entries of the cluster
+    * which would not be reachable anymore from their home slot `k`, once the
+    * slot `i` becomes empty. No tombstones needed.
+    */
+   while (true) {
+
+      j = (j + 1) & (PROF_LIVE - 1);
+
+      if (!prof_live[j].vaddr)
+         break;
+
+      k = prof_hash(prof_live[j].vaddr, PROF_LIVE_LOG2);
+
+      /* The entry at `j` can stay there if `k` is cyclically in (i, j] */
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+         continue;
+
+      prof_live[i] = prof_live[j];
+      i = j;
+   }
+
+   prof_live[i].vaddr = 0;
+   prof_live_count--;
+}
+
+static void kmalloc_prof_alloc(void *ptr, size_t size, void *caller)
+{
+   const u32 site = prof_get_site((ulong)caller);
+   struct kmalloc_site_stats *s = &prof_sites[site];
+   u32 i = prof_hash((ulong)ptr, PROF_LIVE_LOG2);
+
+   ASSERT(!is_preemption_enabled());
+   s->tot_allocs++;
+
+   while (prof_live[i].vaddr) {
+
+      if (prof_live[i].vaddr == (ulong)ptr) {
+
+         /* Stale entry: the block has been freed in a way we couldn't see */
+         prof_live_remove(i);
+         i = prof_hash((ulong)ptr, PROF_LIVE_LOG2);
+         continue;
+      }
+
+      i = (i + 1) & (PROF_LIVE - 1);
+   }
+
+   if (UNLIKELY(prof_live_count == PROF_MAX_LIVE)) {
+      prof_untracked++;
+      return;
+   }
+
+   prof_live[i] = (struct prof_live_alloc) {
+      .vaddr = (ulong)ptr,
+      .size = size,
+      .site = site,
+   };
+
+   prof_live_count++;
+   s->live_allocs++;
+   s->live_bytes += size;
+
+   if (s->live_bytes > s->peak_bytes)
+      s->peak_bytes = s->live_bytes;
+}
+
+static void kmalloc_prof_free(void *ptr)
+{
+   u32 i = prof_hash((ulong)ptr, PROF_LIVE_LOG2);
+
+   ASSERT(!is_preemption_enabled());
+
+   while (prof_live[i].vaddr) {
+
+      if (prof_live[i].vaddr == (ulong)ptr) {
+         prof_live_remove(i);
+         return;
+      }
+
+      i = (i + 1) & (PROF_LIVE - 1);
+   }
+}
+
+void debug_kmalloc_prof_get_info(struct kmalloc_prof_info *info)
+{
+   disable_preemption();
+   {
+      *info = (struct kmalloc_prof_info) {
+         .sites = prof_sites_count,
+         .max_sites = PROF_MAX_SITES,
+         .tracked = prof_live_count,
+         .max_tracked = PROF_MAX_LIVE,
+         .untracked = prof_untracked,
+      };
+   }
+   enable_preemption();
+}
+
+u32
+debug_kmalloc_prof_get_sites(struct kmalloc_site_stats *buf, u32 max_count)
+{
+   u32 n = 0;
+
+   disable_preemption();
+   {
+      for (u32 i = 0; i < ARRAY_SIZE(prof_sites) && n < max_count; i++) {
+         if (prof_sites[i].tot_allocs)
+            buf[n++] = prof_sites[i];
+      }
+   }
+   enable_preemption();
+   return n;
+}
+
+#else
+
+static ALWAYS_INLINE void kmalloc_prof_reset(void) { }
+static ALWAYS_INLINE void kmalloc_prof_alloc(void *p, size_t s, void *c) { }
+static ALWAYS_INLINE void kmalloc_prof_free(void *p) { }
+
+void debug_kmalloc_prof_get_info(struct kmalloc_prof_info *info)
+{
+   bzero(info, sizeof(*info));
+}
+
+u32
+debug_kmalloc_prof_get_sites(struct kmalloc_site_stats *buf, u32 max_count)
+{
+   return 0;
+}
+
+#endif
@@ -17,19 +17,13 @@
    MAX(sizeof(struct small_heap_node), SMALL_HEAP_MAX_ALLOC + 1)
 
 /*
- * Be careful with this: incrementing its value to 2 does not reduce with any of
- * the current tests the value of shs.lifetime_created_heaps_count: this means
- * just wasting memory. While, setting it to 0, increases that by +1. It's a
- * good parameter to have and evaluate it's effects in the long term, with more
- * and more complex uses cases.
+ * Small heaps that become empty are NOT destroyed on kfree: they stay in the
+ * avail list, ready to be re-used, avoiding the churn of creating and
+ * destroying heaps when the number of small allocations oscillates. They're
+ * released only under memory pressure, by the small heaps shrinker (see
+ * below), which is called by kmalloc right before failing.
  */
 
-#if !KERNEL_TEST_INT
-   #define MAX_EMPTY_SMALL_HEAPS    1
-#else
-   #define MAX_EMPTY_SMALL_HEAPS    0
-#endif
-
 struct small_heap_node {
 
    struct list_node node;          /* all nodes */
@@ -196,6 +190,40 @@ static void destroy_small_heap(struct small_heap_node *node)
    free_small_heap_node(node);
 }
 
+static size_t small_heaps_shrinker_count(struct shrinker *s)
+{
+   ASSERT(!is_preemption_enabled());
+   return (size_t)shs.empty_count * SMALL_HEAP_SIZE;
+}
+
+static size_t small_heaps_shrinker_scan(struct shrinker *s, size_t bytes)
+{
+   struct small_heap_node *pos, *tmp;
+   size_t released = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each(pos, tmp, &avail_small_heaps_list, avail_node) {
+
+      if (released >= bytes || !shs.empty_count)
+         break;
+
+      if (pos->heap.mem_allocated != SMALL_HEAP_MD_SIZE)
+         continue;
+
+      destroy_small_heap(pos);
+      shs.empty_count--;
+      released += SMALL_HEAP_SIZE;
+   }
+
+   return released;
+}
+
+static DEFINE_SHRINKER(small_heaps_shrinker,
+                       "small_heaps",
+                       small_heaps_shrinker_count,
+                       small_heaps_shrinker_scan);
+
 static void *small_heaps_kmalloc(size_t *size, u32 flags)
 {
    struct small_heap_node *new_node;
@@ -285,13 +313,8 @@ small_heaps_kfree(void *ptr, size_t *size, u32 flags)
    } else {
 
       /* The chunk wasn't full: we have to check if it's "empty" now. */
-      if (node->heap.mem_allocated == SMALL_HEAP_MD_SIZE) {
-         if (MAX_EMPTY_SMALL_HEAPS && shs.empty_count < MAX_EMPTY_SMALL_HEAPS) {
-            shs.empty_count++;
-         } else {
-            destroy_small_heap(node);
-         }
-      }
+      if (node->heap.mem_allocated == SMALL_HEAP_MD_SIZE)
+         shs.empty_count++;
    }
 
    return 0;
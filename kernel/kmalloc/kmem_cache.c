@@ -0,0 +1,354 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kernel.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/kmem_cache.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/test/kmem_cache.h>
+
+#define KMEM_OBJ_ALIGN                      8
+
+struct kmem_slab {
+
+   struct list_node node;     /* in one of the partial/full/free lists */
+   struct kmem_cache *cache;
+   void *free_list;           /* free objects, see obj_free_link() */
+   u32 inuse;                 /* allocated objects */
+};
+
+#define SLAB_HDR_SIZE \
+   pow2_round_up_at(sizeof(struct kmem_slab), KMEM_OBJ_ALIGN)
+
+STATIC struct list kmem_caches_list = STATIC_LIST_INIT(kmem_caches_list);
+
+/*
+ * The link to the next free object is stored in the object itself, in its
+ * first word. But, for caches with a ctor, that would destroy the constructed
+ * state of the object: in that case, the link follows the object.
+ */
+static inline void **
+obj_free_link(struct kmem_cache *c, void *obj)
+{
+   if (!c->ctor)
+      return obj;
+
+   return (void **)((char *)obj + c->obj_stride - sizeof(void *));
+}
+
+static inline struct kmem_slab *
+obj_to_slab(struct kmem_cache *c, void *obj)
+{
+   return (void *)((ulong)obj & ~((ulong)c->slab_size - 1));
+}
+
+static struct shrinker kmem_cache_shrinker;
+
+static void kmem_cache_setup(struct kmem_cache *c)
+{
+   u32 stride = pow2_round_up_at(c->obj_size, KMEM_OBJ_ALIGN);
+   u32 slab_size = PAGE_SIZE;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(c->obj_size > 0);
+
+   if (c->ctor)
+      stride += pow2_round_up_at(sizeof(void *), KMEM_OBJ_ALIGN);
+
+   while (slab_size - SLAB_HDR_SIZE < KMEM_SLAB_MIN_OBJS * stride)
+      slab_size *= 2;
+
+   /* Slabs are found by aligning down the address of their objects */
+   VERIFY(slab_size <= KMALLOC_MAX_ALIGN);
+
+   c->obj_stride = stride;
+   c->slab_size = slab_size;
+   c->objs_per_slab = (slab_size - SLAB_HDR_SIZE) / stride;
+   c->initialized = true;
+
+   list_init(&c->partial_slabs);
+   list_init(&c->full_slabs);
+   list_init(&c->free_slabs);
+   list_add_tail(&kmem_caches_list, &c->node);
+
+   /* The caches can be used before init_kmalloc(): register it lazily */
+   if (list_node_is_empty(&kmem_cache_shrinker.node))
+      register_shrinker(&kmem_cache_shrinker);
+}
+
+void
+kmem_cache_init(struct kmem_cache *c,
+                const char *name,
+                u32 obj_size,
+                kmem_cache_ctor ctor)
+{
+   *c = (struct kmem_cache) {
+      .name = name,
+      .obj_size = obj_size,
+      .ctor = ctor,
+   };
+
+   disable_preemption();
+   {
+      kmem_cache_setup(c);
+   }
+   enable_preemption();
+}
+
+static struct kmem_slab *kmem_cache_new_slab(struct kmem_cache *c)
+{
+   struct kmem_slab *s;
+   char *obj;
+
+   if (!(s = aligned_kmalloc(c->slab_size, c->slab_size)))
+      return NULL;
+
+   *s = (struct kmem_slab) {
+      .cache = c,
+      .free_list = NULL,
+      .inuse = 0,
+   };
+
+   list_node_init(&s->node);
+
+   /* Link the objects in reverse order, so that they're allocated in order */
+   obj = (char *)s + SLAB_HDR_SIZE + (c->objs_per_slab - 1) * c->obj_stride;
+
+   for (u32 i = 0; i < c->objs_per_slab; i++, obj -= c->obj_stride) {
+
+      if (c->ctor)
+         c->ctor(obj);
+
+      *obj_free_link(c, obj) = s->free_list;
+      s->free_list = obj;
+   }
+
+   c->stats.slabs++;
+   c->stats.slab_allocs++;
+   return s;
+}
+
+static void kmem_cache_free_slab(struct kmem_cache *c, struct kmem_slab *s)
+{
+   ASSERT(s->inuse == 0);
+   list_remove(&s->node);
+   aligned_kfree2(s, c->slab_size);
+   c->stats.slabs--;
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+   struct kmem_slab *s;
+   void *obj = NULL;
+
+   disable_preemption();
+   {
+      if (UNLIKELY(!c->initialized))
+         kmem_cache_setup(c);
+
+      if (!list_is_empty(&c->partial_slabs)) {
+
+         s = list_first_obj(&c->partial_slabs, struct kmem_slab, node);
+
+      } else if (!list_is_empty(&c->free_slabs)) {
+
+         s = list_first_obj(&c->free_slabs, struct kmem_slab, node);
+         list_remove(&s->node);
+         list_add_head(&c->partial_slabs, &s->node);
+         c->free_slabs_count--;
+
+      } else {
+
+         if (!(s = kmem_cache_new_slab(c)))
+            goto out;
+
+         list_add_head(&c->partial_slabs, &s->node);
+      }
+
+      ASSERT(s->free_list != NULL);
+      obj = s->free_list;
+      s->free_list = *obj_free_link(c, obj);
+
+      if (++s->inuse == c->objs_per_slab) {
+         list_remove(&s->node);
+         list_add_tail(&c->full_slabs, &s->node);
+      }
+
+      c->stats.allocs++;
+      c->stats.active_objs++;
+
+      if (c->stats.active_objs > c->stats.peak_active_objs)
+         c->stats.peak_active_objs = c->stats.active_objs;
+   }
+out:
+   enable_preemption();
+   return obj;
+}
+
+void *
+kmem_cache_zalloc(struct kmem_cache *c)
+{
+   void *obj;
+   ASSERT(!c->ctor);
+
+   if ((obj = kmem_cache_alloc(c)))
+      bzero(obj, c->obj_size);
+
+   return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+   struct kmem_slab *s;
+
+   if (!obj)
+      return;
+
+   disable_preemption();
+   {
+      s = obj_to_slab(c, obj);
+
+      ASSERT(c->initialized);
+      ASSERT(s->cache == c);
+      ASSERT(s->inuse > 0);
+
+      if (s->inuse-- == c->objs_per_slab) {
+
+         /* The slab was full: now it's partial */
+         list_remove(&s->node);
+         list_add_head(&c->partial_slabs, &s->node);
+      }
+
+      *obj_free_link(c, obj) = s->free_list;
+      s->free_list = obj;
+
+      if (!s->inuse) {
+
+         if (c->free_slabs_count < KMEM_CACHE_MAX_FREE_SLABS) {
+
+            list_remove(&s->node);
+            list_add_tail(&c->free_slabs, &s->node);
+            c->free_slabs_count++;
+
+         } else {
+
+            kmem_cache_free_slab(c, s);
+         }
+      }
+
+      c->stats.frees++;
+      c->stats.active_objs--;
+   }
+   enable_preemption();
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *c)
+{
+   struct kmem_slab *s, *tmp;
+
+   disable_preemption();
+   {
+      if (c->initialized) {
+
+         VERIFY(list_is_empty(&c->partial_slabs));
+         VERIFY(list_is_empty(&c->full_slabs));
+
+         list_for_each(s, tmp, &c->free_slabs, node)
+            kmem_cache_free_slab(c, s);
+
+         c->free_slabs_count = 0;
+         c->initialized = false;
+         list_remove(&c->node);
+         list_node_init(&c->node);
+      }
+   }
+   enable_preemption();
+}
+
+static size_t kmem_cache_shrinker_count(struct shrinker *s)
+{
+   struct kmem_cache *c;
+   size_t tot = 0;
+
+   list_for_each_ro(c, &kmem_caches_list, node)
+      tot += c->free_slabs_count * c->slab_size;
+
+   return tot;
+}
+
+/* Release the free slabs kept by the caches (see kmem_cache_free()) */
+static size_t kmem_cache_shrinker_scan(struct shrinker *s, size_t bytes)
+{
+   struct kmem_cache *c;
+   struct kmem_slab *slab, *tmp;
+   size_t released = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(c, &kmem_caches_list, node) {
+
+      list_for_each(slab, tmp, &c->free_slabs, node) {
+
+         if (released >= bytes)
+            return released;
+
+         kmem_cache_free_slab(c, slab);
+         c->free_slabs_count--;
+         released += c->slab_size;
+      }
+   }
+
+   return released;
+}
+
+static DEFINE_SHRINKER(kmem_cache_shrinker,
+                       "kmem_cache",
+                       kmem_cache_shrinker_count,
+                       kmem_cache_shrinker_scan);
+
+int
+for_each_kmem_cache(int (*cb)(struct kmem_cache *, void *), void *arg)
+{
+   struct kmem_cache *c;
+   int rc = 0;
+
+   disable_preemption();
+   {
+      list_for_each_ro(c, &kmem_caches_list, node) {
+         if ((rc = cb(c, arg)))
+            break;
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
+#ifdef UNIT_TEST_ENVIRONMENT
+
+/*
+ * Forget about all the slabs of all the caches, without freeing them: used by
+ * the unit tests when the whole kmalloc is re-initialized.
+ */
+void kmem_caches_reset(void)
+{
+   struct kmem_cache *c, *tmp;
+
+   list_for_each(c, tmp, &kmem_caches_list, node) {
+      c->initialized = false;
+      c->free_slabs_count = 0;
+      bzero(&c->stats, sizeof(c->stats));
+      list_node_init(&c->node);
+   }
+
+   list_init(&kmem_caches_list);
+}
+
+#endif
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/ktimer.h>
+#include <tilck/kernel/hal.h>
+
+/*
+ * Hierarchical timer wheel
+ * --------------------------
+ *
+ * Level 0 has one slot per tick, covering the next 256 ticks. Each one of the
+ * next levels has 64 slots, each one covering 64 times the range of a slot
+ * in the level below: a level-1 slot covers 256 ticks, a level-2 slot covers
+ * 2^14 ticks, and so on. With 4 upper levels, any 32-bit delay fits.
+ *
+ * A timer is inserted in the lowest level able to hold its expire time: that
+ * makes the insertion and the cancellation O(1). On each tick, only the
+ * current level-0 slot is processed. Every 256 ticks, the timers in the
+ * current slot of level 1 are re-inserted ("cascaded") in level 0, where
+ * they'll all fit. The same happens for the upper levels, every 2^14 ticks,
+ * 2^20 ticks etc.
+ */
+
+#define WHEEL_L0_BITS              8
+#define WHEEL_LN_BITS              6
+#define WHEEL_L0_SIZE              (1u << WHEEL_L0_BITS)
+#define WHEEL_LN_SIZE              (1u << WHEEL_LN_BITS)
+#define WHEEL_L0_MASK              (WHEEL_L0_SIZE - 1)
+#define WHEEL_LN_MASK              (WHEEL_LN_SIZE - 1)
+#define WHEEL_LN_COUNT             4    /* levels above level 0 */
+
+#define WHEEL_LN_SHIFT(n)          (WHEEL_L0_BITS + (n) * WHEEL_LN_BITS)
+
+STATIC_ASSERT(WHEEL_LN_SHIFT(WHEEL_LN_COUNT) >= 32);
+
+static struct list wheel_l0[WHEEL_L0_SIZE];
+static struct list wheel_ln[WHEEL_LN_COUNT][WHEEL_LN_SIZE];
+static u64 wheel_now;            /* ticks processed by the wheel so far */
+
+static struct list *wheel_get_slot(u64 expires)
+{
+   const u64 delta = expires - wheel_now;
+
+   ASSERT(expires >= wheel_now);
+
+   if (delta < WHEEL_L0_SIZE)
+      return &wheel_l0[expires & WHEEL_L0_MASK];
+
+   for (u32 n = 0; n < WHEEL_LN_COUNT; n++) {
+      if (delta < (1ull << WHEEL_LN_SHIFT(n + 1)))
+         return &wheel_ln[n][(expires >> WHEEL_LN_SHIFT(n)) & WHEEL_LN_MASK];
+   }
+
+   NOT_REACHED();
+}
+
+static ALWAYS_INLINE void wheel_add(struct ktimer *t)
+{
+   list_add_tail(wheel_get_slot(t->expires), &t->node);
+}
+
+static ALWAYS_INLINE void wheel_remove(struct ktimer *t)
+{
+   list_remove(&t->node);
+   list_node_init(&t->node);
+}
+
+/* Re-insert the timers of the given upper-level slot in the lower levels */
+static void wheel_cascade(struct list *slot)
+{
+   struct ktimer *pos, *temp;
+
+   list_for_each(pos, temp, slot, node) {
+      list_remove(&pos->node);
+      wheel_add(pos);
+   }
+
+   list_init(slot);
+}
+
+static void wheel_run_slot(struct list *slot)
+{
+   struct ktimer *t;
+
+   /*
+    * Remove the timers one by one, instead of iterating the list, because
+    * a callback might re-arm or cancel other timers.
+    */
+   while (!list_is_empty(slot)) {
+
+      t = list_first_obj(slot, struct ktimer, node);
+      ASSERT(t->expires == wheel_now);
+
+      wheel_remove(t);
+      t->func(t);
+   }
+}
+
+static void wheel_tick(void)
+{
+   u32 idx;
+
+   wheel_now++;
+
+   if (!(wheel_now & WHEEL_L0_MASK)) {
+
+      for (u32 n = 0; n < WHEEL_LN_COUNT; n++) {
+
+         idx = (wheel_now >> WHEEL_LN_SHIFT(n)) & WHEEL_LN_MASK;
+         wheel_cascade(&wheel_ln[n][idx]);
+
+         if (idx)
+            break;  /* the upper levels don't need to be cascaded yet */
+      }
+   }
+
+   wheel_run_slot(&wheel_l0[wheel_now & WHEEL_L0_MASK]);
+}
+
+void ktimer_init(struct ktimer *t, ktimer_func func, void *arg)
+{
+   list_node_init(&t->node);
+   t->expires = 0;
+   t->func = func;
+   t->arg = arg;
+}
+
+void ktimer_start(struct ktimer *t, u32 ticks)
+{
+   ulong var;
+   ASSERT(ticks > 0);
+   ASSERT(t->func != NULL);
+
+   disable_interrupts(&var);
+   {
+      if (ktimer_is_active(t))
+         wheel_remove(t);
+
+      t->expires = wheel_now + ticks;
+      wheel_add(t);
+   }
+   enable_interrupts(&var);
+}
+
+u32 ktimer_cancel(struct ktimer *t)
+{
+   ulong var;
+   u32 rem = 0;
+
+   disable_interrupts(&var);
+   {
+      if (ktimer_is_active(t)) {
+         rem = (u32)(t->expires - wheel_now);
+         wheel_remove(t);
+      }
+   }
+   enable_interrupts(&var);
+   return rem;
+}
+
+u32 ktimer_get_remaining(struct ktimer *t)
+{
+   ulong var;
+   u32 rem = 0;
+
+   disable_interrupts(&var);
+   {
+      if (ktimer_is_active(t))
+         rem = (u32)(t->expires - wheel_now);
+   }
+   enable_interrupts(&var);
+   return rem;
+}
+
+/*
+ * Advance the wheel by `n` ticks, running all the expired timers. Called by
+ * the timer IRQ handler.
+ */
+void ktimer_tick(u32 n)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      for (u32 i = 0; i < n; i++)
+         wheel_tick();
+   }
+   enable_interrupts(&var);
+}
+
+/*
+ * Return the number of ticks before the next wheel event, or `max_ticks` if
+ * that's farther. Note: the level-0 wrap-around counts as an event, because
+ * the upper levels need to be cascaded at that point.
+ */
+u32 ktimer_get_next_expiry(u32 max_ticks)
+{
+   const u32 curr = wheel_now & WHEEL_L0_MASK;
+   const u32 limit = MIN(max_ticks, WHEEL_L0_SIZE - curr);
+
+   ASSERT(!are_interrupts_enabled());
+
+   for (u32 i = 1; i < limit; i++) {
+      if (!list_is_empty(&wheel_l0[curr + i]))
+         return i;
+   }
+
+   return limit;
+}
+
+void init_ktimers(void)
+{
+   for (u32 i = 0; i < WHEEL_L0_SIZE; i++)
+      list_init(&wheel_l0[i]);
+
+   for (u32 n = 0; n < WHEEL_LN_COUNT; n++)
+      for (u32 i = 0; i < WHEEL_LN_SIZE; i++)
+         list_init(&wheel_ln[n][i]);
+
+   wheel_now = 0;
+}
@@ -20,6 +20,7 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/elf_loader.h>
 #include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/zero_pool.h>
 #include <tilck/kernel/fs/fat32.h>
 #include <tilck/kernel/fs/devfs.h>
 #include <tilck/kernel/timer.h>
@@ -367,6 +368,7 @@ kmain(u32 multiboot_magic, u32 mbi_addr)
    init_sched();
    init_syscall_interfaces();
    init_worker_threads();
+   init_zero_pool();
    init_timer();
    init_system_time();
    init_kernelfs();
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/oom.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/signal.h>
+#include <tilck/kernel/shrinker.h>
+
+#include <tilck/mods/tracing.h>
+
+/*
+ * Page faults are handled with preemption disabled, so the faulting task
+ * cannot just sleep until the victim exits and releases its memory. Instead,
+ * the victim's anonymous memory (brk and anonymous mmap()s) is reclaimed
+ * synchronously, like Linux's OOM reaper does: the victim has a pending
+ * SIGKILL and it will never return to user space, so nobody will miss that
+ * memory. After that, the faulting task simply retries the allocation.
+ */
+
+static struct oom_stats stats;
+
+struct oom_select_ctx {
+
+   struct process *curr;
+   struct process *victim;
+   u32 victim_score;
+};
+
+const struct oom_stats *oom_get_stats(void)
+{
+   return &stats;
+}
+
+/*
+ * The badness of a process is the number of resident anonymous pages it has:
+ * that's what we can reclaim by killing it.
+ */
+static inline u32 oom_score(struct process *pi)
+{
+   return pi->anon_pages;
+}
+
+static bool oom_is_killable(struct task *ti)
+{
+   struct process *pi = ti->pi;
+
+   if (!is_main_thread(ti) || is_kernel_thread(ti))
+      return false;
+
+   if (pi->pid == 1)
+      return false; /* init is critical: killing it means panic */
+
+   if (pi->oom_killed || ti->state == TASK_STATE_ZOMBIE)
+      return false; /* it's dying already */
+
+   if (pi->vforked)
+      return false; /* it's using the memory of its parent */
+
+   return true;
+}
+
+static int oom_select_victim_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct oom_select_ctx *ctx = arg;
+   u32 score;
+
+   if (!oom_is_killable(ti))
+      return 0;
+
+   score = oom_score(ti->pi);
+
+   if (!score)
+      return 0; /* killing it would not free anything */
+
+   /* On a tie, prefer the process that is allocating the memory */
+   if (score > ctx->victim_score ||
+       (score == ctx->victim_score && ti->pi == ctx->curr))
+   {
+      ctx->victim = ti->pi;
+      ctx->victim_score = score;
+   }
+
+   return 0;
+}
+
+static struct process *oom_select_victim(u32 *score)
+{
+   struct oom_select_ctx ctx = {
+      .curr = get_curr_proc(),
+      .victim = NULL,
+      .victim_score = 0,
+   };
+
+   iterate_over_tasks(oom_select_victim_cb, &ctx);
+   *score = ctx.victim_score;
+   return ctx.victim;
+}
+
+static int oom_check_vfork_stopped_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   return ti->pi == arg && ti->vfork_stopped;
+}
+
+/*
+ * Reclaim the anonymous memory of `pi`, unless its address space is still in
+ * use by a vforked child. Returns the number of page frames actually freed:
+ * the pages still shared with other processes (CoW after fork) don't count.
+ */
+static size_t oom_reclaim_memory(struct process *pi)
+{
+   struct user_mapping *um;
+   size_t freed = 0, unmapped = 0;
+   ulong va = 0;
+
+   if (iterate_over_tasks(oom_check_vfork_stopped_cb, pi))
+      return 0;
+
+   freed += reclaim_user_pages(pi->pdir,
+                               pi->initial_brk,
+                               (size_t)(pi->brk - pi->initial_brk)
+                                 >> PAGE_SHIFT,
+                               &unmapped);
+
+   if (pi->mi) {
+
+      while ((um = bintree_find_ge_ptr(pi->mi->mappings, va,
+                                       struct user_mapping, pi_node, vaddr)))
+      {
+         va = um->vaddr + um->len;
+
+         if (!um->h)
+            freed += reclaim_user_pages(pi->pdir,
+                                        um->vaddrp,
+                                        um->len >> PAGE_SHIFT,
+                                        &unmapped);
+      }
+   }
+
+   pi->anon_pages -= MIN((u32)unmapped, pi->anon_pages);
+   return freed;
+}
+
+/*
+ * When the victim is the process faulting in user space, the signal has to be
+ * delivered before returning there, as for any other fault.
+ */
+static inline int oom_sig_flags(struct process *pi)
+{
+   struct task *curr = get_curr_task();
+   return curr->pi == pi && !curr->running_in_kernel ? SIG_FL_FAULT : 0;
+}
+
+/* Returns the number of page frames freed by killing `pi` */
+static size_t oom_kill(struct process *pi, u32 score)
+{
+   const char *cmdline = pi->debug_cmdline ? pi->debug_cmdline : "";
+   size_t reclaimed;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(!pi->oom_killed);
+
+   printk("Out-of-memory: killing pid %d (%s), %u anon pages\n",
+          pi->pid, cmdline, score);
+
+   trace_printk(1, "Out-of-memory: killing pid %d (%s), %u anon pages",
+                pi->pid, cmdline, score);
+
+   pi->oom_killed = true;
+
+   send_signal(pi->pid, SIGKILL, SIG_FL_PROCESS | oom_sig_flags(pi));
+
+   reclaimed = oom_reclaim_memory(pi);
+
+   stats.kills++;
+   stats.reclaimed_pages += reclaimed;
+
+   trace_printk(1, "Out-of-memory: reclaimed %zu pages from pid %d",
+                reclaimed, pi->pid);
+
+   return reclaimed;
+}
+
+bool oom_handle_page_fault(void)
+{
+   struct task *curr = get_curr_task();
+   struct process *victim;
+   u32 score;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* Killing is the last resort: first, try to shrink the kernel's caches */
+   if (shrink_caches(PAGE_SIZE))
+      return true;
+
+   /*
+    * A victim whose pages are all still shared (e.g. CoW after fork) frees
+    * nothing: it has been killed anyway, so the next call won't select it
+    * again. Keep going until some memory is actually freed.
+    */
+   while ((victim = oom_select_victim(&score))) {
+      if (oom_kill(victim, score))
+         return true;
+   }
+
+   /*
+    * There's nothing worth killing. If the faulting task is running in user
+    * space, just kill it: that's always possible.
+    */
+   if (!curr->running_in_kernel) {
+
+      if (!curr->pi->oom_killed)
+         oom_kill(curr->pi, oom_score(curr->pi));
+
+      return true;
+   }
+
+   return false;
+}
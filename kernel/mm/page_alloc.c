@@ -0,0 +1,456 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kernel.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/test/page_alloc.h>
+
+/*
+ * Page-frame allocator
+ * ----------------------
+ *
+ * A classic buddy system, with one free list per order. Its memory comes from
+ * kmalloc, in chunks of 2^PAGE_ALLOC_MAX_ORDER pages: that way, all the
+ * page-granular allocations are packed together in a few big blocks, instead
+ * of being scattered all over the kmalloc heaps, where they'd fragment the
+ * memory needed by the small kernel objects. Also, allocating and freeing a
+ * page is O(1) (ignoring the coalescing, bounded by the max order) instead of
+ * paying kmalloc's tree walk.
+ *
+ * The free blocks are linked in their free list through a list_node stored in
+ * their first page. For each page, the chunk keeps a byte with the order of
+ * the free block starting there (if any), needed for coalescing the buddies.
+ *
+ * Chunks are found by physical address through a table with an entry for each
+ * KMALLOC_MAX_ALIGN bytes of physical memory, which is also the alignment
+ * guaranteed by kmalloc for our chunks. When a chunk becomes completely free,
+ * it's returned to kmalloc, unless we have less than PAGE_ALLOC_MAX_FREE_CHUNKS
+ * free chunks: they're kept for avoiding a continuous alloc/free of chunks.
+ * Under memory pressure, our shrinker returns them to kmalloc as well.
+ *
+ * The allocator is never used in IRQ context: disabling the preemption is
+ * enough to protect it.
+ */
+
+#define PFA_CHUNK_PAGES          (1u << PAGE_ALLOC_MAX_ORDER)
+#define PFA_CHUNK_SIZE           (PFA_CHUNK_PAGES << PAGE_SHIFT)
+#define PFA_GRANULE_SHIFT        (log2_for_power_of_2(KMALLOC_MAX_ALIGN))
+#define PFA_CHUNK_GRANULES       (PFA_CHUNK_SIZE / KMALLOC_MAX_ALIGN)
+
+#define PFA_PG_FREE              (1 << 7)    /* a free block starts here */
+#define PFA_PG_ORDER_MASK        (PFA_PG_FREE - 1)
+
+STATIC_ASSERT(PFA_CHUNK_SIZE >= KMALLOC_MAX_ALIGN);
+STATIC_ASSERT(PAGE_ALLOC_MAX_ORDER <= PFA_PG_ORDER_MASK);
+
+struct pfa_chunk {
+
+   ulong vaddr;
+   u32 free_pages;
+   u8 pages[PFA_CHUNK_PAGES];       /* PFA_PG_FREE | order, see above */
+};
+
+STATIC struct list pfa_free_lists[PAGE_ALLOC_MAX_ORDER + 1];
+STATIC struct pfa_chunk **pfa_chunks_table;
+STATIC ulong pfa_chunks_table_size;
+STATIC u32 pfa_free_chunks;
+STATIC struct page_alloc_stats pfa_stats;
+
+static ALWAYS_INLINE struct pfa_chunk *pfa_get_chunk(ulong vaddr)
+{
+   const ulong idx = KERNEL_VA_TO_PA(vaddr) >> PFA_GRANULE_SHIFT;
+
+   if (UNLIKELY(idx >= pfa_chunks_table_size))
+      return NULL;
+
+   return pfa_chunks_table[idx];
+}
+
+static ALWAYS_INLINE u32 pfa_page_index(struct pfa_chunk *c, ulong vaddr)
+{
+   return (u32)((vaddr - c->vaddr) >> PAGE_SHIFT);
+}
+
+static void pfa_add_free_block(struct pfa_chunk *c, u32 pg, u32 order)
+{
+   struct list_node *n = (void *)(c->vaddr + (pg << PAGE_SHIFT));
+
+   c->pages[pg] = (u8)(PFA_PG_FREE | order);
+   list_add_head(&pfa_free_lists[order], n);
+}
+
+static void pfa_remove_free_block(struct pfa_chunk *c, u32 pg)
+{
+   struct list_node *n = (void *)(c->vaddr + (pg << PAGE_SHIFT));
+
+   ASSERT(c->pages[pg] & PFA_PG_FREE);
+   c->pages[pg] = 0;
+   list_remove(n);
+}
+
+static void pfa_set_chunk(ulong vaddr, struct pfa_chunk *c)
+{
+   const ulong first = KERNEL_VA_TO_PA(vaddr) >> PFA_GRANULE_SHIFT;
+
+   for (ulong i = 0; i < PFA_CHUNK_GRANULES; i++)
+      pfa_chunks_table[first + i] = c;
+}
+
+static bool pfa_add_chunk(void)
+{
+   struct pfa_chunk *c;
+   void *va;
+
+   if (!(c = kalloc_obj(struct pfa_chunk)))
+      return false;
+
+   if (!(va = aligned_kmalloc(PFA_CHUNK_SIZE, KMALLOC_MAX_ALIGN))) {
+      kfree_obj(c, struct pfa_chunk);
+      return false;
+   }
+
+   if ((KERNEL_VA_TO_PA(va) + PFA_CHUNK_SIZE - 1) >> PFA_GRANULE_SHIFT >=
+       pfa_chunks_table_size)
+   {
+      /* Not in the range covered by our table: it should never happen */
+      aligned_kfree2(va, PFA_CHUNK_SIZE);
+      kfree_obj(c, struct pfa_chunk);
+      return false;
+   }
+
+   bzero(c, sizeof(*c));
+   c->vaddr = (ulong)va;
+   c->free_pages = PFA_CHUNK_PAGES;
+   pfa_set_chunk(c->vaddr, c);
+   pfa_add_free_block(c, 0, PAGE_ALLOC_MAX_ORDER);
+
+   pfa_free_chunks++;
+   pfa_stats.chunks++;
+   pfa_stats.free_pages += PFA_CHUNK_PAGES;
+   return true;
+}
+
+static void pfa_release_chunk(struct pfa_chunk *c)
+{
+   ASSERT(c->free_pages == PFA_CHUNK_PAGES);
+
+   pfa_set_chunk(c->vaddr, NULL);
+   aligned_kfree2((void *)c->vaddr, PFA_CHUNK_SIZE);
+   kfree_obj(c, struct pfa_chunk);
+
+   pfa_stats.chunks--;
+   pfa_stats.free_pages -= PFA_CHUNK_PAGES;
+}
+
+static u32 pfa_find_free_order(u32 order)
+{
+   u32 o;
+
+   for (o = order; o <= PAGE_ALLOC_MAX_ORDER; o++) {
+      if (!list_is_empty(&pfa_free_lists[o]))
+         break;
+   }
+
+   return o;
+}
+
+static void *pfa_alloc_unsafe(u32 order)
+{
+   struct list_node *n;
+   struct pfa_chunk *c;
+   u32 o, pg;
+
+   if ((o = pfa_find_free_order(order)) > PAGE_ALLOC_MAX_ORDER) {
+
+      /*
+       * Note: kmalloc doesn't run the shrinkers here, as preemption is
+       * disabled. The page fault handlers do that (see oom.c) before retrying.
+       */
+      if (!pfa_add_chunk())
+         return NULL;
+
+      o = PAGE_ALLOC_MAX_ORDER;
+   }
+
+   n = pfa_free_lists[o].first;
+   c = pfa_get_chunk((ulong)n);
+   ASSERT(c != NULL);
+
+   pg = pfa_page_index(c, (ulong)n);
+   ASSERT((c->pages[pg] & PFA_PG_ORDER_MASK) == o);
+
+   if (c->free_pages == PFA_CHUNK_PAGES)
+      pfa_free_chunks--;
+
+   pfa_remove_free_block(c, pg);
+
+   /* Split the block, putting the upper halves in the free lists */
+   while (o > order) {
+      o--;
+      pfa_add_free_block(c, pg + (1u << o), o);
+   }
+
+   c->free_pages -= 1u << order;
+   pfa_stats.free_pages -= 1u << order;
+   return n;
+}
+
+static void pfa_free_unsafe(struct pfa_chunk *c, ulong vaddr, u32 order)
+{
+   u32 pg = pfa_page_index(c, vaddr);
+   u32 buddy;
+
+   ASSERT((pg & ((1u << order) - 1)) == 0);
+   ASSERT(!(c->pages[pg] & PFA_PG_FREE));
+
+   c->free_pages += 1u << order;
+   pfa_stats.free_pages += 1u << order;
+
+   /* Coalesce the block with its buddy, while it's free */
+   while (order < PAGE_ALLOC_MAX_ORDER) {
+
+      buddy = pg ^ (1u << order);
+
+      if (c->pages[buddy] != (PFA_PG_FREE | order))
+         break;
+
+      pfa_remove_free_block(c, buddy);
+      pg &= ~(1u << order);
+      order++;
+   }
+
+   if (c->free_pages == PFA_CHUNK_PAGES) {
+
+      ASSERT(pg == 0 && order == PAGE_ALLOC_MAX_ORDER);
+
+      if (pfa_free_chunks >= PAGE_ALLOC_MAX_FREE_CHUNKS) {
+         pfa_release_chunk(c);
+         return;
+      }
+
+      pfa_free_chunks++;
+   }
+
+   pfa_add_free_block(c, pg, order);
+}
+
+void *pfa_alloc(u32 order)
+{
+   void *res = NULL;
+   ASSERT(order <= PAGE_ALLOC_MAX_ORDER);
+
+   if (UNLIKELY(!pfa_chunks_table))
+      return NULL; /* Not initialized yet */
+
+   disable_preemption();
+   {
+      res = pfa_alloc_unsafe(order);
+   }
+   enable_preemption();
+   return res;
+}
+
+void pfa_free(void *vaddr, u32 order)
+{
+   struct pfa_chunk *c = pfa_get_chunk((ulong)vaddr);
+
+   ASSERT(c != NULL);
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(order <= PAGE_ALLOC_MAX_ORDER);
+
+   disable_preemption();
+   {
+      pfa_free_unsafe(c, (ulong)vaddr, order);
+   }
+   enable_preemption();
+}
+
+bool pfa_owns_page(void *vaddr)
+{
+   return pfa_get_chunk((ulong)vaddr) != NULL;
+}
+
+void *alloc_page(void)
+{
+   void *res = NULL;
+
+   disable_preemption();
+   {
+      if (LIKELY(pfa_chunks_table != NULL))
+         res = pfa_alloc_unsafe(0);
+
+      pfa_stats.allocs++;
+
+      if (UNLIKELY(!res))
+         pfa_stats.fallback_allocs++;
+   }
+   enable_preemption();
+
+   if (UNLIKELY(!res))
+      res = kmalloc(PAGE_SIZE);
+
+   return res;
+}
+
+void free_page(void *vaddr)
+{
+   if (pfa_owns_page(vaddr))
+      pfa_free(vaddr, 0);
+   else
+      kfree2(vaddr, PAGE_SIZE);
+}
+
+/*
+ * Free the [off, end) range of a block allocated by alloc_aligned_pages(), in
+ * the biggest pieces aligned at their size, as internal_kfree() requires.
+ */
+static void free_aligned_pages_range(char *block, ulong off, ulong end)
+{
+   size_t sz;
+
+   while (off < end) {
+
+      sz = PAGE_SIZE;
+
+      while (!(off & sz) && off + 2 * sz <= end)
+         sz *= 2;
+
+      general_kfree(block + off, &sz, KFREE_FL_ALLOW_SPLIT);
+      off += sz;
+   }
+}
+
+void *alloc_aligned_pages(size_t size)
+{
+   size_t block_size = size;
+   char *block;
+   ulong off;
+
+   ASSERT(roundup_next_power_of_2(size) == size);
+   ASSERT(size >= PAGE_SIZE);
+
+   /*
+    * kmalloc's blocks are aligned at their size only relatively to the heap
+    * they come from: if the heap itself is aligned enough, we're done.
+    */
+   block = general_kmalloc(&block_size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE);
+
+   if (!block)
+      return NULL;
+
+   if (!(KERNEL_VA_TO_PA(block) & (size - 1)))
+      return block;
+
+   general_kfree(block, &block_size, KFREE_FL_ALLOW_SPLIT);
+
+   /*
+    * Otherwise, allocate twice the size, which surely contains an aligned
+    * block of `size` bytes, and give back to kmalloc the rest.
+    */
+   block_size = 2 * size;
+   block = general_kmalloc(&block_size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE);
+
+   if (!block)
+      return NULL;
+
+   off = pow2_round_up_at(KERNEL_VA_TO_PA(block), size)
+         - KERNEL_VA_TO_PA(block);
+
+   free_aligned_pages_range(block, 0, off);
+   free_aligned_pages_range(block, off + size, 2 * size);
+   return block + off;
+}
+
+void free_aligned_pages(void *vaddr, size_t size)
+{
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(size >= KMALLOC_MAX_ALIGN);
+
+   /*
+    * The block is aligned at `size` physically, but not necessarily in its
+    * kmalloc heap: free it in pieces aligned at KMALLOC_MAX_ALIGN, which is
+    * the alignment guaranteed for the heaps themselves.
+    */
+   for (size_t off = 0; off < size; off += KMALLOC_MAX_ALIGN) {
+      size_t sz = KMALLOC_MAX_ALIGN;
+      general_kfree(vaddr + off, &sz, KFREE_FL_ALLOW_SPLIT);
+   }
+}
+
+static size_t pfa_shrinker_count(struct shrinker *s)
+{
+   return (size_t)pfa_free_chunks * PFA_CHUNK_SIZE;
+}
+
+static size_t pfa_shrinker_scan(struct shrinker *s, size_t bytes)
+{
+   struct list *l = &pfa_free_lists[PAGE_ALLOC_MAX_ORDER];
+   struct list_node *n, *next;
+   struct pfa_chunk *c;
+   size_t released = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* Completely free chunks are always in the max order's free list */
+   for (n = l->first; n != (struct list_node *)l; n = next) {
+
+      next = n->next;
+
+      if (released >= bytes || !pfa_free_chunks)
+         break;
+
+      c = pfa_get_chunk((ulong)n);
+      ASSERT(c != NULL);
+
+      if (c->free_pages != PFA_CHUNK_PAGES)
+         continue;
+
+      pfa_remove_free_block(c, 0);
+      pfa_release_chunk(c);
+      pfa_free_chunks--;
+      released += PFA_CHUNK_SIZE;
+   }
+
+   return released;
+}
+
+static DEFINE_SHRINKER(pfa_shrinker,
+                       "page_alloc",
+                       pfa_shrinker_count,
+                       pfa_shrinker_scan);
+
+void page_alloc_get_stats(struct page_alloc_stats *stats)
+{
+   disable_preemption();
+   {
+      *stats = pfa_stats;
+   }
+   enable_preemption();
+}
+
+void init_page_alloc(ulong phys_mem_lim)
+{
+   for (int i = 0; i <= PAGE_ALLOC_MAX_ORDER; i++)
+      list_init(&pfa_free_lists[i]);
+
+   pfa_free_chunks = 0;
+   bzero(&pfa_stats, sizeof(pfa_stats));
+
+   pfa_chunks_table_size = phys_mem_lim >> PFA_GRANULE_SHIFT;
+   pfa_chunks_table =
+      kzalloc_array_obj(struct pfa_chunk *, pfa_chunks_table_size);
+
+   if (!pfa_chunks_table)
+      panic("Unable to allocate the page-frame allocator's table");
+
+   register_shrinker(&pfa_shrinker);
+}
@@ -12,9 +12,41 @@
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/fs/devfs.h>
 #include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/user.h>
 
 #include <sys/mman.h>      // system header
 
+/* Not exposed by <sys/mman.h> without the GNU/BSD extensions */
+#ifndef MREMAP_MAYMOVE
+   #define MREMAP_MAYMOVE 1
+#endif
+
+#ifndef MADV_NORMAL
+   #define MADV_NORMAL       0
+   #define MADV_RANDOM       1
+   #define MADV_SEQUENTIAL   2
+#endif
+
+#ifndef MADV_WILLNEED
+   #define MADV_WILLNEED     3
+   #define MADV_DONTNEED     4
+   #define MADV_FREE         8
+#endif
+
+#ifndef MADV_HUGEPAGE
+   #define MADV_MERGEABLE    12
+   #define MADV_UNMERGEABLE  13
+   #define MADV_HUGEPAGE     14
+   #define MADV_NOHUGEPAGE   15
+   #define MADV_DONTDUMP     16
+   #define MADV_DODUMP       17
+#endif
+
+#ifndef MADV_COLD
+   #define MADV_COLD         20
+   #define MADV_PAGEOUT      21
+#endif
+
 char page_size_buf[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
 static inline void sys_brk_internal(struct process *pi, void *new_brk)
@@ -23,49 +55,25 @@ static inline void sys_brk_internal(struct process *pi, void *new_brk)
 
    if (new_brk < pi->brk) {
 
-      /* we have to free pages */
-
-      for (void *vaddr = new_brk; vaddr < pi->brk; vaddr += PAGE_SIZE) {
-         unmap_page(pi->pdir, vaddr, true);
-      }
-
+      /* we have to free the pages that have been touched */
+      user_unmap_demand_zero_pages(pi,
+                                   new_brk,
+                                   (size_t)(pi->brk - new_brk) >> PAGE_SHIFT);
       pi->brk = new_brk;
       return;
    }
 
-   void *vaddr = pi->brk;
-
-   while (vaddr < new_brk) {
+   for (void *vaddr = pi->brk; vaddr < new_brk; vaddr += PAGE_SIZE) {
 
       if (is_mapped(pi->pdir, vaddr))
          return; // error: vaddr is already mapped!
-
-      vaddr += PAGE_SIZE;
    }
 
-   /* OK, everything looks good here */
-
-   vaddr = pi->brk;
-
-   while (vaddr < new_brk) {
-
-      void *kernel_vaddr = kmalloc(PAGE_SIZE);
-
-      if (!kernel_vaddr)
-         break; /* we've allocated as much as possible */
-
-      const ulong paddr = KERNEL_VA_TO_PA(kernel_vaddr);
-
-      if (map_page(pi->pdir, vaddr, paddr, PAGING_FL_RWUS) != 0) {
-         kfree2(kernel_vaddr, PAGE_SIZE);
-         break;
-      }
-
-      vaddr += PAGE_SIZE;
-   }
-
-   /* We're done. */
-   pi->brk = vaddr;
+   /*
+    * OK, everything looks good here. Just move the program break: the pages
+    * will be allocated on their first access, by the page fault handler.
+    */
+   pi->brk = new_brk;
 }
 
 void *sys_brk(void *new_brk)
@@ -116,7 +124,7 @@ static int create_process_mmap_heap(struct process *pi)
       return -ENOMEM;
    }
 
-   list_init(&pi->mi->mappings);
+   pi->mi->mappings = NULL;
    pi->mi->mmap_heap = mmap_heap;
    pi->mi->mmap_heap_size = USER_MMAP_MIN_SZ;
 
@@ -128,13 +136,8 @@ static int create_process_mmap_heap(struct process *pi)
                           KMALLOC_MAX_ALIGN,    /* alloc block size */
                           false,                /* linear mapping */
                           NULL,                 /* metadata_nodes */
-#if MMAP_NO_COW
                           user_valloc_and_map,
                           user_vfree_and_unmap);
-#else
-                          user_map_zero_page,
-                          user_unmap_zero_page);
-#endif
 
    if (!success)
       return -ENOMEM;
@@ -153,6 +156,41 @@ mmap_err_case_free(struct process *pi, void *ptr, size_t actual_len)
                   KFREE_FL_NO_ACTUAL_FREE);
 }
 
+static bool expand_process_mmap_heap(struct process *pi)
+{
+   struct kmalloc_heap *new_heap;
+   struct kmalloc_heap *h = pi->mi->mmap_heap;
+   size_t heap_sz = pi->mi->mmap_heap_size;
+
+   if (heap_sz == USER_MMAP_MAX_SZ)
+      return false; /* cannot expand the heap more than that */
+
+   new_heap = kmalloc_heap_dup_expanded(h, heap_sz * 2);
+
+   if (!new_heap)
+      return false; /* no enough memory */
+
+   pi->mi->mmap_heap_size = heap_sz * 2;
+   pi->mi->mmap_heap = new_heap;
+   kmalloc_destroy_heap(h);
+   return true;
+}
+
+static inline bool is_fs_handle_writable(struct fs_handle_base *h)
+{
+   return (h->fl_flags & O_WRONLY) || (h->fl_flags & O_RDWR) == O_RDWR;
+}
+
+/*
+ * Like on x86, writable or executable memory is always readable as well: make
+ * that explicit in um->prot, which is used as source of truth by the page
+ * fault handlers.
+ */
+static inline int user_mapping_prot(int prot)
+{
+   return (prot & (PROT_WRITE | PROT_EXEC)) ? prot | PROT_READ : prot;
+}
+
 static struct user_mapping *
 mmap_on_user_heap(struct process *pi,
                   size_t *actual_len_ref,
@@ -166,28 +204,15 @@ mmap_on_user_heap(struct process *pi,
 
    while (true) {
 
-      struct kmalloc_heap *new_heap;
-      struct kmalloc_heap *h = pi->mi->mmap_heap;
-      size_t heap_sz = pi->mi->mmap_heap_size;
-
-      res = per_heap_kmalloc(h,
+      res = per_heap_kmalloc(pi->mi->mmap_heap,
                              actual_len_ref,
                              per_heap_kmalloc_flags);
 
       if (LIKELY(res != NULL))
          break;        /* great! */
 
-      if (heap_sz == USER_MMAP_MAX_SZ)
-         return NULL; /* cannot expand the heap more than that */
-
-      new_heap = kmalloc_heap_dup_expanded(h, heap_sz * 2);
-
-      if (!new_heap)
-         return NULL; /* no enough memory */
-
-      pi->mi->mmap_heap_size = heap_sz * 2;
-      pi->mi->mmap_heap = new_heap;
-      kmalloc_destroy_heap(h);
+      if (!expand_process_mmap_heap(pi))
+         return NULL;
    }
 
    /* NOTE: here `handle` might be NULL (zero-map case) and that's OK */
@@ -211,7 +236,7 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
    struct fs_handle_base *handle = NULL;
    struct user_mapping *um = NULL;
    size_t actual_len;
-   int rc, fl;
+   int rc;
 
    if ((flags & MAP_PRIVATE) && (flags & MAP_SHARED))
       return -EINVAL; /* non-sense parameters */
@@ -222,7 +247,7 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
    if (addr)
       return -EINVAL; /* addr != NULL not supported */
 
-   if (!(prot & PROT_READ))
+   if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
       return -EINVAL;
 
    actual_len = pow2_round_up_at(len, PAGE_SIZE);
@@ -238,34 +263,54 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       if (!(flags & MAP_PRIVATE))
          return -EINVAL;
 
-      if ((prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE))
-         return -EINVAL;
+      if (MMAP_NO_COW && !(prot & PROT_WRITE))
+         return -EINVAL; /* the pages are allocated and mapped as writable */
+
+      /*
+       * The other protections, including PROT_NONE, are enforced by the page
+       * fault handler, see is_demand_zero_vaddr().
+       */
+      prot = user_mapping_prot(prot);
 
       if (pgoffset != 0)
          return -EINVAL; /* pgoffset != 0 does not make sense here */
 
+      /*
+       * NOTE: MAP_HUGETLB doesn't need any special treatment here: the mmap
+       * heap aligns its blocks at their size rounded up to a power of 2, so
+       * all the mappings bigger than 2 MB start at a 4 MB boundary, while the
+       * big pages are allocated on demand, falling back to regular pages when
+       * that's not possible (see handle_potential_demand_zero()).
+       */
+
+      /*
+       * Just reserve the range in the mmap heap: the pages will be allocated
+       * on their first access, by the page fault handler.
+       */
+      if (!MMAP_NO_COW)
+         per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
+
    } else {
 
       if (!(flags & MAP_SHARED))
          return -EINVAL;
 
+      if (flags & MAP_HUGETLB)
+         return -EINVAL; /* Big pages are supported only for anonymous mem */
+
       handle = get_fs_handle(fd);
 
       if (!handle)
          return -EBADF;
 
-      fl = handle->fl_flags;
-
       if ((prot & (PROT_READ | PROT_WRITE)) == 0)
          return -EINVAL; /* nor read nor write prot */
 
       if ((prot & (PROT_READ | PROT_WRITE)) == PROT_WRITE)
          return -EINVAL; /* disallow write-only mappings */
 
-      if (prot & PROT_WRITE) {
-         if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
-            return -EACCES;
-      }
+      if ((prot & PROT_WRITE) && !is_fs_handle_writable(handle))
+         return -EACCES;
 
       per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
    }
@@ -289,6 +334,7 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       return -ENOMEM;
 
    ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
+   um->flags = flags & MAP_HUGETLB;
 
    if (handle) {
 
@@ -319,44 +365,34 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
    return (long)um->vaddr;
 }
 
-static int munmap_int(struct process *pi, void *vaddrp, size_t len)
+/*
+ * Un-map the range [vaddrp, vaddrp + actual_len), entirely contained in `um`.
+ */
+static int
+munmap_in_mapping(struct process *pi,
+                  struct user_mapping *um,
+                  void *vaddrp,
+                  size_t actual_len)
 {
    u32 kfree_flags = KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP;
-   struct user_mapping *um = NULL, *um2 = NULL;
+   struct user_mapping *um2 = NULL;
    ulong vaddr = (ulong) vaddrp;
-   size_t actual_len;
    int rc;
 
-   ASSERT(!is_preemption_enabled());
-
-   actual_len = pow2_round_up_at(len, PAGE_SIZE);
-   um = process_get_user_mapping(vaddrp);
-
-   if (!um) {
-
-      /*
-       * We just don't have any user_mappings containing [vaddrp, vaddrp+len).
-       * Just ignore that and return 0 [linux behavior].
-       */
-
-      printk("[%d] Un-map unknown chunk at [%p, %p)\n",
-             pi->pid, TO_PTR(vaddr), TO_PTR(vaddr + actual_len));
-      return 0;
-   }
-
    const ulong um_vend = um->vaddr + um->len;
+   const bool whole_mapping = actual_len == um->len;
 
-   if (actual_len == um->len) {
-
-      process_remove_user_mapping(um);
-
-   } else {
+   if (!whole_mapping) {
 
       /* partial un-map */
 
       if (vaddr == um->vaddr) {
 
-         /* unmap the beginning of the chunk */
+         /*
+          * Unmap the beginning of the chunk. NOTE: changing the key of `um`
+          * in the mappings tree is fine here, as it cannot pass any other
+          * mapping's one.
+          */
          um->vaddr += actual_len;
          um->off += actual_len;
          um->len -= actual_len;
@@ -391,6 +427,8 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
             um->len = um_vend - um->vaddr;
             return -ENOMEM;
          }
+
+         um2->flags = um->flags;
       }
    }
 
@@ -410,14 +448,72 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
 
       if (um2)
          vfs_mmap(um2, pi->pdir, VFS_MM_DONT_MMAP);
+
+   } else if (!MMAP_NO_COW) {
+
+      /* Demand-zero mapping: nothing was allocated by the mmap heap */
+      kfree_flags |= KFREE_FL_NO_ACTUAL_FREE;
+      user_unmap_demand_zero_pages(pi, vaddrp, actual_len >> PAGE_SHIFT);
    }
 
+   /* Remove the mapping only now that we don't need `um` anymore */
+   if (whole_mapping)
+      process_remove_user_mapping(um);
+
    per_heap_kfree(pi->mi->mmap_heap,
                   vaddrp,
                   &actual_len,
                   kfree_flags);
 
-   ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
+   return 0;
+}
+
+static int munmap_int(struct process *pi, void *vaddrp, size_t len)
+{
+   const ulong vaddr = (ulong) vaddrp;
+   const ulong vend = vaddr + pow2_round_up_at(len, PAGE_SIZE);
+   struct user_mapping *um;
+   bool found = false;
+   ulong va, end;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   /*
+    * The range might span over multiple mappings (e.g. after mprotect() split
+    * a mapping) and it might start or end in a hole: un-map each part of every
+    * mapping intersecting it separately, skipping the holes.
+    */
+   for (va = vaddr; va < vend; va = end) {
+
+      if (!(um = process_get_user_mapping((void *)va))) {
+
+         um = process_get_next_user_mapping((void *)va);
+
+         if (!um || um->vaddr >= vend)
+            break;
+
+         va = um->vaddr;
+      }
+
+      end = MIN(vend, um->vaddr + um->len);
+      found = true;
+
+      if ((rc = munmap_in_mapping(pi, um, (void *)va, end - va)))
+         return rc;
+   }
+
+   if (!found) {
+
+      /*
+       * We just don't have any user_mappings intersecting [vaddrp, vend).
+       * Just ignore that and return 0 [linux behavior].
+       */
+
+      printk("[%d] Un-map unknown chunk at [%p, %p)\n",
+             pi->pid, TO_PTR(vaddr), TO_PTR(vend));
+   }
+
    return 0;
 }
 
@@ -445,3 +541,521 @@ int sys_munmap(void *vaddrp, size_t len)
    enable_preemption();
    return rc;
 }
+
+/*
+ * Try to extend the anonymous mapping `um` by `len` bytes, reserving the range
+ * right after it in the mmap heap.
+ */
+static bool mremap_grow_in_place(struct process *pi,
+                                 struct user_mapping *um,
+                                 size_t len)
+{
+   u32 per_heap_kmalloc_flags = PAGE_SIZE;
+   void *vend = um->vaddrp + um->len;
+   struct user_mapping *next;
+
+   if (!MMAP_NO_COW)
+      per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
+
+   /*
+    * Check that [vend, vend + len) is free and that it fits in the biggest
+    * mmap heap before expanding the heap: the expansion cannot be undone.
+    */
+   if ((ulong)vend + len > USER_MMAP_BEGIN + USER_MMAP_MAX_SZ)
+      return false;
+
+   next = process_get_next_user_mapping(vend);
+
+   if (next && next->vaddr < (ulong)vend + len)
+      return false;
+
+   while ((ulong)vend + len > USER_MMAP_BEGIN + pi->mi->mmap_heap_size) {
+      if (!expand_process_mmap_heap(pi))
+         return false;
+   }
+
+   if (!per_heap_kmalloc_at(pi->mi->mmap_heap,
+                            vend,
+                            len,
+                            per_heap_kmalloc_flags))
+   {
+      return false;
+   }
+
+   if (MMAP_NO_COW)
+      bzero(vend, len);
+
+   um->len += len;
+   return true;
+}
+
+/*
+ * Move the anonymous mapping `um` to a new range of `new_len` bytes. Instead of
+ * copying the data, we move the page table entries (see remap_pages()). The
+ * pages after the old length are demand-zero, as usual.
+ */
+static long mremap_move(struct process *pi,
+                        struct user_mapping *um,
+                        size_t new_len)
+{
+   u32 per_heap_kmalloc_flags = KMALLOC_FL_MULTI_STEP | PAGE_SIZE;
+   const size_t old_len = um->len;
+   struct user_mapping *new_um;
+   size_t actual_len = new_len;
+   int rc;
+
+   if (!MMAP_NO_COW)
+      per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
+
+   new_um = mmap_on_user_heap(pi,
+                              &actual_len,
+                              NULL,
+                              per_heap_kmalloc_flags,
+                              0,
+                              um->prot);
+
+   if (!new_um)
+      return -ENOMEM;
+
+   ASSERT(actual_len == new_len);
+   new_um->flags = um->flags;
+
+   if (MMAP_NO_COW) {
+
+      /* The mmap heap allocated real memory for us: just copy the data */
+      memcpy(new_um->vaddrp, um->vaddrp, old_len);
+      bzero(new_um->vaddrp + old_len, new_len - old_len);
+
+   } else {
+
+      rc = remap_pages(pi->pdir,
+                       um->vaddrp,
+                       new_um->vaddrp,
+                       old_len >> PAGE_SHIFT);
+
+      if (rc) {
+         mmap_err_case_free(pi, new_um->vaddrp, new_len);
+         process_remove_user_mapping(new_um);
+         return rc;
+      }
+   }
+
+   /* Unmapping a whole mapping cannot fail */
+   rc = munmap_int(pi, um->vaddrp, old_len);
+   ASSERT(rc == 0);
+   (void) rc; /* prevent the "unused variable" Werror in release */
+
+   return (long)new_um->vaddr;
+}
+
+static long
+mremap_int(struct process *pi,
+           void *old_addr,
+           size_t old_len,
+           size_t new_len,
+           int flags)
+{
+   struct user_mapping *um;
+   ASSERT(!is_preemption_enabled());
+
+   um = process_get_user_mapping(old_addr);
+
+   if (!um || (ulong)old_addr + old_len > um->vaddr + um->len)
+      return -EFAULT;
+
+   if (new_len == old_len)
+      return (long)old_addr;
+
+   if (new_len < old_len) {
+
+      int rc = munmap_int(pi, old_addr + new_len, old_len - new_len);
+      return rc ? rc : (long)old_addr;
+   }
+
+   /*
+    * Growing is supported only for whole anonymous mappings: that's the case
+    * of realloc() in libc.
+    */
+   if (um->h || old_addr != um->vaddrp || old_len != um->len)
+      return -EINVAL;
+
+   if (mremap_grow_in_place(pi, um, new_len - old_len))
+      return (long)old_addr;
+
+   if (!(flags & MREMAP_MAYMOVE))
+      return -ENOMEM;
+
+   return mremap_move(pi, um, new_len);
+}
+
+long sys_mremap(void *old_addr, size_t old_len, size_t new_len, int flags)
+{
+   struct task *curr = get_curr_task();
+   struct process *pi = curr->pi;
+   ulong vaddr = (ulong) old_addr;
+   long rc;
+
+   if (flags & ~MREMAP_MAYMOVE)
+      return -EINVAL; /* MREMAP_FIXED and MREMAP_DONTUNMAP are not supported */
+
+   if ((vaddr & OFFSET_IN_PAGE_MASK) || !old_len || !new_len)
+      return -EINVAL;
+
+   if (!pi->mi)
+      return -EFAULT;
+
+   if (!IN_RANGE(vaddr,
+                 USER_MMAP_BEGIN,
+                 USER_MMAP_BEGIN + pi->mi->mmap_heap_size))
+   {
+      return -EFAULT;
+   }
+
+   old_len = pow2_round_up_at(old_len, PAGE_SIZE);
+   new_len = pow2_round_up_at(new_len, PAGE_SIZE);
+
+   disable_preemption();
+   {
+      rc = mremap_int(pi, old_addr, old_len, new_len, flags);
+   }
+   enable_preemption();
+   return rc;
+}
+
+/*
+ * Check that the range [vaddr, vend) is entirely covered by user mappings and,
+ * if `brk_allowed`, by the brk heap as well.
+ */
+static bool
+is_user_range_mapped(struct process *pi, ulong vaddr, ulong vend,
+                     bool brk_allowed)
+{
+   struct user_mapping *um;
+
+   for (ulong va = vaddr; va < vend; va = um->vaddr + um->len) {
+
+      if (brk_allowed &&
+          IN_RANGE(va, (ulong)pi->initial_brk, (ulong)pi->brk))
+      {
+         va = (ulong)pi->brk;
+
+         if (va >= vend)
+            break;
+      }
+
+      if (!(um = process_get_user_mapping((void *)va)))
+         return false;
+   }
+
+   return true;
+}
+
+/*
+ * Split `um` in two at `vaddr`, which must be page-aligned and strictly inside
+ * the mapping. Returns the new struct user_mapping for the part starting at
+ * `vaddr`, or NULL in case of OOM.
+ */
+static struct user_mapping *
+split_user_mapping(struct process *pi, struct user_mapping *um, ulong vaddr)
+{
+   const size_t delta = vaddr - um->vaddr;
+   const size_t old_len = um->len;
+   struct user_mapping *um2;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(um->vaddr < vaddr && vaddr < um->vaddr + um->len);
+
+   /* Shrink `um` first: the new mapping must not overlap with it */
+   um->len = delta;
+   um2 = process_add_user_mapping(um->h,
+                                  (void *)vaddr,
+                                  old_len - delta,
+                                  um->off + delta,
+                                  um->prot);
+
+   if (!um2) {
+      um->len = old_len;
+      return NULL;
+   }
+
+   um2->flags = um->flags;
+
+   if (um2->h)
+      vfs_mmap(um2, pi->pdir, VFS_MM_DONT_MMAP);
+
+   return um2;
+}
+
+static int
+mprotect_int(struct process *pi, ulong vaddr, ulong vend, int prot)
+{
+   struct user_mapping *um;
+   u32 pg_flags;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!is_user_range_mapped(pi, vaddr, vend, false))
+      return -ENOMEM;
+
+   if (prot & PROT_WRITE) {
+
+      for (ulong va = vaddr; va < vend; va = um->vaddr + um->len) {
+
+         um = process_get_user_mapping((void *)va);
+
+         if (um->h && !is_fs_handle_writable(um->h))
+            return -EACCES;
+      }
+   }
+
+   for (ulong va = vaddr; va < vend; va = um->vaddr + um->len) {
+
+      um = process_get_user_mapping((void *)va);
+
+      if (um->vaddr < va && !(um = split_user_mapping(pi, um, va)))
+         return -ENOMEM;
+
+      if (um->vaddr + um->len > vend && !split_user_mapping(pi, um, vend))
+         return -ENOMEM;
+
+      /*
+       * The pages of the file mappings never become writable here: the first
+       * write will go through the fault handler of the filesystem, as usual.
+       */
+      pg_flags = (prot & PROT_READ) ? PAGING_FL_US : 0;
+
+      if ((prot & PROT_WRITE) && !um->h)
+         pg_flags |= PAGING_FL_RW;
+
+      rc = protect_pages(pi->pdir, um->vaddrp, um->len >> PAGE_SHIFT, pg_flags);
+
+      if (rc)
+         return rc;
+
+      um->prot = prot;
+   }
+
+   return 0;
+}
+
+int sys_mprotect(void *addr, size_t len, int prot)
+{
+   struct task *curr = get_curr_task();
+   struct process *pi = curr->pi;
+   ulong vaddr = (ulong) addr;
+   int rc;
+
+   if (vaddr & OFFSET_IN_PAGE_MASK)
+      return -EINVAL;
+
+   if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   len = pow2_round_up_at(len, PAGE_SIZE);
+
+   /* Only the mmap()-ed memory is supported */
+   if (!pi->mi || vaddr < USER_MMAP_BEGIN)
+      return -ENOMEM;
+
+   if (vaddr + len > USER_MMAP_BEGIN + pi->mi->mmap_heap_size)
+      return -ENOMEM;
+
+   disable_preemption();
+   {
+      rc = mprotect_int(pi, vaddr, vaddr + len, user_mapping_prot(prot));
+   }
+   enable_preemption();
+   return rc;
+}
+
+/*
+ * MADV_DONTNEED and MADV_FREE: release the pageframes of the anonymous memory
+ * in the range. Its next access will get a fresh zeroed page, as usual for
+ * demand-zero pages. The file mappings are shared, therefore the data is the
+ * same after re-reading it from the file: just leave them as they are.
+ */
+static int madvise_dontneed(struct process *pi, ulong vaddr, ulong vend)
+{
+   struct user_mapping *um;
+   ulong end;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!is_user_range_mapped(pi, vaddr, vend, true))
+      return -ENOMEM;
+
+   for (ulong va = vaddr; va < vend; va = end) {
+
+      if (IN_RANGE(va, (ulong)pi->initial_brk, (ulong)pi->brk)) {
+
+         end = MIN(vend, (ulong)pi->brk);
+         user_unmap_demand_zero_pages(pi,
+                                      (void *)va,
+                                      (end - va) >> PAGE_SHIFT);
+         continue;
+      }
+
+      um = process_get_user_mapping((void *)va);
+      end = MIN(vend, um->vaddr + um->len);
+
+      if (um->h)
+         continue;
+
+      if (MMAP_NO_COW)
+         bzero((void *)va, end - va); /* the memory is owned by the heap */
+      else
+         user_unmap_demand_zero_pages(pi, (void *)va, (end - va) >> PAGE_SHIFT);
+   }
+
+   return 0;
+}
+
+/*
+ * MADV_WILLNEED: map in advance the pages of the file mappings in the range,
+ * in order to avoid the page faults later. It matters only for filesystems
+ * mapping the pages on demand, like ramfs: on FAT, everything is mapped by
+ * mmap() already.
+ */
+static int madvise_willneed(struct process *pi, ulong vaddr, ulong vend)
+{
+   struct user_mapping *um;
+   ulong end;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!is_user_range_mapped(pi, vaddr, vend, true))
+      return -ENOMEM;
+
+   for (ulong va = vaddr; va < vend; va = end) {
+
+      if (IN_RANGE(va, (ulong)pi->initial_brk, (ulong)pi->brk)) {
+         end = MIN(vend, (ulong)pi->brk);
+         continue;
+      }
+
+      um = process_get_user_mapping((void *)va);
+      end = MIN(vend, um->vaddr + um->len);
+
+      if (!um->h || !(um->prot & PROT_READ))
+         continue;
+
+      for (ulong p = va; p < end; p += PAGE_SIZE) {
+
+         if (is_mapped(pi->pdir, (void *)p))
+            continue;
+
+         if (!vfs_handle_fault(um, (void *)p, false, false))
+            break; /* past EOF */
+      }
+   }
+
+   return 0;
+}
+
+int sys_madvise(void *addr, size_t len, int advice)
+{
+   struct task *curr = get_curr_task();
+   struct process *pi = curr->pi;
+   ulong vaddr = (ulong) addr;
+   int rc;
+
+   if (vaddr & OFFSET_IN_PAGE_MASK)
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   len = pow2_round_up_at(len, PAGE_SIZE);
+
+   if (vaddr + len < vaddr || vaddr + len > USERMODE_VADDR_END)
+      return -ENOMEM;
+
+   switch (advice) {
+
+      case MADV_DONTNEED:
+      case MADV_FREE:
+
+         disable_preemption();
+         {
+            rc = madvise_dontneed(pi, vaddr, vaddr + len);
+         }
+         enable_preemption();
+         return rc;
+
+      case MADV_WILLNEED:
+
+         disable_preemption();
+         {
+            rc = madvise_willneed(pi, vaddr, vaddr + len);
+         }
+         enable_preemption();
+         return rc;
+
+      case MADV_NORMAL:
+      case MADV_RANDOM:
+      case MADV_SEQUENTIAL:
+      case MADV_MERGEABLE:
+      case MADV_UNMERGEABLE:
+      case MADV_HUGEPAGE:
+      case MADV_NOHUGEPAGE:
+      case MADV_DONTDUMP:
+      case MADV_DODUMP:
+      case MADV_COLD:
+      case MADV_PAGEOUT:
+         return 0; /* Just a hint: it's fine to ignore it */
+
+      default:
+         return -EINVAL;
+   }
+}
+
+int sys_mincore(void *addr, size_t len, u8 *u_vec)
+{
+   struct task *curr = get_curr_task();
+   struct process *pi = curr->pi;
+   ulong vaddr = (ulong) addr;
+   ulong vend, chunk_end;
+   u8 vec[64];
+   u32 n;
+
+   if (vaddr & OFFSET_IN_PAGE_MASK)
+      return -EINVAL;
+
+   len = pow2_round_up_at(len, PAGE_SIZE);
+   vend = vaddr + len;
+
+   if (vend < vaddr || vend > USERMODE_VADDR_END)
+      return -ENOMEM;
+
+   /*
+    * Fill `vec` one chunk at a time, because copy_to_user() might trigger a
+    * page fault and, therefore, it has to be called with preemption enabled.
+    */
+   while (vaddr < vend) {
+
+      chunk_end = MIN(vend, vaddr + ARRAY_SIZE(vec) * PAGE_SIZE);
+
+      disable_preemption();
+      {
+         if (!is_user_range_mapped(pi, vaddr, chunk_end, true)) {
+            enable_preemption();
+            return -ENOMEM;
+         }
+
+         for (n = 0; vaddr < chunk_end; n++, vaddr += PAGE_SIZE)
+            vec[n] = is_mapped(pi->pdir, (void *)vaddr);
+      }
+      enable_preemption();
+
+      if (copy_to_user(u_vec, vec, n))
+         return -EFAULT;
+
+      u_vec += n;
+   }
+
+   return 0;
+}
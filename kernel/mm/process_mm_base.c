@@ -1,8 +1,52 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_mm.h>
+
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/kmem_cache.h>
+
+#include <sys/mman.h>      // system header
+
+static DEFINE_KMEM_CACHE(user_mappings_cache,
+                         "user_mapping",
+                         sizeof(struct user_mapping),
+                         NULL);
+
+/*
+ * The user mappings of a process never overlap, therefore an AVL tree ordered
+ * by their start address is all we need to find the mapping containing any
+ * given address in O(log n): it's the one with the biggest vaddr <= address,
+ * if that address is before its end. No interval tree augmentation required.
+ */
+
+#define bintree_find_um_le(root, va)                                          \
+   ((struct user_mapping *)bintree_find_le_ptr((root), (va),                  \
+                                               struct user_mapping,           \
+                                               pi_node, vaddr))
+
+#define bintree_find_um_ge(root, va)                                          \
+   ((struct user_mapping *)bintree_find_ge_ptr((root), (va),                  \
+                                               struct user_mapping,           \
+                                               pi_node, vaddr))
+
+static void
+mappings_tree_insert(struct mappings_info *mi, struct user_mapping *um)
+{
+   bool success;
+   bintree_node_init(&um->pi_node);
+
+   success = bintree_insert_ptr(&mi->mappings,
+                                um,
+                                struct user_mapping,
+                                pi_node,
+                                vaddr);
+
+   ASSERT(success);
+   (void) success; /* prevent the "unused variable" Werror in release */
+}
 
 struct user_mapping *
 process_add_user_mapping(fs_handle h,
@@ -19,10 +63,9 @@ process_add_user_mapping(fs_handle h,
    ASSERT(!process_get_user_mapping(vaddr));
    ASSERT(pi->mi);
 
-   if (!(um = kzalloc_obj(struct user_mapping)))
+   if (!(um = kmem_cache_zalloc(&user_mappings_cache)))
       return NULL;
 
-   list_node_init(&um->pi_node);
    list_node_init(&um->inode_node);
 
    um->pi = pi;
@@ -32,85 +75,106 @@ process_add_user_mapping(fs_handle h,
    um->off = off;
    um->prot = prot;
 
-   list_add_tail(&pi->mi->mappings, &um->pi_node);
+   mappings_tree_insert(pi->mi, um);
    return um;
 }
 
 void process_remove_user_mapping(struct user_mapping *um)
 {
+   struct user_mapping *removed;
    ASSERT(!is_preemption_enabled());
 
-   list_remove(&um->pi_node);
+   removed = bintree_remove_ptr(&um->pi->mi->mappings,
+                                um->vaddrp,
+                                struct user_mapping,
+                                pi_node,
+                                vaddr);
+
+   ASSERT(removed == um);
+   (void) removed; /* prevent the "unused variable" Werror in release */
+
    list_remove(&um->inode_node);
-   kfree_obj(um, struct user_mapping);
+   kmem_cache_free(&user_mappings_cache, um);
 }
 
 struct user_mapping *process_get_user_mapping(void *vaddrp)
 {
    const ulong vaddr = (ulong)vaddrp;
    struct process *pi = get_curr_proc();
-   struct user_mapping *pos;
+   struct user_mapping *um;
 
    ASSERT(!is_preemption_enabled());
 
-   if (pi->mi) {
-
-      /*
-       * Given that pi->mi->mappings contains at the moment only the memory
-       * mappings done with mmap(), some small processes that don't use dynamic
-       * memory allocation will not even have this field (pi->mi == NULL).
-       *
-       * For the rest, the list is supposed to be *short*, so a linear scan
-       * is acceptable for the moment. If in the future we start to put
-       * there also the mappings for program's text and data and expect to have
-       * more than a few elements, it will be necessary to use a BST to perform
-       * the lookup here below.
-       */
+   /*
+    * Some small processes that don't use dynamic memory allocation will not
+    * even have this field (pi->mi == NULL).
+    */
+   if (!pi->mi)
+      return NULL;
 
-      list_for_each_ro(pos, &pi->mi->mappings, pi_node) {
+   um = bintree_find_um_le(pi->mi->mappings, vaddr);
 
-         if (IN_RANGE(vaddr, pos->vaddr, pos->vaddr + pos->len))
-            return pos;
-      }
-   }
+   if (um && vaddr < um->vaddr + um->len)
+      return um;
 
    return NULL;
 }
 
+/*
+ * Return the first user mapping starting at `vaddr` or after it, or NULL.
+ * Useful to walk over the mappings in a given range, in order.
+ */
+struct user_mapping *process_get_next_user_mapping(void *vaddr)
+{
+   struct process *pi = get_curr_proc();
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!pi->mi)
+      return NULL;
+
+   return bintree_find_um_ge(pi->mi->mappings, vaddr);
+}
+
 void remove_all_user_zero_mem_mappings(struct process *pi)
 {
    struct user_mapping *um;
-   struct list *mappings_list_p;
+   struct mappings_info *mi = pi->mi;
+   ulong va = 0;
 
    ASSERT(!is_preemption_enabled());
 
-   if (!pi->mi)
+   if (!mi)
       return;
 
-   mappings_list_p = &pi->mi->mappings;
+   while ((um = bintree_find_um_ge(mi->mappings, va))) {
 
-   list_for_each_ro(um, mappings_list_p, pi_node) {
+      va = um->vaddr + um->len;
 
       if (!um->h)
          full_remove_user_mapping(pi, um);
    }
 
-   ASSERT(list_is_empty(mappings_list_p));
+   ASSERT(mi->mappings == NULL);
 }
 
 void remove_all_mappings_of_handle(struct process *pi, fs_handle h)
 {
-   struct user_mapping *pos, *temp;
+   struct user_mapping *um;
    struct mappings_info *mi = pi->mi;
+   ulong va = 0;
 
    if (!mi)
       return;
 
    disable_preemption();
    {
-      list_for_each(pos, temp, &mi->mappings, pi_node) {
-         if (pos->h == h)
-            full_remove_user_mapping(pi, pos);
+      while ((um = bintree_find_um_ge(mi->mappings, va))) {
+
+         va = um->vaddr + um->len;
+
+         if (um->h == h)
+            full_remove_user_mapping(pi, um);
       }
    }
    enable_preemption();
@@ -150,25 +214,55 @@ void remove_all_file_mappings(struct process *pi)
    }
 }
 
+static void free_mappings_tree(struct mappings_info *mi)
+{
+   struct user_mapping *um;
+
+   while ((um = bintree_get_first_obj(mi->mappings,
+                                      struct user_mapping,
+                                      pi_node)))
+   {
+      bintree_remove_ptr(&mi->mappings,
+                         um->vaddrp,
+                         struct user_mapping,
+                         pi_node,
+                         vaddr);
+
+      list_remove(&um->inode_node);
+      kmem_cache_free(&user_mappings_cache, um);
+   }
+}
+
 struct mappings_info *
 duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
 {
    struct mappings_info *new_mi = NULL;
    struct user_mapping *um, *um2;
+   struct bintree_walk_ctx ctx;
 
    if (!(new_mi = kalloc_obj(struct mappings_info)))
       goto oom_case;
 
-   list_init(&new_mi->mappings);
+   new_mi->mappings = NULL;
 
    if (!(new_mi->mmap_heap = kmalloc_heap_dup(mi->mmap_heap)))
       goto oom_case;
 
    new_mi->mmap_heap_size = mi->mmap_heap_size;
 
-   list_for_each_ro(um, &mi->mappings, pi_node) {
+   /*
+    * Visit the mappings in order: that way, each insertion in the new tree
+    * just goes down its rightmost path.
+    */
+   bintree_in_order_visit_start(&ctx,
+                                mi->mappings,
+                                struct user_mapping,
+                                pi_node,
+                                false);
+
+   while ((um = bintree_in_order_visit_next(&ctx))) {
 
-      if (!(um2 = kalloc_obj(struct user_mapping)))
+      if (!(um2 = kmem_cache_alloc(&user_mappings_cache)))
          goto oom_case;
 
       /* First just copy the mapping info */
@@ -177,12 +271,9 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
       /* Re-assign the process pointer */
       um2->pi = new_pi;
 
-      /* Re-init the new nodes */
-      list_node_init(&um2->pi_node);
+      /* Re-init the inode node and add the mapping to the new tree */
       list_node_init(&um2->inode_node);
-
-      /* Add the pi_node to new process's mappings list */
-      list_add_tail(&new_mi->mappings, &um2->pi_node);
+      mappings_tree_insert(new_mi, um2);
 
       /*
        * If the inode_node belongs to a list (mappings per inode)
@@ -203,11 +294,7 @@ oom_case:
          kfree2(new_mi->mmap_heap, kmalloc_get_heap_struct_size());
       }
 
-      list_for_each(um, um2, &new_mi->mappings, pi_node) {
-         list_remove(&um->pi_node);
-         kfree_obj(um, struct user_mapping);
-      }
-
+      free_mappings_tree(new_mi);
       kfree_obj(new_mi, struct mappings_info);
    }
 
@@ -241,7 +328,7 @@ bool user_valloc_and_map_slow(ulong user_vaddr, size_t page_count)
          return false;
       }
 
-      if (!(kernel_vaddr = kmalloc(PAGE_SIZE))) {
+      if (!(kernel_vaddr = alloc_page())) {
          user_vfree_and_unmap(user_vaddr, i);
          return false;
       }
@@ -249,7 +336,7 @@ bool user_valloc_and_map_slow(ulong user_vaddr, size_t page_count)
       pa = KERNEL_VA_TO_PA(kernel_vaddr);
 
       if (map_page(pdir, (void *)va, pa, PAGING_FL_RWUS) != 0) {
-         kfree2(kernel_vaddr, PAGE_SIZE);
+         free_page(kernel_vaddr);
          user_vfree_and_unmap(user_vaddr, i);
          return false;
       }
@@ -289,38 +376,84 @@ bool user_valloc_and_map(ulong user_vaddr, size_t page_count)
    return true;
 }
 
-void user_unmap_zero_page(ulong user_vaddr, size_t page_count)
+/*
+ * Anonymous memory (the brk heap and the anonymous mmap()s, unless MMAP_NO_COW
+ * is set) is allocated on demand: just the ranges are recorded, while each
+ * page is allocated, zeroed and mapped by the page fault handler on its first
+ * access. This function tells the fault handler whether `vaddr` belongs to one
+ * of those ranges in the current process and the access is allowed by its
+ * protection (see mprotect()). In that case, `writable` tells whether the page
+ * has to be mapped as writable.
+ */
+bool is_demand_zero_vaddr(void *vaddr, bool rw, bool *writable)
 {
-   pdir_t *pdir = get_curr_pdir();
-   unmap_pages(pdir, (void *)user_vaddr, page_count, true);
+   struct process *pi = get_curr_proc();
+   struct user_mapping *um;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (IN_RANGE(vaddr, pi->initial_brk, pi->brk)) {
+      *writable = true;
+      return true;
+   }
+
+   if (MMAP_NO_COW)
+      return false;
+
+   um = process_get_user_mapping(vaddr);
+
+   if (!um || um->h || !(um->prot & PROT_READ))
+      return false;
+
+   *writable = !!(um->prot & PROT_WRITE);
+   return !rw || *writable;
 }
 
-bool user_map_zero_page(ulong user_vaddr, size_t page_count)
+/*
+ * Check whether the demand-zero range [vaddr, vaddr + len) can be mapped with
+ * big pages on its first access: that happens only for the anonymous mappings
+ * created with MAP_HUGETLB, when the range is entirely contained in them.
+ */
+bool is_big_demand_zero_range(void *vaddr, size_t len)
 {
-   size_t count = map_zero_pages(get_curr_pdir(),
-                                 (void *)user_vaddr,
-                                 page_count,
-                                 PAGING_FL_US | PAGING_FL_RW);
+   struct user_mapping *um;
 
-   if (count != page_count) {
-      user_unmap_zero_page(user_vaddr, count);
+   ASSERT(!is_preemption_enabled());
+
+   if (MMAP_NO_COW)
       return false;
-   }
 
-   return true;
+   um = process_get_user_mapping(vaddr);
+
+   if (!um || um->h || !(um->flags & MAP_HUGETLB))
+      return false;
+
+   if ((um->prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE))
+      return false;
+
+   return (ulong)vaddr + len <= um->vaddr + um->len;
+}
+
+/*
+ * Unmap the pages in the given demand-zero range that have actually been
+ * touched and free them, unless they're still shared after fork().
+ */
+void user_unmap_demand_zero_pages(struct process *pi,
+                                  void *vaddr,
+                                  size_t page_count)
+{
+   u32 count = (u32)unmap_pages_permissive(pi->pdir, vaddr, page_count, true);
+
+   /* After vfork(), the child's faults are accounted to the child */
+   pi->anon_pages -= MIN(count, pi->anon_pages);
 }
 
 int generic_fs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
 {
    struct fs_handle_base *hb = um->h;
    struct process *pi = hb->pi;
-   ulong vaddr = (ulong)vaddrp;
-   ulong vend = vaddr + len;
    ASSERT(IS_PAGE_ALIGNED(len));
 
-   for (; vaddr < vend; vaddr += PAGE_SIZE) {
-      unmap_page_permissive(pi->pdir, (void *)vaddr, false);
-   }
-
+   unmap_pages_permissive(pi->pdir, vaddrp, len >> PAGE_SHIFT, false);
    return 0;
 }
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/test/shrinker.h>
+
+STATIC struct list shrinkers_list = STATIC_LIST_INIT(shrinkers_list);
+static bool shrinking;
+
+void
+register_shrinker(struct shrinker *s)
+{
+   ASSERT(s->count != NULL);
+   ASSERT(s->scan != NULL);
+
+   disable_preemption();
+   {
+      ASSERT(list_node_is_empty(&s->node));
+      list_add_head(&shrinkers_list, &s->node);
+   }
+   enable_preemption();
+}
+
+void
+unregister_shrinker(struct shrinker *s)
+{
+   disable_preemption();
+   {
+      list_remove(&s->node);
+      list_node_init(&s->node);
+   }
+   enable_preemption();
+}
+
+size_t
+shrinkers_count(void)
+{
+   struct shrinker *s;
+   size_t tot = 0;
+
+   disable_preemption();
+   {
+      list_for_each_ro(s, &shrinkers_list, node)
+         tot += s->count(s);
+   }
+   enable_preemption();
+   return tot;
+}
+
+size_t
+shrink_caches(size_t bytes)
+{
+   struct shrinker *s, *tmp;
+   size_t released = 0, avail, r;
+
+   /*
+    * Never in IRQ context: the interrupted task might be using the structures
+    * the shrinkers change, which are protected just by disabling preemption.
+    */
+   if (in_irq())
+      return 0;
+
+   disable_preemption();
+
+   if (shrinking)
+      goto out; /* a scan() callback ended up here: don't recurse */
+
+   shrinking = true;
+
+   list_for_each(s, tmp, &shrinkers_list, node) {
+
+      if (released >= bytes)
+         break;
+
+      if (!(avail = s->count(s)))
+         continue;
+
+      r = s->scan(s, MIN(avail, bytes - released));
+      s->stats.scans++;
+      s->stats.released += r;
+      released += r;
+   }
+
+   shrinking = false;
+
+out:
+   enable_preemption();
+   return released;
+}
+
+int
+for_each_shrinker(int (*cb)(struct shrinker *, void *), void *arg)
+{
+   struct shrinker *s;
+   int rc = 0;
+
+   disable_preemption();
+   {
+      list_for_each_ro(s, &shrinkers_list, node) {
+         if ((rc = cb(s, arg)))
+            break;
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
+#ifdef UNIT_TEST_ENVIRONMENT
+
+/*
+ * Forget about all the shrinkers: used by the unit tests when the whole
+ * kmalloc is re-initialized, as the shrinkers are registered again.
+ */
+void shrinkers_reset(void)
+{
+   struct shrinker *s, *tmp;
+
+   list_for_each(s, tmp, &shrinkers_list, node) {
+      bzero(&s->stats, sizeof(s->stats));
+      list_node_init(&s->node);
+   }
+
+   list_init(&shrinkers_list);
+   shrinking = false;
+}
+
+#endif
@@ -0,0 +1,484 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/vmalloc.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmem_cache.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/test/vmalloc.h>
+
+/*
+ * vmalloc area
+ * ---------------
+ *
+ * A range of VMALLOC_AREA_SIZE bytes is reserved in the hi virtual memory at
+ * boot and it's managed here with a "gap tree": the free ranges (gaps) are
+ * kept in two AVL trees, one ordered by address, for merging the neighbors
+ * when an area is freed, and one ordered by (size, address), for finding the
+ * best fit in O(log n). The allocated areas are in a third tree, by address.
+ * Each area is followed by an unmapped guard page, catching overflows.
+ *
+ * Pages are allocated in the biggest physically-contiguous runs the page
+ * allocator can give us and each run is mapped with a single map_pages()
+ * call. The page tables of the hi virtual memory are pre-allocated at boot,
+ * so mapping never needs memory.
+ *
+ * Freeing is lazy: the pages are unmapped and released immediately, but the
+ * TLB is not flushed and the virtual range is not re-used until the lazily
+ * freed areas add up to VMALLOC_LAZY_MAX_PAGES or we run out of virtual
+ * space. Then, all of them are purged together, with a single TLB flush for
+ * the whole batch, instead of one INVLPG per page at each vfree. Nobody can
+ * legitimately access a freed area in the meanwhile.
+ *
+ * Like kmalloc, it's never used in IRQ context: disabling the preemption is
+ * enough to protect it.
+ */
+
+#define VMALLOC_AREA_SIZE                 (32 * MB)
+#define VMALLOC_LAZY_MAX_PAGES            1024
+
+struct vmap_area {
+
+   struct bintree_node node;        /* in busy_areas or gaps_by_addr */
+   struct bintree_node size_node;   /* in gaps_by_size (gaps only) */
+   struct list_node lazy_node;      /* in lazy_list (lazily freed areas) */
+   ulong va;
+   size_t size;                     /* including the guard page */
+};
+
+struct vmap_gap_key {
+
+   size_t size;
+   ulong va;
+};
+
+static DEFINE_KMEM_CACHE(vmap_areas_cache,
+                         "vmap_area",
+                         sizeof(struct vmap_area),
+                         NULL);
+
+STATIC ulong vmalloc_start;
+STATIC ulong vmalloc_end;
+
+static struct vmap_area *busy_areas;
+static struct vmap_area *gaps_by_addr;
+static struct vmap_area *gaps_by_size;
+static struct list lazy_list = STATIC_LIST_INIT(lazy_list);
+static struct vmalloc_stats stats;
+
+static long vmap_gap_cmp(const void *a, const void *b)
+{
+   const struct vmap_area *x = a;
+   const struct vmap_area *y = b;
+
+   if (x->size != y->size)
+      return x->size < y->size ? -1 : 1;
+
+   if (x->va != y->va)
+      return x->va < y->va ? -1 : 1;
+
+   return 0;
+}
+
+static long vmap_gap_key_cmp(const void *obj, const void *value)
+{
+   const struct vmap_area *x = obj;
+   const struct vmap_gap_key *k = value;
+
+   if (x->size != k->size)
+      return x->size < k->size ? -1 : 1;
+
+   if (x->va != k->va)
+      return x->va < k->va ? -1 : 1;
+
+   return 0;
+}
+
+static void gap_insert_by_size(struct vmap_area *g)
+{
+   bintree_node_init(&g->size_node);
+
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_insert(&gaps_by_size, g, vmap_gap_cmp,
+                     struct vmap_area, size_node);
+
+   ASSERT(success);
+}
+
+static void gap_remove_by_size(struct vmap_area *g)
+{
+   struct vmap_gap_key k = { .size = g->size, .va = g->va };
+
+   DEBUG_ONLY_UNSAFE(void *removed =)
+      bintree_remove(&gaps_by_size, &k, vmap_gap_key_cmp,
+                     struct vmap_area, size_node);
+
+   ASSERT(removed == g);
+}
+
+static void gap_insert_by_addr(struct vmap_area *g)
+{
+   bintree_node_init(&g->node);
+
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_insert_ptr(&gaps_by_addr, g, struct vmap_area, node, va);
+
+   ASSERT(success);
+   stats.gaps++;
+}
+
+static void gap_remove_by_addr(struct vmap_area *g)
+{
+   DEBUG_ONLY_UNSAFE(void *removed =)
+      bintree_remove_ptr(&gaps_by_addr, g,
+                         struct vmap_area, node, va);
+
+   ASSERT(removed == g);
+   stats.gaps--;
+}
+
+static struct vmap_area *
+vmap_alloc_area(size_t size)
+{
+   struct vmap_gap_key k = { .size = size, .va = 0 };
+   struct vmap_area *g, *a;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* Best fit: the smallest gap big enough, the lowest one among equals */
+   g = bintree_find_ge(gaps_by_size, &k, vmap_gap_key_cmp,
+                       struct vmap_area, size_node);
+
+   if (!g)
+      return NULL;
+
+   if (g->size == size) {
+
+      /* Perfect fit: the gap itself becomes the area */
+      gap_remove_by_size(g);
+      gap_remove_by_addr(g);
+      a = g;
+
+   } else {
+
+      if (!(a = kmem_cache_alloc(&vmap_areas_cache)))
+         return NULL;
+
+      a->va = g->va;
+      a->size = size;
+
+      /* Shrink the gap from below: its order by address doesn't change */
+      gap_remove_by_size(g);
+      g->va += size;
+      g->size -= size;
+      gap_insert_by_size(g);
+   }
+
+   bintree_node_init(&a->node);
+
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_insert_ptr(&busy_areas, a, struct vmap_area, node, va);
+
+   ASSERT(success);
+   return a;
+}
+
+/* Give the virtual range of `a` back to the gaps, merging it if possible */
+static void
+vmap_release_area(struct vmap_area *a)
+{
+   struct vmap_area *prev, *next;
+
+   ASSERT(!is_preemption_enabled());
+
+   prev = bintree_find_le_ptr(gaps_by_addr, a->va, struct vmap_area, node, va);
+   next = bintree_find_ge_ptr(gaps_by_addr, a->va, struct vmap_area, node, va);
+
+   if (prev && prev->va + prev->size == a->va) {
+
+      gap_remove_by_size(prev);
+      prev->size += a->size;
+      kmem_cache_free(&vmap_areas_cache, a);
+      a = prev;
+
+   } else {
+
+      gap_insert_by_addr(a);
+   }
+
+   if (next && a->va + a->size == next->va) {
+
+      gap_remove_by_size(next);
+      gap_remove_by_addr(next);
+      a->size += next->size;
+      kmem_cache_free(&vmap_areas_cache, next);
+   }
+
+   gap_insert_by_size(a);
+}
+
+static void vmalloc_purge_lazy_unsafe(void)
+{
+   struct vmap_area *a, *tmp;
+   bool flush_all;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (list_is_empty(&lazy_list))
+      return;
+
+   /*
+    * Kernel pages are global: a CR3 reload doesn't flush them. For a small
+    * number of pages, INVLPG is cheaper than losing all the TLB entries.
+    */
+   if ((flush_all = stats.lazy_pages > TLB_FLUSH_ALL_THR)) {
+      invalidate_all_pages();
+      stats.full_flushes++;
+   }
+
+   list_for_each(a, tmp, &lazy_list, lazy_node) {
+
+      const size_t pages = (a->size >> PAGE_SHIFT) - 1;
+
+      list_remove(&a->lazy_node);
+
+      if (!flush_all)
+         invalidate_pages(get_kernel_pdir(), TO_PTR(a->va), pages);
+
+      stats.used_size -= a->size;
+      vmap_release_area(a);
+   }
+
+   stats.lazy_pages = 0;
+   stats.purges++;
+}
+
+/*
+ * Unmap and free the first `pages` pages of `a`, without flushing the TLB,
+ * and queue its virtual range for the next purge.
+ */
+static void vmap_free_area_lazy(struct vmap_area *a, size_t pages)
+{
+   ASSERT(!is_preemption_enabled());
+
+   DEBUG_ONLY_UNSAFE(void *removed =)
+      bintree_remove_ptr(&busy_areas, a,
+                         struct vmap_area, node, va);
+
+   ASSERT(removed == a);
+
+   if (pages)
+      unmap_pages_noflush(get_kernel_pdir(), TO_PTR(a->va), pages, true);
+
+   list_add_tail(&lazy_list, &a->lazy_node);
+   stats.lazy_pages += (a->size >> PAGE_SHIFT) - 1;
+
+   if (stats.lazy_pages >= VMALLOC_LAZY_MAX_PAGES)
+      vmalloc_purge_lazy_unsafe();
+}
+
+/*
+ * Map `pages` pages at `va`, allocating them in physically-contiguous runs as
+ * big as possible. Returns the number of pages mapped.
+ */
+static size_t vmap_populate(ulong va, size_t pages)
+{
+   size_t done = 0, rem, mapped;
+   u32 order, n;
+   void *block;
+
+   while (done < pages) {
+
+      rem = pages - done;
+      order = 0;
+
+      while (order < PAGE_ALLOC_MAX_ORDER && (2ul << order) <= rem)
+         order++;
+
+      while (!(block = pfa_alloc(order)) && order > 0)
+         order--;
+
+      /* alloc_page() falls back to kmalloc(): free_page() handles both */
+      if (!block && !(block = alloc_page()))
+         break;
+
+      n = 1u << order;
+
+      mapped = map_kernel_pages(TO_PTR(va + (done << PAGE_SHIFT)),
+                                KERNEL_VA_TO_PA(block),
+                                n,
+                                PAGING_FL_RW);
+      done += mapped;
+
+      if (UNLIKELY(mapped < n)) {
+
+         /* Should never happen: the page tables are pre-allocated */
+         for (u32 i = (u32)mapped; i < n; i++)
+            free_page((char *)block + (i << PAGE_SHIFT));
+
+         break;
+      }
+   }
+
+   return done;
+}
+
+void *vmalloc_pages(size_t size)
+{
+   const size_t pages = pow2_round_up_at(size, PAGE_SIZE) >> PAGE_SHIFT;
+   struct vmap_area *a;
+   size_t mapped;
+
+   if (!vmalloc_start || !size || pages >= VMALLOC_AREA_SIZE >> PAGE_SHIFT)
+      return NULL;
+
+   disable_preemption();
+   {
+      /* +1: the guard page */
+      a = vmap_alloc_area((pages + 1) << PAGE_SHIFT);
+
+      if (!a && !list_is_empty(&lazy_list)) {
+         vmalloc_purge_lazy_unsafe();
+         a = vmap_alloc_area((pages + 1) << PAGE_SHIFT);
+      }
+
+      if (a) {
+
+         stats.used_size += a->size;
+
+         if (stats.used_size > stats.peak_used_size)
+            stats.peak_used_size = stats.used_size;
+
+      } else {
+
+         stats.failed_allocs++;
+      }
+   }
+   enable_preemption();
+
+   if (!a)
+      return NULL;
+
+   mapped = vmap_populate(a->va, pages);
+
+   disable_preemption();
+   {
+      if (LIKELY(mapped == pages)) {
+         stats.areas++;
+         stats.allocs++;
+         stats.mapped_pages += pages;
+      } else {
+         stats.failed_allocs++;
+         vmap_free_area_lazy(a, mapped);
+         a = NULL;
+      }
+   }
+   enable_preemption();
+   return a ? TO_PTR(a->va) : NULL;
+}
+
+void vfree_pages(void *ptr, size_t size)
+{
+   const size_t pages = pow2_round_up_at(size, PAGE_SIZE) >> PAGE_SHIFT;
+   struct vmap_area *a;
+
+   if (!ptr)
+      return;
+
+   disable_preemption();
+   {
+      a = bintree_find_ptr(busy_areas, ptr, struct vmap_area, node, va);
+
+      if (!a)
+         panic("vfree: no vmalloc area at %p", ptr);
+
+      if (a->size != (pages + 1) << PAGE_SHIFT)
+         panic("vfree: wrong size %zu for the area at %p", size, ptr);
+
+      stats.areas--;
+      stats.mapped_pages -= pages;
+      vmap_free_area_lazy(a, pages);
+   }
+   enable_preemption();
+}
+
+void vmalloc_purge_lazy(void)
+{
+   disable_preemption();
+   {
+      vmalloc_purge_lazy_unsafe();
+   }
+   enable_preemption();
+}
+
+bool vmalloc_avail(void)
+{
+   return vmalloc_start != 0;
+}
+
+bool is_vmalloc_addr(void *ptr)
+{
+   return IN_RANGE((ulong)ptr, vmalloc_start, vmalloc_end);
+}
+
+void vmalloc_get_stats(struct vmalloc_stats *s)
+{
+   disable_preemption();
+   {
+      *s = stats;
+   }
+   enable_preemption();
+}
+
+void vmalloc_init_area(ulong va, size_t size)
+{
+   struct vmap_area *g;
+
+   ASSERT(IS_PAGE_ALIGNED(va));
+   ASSERT(IS_PAGE_ALIGNED(size));
+
+   busy_areas = NULL;
+   gaps_by_addr = NULL;
+   gaps_by_size = NULL;
+   list_init(&lazy_list);
+   bzero(&stats, sizeof(stats));
+
+   if (!(g = kmem_cache_alloc(&vmap_areas_cache)))
+      panic("Unable to alloc the first vmap area");
+
+   g->va = va;
+   g->size = size;
+
+   disable_preemption();
+   {
+      gap_insert_by_addr(g);
+      gap_insert_by_size(g);
+   }
+   enable_preemption();
+
+   vmalloc_start = va;
+   vmalloc_end = va + size;
+   stats.area_size = size;
+}
+
+void init_vmalloc(void)
+{
+   void *va;
+
+   if (!hi_vmem_avail())
+      return;        /* vmalloc() will just use kmalloc() */
+
+   if (!(va = hi_vmem_reserve(VMALLOC_AREA_SIZE)))
+      panic("Unable to reserve the vmalloc area in the hi vmem");
+
+   vmalloc_init_area((ulong)va, VMALLOC_AREA_SIZE);
+}
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kernel.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/hal.h>
+
+/*
+ * Zeroing pages synchronously on the hot paths (demand-zero page faults, CoW
+ * faults on the zero page, new ramfs blocks) is pure overhead, paid while the
+ * user is waiting. Instead, we keep a small stack of already-zeroed pages,
+ * filled in background by a dedicated worker thread.
+ *
+ * Because the scheduler always prefers runnable worker threads over user
+ * tasks, the refill job cannot just run in a loop: it's enqueued by the idle
+ * task only (see zero_pool_on_idle()) and it zeroes at most one batch of pages
+ * at a time. That way, it runs only when there's nothing else to do. The pages
+ * are zeroed with non-temporal stores in order to not pollute the caches with
+ * pages that won't be used anytime soon.
+ *
+ * The pool is never used in IRQ context: disabling the preemption is enough
+ * to protect it. Under memory pressure, the pool is drained by its shrinker
+ * and not refilled until some memory is allocated from it again.
+ */
+
+static void *pool[ZERO_POOL_PAGES];
+static struct zero_pool_stats stats;
+static struct worker_thread *zero_pool_wth;
+static bool refill_pending;
+static bool refill_failed;
+
+const struct zero_pool_stats *zero_pool_get_stats(void)
+{
+   return &stats;
+}
+
+void *zero_pool_alloc_page(void)
+{
+   void *page = NULL;
+
+   disable_preemption();
+   {
+      if (stats.depth > 0) {
+         page = pool[--stats.depth];
+         stats.hits++;
+      } else {
+         stats.misses++;
+      }
+
+      /* Memory might have been freed in the meanwhile: allow a new refill */
+      refill_failed = false;
+   }
+   enable_preemption();
+
+   if (!page && (page = alloc_page()))
+      bzero(page, PAGE_SIZE);
+
+   if (!page)
+      return NULL;
+
+   ASSERT(IS_PAGE_ALIGNED(page));
+   return page;
+}
+
+static void zero_pool_refill(void *unused)
+{
+   void *batch[ZERO_POOL_REFILL_BATCH];
+   u32 i, n, count;
+
+   /*
+    * Only this job adds pages to the pool: its free space can only grow (the
+    * shrinker might drain the pool in the meanwhile).
+    */
+   count = MIN((u32)ZERO_POOL_REFILL_BATCH,
+               (u32)(ZERO_POOL_PAGES - stats.depth));
+
+   for (n = 0; n < count; n++) {
+      if (!(batch[n] = alloc_page()))
+         break;
+   }
+
+   if (n > 0) {
+
+      fpu_context_begin();
+      {
+         for (i = 0; i < n; i++)
+            fpu_memset256(batch[i], 0, PAGE_SIZE / 32);
+      }
+      fpu_context_end();
+   }
+
+   disable_preemption();
+   {
+      for (i = 0; i < n; i++)
+         pool[stats.depth++] = batch[i];
+
+      stats.refilled += n;
+      refill_failed = n < count;
+      refill_pending = false;
+   }
+   enable_preemption();
+}
+
+void zero_pool_on_idle(void)
+{
+   bool enqueue;
+
+   if (!zero_pool_wth)
+      return;
+
+   disable_preemption();
+   {
+      enqueue = !refill_pending &&
+                !refill_failed &&
+                stats.depth < ZERO_POOL_PAGES;
+
+      if (enqueue)
+         refill_pending = true;
+   }
+   enable_preemption();
+
+   if (!enqueue)
+      return;
+
+   if (!wth_enqueue_on(zero_pool_wth, &zero_pool_refill, NULL)) {
+      /* Cannot happen, as there's at most one job in the queue */
+      refill_pending = false;
+   }
+}
+
+static size_t zero_pool_shrinker_count(struct shrinker *s)
+{
+   return stats.depth * PAGE_SIZE;
+}
+
+static size_t zero_pool_shrinker_scan(struct shrinker *s, size_t bytes)
+{
+   size_t released = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   while (stats.depth > 0 && released < bytes) {
+      free_page(pool[--stats.depth]);
+      released += PAGE_SIZE;
+   }
+
+   /* Don't refill the pool right away, see zero_pool_alloc_page() */
+   refill_failed = true;
+   return released;
+}
+
+static DEFINE_SHRINKER(zero_pool_shrinker,
+                       "zero_pool",
+                       zero_pool_shrinker_count,
+                       zero_pool_shrinker_scan);
+
+void init_zero_pool(void)
+{
+   ASSERT(!is_preemption_enabled());
+   stats.capacity = ZERO_POOL_PAGES;
+
+   zero_pool_wth = wth_create_thread("zpool",
+                                     WTH_PRIO_LOWEST,
+                                     WTH_ZERO_POOL_QUEUE_SIZE);
+
+   if (!zero_pool_wth)
+      panic("Unable to create the zero pool's worker thread");
+
+   /* Registered after the page allocator's: it has to run before it */
+   register_shrinker(&zero_pool_shrinker);
+}
@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/pid_table.h>
+
+#define PT_LEAF_ENTRIES                                128
+#define PT_USER_IDS                          (MAX_PID + 1)
+#define PT_KERNEL_IDS                 (KERNEL_MAX_TID + 1)
+
+#define PT_LEAVES(ids)     (((ids) + PT_LEAF_ENTRIES - 1) / PT_LEAF_ENTRIES)
+#define PT_BM_WORDS(ids)   (((ids) + NBITS - 1) / NBITS)
+
+struct pid_entry {
+   struct task *ti;              /* task with this tid, if any */
+   struct list pgrp_members;     /* processes having this ID as pgid */
+   struct list session_members;  /* processes having this ID as sid */
+};
+
+struct pid_space {
+   const int ids;                   /* number of IDs in the space */
+   const int off;                   /* tid corresponding to ID 0 */
+   int last;                        /* last allocated ID */
+   ulong *const bitmap;             /* bit set => ID in use */
+   struct pid_entry **const leaves; /* allocated on-demand */
+};
+
+/*
+ * The first leaf of each space is static because the kernel process gets its
+ * pid and tid in a constructor, before kmalloc is initialized.
+ */
+static struct pid_entry user_leaf0[PT_LEAF_ENTRIES];
+static struct pid_entry kernel_leaf0[PT_LEAF_ENTRIES];
+
+static struct pid_entry *user_leaves[PT_LEAVES(PT_USER_IDS)] = {
+   user_leaf0
+};
+
+static struct pid_entry *kernel_leaves[PT_LEAVES(PT_KERNEL_IDS)] = {
+   kernel_leaf0
+};
+
+static ulong user_bitmap[PT_BM_WORDS(PT_USER_IDS)];
+static ulong kernel_bitmap[PT_BM_WORDS(PT_KERNEL_IDS)];
+
+static struct pid_space user_ids = {
+   .ids = PT_USER_IDS,
+   .off = 0,
+   .last = -1,
+   .bitmap = user_bitmap,
+   .leaves = user_leaves,
+};
+
+static struct pid_space kernel_ids = {
+   .ids = PT_KERNEL_IDS,
+   .off = KERNEL_TID_START,
+   .last = -1,
+   .bitmap = kernel_bitmap,
+   .leaves = kernel_leaves,
+};
+
+static struct pid_space *pt_get_space(int tid, int *id)
+{
+   if (0 <= tid && tid < PT_USER_IDS) {
+      *id = tid;
+      return &user_ids;
+   }
+
+   if (KERNEL_TID_START <= tid && tid < KERNEL_TID_START + PT_KERNEL_IDS) {
+      *id = tid - KERNEL_TID_START;
+      return &kernel_ids;
+   }
+
+   return NULL;
+}
+
+static ALWAYS_INLINE struct pid_entry *
+pt_get_entry(struct pid_space *s, int id)
+{
+   struct pid_entry *leaf = s->leaves[id / PT_LEAF_ENTRIES];
+   return leaf ? &leaf[id % PT_LEAF_ENTRIES] : NULL;
+}
+
+static bool pt_ensure_leaf(struct pid_space *s, int id)
+{
+   struct pid_entry **leaf_ref = &s->leaves[id / PT_LEAF_ENTRIES];
+
+   if (LIKELY(*leaf_ref != NULL))
+      return true;
+
+   *leaf_ref = kzalloc_array_obj(struct pid_entry, PT_LEAF_ENTRIES);
+   return *leaf_ref != NULL;
+}
+
+/*
+ * The member lists are lazily initialized: leaves are zeroed and a zeroed
+ * (null) list is treated as an empty one.
+ */
+static ALWAYS_INLINE bool pt_list_is_empty(struct list *l)
+{
+   return list_is_null(l) || list_is_empty(l);
+}
+
+static void pt_list_add(struct list *l, struct list_node *n)
+{
+   if (list_is_null(l))
+      list_init(l);
+
+   list_add_tail(l, n);
+}
+
+static void pt_update_bit(struct pid_space *s, int id)
+{
+   struct pid_entry *e = pt_get_entry(s, id);
+   const ulong mask = 1ul << (id % NBITS);
+   const bool grp_id =
+      !pt_list_is_empty(&e->pgrp_members) ||
+      !pt_list_is_empty(&e->session_members);
+
+   if (e->ti || grp_id)
+      s->bitmap[id / NBITS] |= mask;
+   else
+      s->bitmap[id / NBITS] &= ~mask;
+}
+
+/* Returns the first zero bit in [from, to) or -1 */
+static int bitmap_find_zero(const ulong *bm, int from, int to)
+{
+   int i = from;
+
+   while (i < to) {
+
+      const int bit = i % NBITS;
+      const int base = i - bit;
+      const ulong w = bm[i / NBITS] | (bit ? make_bitmask((ulong)bit) : 0);
+
+      if (w != ~0ul) {
+         const int r = base + (int)get_first_zero_bit_index_l(w);
+         return r < to ? r : -1;
+      }
+
+      i = base + NBITS;
+   }
+
+   return -1;
+}
+
+static int pt_alloc_id(struct pid_space *s)
+{
+   int id;
+   ASSERT(!is_preemption_enabled());
+
+   /*
+    * Like Linux, prefer the lowest free ID after the last allocated one and
+    * wrap-around only when we've reached the end of the space. That makes
+    * the re-use of recently freed IDs unlikely.
+    */
+
+   id = bitmap_find_zero(s->bitmap, s->last + 1, s->ids);
+
+   if (id < 0)
+      id = bitmap_find_zero(s->bitmap, 0, s->last + 1);
+
+   if (id < 0 || !pt_ensure_leaf(s, id))
+      return -1;
+
+   s->last = id;
+   return id + s->off;
+}
+
+int pid_table_alloc_pid(void)
+{
+   return pt_alloc_id(&user_ids);
+}
+
+int pid_table_alloc_kernel_tid(void)
+{
+   return pt_alloc_id(&kernel_ids);
+}
+
+void pid_table_add_task(struct task *ti)
+{
+   struct pid_space *s;
+   struct pid_entry *e;
+   int id;
+
+   ASSERT(!is_preemption_enabled());
+
+   s = pt_get_space(ti->tid, &id);
+   ASSERT(s != NULL);
+
+   e = pt_get_entry(s, id);
+   ASSERT(e != NULL);    /* the leaf is allocated by pt_alloc_id() */
+   ASSERT(e->ti == NULL);
+
+   e->ti = ti;
+   pt_update_bit(s, id);
+}
+
+void pid_table_remove_task(struct task *ti)
+{
+   struct pid_space *s;
+   struct pid_entry *e;
+   int id;
+
+   ASSERT(!is_preemption_enabled());
+
+   s = pt_get_space(ti->tid, &id);
+   ASSERT(s != NULL);
+
+   e = pt_get_entry(s, id);
+   ASSERT(e != NULL);
+   ASSERT(e->ti == ti);
+
+   e->ti = NULL;
+   pt_update_bit(s, id);
+}
+
+struct task *pid_table_get_task(int tid)
+{
+   struct pid_space *s;
+   struct pid_entry *e;
+   int id;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!(s = pt_get_space(tid, &id)))
+      return NULL;
+
+   e = pt_get_entry(s, id);
+   return e ? e->ti : NULL;
+}
+
+static struct pid_entry *pt_get_grp_entry(int id)
+{
+   if (id < 0 || id >= PT_USER_IDS)
+      return NULL;
+
+   return pt_get_entry(&user_ids, id);
+}
+
+void pid_table_add_process(struct process *pi)
+{
+   struct pid_entry *pgrp_e = pt_get_grp_entry(pi->pgid);
+   struct pid_entry *session_e = pt_get_grp_entry(pi->sid);
+
+   ASSERT(!is_preemption_enabled());
+
+   /*
+    * The pgid and the sid of a process are always its own pid or the ID of
+    * an existing group/session: therefore, their leaves must exist.
+    */
+   ASSERT(pgrp_e != NULL);
+   ASSERT(session_e != NULL);
+
+   pt_list_add(&pgrp_e->pgrp_members, &pi->pgrp_node);
+   pt_list_add(&session_e->session_members, &pi->session_node);
+   pt_update_bit(&user_ids, pi->pgid);
+   pt_update_bit(&user_ids, pi->sid);
+}
+
+void pid_table_remove_process(struct process *pi)
+{
+   ASSERT(!is_preemption_enabled());
+   ASSERT(list_is_node_in_list(&pi->pgrp_node));
+   ASSERT(list_is_node_in_list(&pi->session_node));
+
+   list_remove(&pi->pgrp_node);
+   list_remove(&pi->session_node);
+   list_node_init(&pi->pgrp_node);
+   list_node_init(&pi->session_node);
+   pt_update_bit(&user_ids, pi->pgid);
+   pt_update_bit(&user_ids, pi->sid);
+}
+
+struct list *pid_table_get_pgrp_members(int pgid)
+{
+   struct pid_entry *e = pt_get_grp_entry(pgid);
+   ASSERT(!is_preemption_enabled());
+
+   if (!e || pt_list_is_empty(&e->pgrp_members))
+      return NULL;
+
+   return &e->pgrp_members;
+}
+
+struct list *pid_table_get_session_members(int sid)
+{
+   struct pid_entry *e = pt_get_grp_entry(sid);
+   ASSERT(!is_preemption_enabled());
+
+   if (!e || pt_list_is_empty(&e->session_members))
+      return NULL;
+
+   return &e->session_members;
+}
@@ -173,10 +173,8 @@ poll_wait_on_cond(struct pollfd *fds, nfds_t nfds, int timeout, int cond_cnt)
       return ready_fds_cnt;
    }
 
-   if (timeout > 0) {
-      u32 ticks = MAX((u32)timeout / (1000 / TIMER_HZ), 1u);
-      task_set_wakeup_timer(curr, ticks);
-   }
+   if (timeout > 0)
+      task_set_wakeup_timer_ns(curr, (u64)timeout * MILLION);
 
    while (true) {
 
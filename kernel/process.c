@@ -11,6 +11,7 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/list.h>
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmem_cache.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/debug_utils.h>
@@ -24,6 +25,17 @@ STATIC_ASSERT(IS_PAGE_ALIGNED(ARGS_COPYBUF_SIZE));
 
 #define ISOLATED_STACK_HI_VMEM_SPACE   (KERNEL_STACK_SIZE + (2 * PAGE_SIZE))
 
+/* Main threads are allocated together with their process: see process.h */
+static DEFINE_KMEM_CACHE(processes_cache,
+                         "process",
+                         TOT_PROC_AND_TASK_SIZE,
+                         NULL);
+
+static DEFINE_KMEM_CACHE(threads_cache,
+                         "task",
+                         sizeof(struct task),
+                         NULL);
+
 static void *alloc_kernel_isolated_stack(struct process *pi)
 {
    void *vaddr_in_block;
@@ -179,8 +191,9 @@ void free_mem_for_zombie_task(struct task *ti)
 void init_task_lists(struct task *ti)
 {
    bintree_node_init(&ti->tree_by_tid_node);
-   list_node_init(&ti->runnable_node);
-   list_node_init(&ti->wakeup_timer_node);
+   bintree_node_init(&ti->runnable_node);
+   list_node_init(&ti->rt_node);
+   task_init_wakeup_timer(ti);
    list_node_init(&ti->siblings_node);
 
    list_init(&ti->tasks_waiting_list);
@@ -191,6 +204,8 @@ void init_task_lists(struct task *ti)
 void init_process_lists(struct process *pi)
 {
    list_init(&pi->children);
+   list_node_init(&pi->pgrp_node);
+   list_node_init(&pi->session_node);
    kmutex_init(&pi->fslock, KMUTEX_FL_RECURSIVE);
 }
 
@@ -202,7 +217,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    bool common_allocs = false;
    bool arch_fields = false;
 
-   if (UNLIKELY(!(ti = kmalloc(TOT_PROC_AND_TASK_SIZE))))
+   if (UNLIKELY(!(ti = kmem_cache_alloc(&processes_cache))))
       goto oom_case;
 
    pi = (struct process *)(ti + 1);
@@ -233,6 +248,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    pi->automatic_reaping = false;
    pi->cwd.fs = NULL;
    pi->vforked = false;
+   pi->oom_killed = false;
 
    if (new_pdir != parent_pi->pdir) {
 
@@ -304,7 +320,7 @@ oom_case:
       if (MOD_debugpanel && pi->debug_cmdline)
          kfree2(pi->debug_cmdline, PROCESS_CMDLINE_BUF_SIZE);
 
-      kfree2(ti, TOT_PROC_AND_TASK_SIZE);
+      kmem_cache_free(&processes_cache, ti);
    }
 
    return NULL;
@@ -314,14 +330,14 @@ struct task *allocate_new_thread(struct process *pi, int tid, bool alloc_bufs)
 {
    ASSERT(pi != NULL);
    struct task *process_task = get_process_task(pi);
-   struct task *ti = kzalloc_obj(struct task);
+   struct task *ti = kmem_cache_zalloc(&threads_cache);
 
    if (!ti || !(ti->pi = pi) || !do_common_task_allocs(ti, alloc_bufs)) {
 
       if (ti) /* do_common_task_allocs() failed */
          free_common_task_allocs(ti);
 
-      kfree_obj(ti, struct task);
+      kmem_cache_free(&threads_cache, ti);
       return NULL;
    }
 
@@ -353,7 +369,7 @@ static void free_process_int(struct process *pi)
    if (release_obj(pi) == 0) {
 
       arch_specific_free_proc(pi);
-      kfree2(get_process_task(pi), TOT_PROC_AND_TASK_SIZE);
+      kmem_cache_free(&processes_cache, get_process_task(pi));
 
       if (MOD_debugpanel)
          kfree2(pi->debug_cmdline, PROCESS_CMDLINE_BUF_SIZE);
@@ -374,7 +390,7 @@ void free_task(struct task *ti)
    if (is_main_thread(ti))
       free_process_int(ti->pi);
    else
-      kfree_obj(ti, struct task);
+      kmem_cache_free(&threads_cache, ti);
 }
 
 void *task_temp_kernel_alloc(size_t size)
@@ -559,8 +575,7 @@ int sys_setsid(void)
    disable_preemption();
 
    if (!sched_count_proc_in_group(pi->pid)) {
-      pi->pgid = pi->pid;
-      pi->sid = pi->pid;
+      sched_change_pgid_sid(pi, pi->pid, pi->pid);
       pi->proc_tty = NULL;
       rc = pi->sid;
    }
@@ -625,13 +640,26 @@ int sys_setpgid(int pid, int pgid)
          goto out;
       }
 
+      /*
+       * From setpgid(2):
+       *    EPERM An attempt was made to move a process into a process group
+       *    in a different session [...]
+       *
+       * As in Linux, that includes the case of non-existent groups: unless
+       * `pgid` is the pid of the process itself, the group must exist.
+       */
+      if (sid < 0 && pgid != pi->pid) {
+         rc = -EPERM;
+         goto out;
+      }
+
       /* Set process' pgid to `pgid` */
-      pi->pgid = pgid;
+      sched_change_pgid_sid(pi, pgid, pi->sid);
 
    } else {
 
       /* pgid is 0: make the process a group leader */
-      pi->pgid = pi->pid;
+      sched_change_pgid_sid(pi, pi->pid, pi->sid);
    }
 
 out:
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
 #include <tilck/common/basic_defs.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_int.h>
@@ -8,8 +9,10 @@
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/zero_pool.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/errno.h>
+#include <tilck/kernel/pid_table.h>
 
 /* Shared global variables */
 struct task *__current;
@@ -19,15 +22,13 @@ ATOMIC(int) __need_resched;               /* see docs/atomics.md */
 struct task *kernel_process;
 struct process *kernel_process_pi;
 
-/* Task lists */
-struct list runnable_tasks_list;
-
 /* Static variables */
 static struct task *tree_by_tid_root;
-static u64 idle_ticks;
+static struct task *rq_root;             /* runnable tasks, by vruntime */
+static struct task *rq_leftmost;         /* cached first task of the rq */
+static struct list rt_queues[MAX_RT_PRIO + 1];  /* runnable RT tasks, by prio */
+static ulong rt_bitmap[(MAX_RT_PRIO + NBITS) / NBITS];
 static volatile int runnable_tasks_count;
-static int current_max_pid = -1;
-static int current_max_kernel_tid = -1;
 struct task *idle_task;
 
 const char *const task_state_str[5] = {
@@ -38,6 +39,43 @@ const char *const task_state_str[5] = {
    [TASK_STATE_ZOMBIE]   = "zombie",
 };
 
+#define NICE_0_WEIGHT                                  1024
+#define VRUNTIME_SCALE              (NICE_0_WEIGHT * 1024u)
+
+/*
+ * The weight of each nice level, from MIN_NICE to MAX_NICE. It's the same
+ * table used by Linux's CFS: each level is ~1.25x heavier than the next one,
+ * so that a CPU-bound task gets ~10% more CPU time than a task with nice + 1.
+ */
+static const u32 nice_to_weight[NICE_WIDTH] = {
+
+   /* -20 */     88761,     71755,     56483,     46273,     36291,
+   /* -15 */     29154,     23254,     18705,     14949,     11916,
+   /* -10 */      9548,      7620,      6100,      4904,      3906,
+   /*  -5 */      3121,      2501,      1991,      1586,      1277,
+   /*   0 */      1024,       820,       655,       526,       423,
+   /*   5 */       335,       272,       215,       172,       137,
+   /*  10 */       110,        87,        70,        56,        45,
+   /*  15 */        36,        29,        23,        18,        15,
+};
+
+u32 sched_nice_to_weight(int nice)
+{
+   ASSERT(MIN_NICE <= nice && nice <= MAX_NICE);
+   return nice_to_weight[nice - MIN_NICE];
+}
+
+void sched_set_task_nice(struct task *ti, int nice)
+{
+   ASSERT(!is_preemption_enabled());
+
+   /*
+    * The nice value affects only how fast vruntime grows, not the run queue
+    * key itself: therefore, there's no need to re-queue the task here.
+    */
+   ti->nice = CLAMP(nice, MIN_NICE, MAX_NICE);
+}
+
 void enable_preemption(void)
 {
    int oldval =
@@ -101,22 +139,16 @@ get_traced_tasks_count(void)
 
 int sched_count_proc_in_group(int pgid)
 {
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
+   struct process *pos;
+   struct list *members;
    int count = 0;
 
    disable_preemption();
    {
-      bintree_in_order_visit_start(&ctx,
-                                   tree_by_tid_root,
-                                   struct task,
-                                   tree_by_tid_node,
-                                   false);
-
-      while ((ti = bintree_in_order_visit_next(&ctx))) {
-
-         if (ti->pi->pgid == pgid)
+      if ((members = pid_table_get_pgrp_members(pgid))) {
+         list_for_each_ro(pos, members, pgrp_node) {
             count++;
+         }
       }
    }
    enable_preemption();
@@ -125,30 +157,28 @@ int sched_count_proc_in_group(int pgid)
 
 int sched_get_session_of_group(int pgid)
 {
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
+   struct list *members;
    int sid = -ESRCH;
 
    disable_preemption();
    {
-      bintree_in_order_visit_start(&ctx,
-                                   tree_by_tid_root,
-                                   struct task,
-                                   tree_by_tid_node,
-                                   false);
-
-      while ((ti = bintree_in_order_visit_next(&ctx))) {
-
-         if (ti->pi->pgid == pgid) {
-            sid = ti->pi->sid;
-            break;
-         }
-      }
+      if ((members = pid_table_get_pgrp_members(pgid)))
+         sid = list_first_obj(members, struct process, pgrp_node)->sid;
    }
    enable_preemption();
    return sid;
 }
 
+void sched_change_pgid_sid(struct process *pi, int pgid, int sid)
+{
+   ASSERT(!is_preemption_enabled());
+
+   pid_table_remove_process(pi);
+   pi->pgid = pgid;
+   pi->sid = sid;
+   pid_table_add_process(pi);
+}
+
 int get_curr_tid(void)
 {
    struct task *c = get_curr_task();
@@ -161,202 +191,16 @@ int get_curr_pid(void)
    return c ? c->pi->pid : 0;
 }
 
-struct create_pid_visit_ctx {
-
-   bool kernel_tid;
-   bool lowest_avail_invalid;
-   int id_off;
-   int lowest_available;
-   int lowest_after_current_max;
-};
-
-static inline int inc_candicate_if_matches(int *cand, int id, int val)
-{
-   if (*cand != val)
-      return 0; /* Everything is OK */
-
-   /* The lowest_<something> candicate cannot be > id */
-   ASSERT(*cand <= val);
-
-   /*
-    * We've found a case where the candicate is equal to current task's pgid/sid
-    * and that might be a problem.
-    *
-    * Two cases:
-    *
-    *    1) Candidate == id. This means: candidate == pgid/sid == id.
-    *       That's fine: we just hit a group/session leader. By default we'll
-    *       skip this candiate (see the impl. below).
-    *
-    *    2) Candidate < id. This means that the pgid/sid is < id and we didn't
-    *       hit it before (note: we're doing an in-order visit). For example:
-    *
-    *    pid | sid | what
-    *    ----+-----+-----------
-    *     1  |  1  | init
-    *     2  |  1  | ash
-    *     8  |  3  | prog1
-    *
-    *    lowest_available = 3   [our candidate]
-    *
-    *    We don't want this to happen because 3 is the ID of a session, with
-    *    a dead leader. In order to handle this case, we have to increment
-    *    lowest_available and restart the whole iteration. We must end up with
-    *    lowest_available = 4. Actually, if lowest_after_current_max is a good
-    *    value, we're going to use it without restarting the iteration.
-    */
-
-   if (*cand == id)
-      return 0; /* We just hit a group/session leader. That's fine */
-
-   (*cand)++;
-   return 1;
-}
-
-static int create_new_pid_visit_cb(void *obj, void *arg)
-{
-   struct task *ti = obj;
-   struct create_pid_visit_ctx *ctx = arg;
-   const int tid = ti->tid - ctx->id_off;
-
-   if (ctx->kernel_tid) {
-
-      if (!is_kernel_thread(ti))
-         return 0; /* skip non-kernel tasks */
-
-      ASSERT(tid >= 0);
-
-
-   } else {
-
-      if (!is_main_thread(ti))
-         return 0; /* skip threads */
-
-      ASSERT(tid >= 0);
-
-      if (tid < ctx->lowest_available)
-         return 0;
-
-      /*
-       * Both ctx->lowest_available and ctx->lowest_after_current_max are
-       * candidates for the next tid. If one of them gets equal to a sid
-       * without a session leader process or to a pgid without a group leader,
-       * the new process could accidentally become leader of a group/session:
-       * we have to ensure that could never happen.
-       */
-
-      const int pgid = ti->pi->pgid;
-      const int sid = ti->pi->sid;
-      const int should_restart =
-         inc_candicate_if_matches(&ctx->lowest_available, tid, pgid) +
-         inc_candicate_if_matches(&ctx->lowest_available, tid, sid) +
-         inc_candicate_if_matches(&ctx->lowest_after_current_max, tid, pgid) +
-         inc_candicate_if_matches(&ctx->lowest_after_current_max, tid, sid);
-
-      if (should_restart) {
-         ctx->lowest_avail_invalid = true;
-      }
-   }
-
-
-   /*
-    * Algorithm: we start with lowest_available (L) == 0. When we hit
-    * tid == L, that means L is not really the lowest, therefore, we guess
-    * the right value of L is L + 1. The first time tid skips one, for example
-    * jumping from 3 to 5, the value of L set by the iteration with tid == 3,
-    * will stuck. That value will be clearly 4.
-    */
-
-   if (ctx->lowest_available == tid)
-      ctx->lowest_available++;
-
-   /*
-    * For lowest_after_current_max (A) the logic is similar.
-    * We start with A = current_max_pid + 1. The first time A is == tid, will
-    * be when tid is current_max_pid + 1. We continue to update A, until the
-    * first hole is found. In case tid never reaches current_max_pid + 1, `A`
-    * will be just be current_max_pid + 1, as expected.
-    */
-
-   if (ctx->lowest_after_current_max == tid)
-      ctx->lowest_after_current_max++;
-
-   return 0;
-}
-
-static int
-create_id_common(struct create_pid_visit_ctx *ctx, int max_id)
-{
-   int r;
-
-   do {
-
-      ctx->lowest_avail_invalid = false;
-      iterate_over_tasks(&create_new_pid_visit_cb, ctx);
-
-      r = ctx->lowest_after_current_max <= max_id
-            ? ctx->lowest_after_current_max
-            : ctx->lowest_available <= max_id
-               ? ctx->lowest_available
-               : -1;
-
-      /*
-       * Typically, ctx->lowest_avail_invalid is not a problem because the new
-       * id will be ctx->lowest_after_current_max. But, in the case we've
-       * finished the IDs, we have to pick the absolutely lowest ID available,
-       * which might be invalid we it matched with a process' pgid/sid. This
-       * can happen only in case of orphaned sessions/process groups.
-       *
-       * NOTE: in case we're going to repeat the loop, lowest_avail_invalid is
-       * reset, but all the rest of the context is unchanged: that's because
-       * ctx->lowest_available has actually a meaningful value: the lowest ID
-       * after pgid/sid we hit. It doesn't mean we can use this value, but it
-       * means we cannot pick consider IDs smaller than it.
-       */
-
-   } while (r == ctx->lowest_available && ctx->lowest_avail_invalid);
-
-   return r;
-}
-
 int create_new_pid(void)
 {
    ASSERT(!is_preemption_enabled());
-
-   struct create_pid_visit_ctx ctx = {
-      .kernel_tid = false,
-      .id_off = 0,
-      .lowest_available = 0,
-      .lowest_after_current_max = current_max_pid + 1,
-   };
-
-   int r = create_id_common(&ctx, MAX_PID);
-
-   if (r >= 0)
-      current_max_pid = r;
-
-   return r;
+   return pid_table_alloc_pid();
 }
 
 int create_new_kernel_tid(void)
 {
    ASSERT(!is_preemption_enabled());
-
-   struct create_pid_visit_ctx ctx = {
-      .kernel_tid = true,
-      .id_off = KERNEL_TID_START,
-      .lowest_available = 0,
-      .lowest_after_current_max = current_max_kernel_tid + 1,
-   };
-
-   int r = create_id_common(&ctx, KERNEL_MAX_TID);
-
-   if (r >= 0) {
-      current_max_kernel_tid = r;
-      return r + KERNEL_TID_START;
-   }
-
-   return -1;
+   return pid_table_alloc_kernel_tid();
 }
 
 int iterate_over_tasks(bintree_visit_cb func, void *arg)
@@ -376,8 +220,20 @@ static void idle(void)
 
       ASSERT(is_preemption_enabled());
 
-      idle_ticks++;
-      halt();
+      /* Nothing else to do: use the time to pre-zero some pages */
+      if (!need_reschedule() && runnable_tasks_count == 1)
+         zero_pool_on_idle();
+
+      disable_interrupts_forced();
+      {
+         /*
+          * Check if there's anything to run with interrupts disabled: that
+          * way, no task can become runnable between the check and the halt,
+          * as the interrupts are enabled atomically with `hlt`.
+          */
+         timer_idle_halt(!need_reschedule() && runnable_tasks_count == 1);
+      }
+      enable_interrupts_forced();
 
       if (need_reschedule() || runnable_tasks_count > 1)
          schedule();
@@ -402,7 +258,6 @@ static void create_kernel_process(void)
    struct task *s_kernel_ti = (struct task *)kernel_proc_buf;
    struct process *s_kernel_pi = (struct process *)(s_kernel_ti + 1);
 
-   list_init(&runnable_tasks_list);
    s_kernel_pi->pid = create_new_pid();
    s_kernel_ti->tid = create_new_kernel_tid();
    s_kernel_pi->ref_count = 1;
@@ -443,20 +298,43 @@ void process_set_tty(struct process *pi, void *t)
    pi->proc_tty = t;
 }
 
+static void rq_remove(struct task *ti);
+
 void init_sched(void)
 {
+   struct task *ti;
+   ulong var;
    int tid;
 
    ASSERT(kernel_process_pi->pid == 0);
    ASSERT(kernel_process_pi->parent_pid == 0);
 
    kernel_process->pi->pdir = get_kernel_pdir();
+
+   for (int i = 0; i < ARRAY_SIZE(rt_queues); i++)
+      list_init(&rt_queues[i]);
+
    tid = kthread_create(&idle, 0, NULL);
 
    if (tid < 0)
       panic("Unable to create the idle_task!");
 
-   idle_task = get_task(tid);
+   disable_interrupts(&var);
+   {
+      ti = get_task(tid);
+
+      /*
+       * The idle task has been added to the run queue by kthread_create()
+       * before we could know it was the idle task. Take it out: it never
+       * competes with the other tasks and it's just the fall-back choice in
+       * do_schedule(). It's still counted in `runnable_tasks_count`, though.
+       */
+      if (ti->state == TASK_STATE_RUNNABLE)
+         rq_remove(ti);
+
+      idle_task = ti;
+   }
+   enable_interrupts(&var);
 }
 
 void set_current_task_in_kernel(void)
@@ -465,6 +343,152 @@ void set_current_task_in_kernel(void)
    get_curr_task()->running_in_kernel = true;
 }
 
+/*
+ * The run queue is an AVL tree ordered by:
+ *
+ *    1. `rq_timer_ready` (tasks just woken up by a timer come first)
+ *    2. `ticks.vruntime` (lowest first)
+ *    3. the address of the task itself, to make the keys unique
+ *
+ * Because the key is read during the tree operations, the fields above MUST
+ * NOT change while the task is in the run queue: see rq_update_vruntime().
+ */
+static long rq_cmp(const void *a, const void *b)
+{
+   const struct task *t1 = a;
+   const struct task *t2 = b;
+
+   if (t1->rq_timer_ready != t2->rq_timer_ready)
+      return t1->rq_timer_ready ? -1 : 1;
+
+   if (t1->ticks.vruntime != t2->ticks.vruntime)
+      return t1->ticks.vruntime < t2->ticks.vruntime ? -1 : 1;
+
+   if (t1 != t2)
+      return (ulong)t1 < (ulong)t2 ? -1 : 1;
+
+   return 0;
+}
+
+static void rq_insert(struct task *ti)
+{
+   ASSERT(!are_interrupts_enabled());
+   ti->rq_timer_ready = ti->timer_ready;
+   bintree_node_init(&ti->runnable_node);
+
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_insert(&rq_root, ti, &rq_cmp, struct task, runnable_node);
+   ASSERT(success);
+
+   if (!rq_leftmost || rq_cmp(ti, rq_leftmost) < 0)
+      rq_leftmost = ti;
+}
+
+static void rq_remove(struct task *ti)
+{
+   ASSERT(!are_interrupts_enabled());
+
+   DEBUG_ONLY_UNSAFE(void *removed =)
+      bintree_remove(&rq_root, ti, &rq_cmp, struct task, runnable_node);
+   ASSERT(removed == ti);
+
+   if (ti == rq_leftmost)
+      rq_leftmost = bintree_get_first_obj(rq_root, struct task,runnable_node);
+}
+
+static ALWAYS_INLINE bool is_rt_task(struct task *ti)
+{
+   return ti->policy != SCHED_OTHER;
+}
+
+/*
+ * In `rt_bitmap`, the bit N is set when the queue of the priority MAX_RT_PRIO-N
+ * is not empty. Therefore, the first set bit corresponds to the highest
+ * priority runnable RT task.
+ */
+static ALWAYS_INLINE ulong rt_bit(int prio)
+{
+   return 1ul << ((MAX_RT_PRIO - prio) % NBITS);
+}
+
+static ALWAYS_INLINE ulong *rt_bitmap_word(int prio)
+{
+   return &rt_bitmap[(MAX_RT_PRIO - prio) / NBITS];
+}
+
+static void rt_enqueue(struct task *ti)
+{
+   struct list *q = &rt_queues[ti->rt_prio];
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(1 <= ti->rt_prio && ti->rt_prio <= MAX_RT_PRIO);
+
+   /*
+    * Like in Linux, a task preempted by a higher priority task stays at the
+    * head of its queue, while a task that yielded or consumed its RR timeslice
+    * goes to the tail.
+    */
+   if (ti->rt_preempted)
+      list_add_head(q, &ti->rt_node);
+   else
+      list_add_tail(q, &ti->rt_node);
+
+   ti->rt_preempted = false;
+   *rt_bitmap_word(ti->rt_prio) |= rt_bit(ti->rt_prio);
+}
+
+static void rt_dequeue(struct task *ti)
+{
+   ASSERT(!are_interrupts_enabled());
+
+   list_remove(&ti->rt_node);
+   list_node_init(&ti->rt_node);
+
+   if (list_is_empty(&rt_queues[ti->rt_prio]))
+      *rt_bitmap_word(ti->rt_prio) &= ~rt_bit(ti->rt_prio);
+}
+
+/*
+ * Returns the first non-stopped runnable RT task with the highest priority,
+ * considering only the priorities >= `min_prio`.
+ */
+static struct task *rt_get_first_non_stopped(int min_prio)
+{
+   struct task *pos;
+
+   ASSERT(!are_interrupts_enabled());
+
+   for (int w = 0; w < ARRAY_SIZE(rt_bitmap); w++) {
+
+      for (ulong bits = rt_bitmap[w]; bits; bits &= bits - 1) {
+
+         const int idx = w * NBITS + (int)get_first_set_bit_index_l(bits);
+         const int prio = MAX_RT_PRIO - idx;
+
+         if (prio < min_prio)
+            return NULL;
+
+         list_for_each_ro(pos, &rt_queues[prio], rt_node) {
+            if (!pos->stopped)
+               return pos;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+static void rt_check_preempt_curr(struct task *ti)
+{
+   struct task *curr = get_curr_task();
+
+   if (ti == curr)
+      return;
+
+   if (!is_rt_task(curr) || ti->rt_prio > curr->rt_prio)
+      sched_set_need_resched();
+}
+
 static void task_add_to_state_list(struct task *ti)
 {
    if (is_worker_thread(ti))
@@ -473,7 +497,14 @@ static void task_add_to_state_list(struct task *ti)
    switch (atomic_load_explicit(&ti->state, mo_relaxed)) {
 
       case TASK_STATE_RUNNABLE:
-         list_add_tail(&runnable_tasks_list, &ti->runnable_node);
+
+         if (is_rt_task(ti)) {
+            rt_enqueue(ti);
+            rt_check_preempt_curr(ti);
+         } else if (ti != idle_task) {
+            rq_insert(ti);
+         }
+
          runnable_tasks_count++;
          break;
 
@@ -502,7 +533,12 @@ static void task_remove_from_state_list(struct task *ti)
    switch (atomic_load_explicit(&ti->state, mo_relaxed)) {
 
       case TASK_STATE_RUNNABLE:
-         list_remove(&ti->runnable_node);
+
+         if (is_rt_task(ti))
+            rt_dequeue(ti);
+         else if (ti != idle_task)
+            rq_remove(ti);
+
          runnable_tasks_count--;
          ASSERT(runnable_tasks_count >= 0);
          break;
@@ -551,28 +587,67 @@ void task_change_state_idempotent(struct task *ti, enum task_state new_state)
    enable_interrupts(&var);
 }
 
+void sched_set_task_policy(struct task *ti, int policy, int rt_prio)
+{
+   ulong var;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(policy == SCHED_OTHER || policy == SCHED_FIFO || policy == SCHED_RR);
+   ASSERT(policy == SCHED_OTHER ? !rt_prio : rt_prio >= 1);
+   ASSERT(rt_prio <= MAX_RT_PRIO);
+
+   disable_interrupts(&var);
+   {
+      /* The policy and the priority determine the run queue of the task */
+      task_remove_from_state_list(ti);
+      ti->policy = (u8)policy;
+      ti->rt_prio = rt_prio;
+      ti->rt_preempted = false;
+      task_add_to_state_list(ti);
+   }
+   enable_interrupts(&var);
+
+   if (ti == get_curr_task())
+      sched_set_need_resched(); /* it might have lowered its own priority */
+}
+
 void add_task(struct task *ti)
 {
+   ulong var;
    disable_preemption();
    {
-      task_add_to_state_list(ti);
+      disable_interrupts(&var);
+      {
+         task_add_to_state_list(ti);
+      }
+      enable_interrupts(&var);
 
       bintree_insert_ptr(&tree_by_tid_root,
                          ti,
                          struct task,
                          tree_by_tid_node,
                          tid);
+
+      pid_table_add_task(ti);
+
+      if (is_main_thread(ti))
+         pid_table_add_process(ti->pi);
    }
    enable_preemption();
 }
 
 void remove_task(struct task *ti)
 {
+   ulong var;
    disable_preemption();
    {
       ASSERT_TASK_STATE(ti->state, TASK_STATE_ZOMBIE);
 
-      task_remove_from_state_list(ti);
+      disable_interrupts(&var);
+      {
+         task_remove_from_state_list(ti);
+      }
+      enable_interrupts(&var);
 
       bintree_remove_ptr(&tree_by_tid_root,
                          ti,
@@ -580,12 +655,44 @@ void remove_task(struct task *ti)
                          tree_by_tid_node,
                          tid);
 
+      pid_table_remove_task(ti);
+
+      if (is_main_thread(ti))
+         pid_table_remove_process(ti->pi);
+
       free_task(ti);
    }
    enable_preemption();
 }
 
-void sched_account_ticks(void)
+static void rq_update_vruntime(struct task *ti, u64 delta)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      /*
+       * Typically, the current task is RUNNING and, therefore, it's not in the
+       * run queue. But, if it has been woken up (e.g. by an IRQ handler) after
+       * changing its state to SLEEPING and before calling the scheduler, it
+       * might be RUNNABLE: in that case, it has to be re-inserted in the tree
+       * because its key is going to change.
+       */
+
+      const bool in_rq =
+         ti->state == TASK_STATE_RUNNABLE && !is_worker_thread(ti);
+
+      if (in_rq)
+         rq_remove(ti);
+
+      ti->ticks.vruntime += delta;
+
+      if (in_rq)
+         rq_insert(ti);
+   }
+   enable_interrupts(&var);
+}
+
+void sched_account_ticks(u32 n)
 {
    struct task *curr = get_curr_task();
    const enum task_state state = get_curr_task_state();
@@ -596,38 +703,49 @@ void sched_account_ticks(void)
    ASSERT(curr != NULL);
    ASSERT(!is_preemption_enabled());
 
-   t->timeslice++;
-   t->total++;
+   t->timeslice += n;
+   t->total += n;
 
    if (curr->running_in_kernel)
-      t->total_kernel++;
+      t->total_kernel += n;
 
-   if (curr != idle_task) {
+   if (curr != idle_task && !is_rt_task(curr)) {
 
       /*
        * The more currently runnable tasks are, the higher vruntime has to
        * grow: if case of just 1 runnable task (+1 for idle ignored), vruntime
-       * will increase by just +1. In case of 15 runnable tasks, vruntime will
-       * increase by +15. The logic behind is the following: supposing all the
-       * 15 tasks are runnable and they all start with vruntime = 0, after the
-       * first has run, it will have vruntime = 15 * TIME_SLICE_TICKS and will
-       * have to wait until all the other 14 tasks ran until it can be picked
-       * again.
+       * will increase by just +1 unit. In case of 15 runnable tasks, vruntime
+       * will increase by +15 units. The logic behind is the following:
+       * supposing all the 15 tasks are runnable and they all start with
+       * vruntime = 0, after the first has run, it will have vruntime = 15 *
+       * TIME_SLICE_TICKS units and will have to wait until all the other 14
+       * tasks ran until it can be picked again.
        *
        * Now, picking the task with the lowest vruntime will be more fair than
        * picking the task with the lowest `total` number of ticks, because
        * tasks that that consumed 100% of the CPU when no other task was
        * runnable won't be so much penalized.
+       *
+       * Finally, like in CFS, the size of the unit is inversely proportional
+       * to the task's weight: heavier (lower nice) tasks accumulate vruntime
+       * slower and, therefore, get picked more often than lighter ones.
        */
-      t->vruntime += (u64)(runnable_tasks_count - 1);
+      const u32 unit = VRUNTIME_SCALE / sched_nice_to_weight(curr->nice);
+      rq_update_vruntime(curr, (u64)(runnable_tasks_count - 1) * unit * n);
    }
 
    /*
     * need_resched is never set for worker threads when they used too much
     * CPU time: their timeslice is unlimited and can preempted only be another
-    * worker thread.
+    * worker thread. The same applies to SCHED_FIFO tasks, which can be
+    * preempted only by worker threads and higher priority RT tasks.
     */
-   const bool timeout = !is_worker && t->timeslice >= TIME_SLICE_TICKS;
+   const bool timeout =
+      !is_worker &&
+      curr->policy != SCHED_FIFO &&
+      t->timeslice >= (curr->policy == SCHED_RR
+                          ? RR_TIME_SLICE_TICKS
+                          : TIME_SLICE_TICKS);
 
    if (curr->stopped || !is_running || timeout)
       sched_set_need_resched();
@@ -666,27 +784,92 @@ sched_should_return_immediately(struct task *curr, enum task_state curr_state)
 }
 
 static struct task *
-sched_do_select_runnable_task(enum task_state curr_state, bool resched)
+sched_rq_get_first_non_stopped(void)
+{
+   struct bintree_walk_ctx ctx;
+   struct task *pos = rq_leftmost;
+
+   ASSERT(!are_interrupts_enabled());
+
+   /* Fast path: O(1) */
+   if (LIKELY(!pos || !pos->stopped))
+      return pos;
+
+   /*
+    * Slow path: the leftmost task is stopped. Walk the run queue in order
+    * until the first non-stopped task is found. Stopped tasks are few and
+    * rarely stay runnable for long.
+    */
+   bintree_in_order_visit_start(&ctx,
+                                rq_root,
+                                struct task,
+                                runnable_node,
+                                false);
+
+   while ((pos = bintree_in_order_visit_next(&ctx))) {
+      if (!pos->stopped)
+         return pos;
+   }
+
+   return NULL;
+}
+
+static struct task *
+sched_do_select_rt_task(enum task_state curr_state, bool resched)
 {
    struct task *curr = get_curr_task();
-   struct task *selected = NULL;
-   struct task *pos;
+   struct task *selected;
+   int min_prio = 1;
+   ulong var;
 
-   list_for_each_ro(pos, &runnable_tasks_list, runnable_node) {
+   const bool curr_rt_running =
+      curr_state == TASK_STATE_RUNNING && !curr->stopped && is_rt_task(curr);
 
-      ASSERT_TASK_STATE(pos->state, TASK_STATE_RUNNABLE);
+   if (curr_rt_running) {
 
-      if (pos->stopped || pos == idle_task)
-         continue;
+      /*
+       * A running RT task can be preempted only by higher priority tasks or,
+       * if it yielded (or its RR timeslice expired), by another task with the
+       * same priority.
+       */
+      min_prio = curr->rt_prio + (resched ? 0 : 1);
+   }
 
-      if (pos->timer_ready) {
-         selected = pos;
-         break;
-      }
+   disable_interrupts(&var);
+   {
+      selected = rt_get_first_non_stopped(min_prio);
+   }
+   enable_interrupts(&var);
+
+   ASSERT(!selected || selected->state == TASK_STATE_RUNNABLE);
+
+   if (!selected && curr_rt_running)
+      selected = curr;
+
+   return selected;
+}
+
+static struct task *
+sched_do_select_runnable_task(enum task_state curr_state, bool resched)
+{
+   struct task *curr = get_curr_task();
+   struct task *selected;
+   ulong var;
 
-      if (!selected || pos->ticks.vruntime < selected->ticks.vruntime)
-         selected = pos;
+   /*
+    * Timer-woken tasks are always at the beginning of the run queue, followed
+    * by the other tasks ordered by vruntime: see rq_cmp(). Therefore, just
+    * picking the leftmost task gives us the same results as linearly looking
+    * first for a `timer_ready` task and then for the one with the lowest
+    * vruntime.
+    */
+   disable_interrupts(&var);
+   {
+      selected = sched_rq_get_first_non_stopped();
    }
+   enable_interrupts(&var);
+
+   ASSERT(!selected || selected->state == TASK_STATE_RUNNABLE);
 
    /* If there is still no selected task, check for current task */
    if (!selected) {
@@ -700,8 +883,8 @@ sched_do_select_runnable_task(enum task_state curr_state, bool resched)
       /*
        * If need_resched is not set, the caller didn't want necessarily to
        * yield, but just give the scheduler an opportunity to switch the current
-       * task. In the loop avoid, the current task was not included because its
-       * state is typically RUNNING, so it's not present in the runnable_list.
+       * task. Above, the current task was not considered because its state
+       * is typically RUNNING, so it's not present in the run queue.
        */
 
       if (curr_state == TASK_STATE_RUNNING && !curr->stopped)
@@ -731,6 +914,10 @@ void do_schedule(void)
    /* Check for worker threads ready to run */
    selected = wth_get_runnable_thread();
 
+   /* Check for real-time tasks */
+   if (!selected)
+      selected = sched_do_select_rt_task(curr_state, resched);
+
    /* Check for regular runnable tasks */
    if (!selected) {
 
@@ -746,8 +933,16 @@ void do_schedule(void)
       ASSERT(!selected->stopped);
 
       /* If we preempted the process, it is still `running` */
-      if (curr_state == TASK_STATE_RUNNING)
+      if (curr_state == TASK_STATE_RUNNING) {
+
+         if (is_rt_task(curr)) {
+            curr->rt_preempted =
+               is_worker_thread(selected) ||
+               (is_rt_task(selected) && selected->rt_prio > curr->rt_prio);
+         }
+
          task_change_state(curr, TASK_STATE_RUNNABLE);
+      }
 
       /* A task switch is required */
       switch_to_task(selected);
@@ -769,17 +964,8 @@ void do_schedule(void)
 
 struct task *get_task(int tid)
 {
-   long ltid = tid;
-   struct task *res = NULL;
    ASSERT(!is_preemption_enabled());
-
-   res = bintree_find_ptr(tree_by_tid_root,
-                          ltid,
-                          struct task,
-                          tree_by_tid_node,
-                          tid);
-
-   return res;
+   return pid_table_get_task(tid);
 }
 
 struct process *get_process(int pid)
@@ -800,93 +986,88 @@ bool in_currently_dying_task(void)
    return get_curr_task_state() == TASK_STATE_ZOMBIE;
 }
 
-int send_signal_to_group(int pgid, int sig)
-{
-   struct process *curr_pi = get_curr_proc();
-   struct process *leader = NULL;
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
-   int count = 0;
-
-   disable_preemption();
-
-   bintree_in_order_visit_start(&ctx,
-                                tree_by_tid_root,
-                                struct task,
-                                tree_by_tid_node,
-                                false);
-
-   while ((ti = bintree_in_order_visit_next(&ctx))) {
-
-      struct process *pi = ti->pi;
+struct signal_members_ctx {
 
-      if (pi->pgid == pgid && pi != curr_pi && pi->pid != 1) {
-
-         if (pi->pid != pgid)
-            send_signal(pi->pid, sig, true);
-         else
-            leader = pi;
+   struct process *curr_pi;
+   struct process *leader;
+   bool curr_is_member;
+   int id;
+   int sig;
+   int count;
+};
 
-         count++;
-      }
+static void
+signal_member(struct signal_members_ctx *ctx, struct process *pi)
+{
+   if (pi == ctx->curr_pi) {
+      ctx->curr_is_member = true;
+      return;
    }
 
-   if (leader)
-      send_signal(leader->pid, sig, true); /* kill the leader last */
-
-   enable_preemption();
-
-   if (curr_pi->pgid == pgid) {
+   if (pi->pid == 1)
+      return;
 
-      /* kill the current process, as _very_ last */
-      send_signal(curr_pi->pid, sig, true);
-      count++;
-   }
+   if (pi->pid != ctx->id)
+      send_signal(pi->pid, ctx->sig, true);
+   else
+      ctx->leader = pi;
 
-   return count > 0 ? 0 : -ESRCH;
+   ctx->count++;
 }
 
-int send_signal_to_session(int sid, int sig)
+static int send_signal_to_members(int id, int sig, bool session)
 {
-   struct process *curr_pi = get_curr_proc();
-   struct process *leader = NULL;
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
-   int count = 0;
-
-   disable_preemption();
-
-   bintree_in_order_visit_start(&ctx,
-                                tree_by_tid_root,
-                                struct task,
-                                tree_by_tid_node,
-                                false);
+   struct signal_members_ctx ctx = {
+      .curr_pi = get_curr_proc(),
+      .leader = NULL,
+      .curr_is_member = false,
+      .id = id,
+      .sig = sig,
+      .count = 0,
+   };
 
-   while ((ti = bintree_in_order_visit_next(&ctx))) {
+   struct list *members;
+   struct process *pi;
 
-      struct process *pi = ti->pi;
+   disable_preemption();
 
-      if (pi->pgid == sid && pi != curr_pi && pi->pid != 1) {
+   members = session
+      ? pid_table_get_session_members(id)
+      : pid_table_get_pgrp_members(id);
 
-         if (pi->pid != sid)
-            send_signal(pi->pid, sig, true);
-         else
-            leader = pi;
+   if (!members)
+      goto out;
 
-         count++;
-      }
+   if (session) {
+      list_for_each_ro(pi, members, session_node)
+         signal_member(&ctx, pi);
+   } else {
+      list_for_each_ro(pi, members, pgrp_node)
+         signal_member(&ctx, pi);
    }
 
-   if (leader)
-      send_signal(leader->pid, sig, true); /* kill the leader last */
+   if (ctx.leader)
+      send_signal(ctx.leader->pid, sig, true); /* kill the leader last */
 
+out:
    enable_preemption();
 
-   /* kill the current process, as _very_ last */
-   if (curr_pi->pgid == sid) {
-      send_signal(curr_pi->pid, sig, true);
-      count++;
+   if (ctx.curr_is_member) {
+
+      /* kill the current process, as _very_ last */
+      send_signal(ctx.curr_pi->pid, sig, true);
+      ctx.count++;
    }
 
-   return count > 0 ? 0 : -ESRCH;
+   return ctx.count > 0 ? 0 : -ESRCH;
+}
+
+int send_signal_to_group(int pgid, int sig)
+{
+   return send_signal_to_members(pgid, sig, false);
+}
+
+int send_signal_to_session(int sid, int sig)
+{
+   return send_signal_to_members(sid, sig, true);
 }
@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/pid_table.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/datetime.h>
+
+typedef void (*prio_task_cb)(struct task *ti, void *arg);
+
+struct prio_visit_ctx {
+   prio_task_cb cb;
+   void *arg;
+   int count;
+};
+
+static int prio_visit_user_task(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct prio_visit_ctx *ctx = arg;
+
+   if (!is_kernel_thread(ti) && ti->state != TASK_STATE_ZOMBIE) {
+      ctx->cb(ti, ctx->arg);
+      ctx->count++;
+   }
+
+   return 0;
+}
+
+/*
+ * Call `cb` on each task matching the (which, who) pair, as defined in
+ * getpriority(2). Returns the number of matching tasks or -EINVAL.
+ * Must be called with preemption disabled.
+ */
+static int
+prio_for_each_task(int which, int who, prio_task_cb cb, void *arg)
+{
+   struct prio_visit_ctx ctx = { .cb = cb, .arg = arg, .count = 0 };
+   struct process *pos;
+   struct list *members;
+   struct task *ti;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (who < 0)
+      return -EINVAL;
+
+   switch (which) {
+
+      case PRIO_PROCESS:
+
+         if ((ti = who ? get_task(who) : get_curr_task()))
+            prio_visit_user_task(ti, &ctx);
+
+         break;
+
+      case PRIO_PGRP:
+
+         who = who ? who : get_curr_proc()->pgid;
+         members = pid_table_get_pgrp_members(who);
+
+         if (members) {
+            list_for_each_ro(pos, members, pgrp_node) {
+               prio_visit_user_task(get_process_task(pos), &ctx);
+            }
+         }
+
+         break;
+
+      case PRIO_USER:
+
+         /* Only the root user (uid 0) exists: see auth.c */
+         if (who == 0)
+            iterate_over_tasks(&prio_visit_user_task, &ctx);
+
+         break;
+
+      default:
+         return -EINVAL;
+   }
+
+   return ctx.count;
+}
+
+static void prio_get_min_nice_cb(struct task *ti, void *arg)
+{
+   int *min_nice = arg;
+   *min_nice = MIN(*min_nice, ti->nice);
+}
+
+static void prio_set_nice_cb(struct task *ti, void *arg)
+{
+   sched_set_task_nice(ti, *(int *)arg);
+}
+
+int sys_getpriority(int which, int who)
+{
+   int min_nice = MAX_NICE;
+   int rc;
+
+   disable_preemption();
+   {
+      rc = prio_for_each_task(which, who, &prio_get_min_nice_cb, &min_nice);
+   }
+   enable_preemption();
+
+   if (rc < 0)
+      return rc;
+
+   if (!rc)
+      return -ESRCH;
+
+   /*
+    * Like Linux, return the nice value of the highest priority matching task
+    * in the range [1, 40] (20 - nice) in order to avoid negative values, which
+    * would be interpreted as errors. The libc converts it back.
+    */
+   return 20 - min_nice;
+}
+
+int sys_setpriority(int which, int who, int prio)
+{
+   int nice = CLAMP(prio, MIN_NICE, MAX_NICE);
+   int rc;
+
+   disable_preemption();
+   {
+      rc = prio_for_each_task(which, who, &prio_set_nice_cb, &nice);
+   }
+   enable_preemption();
+
+   if (rc < 0)
+      return rc;
+
+   return rc > 0 ? 0 : -ESRCH;
+}
+
+int sys_nice(int inc)
+{
+   struct task *curr = get_curr_task();
+
+   /*
+    * No permission checks: only the root user exists. Also, like Linux, clamp
+    * the increment first, to avoid overflows.
+    */
+   inc = CLAMP(inc, -NICE_WIDTH, NICE_WIDTH);
+
+   disable_preemption();
+   {
+      sched_set_task_nice(curr, curr->nice + inc);
+   }
+   enable_preemption();
+   return 0;
+}
+
+static struct task *sched_get_user_task(int pid)
+{
+   struct task *ti;
+   ASSERT(!is_preemption_enabled());
+
+   ti = pid ? get_task(pid) : get_curr_task();
+
+   if (!ti || is_kernel_thread(ti) || ti->state == TASK_STATE_ZOMBIE)
+      return NULL;
+
+   return ti;
+}
+
+static int sched_check_policy_prio(int policy, int prio)
+{
+   switch (policy) {
+
+      case SCHED_OTHER:
+         return prio == 0 ? 0 : -EINVAL;
+
+      case SCHED_FIFO:
+      case SCHED_RR:
+         return IN_RANGE_INC(prio, 1, MAX_RT_PRIO) ? 0 : -EINVAL;
+
+      default:
+         /* SCHED_BATCH, SCHED_IDLE and SCHED_DEADLINE are not supported */
+         return -EINVAL;
+   }
+}
+
+/* policy < 0 means: keep the current policy (sched_setparam) */
+static int
+do_sched_setscheduler(int pid, int policy, const struct k_sched_param *u_param)
+{
+   struct k_sched_param param;
+   struct task *ti;
+   int rc;
+
+   if (pid < 0 || !u_param)
+      return -EINVAL;
+
+   if (copy_from_user(&param, u_param, sizeof(param)))
+      return -EFAULT;
+
+   disable_preemption();
+   {
+      if ((ti = sched_get_user_task(pid))) {
+
+         if (policy < 0)
+            policy = ti->policy;
+
+         rc = sched_check_policy_prio(policy, param.sched_priority);
+
+         if (!rc)
+            sched_set_task_policy(ti, policy, param.sched_priority);
+
+      } else {
+
+         rc = -ESRCH;
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
+int sys_sched_setscheduler(int pid,
+                           int policy,
+                           const struct k_sched_param *u_param)
+{
+   if (policy < 0)
+      return -EINVAL;
+
+   return do_sched_setscheduler(pid, policy, u_param);
+}
+
+int sys_sched_setparam(int pid, const struct k_sched_param *u_param)
+{
+   return do_sched_setscheduler(pid, -1, u_param);
+}
+
+int sys_sched_getscheduler(int pid)
+{
+   struct task *ti;
+   int rc;
+
+   if (pid < 0)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      ti = sched_get_user_task(pid);
+      rc = ti ? ti->policy : -ESRCH;
+   }
+   enable_preemption();
+   return rc;
+}
+
+int sys_sched_getparam(int pid, struct k_sched_param *u_param)
+{
+   struct k_sched_param param;
+   struct task *ti;
+
+   if (pid < 0 || !u_param)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      ti = sched_get_user_task(pid);
+      param.sched_priority = ti ? ti->rt_prio : 0;
+   }
+   enable_preemption();
+
+   if (!ti)
+      return -ESRCH;
+
+   if (copy_to_user(u_param, &param, sizeof(param)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_sched_get_priority_max(int policy)
+{
+   switch (policy) {
+
+      case SCHED_FIFO:
+      case SCHED_RR:
+         return MAX_RT_PRIO;
+
+      case SCHED_OTHER:
+         return 0;
+
+      default:
+         return -EINVAL;
+   }
+}
+
+int sys_sched_get_priority_min(int policy)
+{
+   switch (policy) {
+
+      case SCHED_FIFO:
+      case SCHED_RR:
+         return 1;
+
+      case SCHED_OTHER:
+         return 0;
+
+      default:
+         return -EINVAL;
+   }
+}
+
+static int do_sched_rr_get_interval(int pid, struct k_timespec64 *interval)
+{
+   struct task *ti;
+   u32 ticks = 0;
+
+   if (pid < 0)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      if ((ti = sched_get_user_task(pid))) {
+
+         if (ti->policy == SCHED_RR)
+            ticks = RR_TIME_SLICE_TICKS;
+         else if (ti->policy == SCHED_OTHER)
+            ticks = TIME_SLICE_TICKS;
+      }
+   }
+   enable_preemption();
+
+   if (!ti)
+      return -ESRCH;
+
+   /* SCHED_FIFO tasks have no timeslice: report 0, like Linux */
+   ticks_to_timespec(ticks, interval);
+   return 0;
+}
+
+int sys_sched_rr_get_interval(int pid, struct k_timespec64 *u_interval)
+{
+   struct k_timespec64 ts;
+   int rc;
+
+   if ((rc = do_sched_rr_get_interval(pid, &ts)))
+      return rc;
+
+   if (copy_to_user(u_interval, &ts, sizeof(ts)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_sched_rr_get_interval_time32(int pid, struct k_timespec32 *u_interval)
+{
+   struct k_timespec64 ts;
+   struct k_timespec32 ts32;
+   int rc;
+
+   if ((rc = do_sched_rr_get_interval(pid, &ts)))
+      return rc;
+
+   ts32 = (struct k_timespec32) {
+      .tv_sec = (s32) ts.tv_sec,
+      .tv_nsec = ts.tv_nsec,
+   };
+
+   if (copy_to_user(u_interval, &ts32, sizeof(ts32)))
+      return -EFAULT;
+
+   return 0;
+}
@@ -24,21 +24,19 @@
 #define LINUX_REBOOT_CMD_HALT       0xcdef0123
 #define LINUX_REBOOT_CMD_POWER_OFF  0x4321fedc
 
-int sys_madvise(void *addr, size_t len, int advice)
-{
-   // TODO (future): consider implementing at least part of sys_madvice().
-   return 0;
-}
-
 int
 do_nanosleep(const struct k_timespec64 *req, struct k_timespec64 *rem)
 {
-   u64 ticks_to_sleep;
-   u64 exp_wake_up_ticks;
+   u64 ns_to_sleep;
+   u64 exp_wake_up_time;
+   u64 now;
+
+   if (req->tv_sec < 0 || !IN_RANGE(req->tv_nsec, 0, BILLION))
+      return -EINVAL;
 
-   ticks_to_sleep = timespec_to_ticks(req);
-   exp_wake_up_ticks = get_ticks() + ticks_to_sleep;
-   kernel_sleep(ticks_to_sleep);
+   ns_to_sleep = (u64)req->tv_sec * BILLION + (u64)req->tv_nsec;
+   exp_wake_up_time = get_sys_time_hr() + ns_to_sleep;
+   kernel_sleep_ns(ns_to_sleep);
 
    /* After wake-up */
    rem->tv_sec = 0;
@@ -46,10 +44,12 @@ do_nanosleep(const struct k_timespec64 *req, struct k_timespec64 *rem)
 
    if (pending_signals()) {
 
-      u64 ticks = get_ticks();
+      now = get_sys_time_hr();
 
-      if (ticks < exp_wake_up_ticks)
-         ticks_to_timespec(exp_wake_up_ticks - ticks, rem);
+      if (now < exp_wake_up_time) {
+         rem->tv_sec = (s64)((exp_wake_up_time - now) / BILLION);
+         rem->tv_nsec = (long)((exp_wake_up_time - now) % BILLION);
+      }
 
       return -EINTR;
    }
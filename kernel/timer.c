@@ -5,11 +5,16 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/atomics.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/timer.h>
+#include <tilck/kernel/ktimer.h>
+#include <tilck/kernel/hrtimer.h>
+#include <tilck/kernel/clocksource.h>
+#include <tilck/kernel/vdso.h>
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/datetime.h>
@@ -32,11 +37,18 @@ u32 slow_timer_irq_handler_count;
 volatile ATOMIC(u32) __bogo_loops;
 
 /* Static variables */
-static struct list timer_wakeup_list = STATIC_LIST_INIT(timer_wakeup_list);
 static u32 loops_per_tick;         /* Tilck bogoMips as loops/tick    */
 static u32 loops_per_ms = 5000000; /* loops/millisecond (initial val)  */
 static u32 loops_per_us = 5000;    /* loops/microsecond (initial val) */
 
+/* Dynamic tick (KRN_NO_HZ_IDLE) */
+static bool nohz_active;           /* the idle task stopped the tick */
+static struct idle_stats idle_stats;
+
+/* Timer IRQs nested in timer_irq_handler(), left to the outer handler */
+static bool deferred_irq;
+static u32 deferred_ticks;
+
 u64 get_ticks(void)
 {
    u64 curr_ticks;
@@ -50,21 +62,81 @@ u64 get_ticks(void)
    return curr_ticks;
 }
 
+static void task_wakeup(struct task *ti)
+{
+   ASSERT(!are_interrupts_enabled());
+
+   ti->timer_ready = true;
+
+   if (ti->state == TASK_STATE_SLEEPING) {
+      task_change_state(ti, TASK_STATE_RUNNABLE);
+      sched_set_need_resched();
+   }
+}
+
+static void task_arm_wakeup_timer_ns(struct task *ti, u64 ns)
+{
+   const u64 ticks = ns / __tick_duration;
+
+   if (ticks > 0)
+      ktimer_start(&ti->wakeup_timer, (u32)MIN(ticks, UINT32_MAX));
+   else
+      hrtimer_start(&ti->wakeup_hrtimer, ns);
+}
+
+static void task_wakeup_timer_expired(struct ktimer *t)
+{
+   struct task *ti = t->arg;
+   u64 now;
+
+   if (ti->wakeup_deadline) {
+
+      now = get_sys_time_hr();
+
+      if (now < ti->wakeup_deadline) {
+         task_arm_wakeup_timer_ns(ti, ti->wakeup_deadline - now);
+         return;
+      }
+   }
+
+   task_wakeup(ti);
+}
+
+static void task_wakeup_hrtimer_expired(struct hrtimer *t)
+{
+   task_wakeup(t->arg);
+}
+
+void task_init_wakeup_timer(struct task *ti)
+{
+   ti->wakeup_deadline = 0;
+   ktimer_init(&ti->wakeup_timer, &task_wakeup_timer_expired, ti);
+   hrtimer_init(&ti->wakeup_hrtimer, &task_wakeup_hrtimer_expired, ti);
+}
+
 void task_set_wakeup_timer(struct task *ti, u32 ticks)
 {
-   ulong var;
    ASSERT(ticks > 0);
+   ti->wakeup_deadline = 0;
+   ktimer_start(&ti->wakeup_timer, ticks);
+}
 
+/*
+ * The whole ticks of the timeout are waited on the ktimer wheel, which is
+ * O(1): only the sub-tick remainder goes in the sorted list of the hrtimers,
+ * once the wheel timer expired (see task_wakeup_timer_expired()). This way,
+ * the hrtimer list contains only the timers expiring within the next tick.
+ */
+void task_set_wakeup_timer_ns(struct task *ti, u64 ns)
+{
+   ulong var;
    disable_interrupts(&var);
    {
-      if (ti->ticks_before_wake_up == 0) {
-         ASSERT(!list_is_node_in_list(&ti->wakeup_timer_node));
-         list_add_tail(&timer_wakeup_list, &ti->wakeup_timer_node);
-      } else {
-         ASSERT(list_is_node_in_list(&ti->wakeup_timer_node));
-      }
+      ktimer_cancel(&ti->wakeup_timer);
+      hrtimer_cancel(&ti->wakeup_hrtimer);
 
-      ti->ticks_before_wake_up = ticks;
+      ti->wakeup_deadline = get_sys_time_hr() + ns;
+      task_arm_wakeup_timer_ns(ti, ns);
    }
    enable_interrupts(&var);
 }
@@ -76,102 +148,52 @@ void task_update_wakeup_timer_if_any(struct task *ti, u32 new_ticks)
 
    disable_interrupts(&var);
    {
-      if (ti->ticks_before_wake_up > 0) {
-         ASSERT(list_is_node_in_list(&ti->wakeup_timer_node));
-         ti->ticks_before_wake_up = new_ticks;
+      if (ktimer_is_active(&ti->wakeup_timer)) {
+         ti->wakeup_deadline = 0;
+         ktimer_start(&ti->wakeup_timer, new_ticks);
       }
    }
    enable_interrupts(&var);
 }
 
-u32 task_cancel_wakeup_timer(struct task *ti)
+/* Cancel the wake-up timer, if any: returns the ns it had before expiring */
+u64 task_cancel_wakeup_timer_ns(struct task *ti)
 {
    ulong var;
-   u32 old;
+   u64 old, now;
+   u32 ticks;
+
    disable_interrupts(&var);
    {
-      old = ti->ticks_before_wake_up;
+      ticks = ktimer_cancel(&ti->wakeup_timer);
+      old = hrtimer_cancel(&ti->wakeup_hrtimer);
 
-      if (old > 0) {
-         ti->timer_ready = false;
-         ti->ticks_before_wake_up = 0;
-         list_remove(&ti->wakeup_timer_node);
-      }
-   }
-   enable_interrupts(&var);
-   return old;
-}
+      if (ti->wakeup_deadline) {
 
-static void tick_all_timers(void)
-{
-   struct task *pos, *temp;
-   bool any_woken_up_task = false;
-   ulong var;
+         now = get_sys_time_hr();
 
-   /*
-    * This is *NOT* the best we can do. In particular, it's terrible to keep
-    * the interrupts disabled while iterating the _whole_ timer_wakeup_list.
-    *
-    * Possible better solutions
-    * -----------------------------
-    * 1. Keep the tasks to wake-up in a sort of ordered list and then use
-    * relative timers. This way, at each tick we'll have to decrement just one
-    * single counter. We'll start decrement the next counter only when the first
-    * counter reaches 0 and its list node is removed. Of course, if we cannot
-    * use kmalloc() in case of sleep, it gets much harder to create such an
-    * ordered list and make it live inside a member of struct task. Maybe a BST
-    * will do the job, but that would require paying O(logN) per tick for
-    * finding the earliest timer. Not sure how better would be now for N < 50
-    * (typical), given the huge added constant for the BST functions. Also, the
-    * cancellation of a timer would require some extra effort in order to
-    * re-calculate the relative timer values, while we want the cancellation to
-    * be light-fast because it's run by IRQ handlers.
-    *
-    * 2. Use a fixed number of wakeup lists like: short-term, mid-term and
-    * long-term. Current task's wakeup list node will be placed in one those
-    * lists, depending on far in the future the task is supposted to be woke up.
-    * On every tick, here in tick_all_timers(), ONLY the short-term list will be
-    * iterated. That's a considerable improvement. In a system, there might be
-    * even 1,000 active timers, but how many of them will expire in the next
-    * second? Only a small percentage of them. To further improve the
-    * scalability, it's possible to have even more than 3 lists, or to further
-    * reduce the time-horizon of the short-term list. Periodically, but NOT on
-    * every tick, the `ticks_before_wake_up` field belonging to tasks in the
-    * other wakeup lists will adjusted with bigger decrements and tasks will be
-    * moved from one list to another. That will also happen in case the wakeup
-    * timer is changed for task with an already active timer. This solution
-    * looks much better than solution 1.
-    *
-    * Conclusion
-    * ---------------------
-    * For the moment, given the very limited scale of Tilck (tens of tasks at
-    * most running on the whole system), the current solution is safe and
-    * good-enough but, at some point, a smarter ad-hoc solution should be
-    * devised. Probably solution 2 is the right candidate.
-    */
-   disable_interrupts(&var);
+         if (ticks > 0 && now < ti->wakeup_deadline)
+            old = ti->wakeup_deadline - now;
 
-   list_for_each(pos, temp, &timer_wakeup_list, wakeup_timer_node) {
+         ti->wakeup_deadline = 0;
 
-      /* If task is part of this list, it's counter must be > 0 */
-      ASSERT(pos->ticks_before_wake_up > 0);
-
-      if (UNLIKELY(--pos->ticks_before_wake_up == 0)) {
-
-         pos->timer_ready = true;
-         list_remove(&pos->wakeup_timer_node);
+      } else {
 
-         if (pos->state == TASK_STATE_SLEEPING) {
-            task_change_state(pos, TASK_STATE_RUNNABLE);
-            any_woken_up_task = true;
-         }
+         old += (u64)ticks * __tick_duration;
       }
-   }
 
+      if (old > 0)
+         ti->timer_ready = false;
+   }
    enable_interrupts(&var);
+   return old;
+}
 
-   if (any_woken_up_task)
-      sched_set_need_resched();
+/* Same as above, but returns the ticks (rounded up) before expiring */
+u32 task_cancel_wakeup_timer(struct task *ti)
+{
+   const u64 ns = task_cancel_wakeup_timer_ns(ti);
+   return (u32)MIN(div_round_up64(ns, __tick_duration), UINT32_MAX);
 }
 
 static void do_sleep_internal(u32 ticks)
@@ -213,14 +235,14 @@ void kernel_sleep(u64 ticks)
     *    }
     *    kernel_yield();
     *
-    * But that would require task->ticks_before_wake_up to be actually 64-bit,
-    * wide and that's bad on 32-bit systems because:
+    * But that would require ktimer_start() to accept 64-bit tick counts
+    * and that's bad on 32-bit systems because:
     *
     *    - it would require using the soft 64-bit integers (slow)
     *    - it would make impossible, in the case we wanted that, the counter
     *      to be atomic.
     *
-    * Therefore, in order to use a 32-bit value for 'ticks_before_wake_up' and,
+    * Therefore, in order to use a 32-bit value for the timer ticks and,
     * at the same time being able to sleep for more than 2^32-1 ticks, we need
     * a more tricky implementation (below), and the little extra runtime price
     * for it is totally fine, since we're going to sleep anyways!
@@ -229,7 +251,7 @@ void kernel_sleep(u64 ticks)
     * ----------------------
     *
     * The simpler way to explain the algorithm is to just assume everything
-    * is in base 10 and that ticks_before_wake_up has 2 digits, while we want
+    * is in base 10 and that the tick counter has 2 digits, while we want
     * to support 4 digits sleep time. For example, we want to sleep for 234
     * ticks. The algorithm first computes 534 % 100 = 34 and then 534 / 100 = 5.
     * After that, it sleeps q (= 5) times for 99 ticks (max allowed). Clearly,
@@ -274,6 +296,33 @@ void kernel_sleep_ms(u64 ms)
    kernel_sleep(MAX(1u, ms_to_ticks(ms)));
 }
 
+/*
+ * Sleep for `ns` nanoseconds, using a hrtimer: unlike kernel_sleep(), it is
+ * not limited by the tick granularity.
+ */
+void kernel_sleep_ns(u64 ns)
+{
+   struct task *curr = get_curr_task();
+
+   if (in_panic())
+      return;   /* See kernel_sleep() */
+
+   DEBUG_ONLY(check_not_in_irq_handler());
+
+   if (!ns) {
+      kernel_yield();
+      return;
+   }
+
+   disable_preemption();
+   task_change_state(curr, TASK_STATE_SLEEPING);
+   task_set_wakeup_timer_ns(curr, ns);
+   kernel_yield_preempt_disabled();
+
+   /* We might have been woken up by a signal */
+   task_cancel_wakeup_timer(curr);
+}
+
 static ALWAYS_INLINE bool timer_nested_irq(void)
 {
    bool res = false;
@@ -294,14 +343,11 @@ static ALWAYS_INLINE bool timer_nested_irq(void)
    return res;
 }
 
-static enum irq_action timer_irq_handler(void *ctx)
+static void timer_advance_clock(u32 n)
 {
-   u32 ns_delta;
-   ASSERT(are_interrupts_enabled());
-
-   if (KRN_TRACK_NESTED_INTERR)
-      if (timer_nested_irq())
-         return IRQ_HANDLED;
+   u64 ns_delta = 0;
+   u32 next_tick_ns;
+   ulong var;
 
    /*
     * Compute `ns_delta` by reading `__tick_duration` and `__tick_adj_val` here
@@ -312,16 +358,25 @@ static enum irq_action timer_irq_handler(void *ctx)
     *    2. `__tick_adj_val` is changed only by datetime.c while keeping
     *       interrupts disabled and it's read only here. Nested timer IRQs
     *       will be ignored (see above). No other IRQ handler should read it.
+    *       The idle task calls us with interrupts disabled (see below).
     */
 
-   if (__tick_adj_ticks_rem) {
-      ns_delta = (u32)((s32)__tick_duration + __tick_adj_val);
-      __tick_adj_ticks_rem--;
-   } else {
-      ns_delta = __tick_duration;
+   for (u32 i = 0; i < n; i++) {
+
+      if (__tick_adj_ticks_rem) {
+         ns_delta += (u32)((s32)__tick_duration + __tick_adj_val);
+         __tick_adj_ticks_rem--;
+      } else {
+         ns_delta += __tick_duration;
+      }
    }
 
-   disable_interrupts_forced();
+   if (__tick_adj_ticks_rem)
+      next_tick_ns = (u32)((s32)__tick_duration + __tick_adj_val);
+   else
+      next_tick_ns = __tick_duration;
+
+   disable_interrupts(&var);
    {
       /*
        * Alter __ticks and __time_ns here, while keeping the interrupts disabled
@@ -329,13 +384,193 @@ static enum irq_action timer_irq_handler(void *ctx)
        * above, `__tick_adj_val` and `__tick_adj_ticks_rem` will never need to
        * be read or written by IRQ handlers.
        */
-      __ticks++;
+      __ticks += n;
       __time_ns += ns_delta;
+
+      /* Re-sync the clocksource (if any) with the tick-based time */
+      clocksource_update(__time_ns + hw_timer_get_elapsed_ns(),
+                         next_tick_ns,
+                         __tick_duration);
+
+      vdso_update_time();
+   }
+   enable_interrupts(&var);
+}
+
+static void timer_advance(u32 n)
+{
+   timer_advance_clock(n);
+   sched_account_ticks(n);
+   ktimer_tick(n);
+}
+
+/*
+ * Program the hardware timer in one-shot mode, if the next timer event is
+ * before the next tick (hrtimers) or, when `stop_tick` is true, if it's more
+ * than one tick away (tickless idle). Returns true if the one-shot mode has
+ * been used. Expects interrupts to be disabled.
+ */
+static bool timer_setup_next_event(bool stop_tick)
+{
+   const u64 tick_ns = __tick_duration;
+   u64 ns;
+   u32 ticks;
+
+   ASSERT(!are_interrupts_enabled());
+
+   /* The bogoMips measurement requires every single tick */
+   if (!loops_per_tick || in_panic())
+      return false;
+
+   ns = hrtimer_get_next_delta();
+
+   if (stop_tick) {
+      ticks = ktimer_get_next_expiry(hw_timer_max_oneshot_ticks());
+      ns = MIN(ns, ticks * tick_ns);
+   }
+
+   if (ns < tick_ns || (stop_tick && ns > tick_ns)) {
+      hw_timer_setup_oneshot((u32)ns);
+      return true;
+   }
+
+   return false;
+}
+
+/* Called when a new hrtimer became the first one to expire */
+void timer_update_next_event(void)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      timer_setup_next_event(false);
+   }
+   enable_interrupts(&var);
+}
+
+/*
+ * Account `ticks` ticks, run the expired timers and program the next timer
+ * event, if necessary. Requires preemption to be disabled.
+ */
+static void timer_process(u32 ticks)
+{
+   ulong var;
+
+   if (ticks)
+      timer_advance(ticks);
+
+   disable_interrupts(&var);
+   {
+      hrtimer_run_expired();
+
+      if (!hw_timer_is_oneshot())
+         timer_setup_next_event(false);
+   }
+   enable_interrupts(&var);
+}
+
+/*
+ * Halt the CPU until the next IRQ. Called by the idle task with interrupts
+ * disabled: when `stop_tick` is true, there's nothing else to run and the
+ * periodic tick can be stopped until the first timer expires.
+ */
+void timer_idle_halt(bool stop_tick)
+{
+   u32 ticks;
+   ASSERT(!are_interrupts_enabled());
+
+   if (KRN_NO_HZ_IDLE && stop_tick && timer_setup_next_event(true)) {
+      nohz_active = true;
+      idle_stats.nohz_halts++;
+   }
+
+   idle_stats.halts++;
+   enable_interrupts_and_halt();
+   disable_interrupts_forced();
+
+   if (nohz_active) {
+
+      /*
+       * Woken up by an IRQ other than the timer: restore the periodic tick
+       * and catch up with the ticks elapsed so far. Note: it's safe to do that
+       * with interrupts disabled because the functions below all use
+       * disable_interrupts().
+       */
+      ticks = hw_timer_stop_oneshot();
+      nohz_active = false;
+      idle_stats.nohz_ticks += ticks;
+
+      disable_preemption();
+      {
+         timer_process(ticks);
+      }
+      enable_preemption_nosched();
+   }
+}
+
+void timer_get_idle_stats(struct idle_stats *stats)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      *stats = idle_stats;
+   }
+   enable_interrupts(&var);
+}
+
+static enum irq_action timer_irq_handler(void *ctx)
+{
+   bool again;
+   u32 ticks;
+   ASSERT(are_interrupts_enabled());
+
+   /*
+    * Always ack the IRQ first, even when nested: the hardware timer might
+    * need to be switched back to periodic mode.
+    */
+   disable_interrupts_forced();
+   {
+      ticks = hw_timer_ack_irq();
+
+      if (nohz_active && !hw_timer_is_oneshot()) {
+         nohz_active = false;
+         idle_stats.nohz_ticks += ticks;
+         idle_stats.nohz_expired++;
+      }
    }
    enable_interrupts_forced();
 
-   sched_account_ticks();
-   tick_all_timers();
+   if (KRN_TRACK_NESTED_INTERR && timer_nested_irq()) {
+
+      /*
+       * The ticks just acked must not be lost: with one-shot multi-tick
+       * periods, that would mean losing whole periods. Leave them to the
+       * outer handler, which will process them before returning.
+       */
+      disable_interrupts_forced();
+      {
+         deferred_irq = true;
+         deferred_ticks += ticks;
+      }
+      enable_interrupts_forced();
+      return IRQ_HANDLED;
+   }
+
+   do {
+
+      timer_process(ticks);
+
+      disable_interrupts_forced();
+      {
+         again = deferred_irq;
+         ticks = deferred_ticks;
+         deferred_irq = false;
+         deferred_ticks = 0;
+      }
+      enable_interrupts_forced();
+
+   } while (again);
+
    return IRQ_HANDLED;
 }
 
@@ -348,8 +583,24 @@ struct bogo_measure_ctx {
    bool started;
    bool pass_start;
    u32 ticks;
+   struct clocksource *cs;    /* clocksource to calibrate, if any */
+   u64 cs_start;              /* its counter value at the first tick */
 };
 
+/*
+ * Calibrate the clocksource using the same ticks as the bogoMips measurement:
+ * from now on, it will be used to interpolate the time between the ticks.
+ * Without a clocksource, the hardware timer's counter is used instead.
+ */
+static void calibrate_clocksource(struct bogo_measure_ctx *ctx)
+{
+   struct clocksource *cs = ctx->cs;
+   const u64 cycles = cs->read() - ctx->cs_start;
+
+   clocksource_calibrate(cs, cycles, MEASURE_BOGOMIPS_TICKS * __tick_duration);
+   clocksource_select(cs);
+}
+
 static enum irq_action measure_bogomips_irq_handler(void *arg)
 {
    struct bogo_measure_ctx *ctx = arg;
@@ -370,6 +621,10 @@ static enum irq_action measure_bogomips_irq_handler(void *arg)
        */
       __bogo_loops = 0;
       ctx->pass_start = true;
+
+      if (ctx->cs)
+         ctx->cs_start = ctx->cs->read();
+
       return IRQ_NOT_HANDLED;
    }
 
@@ -385,6 +640,9 @@ static enum irq_action measure_bogomips_irq_handler(void *arg)
          loops_per_ms = loops_per_tick / (1000 / TIMER_HZ);
          loops_per_us = loops_per_ms / 1000;
          __bogo_loops = -1;
+
+         if (ctx->cs)
+            calibrate_clocksource(ctx);
       }
       enable_interrupts_forced();
    }
@@ -405,6 +663,9 @@ static void do_bogomips_loop(void *arg)
    }
    enable_preemption();
    printk("Tilck bogoMips: %u.%03u\n", loops_per_us, loops_per_ms % 1000);
+
+   if (ctx->cs)
+      printk("Clocksource: %s\n", ctx->cs->name);
 }
 
 void delay_us(u32 us)
@@ -425,8 +686,10 @@ void init_timer(void)
 {
    static struct bogo_measure_ctx ctx;
    measure_bogomips.context = &ctx;
+   ctx.cs = hw_get_clocksource();
 
    __tick_duration = hw_timer_setup(TS_SCALE / TIMER_HZ);
+   init_ktimers();
 
    printk("*** Init the kernel timer\n");
 
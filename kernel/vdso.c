@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/vdso.h>
+#include <tilck/kernel/clocksource.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/hal.h>
+
+/*
+ * The vvar page: the only page of kernel data mapped (read-only) in user
+ * space. See struct vdso_data and kernel/arch/i386/vdso.S.
+ */
+static union {
+
+   struct vdso_data data;
+   char page[PAGE_SIZE];
+
+} vvar ALIGNED_AT(PAGE_SIZE);
+
+STATIC_ASSERT(sizeof(vvar) == PAGE_SIZE);
+
+/*
+ * NOTE: the vDSO code runs on the same (only) CPU as the timer IRQ handler,
+ * which is the only writer. Therefore, compiler barriers are enough here.
+ */
+static ALWAYS_INLINE void vvar_write_begin(struct vdso_data *d)
+{
+   d->seq++;
+   asmVolatile("" ::: "memory");
+}
+
+static ALWAYS_INLINE void vvar_write_end(struct vdso_data *d)
+{
+   asmVolatile("" ::: "memory");
+   d->seq++;
+}
+
+void *vdso_get_vvar_page(void)
+{
+   return &vvar;
+}
+
+/* Called by the timer IRQ handler, after each clocksource update */
+void vdso_update_time(void)
+{
+   struct vdso_data *d = &vvar.data;
+   struct clocksource_base b;
+   struct k_timespec64 base, coarse;
+
+   ASSERT(!are_interrupts_enabled());
+
+   clocksource_get_base(&b);
+   sys_time_to_timespec(get_sys_time(), &coarse);
+
+   if (b.cs)
+      sys_time_to_timespec(b.base_ns, &base);
+
+   vvar_write_begin(d);
+   {
+      if (b.cs && b.cs->vdso_mode != VDSO_CLOCK_NONE) {
+
+         d->clock_mode = b.cs->vdso_mode;
+         d->base_cycles = b.base_cycles;
+         d->max_cycles = b.max_cycles;
+         d->mult = b.mult;
+         d->shift = b.shift;
+         d->base_sec = base.tv_sec;
+         d->base_nsec = (u32)base.tv_nsec;
+
+      } else {
+
+         d->clock_mode = VDSO_CLOCK_NONE;
+      }
+
+      d->coarse_sec = coarse.tv_sec;
+      d->coarse_nsec = (u32)coarse.tv_nsec;
+   }
+   vvar_write_end(d);
+}
@@ -596,7 +596,7 @@ dispose_term(term *_t)
    dispose_term_rb_data(&t->rb_data);
 
    if (t->buffer) {
-      kfree_array_obj(t->buffer, u16, t->total_buffer_rows * t->cols);
+      vfree2(t->buffer, 2 * t->total_buffer_rows * t->cols);
       t->buffer = NULL;
    }
 
@@ -701,7 +701,7 @@ init_vterm(term *_t,
       t->total_buffer_rows = t->rows + t->extra_buffer_rows;
 
       if (is_kmalloc_initialized())
-         t->buffer = kmalloc(2 * t->total_buffer_rows * t->cols);
+         t->buffer = vmalloc(2 * t->total_buffer_rows * t->cols);
    }
 
    if (t->buffer) {
@@ -715,7 +715,7 @@ init_vterm(term *_t,
       } else {
 
          if (t != &first_instance) {
-            kfree2(t->buffer, 2 * t->total_buffer_rows * t->cols);
+            vfree2(t->buffer, 2 * t->total_buffer_rows * t->cols);
             return -ENOMEM;
          }
 
@@ -5,6 +5,12 @@
 
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/oom.h>
+#include <tilck/kernel/kmem_cache.h>
+#include <tilck/kernel/shrinker.h>
+#include <tilck/kernel/vmalloc.h>
 
 #include "termutil.h"
 #include "dp_int.h"
@@ -15,6 +21,73 @@ static struct debug_kmalloc_stats stats;
 static size_t tot_usable_mem_kb;
 static size_t tot_used_mem_kb;
 static long tot_diff;
+static ulong anon_faults;
+static ulong anon_pages;
+static struct vmalloc_stats vm_stats;
+
+#define DP_MAX_KMEM_CACHES          16
+
+struct dp_kmem_cache_info {
+
+   const char *name;
+   u32 obj_size;
+   struct kmem_cache_stats stats;
+};
+
+static struct dp_kmem_cache_info caches[DP_MAX_KMEM_CACHES];
+static int caches_count;
+
+#define DP_MAX_SHRINKERS            8
+
+struct dp_shrinker_info {
+
+   const char *name;
+   size_t count;
+   struct shrinker_stats stats;
+};
+
+static struct dp_shrinker_info shrinkers[DP_MAX_SHRINKERS];
+static int shrinkers_cnt;
+
+static int dp_heaps_save_kmem_cache(struct kmem_cache *c, void *arg)
+{
+   if (caches_count == DP_MAX_KMEM_CACHES)
+      return 1;
+
+   caches[caches_count++] = (struct dp_kmem_cache_info) {
+      .name = c->name,
+      .obj_size = c->obj_size,
+      .stats = c->stats,
+   };
+
+   return 0;
+}
+
+static int dp_heaps_save_shrinker(struct shrinker *s, void *arg)
+{
+   if (shrinkers_cnt == DP_MAX_SHRINKERS)
+      return 1;
+
+   shrinkers[shrinkers_cnt++] = (struct dp_shrinker_info) {
+      .name = s->name,
+      .count = s->count(s),
+      .stats = s->stats,
+   };
+
+   return 0;
+}
+
+static int dp_heaps_count_anon_pages(void *obj, void *arg)
+{
+   struct task *ti = obj;
+
+   if (!is_main_thread(ti) || is_kernel_thread(ti))
+      return 0;
+
+   anon_faults += ti->pi->anon_faults;
+   anon_pages += ti->pi->anon_pages;
+   return 0;
+}
 
 static void dp_heaps_on_enter(void)
 {
@@ -40,6 +113,23 @@ static void dp_heaps_on_enter(void)
    ASSERT(tot_usable_mem_kb > 0);
 
    debug_kmalloc_get_stats(&stats);
+
+   anon_faults = 0;
+   anon_pages = 0;
+
+   disable_preemption();
+   {
+      iterate_over_tasks(dp_heaps_count_anon_pages, NULL);
+   }
+   enable_preemption();
+
+   caches_count = 0;
+   for_each_kmem_cache(dp_heaps_save_kmem_cache, NULL);
+
+   shrinkers_cnt = 0;
+   for_each_shrinker(dp_heaps_save_shrinker, NULL);
+
+   vmalloc_get_stats(&vm_stats);
 }
 
 static void dp_show_kmalloc_heaps(void)
@@ -120,6 +210,90 @@ static void dp_show_kmalloc_heaps(void)
       );
    }
 
+   dp_writeln("");
+   dp_writeln("Demand-zero pages: %u faults, %u KB resident",
+              anon_faults, anon_pages * (PAGE_SIZE / KB));
+   dp_writeln("OOM killer: %lu kills, %lu KB reclaimed",
+              oom_get_stats()->kills,
+              oom_get_stats()->reclaimed_pages * (PAGE_SIZE / KB));
+   dp_writeln("vmalloc: %lu areas, %lu/%lu KB [peak: %lu KB], %lu gaps",
+              vm_stats.areas,
+              vm_stats.used_size / KB,
+              vm_stats.area_size / KB,
+              vm_stats.peak_used_size / KB,
+              vm_stats.gaps);
+   dp_writeln("vmalloc: %lu lazy pages, %lu purges (%lu full TLB flushes)",
+              vm_stats.lazy_pages,
+              vm_stats.purges,
+              vm_stats.full_flushes);
+   dp_writeln("");
+
+   dp_writeln(
+      "    kmem cache    "
+      TERM_VLINE " obj sz "
+      TERM_VLINE " slabs "
+      TERM_VLINE " active "
+      TERM_VLINE "  peak  "
+      TERM_VLINE "   allocs   "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqqqqqqqnqqqqqqqqnqqqqqqqnqqqqqqqqnqqqqqqqqnqqqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; i < caches_count; i++) {
+
+      struct dp_kmem_cache_info *ci = &caches[i];
+
+      dp_writeln(
+         " %-16s "
+         TERM_VLINE " %6u "
+         TERM_VLINE " %5lu "
+         TERM_VLINE " %6lu "
+         TERM_VLINE " %6lu "
+         TERM_VLINE " %10lu ",
+         ci->name,
+         ci->obj_size,
+         ci->stats.slabs,
+         ci->stats.active_objs,
+         ci->stats.peak_active_objs,
+         ci->stats.allocs
+      );
+   }
+
+   dp_writeln("");
+
+   dp_writeln(
+      "     shrinker     "
+      TERM_VLINE " reclaimable KB "
+      TERM_VLINE "  scans  "
+      TERM_VLINE " released KB "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqqqqqqqnqqqqqqqqqqqqqqqqnqqqqqqqqqnqqqqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; i < shrinkers_cnt; i++) {
+
+      struct dp_shrinker_info *si = &shrinkers[i];
+
+      dp_writeln(
+         " %-16s "
+         TERM_VLINE " %14zu "
+         TERM_VLINE " %7lu "
+         TERM_VLINE " %11lu ",
+         si->name,
+         si->count / KB,
+         si->stats.scans,
+         si->stats.released / KB
+      );
+   }
+
    dp_writeln("");
 }
 
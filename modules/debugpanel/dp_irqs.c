@@ -72,6 +72,30 @@ static void debug_dump_masked_irqs(void)
    dp_writeln("");
 }
 
+static void debug_dump_idle_stats(void)
+{
+   struct idle_stats s;
+   const u64 ticks = get_ticks();
+   const u64 idle = idle_task->ticks.total;
+
+   timer_get_idle_stats(&s);
+
+   dp_writeln("");
+   dp_writeln("Idle and dynamic tick (NO_HZ: %s)",
+              KRN_NO_HZ_IDLE ? "enabled" : "disabled");
+
+   dp_writeln("   Idle residency:        %llu%%",
+              ticks ? idle * 100 / ticks : 0);
+   dp_writeln("   Idle halts:            %llu", s.halts);
+
+   if (KRN_NO_HZ_IDLE) {
+      dp_writeln("   Tickless halts:        %llu", s.nohz_halts);
+      dp_writeln("   Tickless ticks:        %llu", s.nohz_ticks);
+      dp_writeln("   Timer IRQs avoided:    %llu",
+                 s.nohz_ticks - MIN(s.nohz_ticks, s.nohz_expired));
+   }
+}
+
 static void dp_show_irq_stats(void)
 {
    row = dp_screen_start_row;
@@ -81,6 +105,7 @@ static void dp_show_irq_stats(void)
    debug_dump_spur_irq_count();
    debug_dump_unhandled_irq_count();
    debug_dump_masked_irqs();
+   debug_dump_idle_stats();
 }
 
 static struct dp_screen dp_irqs_screen =
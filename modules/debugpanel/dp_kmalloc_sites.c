@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kmalloc.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/sort.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+static struct kmalloc_prof_info info;
+static struct kmalloc_site_stats *sites_arr;
+static u32 sites_arr_size;
+static u32 sites_count;
+static char sites_order_by;
+
+static long dp_sites_cmpf_live(const void *a, const void *b)
+{
+   const struct kmalloc_site_stats *x = a;
+   const struct kmalloc_site_stats *y = b;
+
+   if (x->live_bytes == y->live_bytes)
+      return 0;
+
+   return x->live_bytes < y->live_bytes ? 1 : -1;
+}
+
+static long dp_sites_cmpf_peak(const void *a, const void *b)
+{
+   const struct kmalloc_site_stats *x = a;
+   const struct kmalloc_site_stats *y = b;
+
+   if (x->peak_bytes == y->peak_bytes)
+      return 0;
+
+   return x->peak_bytes < y->peak_bytes ? 1 : -1;
+}
+
+static long dp_sites_cmpf_allocs(const void *a, const void *b)
+{
+   const struct kmalloc_site_stats *x = a;
+   const struct kmalloc_site_stats *y = b;
+
+   if (x->tot_allocs == y->tot_allocs)
+      return 0;
+
+   return x->tot_allocs < y->tot_allocs ? 1 : -1;
+}
+
+static void dp_sites_sort(char order_by)
+{
+   cmpfun_ptr cmp;
+
+   switch (order_by) {
+      case 'p':
+         cmp = dp_sites_cmpf_peak;
+         break;
+      case 'a':
+         cmp = dp_sites_cmpf_allocs;
+         break;
+      default:
+         cmp = dp_sites_cmpf_live;
+         break;
+   }
+
+   insertion_sort_generic(sites_arr, sizeof(sites_arr[0]), sites_count, cmp);
+   sites_order_by = order_by;
+}
+
+static void dp_sites_enter(void)
+{
+   if (!KMALLOC_CALLSITE_PROFILER)
+      return;
+
+   debug_kmalloc_prof_get_info(&info);
+
+   if (!sites_arr) {
+
+      sites_arr_size = info.max_sites + 1;
+      sites_arr = kalloc_array_obj(struct kmalloc_site_stats, sites_arr_size);
+
+      if (!sites_arr)
+         panic("Unable to alloc memory for sites_arr");
+   }
+
+   sites_count = debug_kmalloc_prof_get_sites(sites_arr, sites_arr_size);
+   dp_sites_sort('l');
+}
+
+static int dp_sites_keypress(struct key_event ke)
+{
+   const char c = ke.print_char;
+
+   switch (c) {
+
+      case 'l':
+      case 'p':
+      case 'a':
+         dp_sites_sort(c);
+         ui_need_update = true;
+         return kb_handler_ok_and_continue;
+
+      default:
+         return kb_handler_nak;
+   }
+}
+
+static void dp_show_sites(void)
+{
+   int row = dp_screen_start_row;
+   char name[48];
+
+   if (!KMALLOC_CALLSITE_PROFILER) {
+      dp_writeln("Not available: recompile with KMALLOC_CALLSITE_PROFILER=1");
+      return;
+   }
+
+   dp_writeln("Call sites:     %5u / %u", info.sites, info.max_sites);
+   dp_writeln("Tracked allocs: %5u / %u [untracked: %lu]",
+              info.tracked, info.max_tracked, info.untracked);
+
+   dp_writeln(
+      "Order by: "
+      E_COLOR_BR_WHITE "l" RESET_ATTRS "ive bytes, "
+      E_COLOR_BR_WHITE "p" RESET_ATTRS "eak bytes, "
+      E_COLOR_BR_WHITE "a" RESET_ATTRS "llocs"
+   );
+
+   dp_writeln("");
+
+   dp_writeln(
+                 "               Caller               "  RESET_ATTRS
+      TERM_VLINE "%s" "  Live KB  "                       RESET_ATTRS
+      TERM_VLINE "%s" "  Peak KB  "                       RESET_ATTRS
+      TERM_VLINE      "  Live  "                          RESET_ATTRS
+      TERM_VLINE "%s" "   Allocs  "                       RESET_ATTRS,
+      sites_order_by == 'l' ? E_COLOR_BR_WHITE REVERSE_VIDEO : "",
+      sites_order_by == 'p' ? E_COLOR_BR_WHITE REVERSE_VIDEO : "",
+      sites_order_by == 'a' ? E_COLOR_BR_WHITE REVERSE_VIDEO : ""
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqnqqqqqqqqqqqnqqqqqqqqqqqn"
+      "qqqqqqqqnqqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (u32 i = 0; i < sites_count; i++) {
+
+      const struct kmalloc_site_stats *s = &sites_arr[i];
+      debug_kmalloc_prof_site_name(s->caller, name, sizeof(name));
+
+      dp_writeln("%-35.35s "
+                 TERM_VLINE " %9zu "
+                 TERM_VLINE " %9zu "
+                 TERM_VLINE " %6lu "
+                 TERM_VLINE " %10lu",
+                 name,
+                 s->live_bytes / KB,
+                 s->peak_bytes / KB,
+                 s->live_allocs,
+                 s->tot_allocs);
+   }
+
+   dp_writeln("");
+}
+
+static struct dp_screen dp_sites_screen =
+{
+   .index = 6,
+   .label = "KmSites",
+   .draw_func = dp_show_sites,
+   .on_dp_enter = dp_sites_enter,
+   .on_keypress_func = dp_sites_keypress,
+};
+
+__attribute__((constructor))
+static void dp_sites_init(void)
+{
+   dp_register_screen(&dp_sites_screen);
+}
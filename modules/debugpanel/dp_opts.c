@@ -54,6 +54,7 @@ static void dp_show_opts(void)
    DUMP_INT_OPT(TIMER_HZ);
    DUMP_INT_OPT(KERNEL_STACK_PAGES);
    DUMP_INT_OPT(USER_STACK_PAGES);
+   DUMP_INT_OPT(TLB_FLUSH_ALL_THR);
 
    DUMP_LABEL("Kernel modules");
    DUMP_BOOL_OPT(MOD_acpi);
@@ -94,6 +95,7 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(KERNEL_UBSAN);
    DUMP_BOOL_OPT(TERM_BIG_SCROLL_BUF);
    DUMP_BOOL_OPT(KRN_RESCHED_ENABLE_PREEMPT);
+   DUMP_BOOL_OPT(KRN_NO_HZ_IDLE);
    DUMP_BOOL_OPT(KERNEL_BIG_IO_BUF);
    DUMP_BOOL_OPT(PS2_DO_SELFTEST);
    DUMP_BOOL_OPT(PS2_VERBOSE_DEBUG_LOG);
@@ -105,6 +107,7 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(KMALLOC_FREE_MEM_POISONING);
    DUMP_BOOL_OPT(KMALLOC_SUPPORT_DEBUG_LOG);
    DUMP_BOOL_OPT(KMALLOC_SUPPORT_LEAK_DETECTOR);
+   DUMP_BOOL_OPT(KMALLOC_CALLSITE_PROFILER);
    DUMP_BOOL_OPT(BOOTLOADER_POISON_MEMORY);
    DUMP_BOOL_OPT(FB_CONSOLE_FAILSAFE_OPT);
 
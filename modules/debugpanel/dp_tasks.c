@@ -15,7 +15,7 @@
 #include <tilck/mods/tracing.h>
 
 #include "termutil.h"
-#define MAX_EXEC_PATH_LEN     34
+#define MAX_EXEC_PATH_LEN     28
 
 void init_dp_tracing(void);
 
@@ -90,7 +90,7 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
    static char fmt[120];
    static char hfmt[120];
    static char header[120];
-   static char hline_sep[120] = "qqqqqqqnqqqqqqnqqqqqqnqqqqqqnqqqqqnqqqqqn";
+   static char hline_sep[120] = "qqqqqqqnqqqqqqnqqqqqqnqqqqqqnqqqqqnqqqqqnqqqqqn";
 
    static char *hline_sep_end = &hline_sep[sizeof(hline_sep)];
 
@@ -104,6 +104,7 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
                TERM_VLINE " %%-4d "
                TERM_VLINE " %%-4d "
                TERM_VLINE " %%-3s "
+               TERM_VLINE " %%-3d "
                TERM_VLINE "  %%-2d "
                TERM_VLINE " %%-%ds",
                dp_start_col+1, path_field_len);
@@ -115,6 +116,7 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
                TERM_VLINE " %%-4s "
                TERM_VLINE " %%-3s "
                TERM_VLINE " %%-3s "
+               TERM_VLINE " %%-3s "
                TERM_VLINE " %%-%ds",
                path_field_len);
 
@@ -126,6 +128,7 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
                "sid",
                "ppid",
                "S",
+               "ni",
                "tty",
                "cmdline");
 
@@ -236,6 +239,7 @@ static int debug_per_task_cb(void *obj, void *arg)
                  pi->sid,
                  pi->parent_pid,
                  state_str,
+                 ti->nice,
                  ttynum,
                  buf);
 
@@ -250,6 +254,7 @@ static int debug_per_task_cb(void *obj, void *arg)
                    pi->sid,
                    pi->parent_pid,
                    state_str,
+                   ti->nice,
                    ttynum,
                    buf);
 
@@ -34,6 +34,7 @@ DEF_STATIC_CONF_RO(BOOL,   debugchecks,            DEBUG_CHECKS);
 DEF_STATIC_CONF_RO(ULONG, timer_hz,                TIMER_HZ);
 DEF_STATIC_CONF_RO(ULONG, stack_pages,             KERNEL_STACK_PAGES);
 DEF_STATIC_CONF_RO(ULONG, user_stack_pages,        USER_STACK_PAGES);
+DEF_STATIC_CONF_RO(ULONG, tlb_flush_all_thr,       TLB_FLUSH_ALL_THR);
 DEF_STATIC_CONF_RO(BOOL,  track_nested_int,        KRN_TRACK_NESTED_INTERR);
 DEF_STATIC_CONF_RO(BOOL,  panic_backtrace,         PANIC_SHOW_STACKTRACE);
 DEF_STATIC_CONF_RO(BOOL,  panic_regs,              PANIC_SHOW_REGS);
@@ -42,6 +43,7 @@ DEF_STATIC_CONF_RO(BOOL,  stack_isolation,         KERNEL_STACK_ISOLATION);
 DEF_STATIC_CONF_RO(BOOL,  symbols,                 KERNEL_SYMBOLS);
 DEF_STATIC_CONF_RO(BOOL,  printk_on_curr_tty,      KRN_PRINTK_ON_CURR_TTY);
 DEF_STATIC_CONF_RO(BOOL,  resched_enable_preempt,  KRN_RESCHED_ENABLE_PREEMPT);
+DEF_STATIC_CONF_RO(BOOL,  no_hz_idle,              KRN_NO_HZ_IDLE);
 DEF_STATIC_CONF_RO(BOOL,  big_io_buf,              KERNEL_BIG_IO_BUF);
 DEF_STATIC_CONF_RO(BOOL,  gcov,                    KERNEL_GCOV);
 DEF_STATIC_CONF_RO(BOOL,  fork_no_cow,             FORK_NO_COW);
@@ -98,6 +100,7 @@ void sysfs_create_config_obj(void)
       SYSOBJ_CONF_PROP_PAIR(timer_hz),
       SYSOBJ_CONF_PROP_PAIR(stack_pages),
       SYSOBJ_CONF_PROP_PAIR(user_stack_pages),
+      SYSOBJ_CONF_PROP_PAIR(tlb_flush_all_thr),
       SYSOBJ_CONF_PROP_PAIR(track_nested_int),
       SYSOBJ_CONF_PROP_PAIR(panic_backtrace),
       SYSOBJ_CONF_PROP_PAIR(panic_regs),
@@ -106,6 +109,7 @@ void sysfs_create_config_obj(void)
       SYSOBJ_CONF_PROP_PAIR(symbols),
       SYSOBJ_CONF_PROP_PAIR(printk_on_curr_tty),
       SYSOBJ_CONF_PROP_PAIR(resched_enable_preempt),
+      SYSOBJ_CONF_PROP_PAIR(no_hz_idle),
       SYSOBJ_CONF_PROP_PAIR(big_io_buf),
       SYSOBJ_CONF_PROP_PAIR(gcov),
       SYSOBJ_CONF_PROP_PAIR(fork_no_cow),
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kmalloc.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/sort.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/*                zero pool's hit rate (percentage)             */
+
+static offt
+sys_zero_pool_hit_rate_load(struct sysobj *obj,
+                            void *data, void *buf, offt buf_sz, offt off)
+{
+   const struct zero_pool_stats *s = data;
+   const u64 hits = s->hits;
+   const u64 total = hits + s->misses;
+
+   ASSERT(off == 0);
+   return snprintk(buf, (size_t)buf_sz, "%u\n",
+                   total ? (u32)(hits * 100 / total) : 0);
+}
+
+static const struct sysobj_prop_type sysobj_ptype_ro_zero_pool_hit_rate = {
+   .load = &sys_zero_pool_hit_rate_load,
+};
+
+/*                kmalloc's call sites, by live bytes             */
+
+#define KMALLOC_SITE_LINE_MAX            96
+
+static long kmalloc_site_cmp_live_bytes(const void *a, const void *b)
+{
+   const struct kmalloc_site_stats *x = a;
+   const struct kmalloc_site_stats *y = b;
+
+   if (x->live_bytes == y->live_bytes)
+      return 0;
+
+   return x->live_bytes < y->live_bytes ? 1 : -1;
+}
+
+static offt
+sys_kmalloc_callsites_get_buf_sz(struct sysobj *obj, void *data)
+{
+   struct kmalloc_prof_info info;
+   debug_kmalloc_prof_get_info(&info);
+
+   /* Header + all the sites + the "other" site */
+   return (offt)(info.max_sites + 3) * KMALLOC_SITE_LINE_MAX;
+}
+
+static offt
+sys_kmalloc_callsites_load(struct sysobj *obj,
+                           void *data, void *buf, offt buf_sz, offt off)
+{
+   char *dest = buf;
+   struct kmalloc_site_stats *sites;
+   struct kmalloc_prof_info info;
+   char name[48];
+   offt w = 0;
+   u32 count;
+
+   ASSERT(off == 0);
+   debug_kmalloc_prof_get_info(&info);
+   sites = kalloc_array_obj(struct kmalloc_site_stats, info.max_sites + 1);
+
+   if (!sites)
+      return -ENOMEM;
+
+   count = debug_kmalloc_prof_get_sites(sites, info.max_sites + 1);
+
+   insertion_sort_generic(sites,
+                          sizeof(sites[0]),
+                          count,
+                          &kmalloc_site_cmp_live_bytes);
+
+   w += snprintk(dest + w, (size_t)(buf_sz - w),
+                 "# sites: %u/%u, tracked: %u/%u, untracked: %lu\n",
+                 info.sites, info.max_sites,
+                 info.tracked, info.max_tracked, info.untracked);
+
+   w += snprintk(dest + w, (size_t)(buf_sz - w),
+                 "# %-38s %10s %10s %8s %10s\n",
+                 "caller", "live_bytes", "peak_bytes", "live", "allocs");
+
+   for (u32 i = 0; i < count; i++) {
+
+      debug_kmalloc_prof_site_name(sites[i].caller, name, sizeof(name));
+
+      w += snprintk(dest + w, (size_t)(buf_sz - w),
+                    "%-40s %10zu %10zu %8lu %10lu\n",
+                    name,
+                    sites[i].live_bytes,
+                    sites[i].peak_bytes,
+                    sites[i].live_allocs,
+                    sites[i].tot_allocs);
+   }
+
+   kfree_array_obj(sites, struct kmalloc_site_stats, info.max_sites + 1);
+   return w;
+}
+
+static const struct sysobj_prop_type sysobj_ptype_ro_kmalloc_callsites = {
+   .get_buf_sz = &sys_kmalloc_callsites_get_buf_sz,
+   .load = &sys_kmalloc_callsites_load,
+};
+
+DEF_STATIC_SYSOBJ_PROP(callsites,   &sysobj_ptype_ro_kmalloc_callsites);
+
+DEF_STATIC_SYSOBJ_PROP(depth,       &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(capacity,    &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(hits,        &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(misses,      &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(refilled,    &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(hit_rate,    &sysobj_ptype_ro_zero_pool_hit_rate);
+
+void sysfs_create_mm_obj(void)
+{
+   struct zero_pool_stats *zs = (void *)zero_pool_get_stats();
+   struct sysobj *mm, *zero_pool;
+
+   mm = sysfs_create_empty_obj();
+
+   if (!mm)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "mm", mm))
+      goto fail;
+
+   zero_pool = sysfs_create_custom_obj(
+      "zero_pool",
+      NULL,       /* hooks */
+      &prop_depth, &zs->depth,
+      &prop_capacity, &zs->capacity,
+      &prop_hits, &zs->hits,
+      &prop_misses, &zs->misses,
+      &prop_refilled, &zs->refilled,
+      &prop_hit_rate, zs,
+      NULL
+   );
+
+   if (!zero_pool)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, mm, "zero_pool", zero_pool))
+      goto fail;
+
+   if (KMALLOC_CALLSITE_PROFILER) {
+
+      struct sysobj *kmalloc_obj =
+         sysfs_create_custom_obj(
+            "kmalloc",
+            NULL,       /* hooks */
+            &prop_callsites, NULL,
+            NULL
+         );
+
+      if (!kmalloc_obj)
+         goto fail;
+
+      if (sysfs_register_obj(NULL, mm, "kmalloc", kmalloc_obj))
+         goto fail;
+   }
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs mm obj");
+}
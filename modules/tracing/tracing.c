@@ -781,9 +781,11 @@ tracing_init_oom_panic(const char *buf_name)
 void
 init_tracing(void)
 {
-   if (!(tracing_buf = kzmalloc(TRACE_BUF_SIZE)))
+   if (!(tracing_buf = vmalloc(TRACE_BUF_SIZE)))
       tracing_init_oom_panic("tracing_buf");
 
+   bzero(tracing_buf, TRACE_BUF_SIZE);
+
    if (!(syms_buf = kalloc_array_obj(struct symbol_node, MAX_SYSCALLS)))
       tracing_init_oom_panic("syms_buf");
 
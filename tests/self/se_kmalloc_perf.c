@@ -6,6 +6,7 @@
 
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmem_cache.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/self_tests.h>
 
@@ -49,6 +50,63 @@ static void kmalloc_perf_per_size(u32 size)
           size, duration / (u64) iters);
 }
 
+/*
+ * Compare kmalloc() + kfree() with kmem_cache_alloc() + kmem_cache_free() for
+ * a batch of objects of the given size, like the hot kernel objects.
+ */
+static void kmem_cache_perf_per_size(u32 size)
+{
+   const int iters = 1000;
+   const int batch = 100;
+   struct kmem_cache cache;
+   u64 start, kmalloc_cycles, cache_cycles;
+
+   kmem_cache_init(&cache, "se_perf", size, NULL);
+
+   start = RDTSC();
+
+   for (int i = 0; i < iters; i++) {
+
+      for (int j = 0; j < batch; j++) {
+
+         allocations[j] = kmalloc(size);
+
+         if (!allocations[j])
+            panic("We were unable to allocate %u bytes\n", size);
+      }
+
+      for (int j = 0; j < batch; j++)
+         kfree2(allocations[j], size);
+   }
+
+   kmalloc_cycles = RDTSC() - start;
+   start = RDTSC();
+
+   for (int i = 0; i < iters; i++) {
+
+      for (int j = 0; j < batch; j++) {
+
+         allocations[j] = kmem_cache_alloc(&cache);
+
+         if (!allocations[j])
+            panic("We were unable to allocate an object of %u bytes\n", size);
+      }
+
+      for (int j = 0; j < batch; j++)
+         kmem_cache_free(&cache, allocations[j]);
+   }
+
+   cache_cycles = RDTSC() - start;
+   kmem_cache_destroy(&cache);
+
+   kmalloc_perf_print_iters(iters * batch);
+   printk(NO_PREFIX "Cycles per alloc(%4u) + free: kmalloc: %4" PRIu64
+          ", kmem_cache: %4" PRIu64 "\n",
+          size,
+          kmalloc_cycles / (u64)(iters * batch),
+          cache_cycles / (u64)(iters * batch));
+}
+
 void selftest_kmalloc_perf(void)
 {
    const int iters = 1000;
@@ -90,6 +148,14 @@ void selftest_kmalloc_perf(void)
       kmalloc_perf_per_size(s);
    }
 
+   for (u32 s = 32; s <= 1024; s *= 2) {
+
+      if (se_is_stop_requested())
+         break;
+
+      kmem_cache_perf_per_size(s);
+   }
+
    kfree_array_obj(allocations, void *, 10000);
 
    if (se_is_stop_requested())
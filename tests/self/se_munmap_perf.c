@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/self_tests.h>
+
+#define MUNMAP_PERF_VADDR        ((void *)USER_MMAP_BEGIN)
+
+static void munmap_perf_map_and_touch(pdir_t *pdir, size_t page_count)
+{
+   const ulong vaddr = (ulong)MUNMAP_PERF_VADDR;
+   size_t count;
+
+   count = map_zero_pages(pdir, MUNMAP_PERF_VADDR, page_count, PAGING_FL_US);
+
+   if (count != page_count)
+      panic("Unable to map %zu zero pages\n", page_count);
+
+   /* Read every page, in order to have (some of) them cached in the TLB */
+   for (size_t i = 0; i < page_count; i++)
+      (void)*(volatile char *)(vaddr + (i << PAGE_SHIFT));
+}
+
+static u64 munmap_perf_run(pdir_t *pdir, size_t page_count, bool batched)
+{
+   const int iters = page_count < 1024 ? 100 : 4;
+   const ulong vaddr = (ulong)MUNMAP_PERF_VADDR;
+   u64 start, tot = 0;
+
+   for (int i = 0; i < iters; i++) {
+
+      munmap_perf_map_and_touch(pdir, page_count);
+      start = RDTSC();
+
+      if (batched) {
+
+         unmap_pages(pdir, MUNMAP_PERF_VADDR, page_count, false);
+
+      } else {
+
+         for (size_t j = 0; j < page_count; j++)
+            unmap_page(pdir, (void *)(vaddr + (j << PAGE_SHIFT)), false);
+      }
+
+      tot += RDTSC() - start;
+   }
+
+   return tot / (u64)iters;
+}
+
+void selftest_munmap_perf(void)
+{
+   static const size_t sizes[] = {
+      4 * KB, 16 * KB, 64 * KB, 256 * KB, 1 * MB, 4 * MB, 16 * MB, 64 * MB
+   };
+
+   pdir_t *pdir, *old_pdir;
+   u64 batched, single;
+
+   printk("*** munmap perf test (TLB_FLUSH_ALL_THR: %d pages) ***\n",
+          TLB_FLUSH_ALL_THR);
+
+   if (!(pdir = pdir_clone(get_kernel_pdir())))
+      panic("No enough memory for the pdir");
+
+   disable_preemption();
+   {
+      old_pdir = get_curr_pdir();
+      set_curr_pdir(pdir);
+
+      for (u32 i = 0; i < ARRAY_SIZE(sizes); i++) {
+
+         const size_t page_count = sizes[i] >> PAGE_SHIFT;
+
+         batched = munmap_perf_run(pdir, page_count, true);
+         single = munmap_perf_run(pdir, page_count, false);
+
+         printk("%6zu KB: range flush: %10" PRIu64 " cycles "
+                "(%4" PRIu64 " per page), per-page flush: %10" PRIu64 "\n",
+                sizes[i] / KB,
+                batched,
+                batched / (u64)page_count,
+                single);
+      }
+
+      set_curr_pdir(old_pdir);
+   }
+   enable_preemption();
+
+   pdir_destroy(pdir);
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(munmap_perf, se_med, &selftest_munmap_perf)
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/self_tests.h>
+
+#define PAGES_PER_ITER        512
+
+static void **pages;
+
+static void *perf_kmalloc_page(void) { return kmalloc(PAGE_SIZE); }
+static void perf_kfree_page(void *p) { kfree2(p, PAGE_SIZE); }
+
+static u64
+page_alloc_perf_run(void *(*alloc_func)(void), void (*free_func)(void *))
+{
+   const int iters = 100;
+   u64 start = RDTSC();
+
+   for (int i = 0; i < iters; i++) {
+
+      for (int j = 0; j < PAGES_PER_ITER; j++) {
+         if (!(pages[j] = alloc_func()))
+            panic("We were unable to allocate a page\n");
+      }
+
+      /* Free the pages in a different order, like it happens in practice */
+      for (int j = 0; j < PAGES_PER_ITER; j += 2)
+         free_func(pages[j]);
+
+      for (int j = 1; j < PAGES_PER_ITER; j += 2)
+         free_func(pages[j]);
+   }
+
+   return (RDTSC() - start) / (iters * PAGES_PER_ITER);
+}
+
+void selftest_page_alloc_perf(void)
+{
+   u64 kmalloc_cycles, pfa_cycles;
+   printk("*** page alloc perf test ***\n");
+
+   pages = kalloc_array_obj(void *, PAGES_PER_ITER);
+
+   if (!pages)
+      panic("No enough memory for the 'pages' buffer");
+
+   kmalloc_cycles = page_alloc_perf_run(&perf_kmalloc_page, &perf_kfree_page);
+   pfa_cycles = page_alloc_perf_run(&alloc_page, &free_page);
+
+   printk("Cycles per kmalloc(PAGE_SIZE) + kfree:   %" PRIu64 "\n",
+          kmalloc_cycles);
+   printk("Cycles per alloc_page() + free_page():   %" PRIu64 "\n",
+          pfa_cycles);
+
+   kfree_array_obj(pages, void *, PAGES_PER_ITER);
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(page_alloc_perf, se_med, &selftest_page_alloc_perf)
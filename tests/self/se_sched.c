@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/atomics.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/self_tests.h>
+
+#define SE_SCHED_MAX_THREADS        1000
+#define SE_SCHED_TOT_SWITCHES      50000
+
+static int *sched_perf_tids;
+static volatile bool sched_perf_go;
+static ATOMIC(u32) sched_perf_switches;
+
+static void sched_perf_thread(void *arg)
+{
+   const u32 iters = (u32)(ulong)arg;
+
+   /* Wait for all the other threads to be created */
+   while (!sched_perf_go)
+      kernel_yield();
+
+   for (u32 i = 0; i < iters; i++) {
+
+      if (UNLIKELY(se_is_stop_requested()))
+         break;
+
+      kernel_yield();
+   }
+
+   atomic_fetch_add_explicit(&sched_perf_switches, iters, mo_relaxed);
+}
+
+static void sched_perf_run(int n)
+{
+   const u32 iters = MAX(10, SE_SCHED_TOT_SWITCHES / n);
+   u64 start, duration;
+   u32 switches;
+
+   sched_perf_go = false;
+   sched_perf_switches = 0;
+
+   for (int i = 0; i < n; i++) {
+
+      sched_perf_tids[i] =
+         kthread_create(&sched_perf_thread, 0, TO_PTR(iters));
+
+      if (sched_perf_tids[i] < 0)
+         panic("[se_sched] Unable to create thread %d/%d", i, n);
+   }
+
+   start = RDTSC();
+   sched_perf_go = true;
+   kthread_join_all(sched_perf_tids, (size_t)n, true);
+   duration = RDTSC() - start;
+
+   switches = atomic_load_explicit(&sched_perf_switches, mo_relaxed);
+   ASSERT(switches > 0); // SA: avoid division by zero warning
+
+   printk("[se_sched] runnable: %4d -> cycles per switch: %" PRIu64 "\n",
+          n, duration / switches);
+}
+
+void selftest_sched_perf(void)
+{
+   static const int counts[] = { 10, 100, SE_SCHED_MAX_THREADS };
+
+   sched_perf_tids = kalloc_array_obj(int, SE_SCHED_MAX_THREADS);
+
+   if (!sched_perf_tids)
+      panic("[se_sched] No enough memory for the tids array");
+
+   for (int i = 0; i < ARRAY_SIZE(counts); i++) {
+
+      if (se_is_stop_requested())
+         break;
+
+      sched_perf_run(counts[i]);
+   }
+
+   kfree_array_obj(sched_perf_tids, int, SE_SCHED_MAX_THREADS);
+   sched_perf_tids = NULL;
+
+   if (se_is_stop_requested())
+      se_interrupted_end();
+   else
+      se_regular_end();
+}
+
+REGISTER_SELF_TEST(sched_perf, se_med, &selftest_sched_perf)
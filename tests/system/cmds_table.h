@@ -22,11 +22,18 @@ CMD_ENTRY(bad_read,     TT_SHORT,  true)
 CMD_ENTRY(bad_write,    TT_SHORT,  true)
 CMD_ENTRY(fork_perf,    TT_LONG,   true)
 CMD_ENTRY(vfork_perf,   TT_LONG,   true)
+CMD_ENTRY(fork_rss_perf, TT_MED,   true)
 CMD_ENTRY(syscall_perf, TT_MED,    true)
 CMD_ENTRY(fpu,          TT_SHORT,  true)
 CMD_ENTRY(brk,          TT_SHORT,  true)
 CMD_ENTRY(mmap,         TT_MED,    true)
 CMD_ENTRY(mmap2,        TT_SHORT,  true)
+CMD_ENTRY(mmap_touch,   TT_MED,    true)
+CMD_ENTRY(mmap_many,    TT_SHORT,  true)
+CMD_ENTRY(mmap_huge,    TT_MED,    true)
+CMD_ENTRY(mremap,       TT_MED,    true)
+CMD_ENTRY(mprotect,     TT_SHORT,  true)
+CMD_ENTRY(madvise,      TT_SHORT,  true)
 CMD_ENTRY(kcow,         TT_SHORT,  true)
 CMD_ENTRY(wpid1,        TT_SHORT,  true)
 CMD_ENTRY(wpid2,        TT_SHORT,  true)
@@ -92,7 +99,11 @@ CMD_ENTRY(sig11,        TT_SHORT,  true)
 CMD_ENTRY(sig12,        TT_SHORT,  true)
 CMD_ENTRY(sig13,        TT_SHORT,  true)
 CMD_ENTRY(fork_oom,     TT_MED,    true)
+CMD_ENTRY(oom_kill,     TT_MED,    true)
 CMD_ENTRY(sigsegv3,     TT_SHORT,  true)
 CMD_ENTRY(sigsegv4,     TT_SHORT,  true)
 CMD_ENTRY(sigsegv5,     TT_SHORT,  true)
 CMD_ENTRY(getuids,      TT_SHORT,  true)
+CMD_ENTRY(nice,         TT_SHORT,  true)
+CMD_ENTRY(rt_latency,   TT_SHORT,  true)
+CMD_ENTRY(sleep_overshoot, TT_SHORT, true)
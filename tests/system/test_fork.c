@@ -121,6 +121,82 @@ static int do_fork_perf(int (*fork_func)(void))
    return 0;
 }
 
+/*
+ * Measure the cost of fork() + exit() + waitpid() in a parent having `mb` MB of
+ * resident anonymous memory, while the child writes to `child_writes` pages,
+ * one every 4 MB. Also check that the parent's memory is not affected.
+ */
+static ull_t
+fork_resident_perf(char *buf, size_t mb, int child_writes, int iters)
+{
+   int rc, wstatus, child_pid;
+   ull_t start, duration;
+
+   start = RDTSC();
+
+   for (int i = 0; i < iters; i++) {
+
+      child_pid = fork();
+      DEVSHELL_CMD_ASSERT(child_pid >= 0);
+
+      if (!child_pid) {
+
+         for (int j = 0; j < child_writes; j++) {
+
+            char *p = buf + ((size_t)j * 4 * MB) % (mb * MB);
+
+            if (*p != 'A')
+               exit(1);
+
+            *p = 'B';
+         }
+
+         exit(0);
+      }
+
+      rc = waitpid(child_pid, &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc == child_pid);
+      DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   }
+
+   duration = RDTSC() - start;
+
+   for (size_t off = 0; off < mb * MB; off += 4 * MB)
+      DEVSHELL_CMD_ASSERT(buf[off] == 'A');
+
+   return duration / iters;
+}
+
+int cmd_fork_rss_perf(int argc, char **argv)
+{
+   const size_t sizes[] = { 4, 16, 48 };  /* MB */
+   const int iters = 200;
+
+   for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+
+      const size_t mb = sizes[i];
+      char *buf = mmap(NULL,
+                       mb * MB,
+                       PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE,
+                       -1,
+                       0);
+
+      DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+      memset(buf, 'A', mb * MB);
+
+      printf("Resident: %2zu MB, fork + exit: %6llu K cycles, "
+             "fork + 1 write + exit: %6llu K cycles\n",
+             mb,
+             fork_resident_perf(buf, mb, 0, iters) / 1000,
+             fork_resident_perf(buf, mb, 1, iters) / 1000);
+
+      DEVSHELL_CMD_ASSERT(munmap(buf, mb * MB) == 0);
+   }
+
+   return 0;
+}
+
 int cmd_fork_se(int argc, char **argv)
 {
    return fork_test(&sysenter_fork);
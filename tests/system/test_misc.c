@@ -14,6 +14,8 @@
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/auxv.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -107,7 +109,42 @@ int cmd_sysenter(int argc, char **argv)
    return 0;
 }
 
-int cmd_syscall_perf(int argc, char **argv)
+static void do_int80_getuid(void)
+{
+   syscall(SYS_getuid);
+}
+
+static void do_sysenter_getuid(void)
+{
+   sysenter_call0(SYS_getuid);
+}
+
+static void do_syscall_clock_gettime(void)
+{
+   struct timespec ts;
+   syscall(SYS_clock_gettime, CLOCK_REALTIME, &ts);
+}
+
+static void do_vdso_clock_gettime(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts); /* libmusl uses the vDSO, if any */
+}
+
+static void do_syscall_gettimeofday(void)
+{
+   struct timeval tv;
+   syscall(SYS_gettimeofday, &tv, NULL);
+}
+
+static void do_vdso_gettimeofday(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+}
+
+/* Best-of-N measurement of `func`, in cycles per call */
+static ull_t syscall_perf_measure(void (*func)(void))
 {
    const int major_iters = 100;
    const int iters = 1000;
@@ -119,7 +156,7 @@ int cmd_syscall_perf(int argc, char **argv)
       start = RDTSC();
 
       for (int i = 0; i < iters; i++)
-         syscall(SYS_getuid);
+         func();
 
       duration = RDTSC() - start;
 
@@ -127,23 +164,59 @@ int cmd_syscall_perf(int argc, char **argv)
          best = duration;
    }
 
-   printf("int 0x80 getuid(): %llu cycles\n", best/iters);
-   best = (ull_t) -1;
+   return best / iters;
+}
 
-   for (int j = 0; j < major_iters; j++) {
+static ull_t timespec_to_ns(struct timespec *ts)
+{
+   return (ull_t)ts->tv_sec * 1000000000ull + (ull_t)ts->tv_nsec;
+}
 
-      start = RDTSC();
+int cmd_syscall_perf(int argc, char **argv)
+{
+   struct timespec ts1, ts2, ts3;
+   ull_t t1, t2, t3;
 
-      for (int i = 0; i < iters; i++)
-         sysenter_call0(SYS_getuid);
+   printf("int 0x80 getuid(): %llu cycles\n",
+          syscall_perf_measure(&do_int80_getuid));
 
-      duration = RDTSC() - start;
+   printf("sysenter getuid(): %llu cycles\n",
+          syscall_perf_measure(&do_sysenter_getuid));
 
-      if (duration < best)
-         best = duration;
+   printf("syscall clock_gettime(): %llu cycles\n",
+          syscall_perf_measure(&do_syscall_clock_gettime));
+
+   printf("vDSO clock_gettime(): %llu cycles\n",
+          syscall_perf_measure(&do_vdso_clock_gettime));
+
+   printf("syscall gettimeofday(): %llu cycles\n",
+          syscall_perf_measure(&do_syscall_gettimeofday));
+
+   printf("vDSO gettimeofday(): %llu cycles\n",
+          syscall_perf_measure(&do_vdso_gettimeofday));
+
+   if (!running_on_tilck())
+      return 0;
+
+   /* The vDSO must be there and agree with the syscall on the time */
+   DEVSHELL_CMD_ASSERT(getauxval(AT_SYSINFO_EHDR) != 0);
+
+   for (int i = 0; i < 1000; i++) {
+
+      syscall(SYS_clock_gettime, CLOCK_REALTIME, &ts1);
+      clock_gettime(CLOCK_REALTIME, &ts2);
+      syscall(SYS_clock_gettime, CLOCK_REALTIME, &ts3);
+
+      t1 = timespec_to_ns(&ts1);
+      t2 = timespec_to_ns(&ts2);
+      t3 = timespec_to_ns(&ts3);
+
+      if (t1 > t2 || t2 > t3) {
+         printf("Time went backwards: %llu, %llu, %llu\n", t1, t2, t3);
+         return 1;
+      }
    }
 
-   printf("sysenter getuid(): %llu cycles\n", best/iters);
    return 0;
 }
 
@@ -338,3 +411,67 @@ int cmd_getuids(void)
 
    return 0;
 }
+
+static void nice_child(void)
+{
+   int wstatus;
+   int child;
+   int rc;
+
+   errno = 0;
+   rc = getpriority(PRIO_PROCESS, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0 && errno == 0);
+
+   rc = setpriority(PRIO_PROCESS, 0, 5);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, getpid()) == 5);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PGRP, 0) <= 5);
+
+   errno = 0;
+   rc = nice(2);
+   DEVSHELL_CMD_ASSERT(rc == 7 && errno == 0);
+
+   /* Out of range values get clamped */
+   rc = setpriority(PRIO_PROCESS, 0, 100);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, 0) == 19);
+
+   rc = setpriority(12345, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   if (running_on_tilck()) {
+
+      /* Only the root user exists on Tilck: lowering the nice value is OK */
+      rc = setpriority(PRIO_PROCESS, 0, -20);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+      DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, 0) == -20);
+      DEVSHELL_CMD_ASSERT(nice(100) == 19);
+   }
+
+   /* The nice value is inherited across fork() */
+   if (!(child = fork()))
+      exit(getpriority(PRIO_PROCESS, 0));
+
+   DEVSHELL_CMD_ASSERT(child > 0);
+   rc = waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == child);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus));
+   exit(WEXITSTATUS(wstatus));
+}
+
+int cmd_nice(int argc, char **argv)
+{
+   int wstatus;
+   int child;
+   int rc;
+
+   if (!(child = fork()))
+      nice_child();
+
+   DEVSHELL_CMD_ASSERT(child > 0);
+   rc = waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == child);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus));
+   DEVSHELL_CMD_ASSERT(WEXITSTATUS(wstatus) == 19);
+   return 0;
+}
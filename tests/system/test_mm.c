@@ -125,6 +125,128 @@ int cmd_mmap(int argc, char **argv)
    return 0;
 }
 
+static bool is_zeroed(char *buf, size_t len, size_t step)
+{
+   for (size_t off = 0; off < len; off += step)
+      if (buf[off])
+         return false;
+
+   return true;
+}
+
+/*
+ * mmap() a region of `mb` MB, then write one byte on every `step`-th page and
+ * return the cycles spent in the mmap, in the touching and in the munmap.
+ */
+static void
+mmap_touch_measure(size_t mb, size_t step, ull_t *mmap_c, ull_t *touch_c,
+                   ull_t *munmap_c)
+{
+   const size_t page_size = getpagesize();
+   const size_t len = mb * MB;
+   ull_t start;
+   char *buf;
+   int rc;
+
+   start = RDTSC();
+   buf = mmap(NULL,
+              len,
+              PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE,
+              -1,
+              0);
+   *mmap_c = RDTSC() - start;
+
+   DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+
+   start = RDTSC();
+
+   for (size_t off = 0; off < len; off += step * page_size)
+      buf[off] = 1;
+
+   *touch_c = RDTSC() - start;
+
+   /* The pages we didn't touch must read as zero, like the rest */
+   for (size_t off = 0; off < len; off += step * page_size)
+      buf[off] = 0;
+
+   DEVSHELL_CMD_ASSERT(is_zeroed(buf, len, page_size / 4));
+
+   start = RDTSC();
+   rc = munmap(buf, len);
+   *munmap_c = RDTSC() - start;
+
+   DEVSHELL_CMD_ASSERT(rc == 0);
+}
+
+static void mmap_touch_brk_check(void)
+{
+   const size_t page_size = getpagesize();
+   const size_t len = 16 * MB;
+   char *orig_brk = (void *)syscall(SYS_brk, 0);
+   char *b;
+
+   b = (void *)syscall(SYS_brk, orig_brk + len);
+   DEVSHELL_CMD_ASSERT(b == orig_brk + len);
+   DEVSHELL_CMD_ASSERT(is_zeroed(orig_brk, len, page_size / 2));
+
+   memset(orig_brk, 0xaa, len);
+
+   /* Shrink and grow back: the pages must come back zeroed */
+   b = (void *)syscall(SYS_brk, orig_brk);
+   DEVSHELL_CMD_ASSERT(b == orig_brk);
+
+   b = (void *)syscall(SYS_brk, orig_brk + len);
+   DEVSHELL_CMD_ASSERT(b == orig_brk + len);
+   DEVSHELL_CMD_ASSERT(is_zeroed(orig_brk, len, page_size / 2));
+
+   b = (void *)syscall(SYS_brk, orig_brk);
+   DEVSHELL_CMD_ASSERT(b == orig_brk);
+}
+
+/*
+ * Measure the cost of mmap() + touching the memory, in the "sparse" case (one
+ * page every 64) and in the "dense" one (all the pages). With anonymous memory
+ * allocated on demand, the mmap() itself is cheap and the cost is paid only
+ * for the pages actually touched, while with MMAP_NO_COW=1 everything is
+ * allocated in mmap().
+ */
+int cmd_mmap_touch(int argc, char **argv)
+{
+   const size_t mb = 32;
+   const size_t pages = mb * MB / getpagesize();
+   const size_t steps[] = { 64, 1 };
+   const int iters = 4;
+
+   mmap_touch_brk_check();
+
+   printf("Anonymous mmap() of %zu MB%s\n",
+          mb, MMAP_NO_COW ? " [MMAP_NO_COW]" : "");
+
+   for (int i = 0; i < ARRAY_SIZE(steps); i++) {
+
+      ull_t tot_mmap = 0, tot_touch = 0, tot_munmap = 0;
+      ull_t mmap_c, touch_c, munmap_c;
+      const size_t touched = pages / steps[i];
+
+      for (int j = 0; j < iters; j++) {
+         mmap_touch_measure(mb, steps[i], &mmap_c, &touch_c, &munmap_c);
+         tot_mmap += mmap_c;
+         tot_touch += touch_c;
+         tot_munmap += munmap_c;
+      }
+
+      printf("Touch %5zu pages: mmap: %7llu K, touch: %5llu/page, "
+             "munmap: %7llu K cycles\n",
+             touched,
+             tot_mmap / iters / 1000,
+             tot_touch / iters / touched,
+             tot_munmap / iters / 1000);
+   }
+
+   return 0;
+}
+
 static void no_munmap_bad_child(void)
 {
    const size_t alloc_size = 128 * KB;
@@ -391,3 +513,661 @@ int cmd_fork_oom(int argc, char **argv)
    free(buf);
    return rc;
 }
+
+static void oom_kill_alloc(size_t size, const char *who)
+{
+   char *buf = malloc(size);
+
+   if (!buf) {
+      printf("%s [%d]: Alloc failed!\n", who, getpid());
+      exit(1);
+   }
+
+   memset(buf, 0xAA, size);
+}
+
+/*
+ * Let a process (the "hog") commit more than half of the usable memory and
+ * then make another one (the "grower") try to do the same. Check that the OOM
+ * killer picks the hog, because it's the biggest process, and that the grower
+ * gets the memory it needs and completes successfully.
+ */
+int cmd_oom_kill(int argc, char **argv)
+{
+   int rc, wstatus, pipefd[2];
+   pid_t hog, grower;
+   size_t size;
+   char c;
+
+   if (!getenv("TILCK")) {
+      printf(PFX "[SKIP] because we're not running on Tilck\n");
+      return 0;
+   }
+
+   size = mm_estimate_usable_mem();
+   DEVSHELL_CMD_ASSERT(size != 0);
+
+   if (size > 500 * MB) {
+
+      /*
+       * The usable memory is limited by the size of the user mappings heap,
+       * not by the physical memory: two processes won't exhaust the latter.
+       */
+      printf(PFX "[SKIP] because there's too much memory\n");
+      return 0;
+   }
+
+   size = size / 2 + size / 8;
+   printf(PFX "Hog and grower alloc %zu KB each\n", size / KB);
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   hog = fork();
+   DEVSHELL_CMD_ASSERT(hog >= 0);
+
+   if (!hog) {
+
+      close(pipefd[0]);
+      oom_kill_alloc(size, "Hog");
+      rc = write(pipefd[1], "x", 1);
+
+      while (true)
+         pause();
+   }
+
+   close(pipefd[1]);
+   rc = read(pipefd[0], &c, 1);
+   close(pipefd[0]);
+
+   if (rc != 1) {
+      printf(PFX "The hog died before committing its memory\n");
+      waitpid(hog, &wstatus, 0);
+      return 1;
+   }
+
+   grower = fork();
+   DEVSHELL_CMD_ASSERT(grower >= 0);
+
+   if (!grower) {
+      oom_kill_alloc(size, "Grower");
+      exit(0);
+   }
+
+   rc = waitpid(grower, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == grower);
+
+   if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+      printf(PFX "The grower failed, wstatus: %#x\n", wstatus);
+      kill(hog, SIGKILL);
+      waitpid(hog, &wstatus, 0);
+      return 1;
+   }
+
+   /* The hog has a pending SIGKILL, but it might have not run yet */
+   for (int i = 0; i < 40; i++) {
+
+      rc = waitpid(hog, &wstatus, WNOHANG);
+      DEVSHELL_CMD_ASSERT(rc >= 0);
+
+      if (rc == hog)
+         break;
+
+      usleep(50 * 1000);
+   }
+
+   if (rc != hog) {
+      printf(PFX "The hog has not been killed\n");
+      kill(hog, SIGKILL);
+      waitpid(hog, &wstatus, 0);
+      return 1;
+   }
+
+   if (!WIFSIGNALED(wstatus) || WTERMSIG(wstatus) != SIGKILL) {
+      printf(PFX "The hog did not die by SIGKILL, wstatus: %#x\n", wstatus);
+      return 1;
+   }
+
+   printf(PFX "The hog has been killed by the OOM killer, as expected\n");
+   return 0;
+}
+
+#define HUGE_PAGE_SIZE        (4 * MB)
+
+static char *mmap_anon(size_t len, int extra_flags)
+{
+   char *buf = mmap(NULL,
+                    len,
+                    PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE | extra_flags,
+                    -1,
+                    0);
+
+   DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+   return buf;
+}
+
+static void mmap_huge_fork_child(char *buf, size_t len)
+{
+   const size_t page_size = getpagesize();
+
+   for (size_t off = 0; off < len; off += page_size) {
+      if (buf[off] != (char)(off / page_size)) {
+         printf(STR_CHILD "Unexpected value at offset %zu\n", off);
+         exit(1);
+      }
+   }
+
+   /* Write on both the parent's big pages and on the split ones */
+   memset(buf, 0xcc, len);
+   exit(0);
+}
+
+/*
+ * Check that the memory mapped with MAP_HUGETLB behaves exactly like the
+ * regular anonymous memory, after fork() and after partial munmap()s, which
+ * both require the big pages to be split.
+ */
+static void mmap_huge_check(void)
+{
+   const size_t page_size = getpagesize();
+   const size_t len = 4 * HUGE_PAGE_SIZE;
+   int child, wstatus, rc;
+   char *buf;
+
+   buf = mmap_anon(len, MAP_HUGETLB);
+   DEVSHELL_CMD_ASSERT(((size_t)buf & (HUGE_PAGE_SIZE - 1)) == 0);
+   DEVSHELL_CMD_ASSERT(is_zeroed(buf, len, page_size / 4));
+
+   for (size_t off = 0; off < len; off += page_size)
+      buf[off] = (char)(off / page_size);
+
+   /* Unmap a single page in the middle of the 2nd big page */
+   rc = munmap(buf + HUGE_PAGE_SIZE + 7 * page_size, page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(buf[HUGE_PAGE_SIZE + 6 * page_size] == 6);
+   DEVSHELL_CMD_ASSERT(buf[HUGE_PAGE_SIZE + 8 * page_size] == 8);
+
+   /* Unmap the whole 3rd big page */
+   rc = munmap(buf + 2 * HUGE_PAGE_SIZE, HUGE_PAGE_SIZE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Check the 1st big page across fork() */
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child)
+      mmap_huge_fork_child(buf, HUGE_PAGE_SIZE);
+
+   rc = waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == child);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   for (size_t off = 0; off < HUGE_PAGE_SIZE; off += page_size)
+      DEVSHELL_CMD_ASSERT(buf[off] == (char)(off / page_size));
+
+   rc = munmap(buf, HUGE_PAGE_SIZE + 7 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = munmap(buf + HUGE_PAGE_SIZE + 8 * page_size,
+               HUGE_PAGE_SIZE - 8 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = munmap(buf + 3 * HUGE_PAGE_SIZE, HUGE_PAGE_SIZE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+}
+
+/*
+ * Touch all the pages of an anonymous mapping of `mb` MB, then read one byte
+ * from a pseudo-random page, `reads` times. With 4 KB pages, such a pattern
+ * misses the TLB almost every time, while with 4 MB pages the whole region is
+ * covered by a few TLB entries. Returns the cycles per read and, through
+ * `touch_c`, the cycles spent for populating the mapping.
+ */
+static ull_t
+mmap_huge_measure(size_t mb, int extra_flags, size_t reads, ull_t *touch_c)
+{
+   const size_t page_size = getpagesize();
+   const size_t len = mb * MB;
+   const size_t pages = len / page_size;
+   volatile char *buf = mmap_anon(len, extra_flags);
+   ull_t start, elapsed;
+   size_t sum = 0;
+   unsigned r = 1234;
+   int rc;
+
+   start = RDTSC();
+
+   for (size_t off = 0; off < len; off += page_size)
+      buf[off] = 1;
+
+   *touch_c = RDTSC() - start;
+   start = RDTSC();
+
+   for (size_t i = 0; i < reads; i++) {
+      r = r * 1103515245 + 12345;
+      sum += buf[(r % pages) * page_size];
+   }
+
+   elapsed = RDTSC() - start;
+   DEVSHELL_CMD_ASSERT(sum == reads);
+
+   rc = munmap((void *)buf, len);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return elapsed / reads;
+}
+
+int cmd_mmap_huge(int argc, char **argv)
+{
+   const size_t mb = 64;
+   const size_t reads = 4 * 1000 * 1000;
+   ull_t touch_c, touch_huge_c, read_c, read_huge_c;
+
+   if (MMAP_NO_COW) {
+      printf(PFX "[SKIP] because MMAP_NO_COW=1\n");
+      return 0;
+   }
+
+   if (!getenv("TILCK")) {
+      printf(PFX "[SKIP] because we're not running on Tilck\n");
+      return 0;
+   }
+
+   mmap_huge_check();
+
+   read_c = mmap_huge_measure(mb, 0, reads, &touch_c);
+   read_huge_c = mmap_huge_measure(mb, MAP_HUGETLB, reads, &touch_huge_c);
+
+   printf("Anonymous mmap() of %zu MB, random reads\n", mb);
+   printf("4 KB pages:  touch: %6llu K, read: %4llu cycles\n",
+          touch_c / 1000, read_c);
+   printf("4 MB pages:  touch: %6llu K, read: %4llu cycles\n",
+          touch_huge_c / 1000, read_huge_c);
+   return 0;
+}
+
+/* Write a different byte at the beginning of each page in [off, len) */
+static void fill_pattern(char *buf, size_t off, size_t len)
+{
+   const size_t page_size = getpagesize();
+
+   for (; off < len; off += page_size)
+      buf[off] = (char)(off / page_size + 1);
+}
+
+static bool check_pattern(char *buf, size_t off, size_t len)
+{
+   const size_t page_size = getpagesize();
+
+   for (; off < len; off += page_size) {
+      if (buf[off] != (char)(off / page_size + 1))
+         return false;
+   }
+
+   return true;
+}
+
+static void mremap_fork_child(char *buf, size_t len)
+{
+   char *res = mremap(buf, len, 8 * len, MREMAP_MAYMOVE);
+
+   if (res == MAP_FAILED) {
+      printf(STR_CHILD "mremap() failed: %s\n", strerror(errno));
+      exit(1);
+   }
+
+   if (!check_pattern(res, 0, len)) {
+      printf(STR_CHILD "Unexpected data after mremap()\n");
+      exit(1);
+   }
+
+   /* Write on the moved CoW pages: our parent must not see that */
+   memset(res, 0xcc, 8 * len);
+   exit(0);
+}
+
+/*
+ * Check growth in place, shrinking and moves, using a hole made by munmap()
+ * and a mapping right after it: that doesn't depend on the mmap heap's state.
+ */
+static void mremap_check(void)
+{
+   const size_t page_size = getpagesize();
+   const size_t len = 8 * page_size;
+   int child, wstatus, rc;
+   char *buf, *res;
+
+   buf = mmap_anon(len, 0);
+   fill_pattern(buf, 0, len);
+
+   /* Make a hole: [buf, +2 pages) and [buf + 4 pages, +4 pages) remain */
+   rc = munmap(buf + 2 * page_size, 2 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Grow in place, in the hole */
+   res = mremap(buf, 2 * page_size, 4 * page_size, 0);
+   DEVSHELL_CMD_ASSERT(res == buf);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 0, 2 * page_size));
+   DEVSHELL_CMD_ASSERT(is_zeroed(buf + 2 * page_size, 2 * page_size, 4));
+   fill_pattern(buf, 0, 4 * page_size);
+
+   /* Shrink, then grow again: the dropped pages must be zero now */
+   res = mremap(buf, 4 * page_size, 3 * page_size, 0);
+   DEVSHELL_CMD_ASSERT(res == buf);
+   res = mremap(buf, 3 * page_size, 4 * page_size, 0);
+   DEVSHELL_CMD_ASSERT(res == buf);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 0, 3 * page_size));
+   DEVSHELL_CMD_ASSERT(is_zeroed(buf + 3 * page_size, page_size, 4));
+   fill_pattern(buf, 0, 4 * page_size);
+
+   /* The next pages are mapped: we cannot grow without moving */
+   res = mremap(buf, 4 * page_size, 6 * page_size, 0);
+   DEVSHELL_CMD_ASSERT(res == MAP_FAILED && errno == ENOMEM);
+
+   /*
+    * Same, with a new size beyond the end of the initial mmap heap: the
+    * adjacent mapping must be detected before trying to expand the heap.
+    */
+   res = mremap(buf, 4 * page_size, 2 * USER_MMAP_MIN_SZ, 0);
+   DEVSHELL_CMD_ASSERT(res == MAP_FAILED && errno == ENOMEM);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 0, 4 * page_size));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 4 * page_size, len));
+
+   /* Check that moving the pages works with CoW too */
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child)
+      mremap_fork_child(buf, 4 * page_size);
+
+   rc = waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == child);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 0, 4 * page_size));
+
+   /* Now move it in the parent, without CoW */
+   res = mremap(buf, 4 * page_size, 6 * page_size, MREMAP_MAYMOVE);
+   DEVSHELL_CMD_ASSERT(res != MAP_FAILED && res != buf);
+   DEVSHELL_CMD_ASSERT(check_pattern(res, 0, 4 * page_size));
+   DEVSHELL_CMD_ASSERT(is_zeroed(res + 4 * page_size, 2 * page_size, 4));
+
+   /* The mapping after the old one must be untouched */
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 4 * page_size, len));
+
+   rc = munmap(res, 6 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = munmap(buf + 4 * page_size, 4 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+}
+
+/*
+ * Grow a buffer from 64 KB to `max_len`, doubling its size each time, like
+ * realloc() does, touching all of its pages. With `use_mremap` false, we do
+ * what libc does without mremap(): mmap() + memcpy() + munmap().
+ */
+static ull_t mremap_measure(size_t max_len, bool use_mremap)
+{
+   const size_t page_size = getpagesize();
+   size_t len = 64 * KB;
+   ull_t start, tot = 0;
+   char *buf, *new_buf;
+   int rc;
+
+   buf = mmap_anon(len, 0);
+   memset(buf, 1, len);
+
+   for (; len < max_len; len *= 2) {
+
+      start = RDTSC();
+
+      if (use_mremap) {
+
+         new_buf = mremap(buf, len, 2 * len, MREMAP_MAYMOVE);
+         DEVSHELL_CMD_ASSERT(new_buf != MAP_FAILED);
+
+      } else {
+
+         new_buf = mmap_anon(2 * len, 0);
+         memcpy(new_buf, buf, len);
+         rc = munmap(buf, len);
+         DEVSHELL_CMD_ASSERT(rc == 0);
+      }
+
+      tot += RDTSC() - start;
+      buf = new_buf;
+
+      for (size_t off = len; off < 2 * len; off += page_size)
+         buf[off] = 1;
+   }
+
+   rc = munmap(buf, len);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return tot;
+}
+
+int cmd_mremap(int argc, char **argv)
+{
+   const size_t max_len = 32 * MB;
+   ull_t copy_c, mremap_c;
+
+   mremap_check();
+
+   copy_c = mremap_measure(max_len, false);
+   mremap_c = mremap_measure(max_len, true);
+
+   printf("Growing a buffer from 64 KB to %zu MB, doubling its size\n",
+          max_len / MB);
+   printf("mmap + memcpy + munmap: %8llu K cycles\n", copy_c / 1000);
+   printf("mremap:                 %8llu K cycles\n", mremap_c / 1000);
+   return 0;
+}
+
+static void mprotect_write_child(void *arg)
+{
+   char *ptr = arg;
+   char val = *ptr; /* reading must be allowed */
+
+   *ptr = val + 1;  /* but writing must not */
+   exit(0);         /* we should never get here */
+}
+
+static void mprotect_read_child(void *arg)
+{
+   printf(STR_CHILD "Value: %d\n", *(volatile char *)arg);
+   exit(0);         /* we should never get here */
+}
+
+static void mprotect_cow_child(char *buf, size_t len)
+{
+   /* Whenever the parent writes on its pages, we must not see that */
+   if (!check_pattern(buf, 0, len)) {
+      printf(STR_CHILD "Unexpected data after mprotect() in the parent\n");
+      exit(1);
+   }
+
+   exit(0);
+}
+
+int cmd_mprotect(int argc, char **argv)
+{
+   const size_t page_size = getpagesize();
+   const size_t len = 4 * page_size;
+   int child, wstatus, rc;
+   char *buf;
+
+   buf = mmap_anon(len, 0);
+   fill_pattern(buf, 0, len);
+
+   rc = mprotect(buf + 1, page_size, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   /* Make just the 2nd page read-only: that splits the mapping in 3 parts */
+   rc = mprotect(buf + page_size, page_size, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = test_sig(&mprotect_write_child, buf + page_size, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* The other pages are still writable */
+   buf[0]++;
+   buf[2 * page_size]++;
+   buf[0]--;
+   buf[2 * page_size]--;
+
+   /* Make the whole range inaccessible */
+   rc = mprotect(buf, len, PROT_NONE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = test_sig(&mprotect_read_child, buf + 3 * page_size, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Read-only again, then writable after fork(): that requires CoW */
+   rc = mprotect(buf, len, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 0, len));
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child)
+      mprotect_cow_child(buf, len);
+
+   rc = mprotect(buf, len, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   memset(buf, 0xcc, len);
+
+   rc = waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == child);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   /* munmap() must work across the parts of the split mapping */
+   rc = munmap(buf, len);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = mprotect(buf, len, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOMEM);
+   return 0;
+}
+
+/* Number of pages actually mapped in [buf, buf + len), according to mincore */
+static size_t count_resident_pages(char *buf, size_t len)
+{
+   const size_t page_size = getpagesize();
+   unsigned char vec[16];
+   size_t count = 0;
+   int rc;
+
+   DEVSHELL_CMD_ASSERT(len <= sizeof(vec) * page_size);
+
+   rc = mincore(buf, len, vec);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (size_t i = 0; i < len / page_size; i++)
+      count += vec[i] & 1;
+
+   return count;
+}
+
+int cmd_madvise(int argc, char **argv)
+{
+   static const char test_file[] = "/tmp/madvise_test";
+   const size_t page_size = getpagesize();
+   const size_t len = 4 * page_size;
+   char *buf, *fbuf;
+   int fd, rc;
+
+   buf = mmap_anon(len, 0);
+
+   /* MADV_DONTNEED and MADV_FREE drop the pages: they're zero afterwards */
+   fill_pattern(buf, 0, len);
+   rc = madvise(buf + page_size, 2 * page_size, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 0, page_size));
+   DEVSHELL_CMD_ASSERT(is_zeroed(buf + page_size, 2 * page_size, 4));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 3 * page_size, len));
+
+   fill_pattern(buf, 0, len);
+   rc = madvise(buf, len, MADV_FREE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(is_zeroed(buf, len, 4));
+
+   /* The recognized hints can be ignored, but not the unknown ones */
+   rc = madvise(buf, len, MADV_SEQUENTIAL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = madvise(buf, len, 1234);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = munmap(buf, len);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = madvise(buf, len, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOMEM);
+
+   /* MADV_WILLNEED on a ramfs file: the data must be the same */
+   fd = open(test_file, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+
+   buf = malloc(len);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   fill_pattern(buf, 0, len);
+   rc = write(fd, buf, len);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+
+   fbuf = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(fbuf != MAP_FAILED);
+
+   /* The pages of a file mapping are mapped on the first access */
+   DEVSHELL_CMD_ASSERT(count_resident_pages(fbuf, len) == 0);
+
+   rc = madvise(fbuf, len, MADV_WILLNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(count_resident_pages(fbuf, len) == len / page_size);
+   DEVSHELL_CMD_ASSERT(!memcmp(fbuf, buf, len));
+
+   /* On file mappings, MADV_DONTNEED must not lose any data */
+   rc = madvise(fbuf, len, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(!memcmp(fbuf, buf, len));
+
+   rc = munmap(fbuf, len);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   free(buf);
+   close(fd);
+
+   rc = unlink(test_file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+/*
+ * Create many small mappings, in order to have a deep mappings tree in the
+ * kernel, then check their contents and remove them in a scattered order.
+ */
+int cmd_mmap_many(int argc, char **argv)
+{
+   const size_t page_size = getpagesize();
+   const int count = 512;
+   char *bufs[count];
+   int rc;
+
+   for (int i = 0; i < count; i++) {
+      bufs[i] = mmap_anon(page_size, 0);
+      bufs[i][0] = (char)i;
+   }
+
+   for (int i = 0; i < count; i++)
+      DEVSHELL_CMD_ASSERT(bufs[i][0] == (char)i);
+
+   /* Unmap the odd ones first, then check the even ones are still there */
+   for (int i = 1; i < count; i += 2) {
+      rc = munmap(bufs[i], page_size);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   for (int i = 0; i < count; i += 2) {
+      DEVSHELL_CMD_ASSERT(bufs[i][0] == (char)i);
+      rc = munmap(bufs[i], page_size);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   return 0;
+}
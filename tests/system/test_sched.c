@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/select.h>
+#include <poll.h>
+
+#include "devshell.h"
+#include "test_common.h"
+
+#define RT_LAT_ITERS                   50
+#define RT_LAT_SLEEP_US              1000
+#define RT_LAT_MAX_US               20000
+
+#define OVERSHOOT_ITERS               100
+#define OVERSHOOT_MAX_P50_US         1000
+
+/*
+ * NOTE: libmusl's sched_setscheduler() is just a stub returning ENOSYS,
+ * because on Linux the syscall works at thread level. Use the syscall directly.
+ */
+static int set_sched(int policy, int prio)
+{
+   struct sched_param p = { .sched_priority = prio };
+   return (int)syscall(SYS_sched_setscheduler, 0, policy, &p);
+}
+
+static int get_sched(void)
+{
+   return (int)syscall(SYS_sched_getscheduler, 0);
+}
+
+static u64 ts_to_us(const struct timespec *ts)
+{
+   return (u64)ts->tv_sec * 1000000 + (u64)ts->tv_nsec / 1000;
+}
+
+/*
+ * Sleep RT_LAT_ITERS times for RT_LAT_SLEEP_US and return the max wake-up
+ * latency, in microseconds: the time elapsed after the requested sleep time.
+ */
+static u64 measure_wakeup_latency(u64 *avg)
+{
+   const struct timespec req = { .tv_sec = 0, .tv_nsec = RT_LAT_SLEEP_US*1000 };
+   struct timespec t0, t1;
+   u64 lat, max_lat = 0, tot_lat = 0;
+
+   for (int i = 0; i < RT_LAT_ITERS; i++) {
+
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      nanosleep(&req, NULL);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+
+      lat = ts_to_us(&t1) - ts_to_us(&t0);
+      lat = lat > RT_LAT_SLEEP_US ? lat - RT_LAT_SLEEP_US : 0;
+      max_lat = MAX(max_lat, lat);
+      tot_lat += lat;
+   }
+
+   *avg = tot_lat / RT_LAT_ITERS;
+   return max_lat;
+}
+
+int cmd_rt_latency(int argc, char **argv)
+{
+   u64 cfs_max, cfs_avg, rt_max, rt_avg;
+   int hog_pid, rc, wstatus;
+
+   DEVSHELL_CMD_ASSERT(syscall(SYS_sched_get_priority_min, SCHED_FIFO) == 1);
+   DEVSHELL_CMD_ASSERT(syscall(SYS_sched_get_priority_max, SCHED_FIFO) == 99);
+   DEVSHELL_CMD_ASSERT(syscall(SYS_sched_get_priority_max, SCHED_OTHER) == 0);
+   DEVSHELL_CMD_ASSERT(get_sched() == SCHED_OTHER);
+
+   /* Invalid priorities for the given policy */
+   DEVSHELL_CMD_ASSERT(set_sched(SCHED_OTHER, 1) < 0 && errno == EINVAL);
+   DEVSHELL_CMD_ASSERT(set_sched(SCHED_FIFO, 0) < 0 && errno == EINVAL);
+   DEVSHELL_CMD_ASSERT(set_sched(SCHED_RR, 100) < 0 && errno == EINVAL);
+
+   hog_pid = fork();
+   DEVSHELL_CMD_ASSERT(hog_pid >= 0);
+
+   if (!hog_pid) {
+
+      /* The CPU hog: just spin until killed */
+      while (true) { }
+   }
+
+   cfs_max = measure_wakeup_latency(&cfs_avg);
+   printf("SCHED_OTHER wake-up latency: avg: %5llu us, max: %5llu us\n",
+          (ull_t)cfs_avg, (ull_t)cfs_max);
+
+   if ((rc = set_sched(SCHED_FIFO, 50)) < 0) {
+
+      rc = errno;
+      kill(hog_pid, SIGKILL);
+      waitpid(hog_pid, &wstatus, 0);
+
+      if (rc == EPERM && !running_on_tilck()) {
+         printf("[SKIP]: Unable to set SCHED_FIFO (no privileges)\n");
+         return 0;
+      }
+
+      errno = rc;
+      DEVSHELL_CMD_ASSERT(false);
+   }
+
+   DEVSHELL_CMD_ASSERT(get_sched() == SCHED_FIFO);
+   rt_max = measure_wakeup_latency(&rt_avg);
+   DEVSHELL_CMD_ASSERT(set_sched(SCHED_OTHER, 0) == 0);
+
+   printf("SCHED_FIFO  wake-up latency: avg: %5llu us, max: %5llu us\n",
+          (ull_t)rt_avg, (ull_t)rt_max);
+
+   kill(hog_pid, SIGKILL);
+   rc = waitpid(hog_pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == hog_pid);
+
+   /*
+    * A SCHED_FIFO task preempts the CPU hog as soon as it's woken up, while a
+    * SCHED_OTHER task might have to wait until the end of the hog's timeslice.
+    */
+   DEVSHELL_CMD_ASSERT(rt_max <= RT_LAT_MAX_US);
+   return 0;
+}
+
+enum sleep_kind {
+   SLEEP_NANOSLEEP,
+   SLEEP_POLL,
+   SLEEP_SELECT,
+};
+
+static const char *const sleep_kind_str[] = {
+   [SLEEP_NANOSLEEP] = "nanosleep",
+   [SLEEP_POLL]      = "poll",
+   [SLEEP_SELECT]    = "select",
+};
+
+static void do_sleep_us(enum sleep_kind kind, u64 us)
+{
+   struct timespec req = {
+      .tv_sec = (time_t)(us / 1000000),
+      .tv_nsec = (long)(us % 1000000) * 1000,
+   };
+   struct timeval tv = {
+      .tv_sec = (time_t)(us / 1000000),
+      .tv_usec = (suseconds_t)(us % 1000000),
+   };
+
+   switch (kind) {
+      case SLEEP_NANOSLEEP:
+         nanosleep(&req, NULL);
+         break;
+      case SLEEP_POLL:
+         poll(NULL, 0, (int)(us / 1000));
+         break;
+      case SLEEP_SELECT:
+         select(0, NULL, NULL, NULL, &tv);
+         break;
+   }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+   const u64 x = *(const u64 *)a;
+   const u64 y = *(const u64 *)b;
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+ * Sleep OVERSHOOT_ITERS times for `us` microseconds and print the distribution
+ * of the overshoot (actual sleep time - requested sleep time). Returns the
+ * median overshoot, in microseconds.
+ */
+static u64 measure_sleep_overshoot(enum sleep_kind kind, u64 us)
+{
+   static const u64 buckets[] = { 10, 50, 100, 500, 1000, 5000 };
+   u64 overshoot[OVERSHOOT_ITERS];
+   u32 hist[ARRAY_SIZE(buckets) + 1] = {0};
+   struct timespec t0, t1;
+   u64 elapsed;
+   u32 b;
+
+   for (int i = 0; i < OVERSHOOT_ITERS; i++) {
+
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      do_sleep_us(kind, us);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+
+      elapsed = ts_to_us(&t1) - ts_to_us(&t0);
+      overshoot[i] = elapsed > us ? elapsed - us : 0;
+
+      for (b = 0; b < ARRAY_SIZE(buckets); b++)
+         if (overshoot[i] < buckets[b])
+            break;
+
+      hist[b]++;
+   }
+
+   qsort(overshoot, OVERSHOOT_ITERS, sizeof(u64), &cmp_u64);
+
+   printf("%-9s %6llu us: overshoot min: %5llu, p50: %5llu, "
+          "p90: %5llu, max: %5llu us\n",
+          sleep_kind_str[kind],
+          (ull_t)us,
+          (ull_t)overshoot[0],
+          (ull_t)overshoot[OVERSHOOT_ITERS / 2],
+          (ull_t)overshoot[OVERSHOOT_ITERS * 9 / 10],
+          (ull_t)overshoot[OVERSHOOT_ITERS - 1]);
+
+   printf("   ");
+
+   for (b = 0; b < ARRAY_SIZE(buckets); b++)
+      printf("<%llu: %3u  ", (ull_t)buckets[b], hist[b]);
+
+   printf(">=%llu: %3u\n", (ull_t)buckets[b - 1], hist[b]);
+   return overshoot[OVERSHOOT_ITERS / 2];
+}
+
+int cmd_sleep_overshoot(int argc, char **argv)
+{
+   static const u64 nanosleep_us[] = { 50, 100, 500, 1000, 5000 };
+   u64 p50;
+
+   for (u32 i = 0; i < ARRAY_SIZE(nanosleep_us); i++) {
+
+      p50 = measure_sleep_overshoot(SLEEP_NANOSLEEP, nanosleep_us[i]);
+
+      /*
+       * With high-resolution timers, sleeping must not be rounded up to
+       * whole ticks: the median overshoot must be well below a tick.
+       */
+      DEVSHELL_CMD_ASSERT(p50 <= OVERSHOOT_MAX_P50_US);
+   }
+
+   p50 = measure_sleep_overshoot(SLEEP_POLL, 1000);
+   DEVSHELL_CMD_ASSERT(p50 <= OVERSHOOT_MAX_P50_US);
+
+   p50 = measure_sleep_overshoot(SLEEP_SELECT, 200);
+   DEVSHELL_CMD_ASSERT(p50 <= OVERSHOOT_MAX_P50_US);
+   return 0;
+}
@@ -411,6 +411,58 @@ TEST(avl_bintree, first_last_obj)
    ASSERT_TRUE(l == &arr[elems - 1]);
 }
 
+TEST(avl_bintree, find_le_ge)
+{
+   struct long_struct {
+      long val;
+      struct bintree_node node;
+   };
+
+   constexpr const int elems = 32;
+   int_struct arr[elems];
+   long_struct larr[elems];
+   int_struct *root = NULL;
+   long_struct *lroot = NULL;
+   int le_idx, ge_idx;
+
+   /* Insert the even numbers: 10, 12, ... 72 */
+   for (int i = 0; i < elems; i++) {
+
+      arr[i] = int_struct(10 + 2 * i);
+      bintree_insert(&root, &arr[i], my_cmpfun, int_struct, node);
+
+      larr[i].val = 10 + 2 * i;
+      bintree_node_init(&larr[i].node);
+      bintree_insert_ptr(&lroot, &larr[i], long_struct, node, val);
+   }
+
+   for (int v = 0; v < 100; v++) {
+
+      le_idx = v < 10 ? -1 : MIN(v - 10, 2 * elems - 2) / 2;
+      ge_idx = v > 72 ? -1 : (MAX(v, 10) - 9) / 2;
+
+      ASSERT_EQ(
+         bintree_find_le(root, &v, cmpfun_objval, int_struct, node),
+         le_idx >= 0 ? &arr[le_idx] : NULL
+      ) << "v: " << v;
+
+      ASSERT_EQ(
+         bintree_find_ge(root, &v, cmpfun_objval, int_struct, node),
+         ge_idx >= 0 ? &arr[ge_idx] : NULL
+      ) << "v: " << v;
+
+      ASSERT_EQ(
+         bintree_find_le_ptr(lroot, v, long_struct, node, val),
+         le_idx >= 0 ? &larr[le_idx] : NULL
+      ) << "v: " << v;
+
+      ASSERT_EQ(
+         bintree_find_ge_ptr(lroot, v, long_struct, node, val),
+         ge_idx >= 0 ? &larr[ge_idx] : NULL
+      ) << "v: " << v;
+   }
+}
+
 static void test_insert_rand_data(int iters, int elems, bool slow_checks)
 {
    random_device rdev;
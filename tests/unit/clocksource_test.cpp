@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <random>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/kernel/clocksource.h>
+}
+
+using namespace std;
+using namespace testing;
+
+/* Fake hardware: a counter running at `freq_mhz` MHz */
+static u64 true_ns;
+static u64 freq_mhz;
+
+static u64 fake_read(void)
+{
+   return true_ns * freq_mhz / 1000;
+}
+
+static u64 read_ns(void)
+{
+   u64 ns;
+   bool ok = clocksource_get_ns(&ns);
+   EXPECT_TRUE(ok);
+   return ns;
+}
+
+class clocksource_test : public Test {
+
+   void TearDown() override {
+      clocksource_select(NULL);
+   }
+};
+
+TEST_F(clocksource_test, calibrate)
+{
+   const u64 freqs[] = { 14, 100, 1000, 2500, 3333, 5000 };   /* MHz */
+   const u64 calib_ns = 100 * 1000 * 1000;
+   struct clocksource cs = { "fake", &fake_read, 0, 0, 0 };
+
+   for (u64 f : freqs) {
+
+      const u64 cycles_per_sec = f * 1000 * 1000;
+      u64 ns;
+
+      clocksource_calibrate(&cs, calib_ns * f / 1000, calib_ns);
+      ns = clocksource_cyc2ns(cycles_per_sec, cs.mult, cs.shift);
+
+      /* Slightly slower than the real time, by design */
+      ASSERT_LE(ns, 1000000000ull) << "freq: " << f << " MHz";
+      ASSERT_GE(ns, 1000000000ull - 300000ull) << "freq: " << f << " MHz";
+   }
+}
+
+/*
+ * How much the tick-based time advances at the i-th tick. Simulate the clock
+ * drift compensation, which makes the ticks 10% shorter or longer.
+ */
+static u32 get_tick_ns(u32 i, u32 tick)
+{
+   if (IN_RANGE(i, 5050, 8050))
+      return tick - tick / 10;
+
+   if (IN_RANGE(i, 12050, 14050))
+      return tick + tick / 10;
+
+   return tick;
+}
+
+TEST_F(clocksource_test, monotonic)
+{
+   const u32 tick = 4 * 1000 * 1000;     /* 250 Hz */
+   struct clocksource cs = { "fake", &fake_read, 0, 0, 0 };
+   mt19937 e(1234);
+   uniform_int_distribution<u32> latency_dist(0, 50 * 1000);
+   uniform_int_distribution<u32> read_dist(0, tick / 8);
+   u64 sys_time = 0;       /* tick-based time, as in timer.c */
+   u64 edge;               /* true time of the last tick */
+   u64 last = 0;
+   u32 tick_ns;
+
+   freq_mhz = 2500;
+   true_ns = 123456789;
+   edge = true_ns;
+
+   /* Calibrate over 25 ticks, with some error */
+   clocksource_calibrate(&cs, (25 * tick + 1500) * freq_mhz / 1000,
+                         25 * tick);
+   clocksource_select(&cs);
+   clocksource_update(sys_time, get_tick_ns(0, tick), tick);
+
+   for (u32 i = 0; i < 20000; i++) {
+
+      tick_ns = get_tick_ns(i, tick);
+
+      /* Read the time a few times, before the next tick */
+      while (true_ns + tick / 8 < edge + tick) {
+
+         const u64 expected = sys_time + (true_ns - edge) * tick_ns / tick;
+         const u64 ns = read_ns();
+
+         /*
+          * When the tick-based time slows down, the interpolated time might
+          * be ahead of it by up to 10% of the IRQ latency: it won't go back,
+          * it will just slowly converge, because of the calibration bias.
+          */
+         ASSERT_GE(ns, last) << "tick: " << i;
+         ASSERT_LE(ns, expected + 10 * 1000) << "tick: " << i;
+         ASSERT_GE(ns + 100 * 1000, expected) << "tick: " << i;
+
+         last = ns;
+         true_ns += read_dist(e);
+      }
+
+      /* The timer IRQ handler runs a bit after the tick */
+      edge += tick;
+      sys_time += tick_ns;
+      true_ns = edge + latency_dist(e);
+
+      tick_ns = get_tick_ns(i + 1, tick);
+
+      /* Simulate the tickless idle, by skipping some updates */
+      if (i % 100)
+         clocksource_update(sys_time + (true_ns - edge) * tick_ns / tick,
+                            tick_ns,
+                            tick);
+   }
+}
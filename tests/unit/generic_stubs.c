@@ -17,6 +17,8 @@ bool hi_vmem_avail(void) { return false; }
 int kthread_create2() { return -12; /* ENOMEM */}
 
 void invalidate_page() {}
+void invalidate_pages() {}
+void invalidate_all_pages() {}
 void init_serial_port() { }
 void serial_write() { }
 void handle_fault() { }
@@ -32,6 +34,13 @@ void gdt_install() { }
 void idt_install() { }
 void irq_install() { }
 void hw_timer_setup() { }
+void hw_timer_max_oneshot_ticks() { }
+void hw_timer_setup_oneshot() { }
+void hw_timer_stop_oneshot() { }
+void hw_timer_is_oneshot() { }
+void hw_timer_ack_irq() { }
+void hw_timer_get_elapsed_ns() { }
+void hw_get_clocksource() { }
 void irq_install_handler() { }
 void irq_uninstall_handler() { }
 void setup_sysenter_interface() { }
@@ -48,6 +57,7 @@ void arch_specific_new_proc_setup() { NOT_REACHED(); }
 void arch_specific_free_proc() { NOT_REACHED(); }
 void fpu_context_begin() { }
 void fpu_context_end() { }
+void fpu_memset256() { NOT_REACHED(); }
 void map_zero_pages() { NOT_REACHED(); }
 void dump_var_mtrrs() { }
 void set_page_rw() { }
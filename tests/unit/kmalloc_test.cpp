@@ -5,6 +5,7 @@
 #include <cassert>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 #include <random>
 #include <memory>
@@ -18,11 +19,16 @@
 
 extern "C" {
 
+   #include <tilck_gen_headers/config_kmalloc.h>
+
    #include <tilck/common/utils.h>
+   #include <tilck/common/arch/generic_x86/x86_utils.h>
 
    #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/kmalloc_debug.h>
    #include <tilck/kernel/paging.h>
    #include <tilck/kernel/self_tests.h>
+   #include <tilck/kernel/shrinker.h>
 
    #include <kernel/kmalloc/kmalloc_heap_struct.h> // kmalloc private header
    #include <kernel/kmalloc/kmalloc_block_node.h>  // kmalloc private header
@@ -30,6 +36,9 @@ extern "C" {
    extern bool mock_kmalloc;
    extern bool suppress_printk;
    extern struct kmalloc_heap *heaps[KMALLOC_HEAPS_COUNT];
+   extern int used_heaps;
+   extern u32 main_heaps_free_summary[KMALLOC_SIZE_CLASSES];
+   extern u32 main_heaps_dma_mask;
    void selftest_kmalloc_perf_per_size(int size);
    void kmalloc_dump_heap_stats(void);
    void *node_to_ptr(struct kmalloc_heap *h, int node, size_t size);
@@ -177,12 +186,234 @@ TEST_F(kmalloc_test, chaos_test)
          kmalloc_chaos_test_sub(e, dist);
       }) << "i: " << i;
 
+      /* The empty small heaps are kept until there's memory pressure */
+      shrink_caches((size_t)-1);
+
       ASSERT_NO_FATAL_FAILURE({
          check_heaps_metadata(meta_before);
       }) << "i: " << i;
    }
 }
 
+/* Size of the biggest free block in the sub-tree of `node`, by the metadata */
+static size_t
+heap_biggest_free_block(struct kmalloc_heap *h, int node, size_t size)
+{
+   struct block_node n = ((struct block_node *)h->metadata_nodes)[node];
+
+   if (n.allocated || n.full)
+      return 0;
+
+   if (!n.split)
+      return size;
+
+   return max(heap_biggest_free_block(h, NODE_LEFT(node), size / 2),
+              heap_biggest_free_block(h, NODE_RIGHT(node), size / 2));
+}
+
+/*
+ * Check that, for each main heap, `max_free` is an upper bound for its biggest
+ * free block and that the global summary matches the heaps' `max_free`.
+ */
+static void check_main_heaps_free_summary()
+{
+   for (int i = 0; i < used_heaps; i++) {
+
+      struct kmalloc_heap *h = heaps[i];
+      const size_t biggest = heap_biggest_free_block(h, 0, h->size);
+
+      ASSERT_EQ(h->main_idx, i);
+      ASSERT_GE(h->max_free, biggest) << "heap: " << i;
+      ASSERT_EQ(!!(main_heaps_dma_mask & (1u << i)), h->dma);
+
+      for (u32 c = 0; c < KMALLOC_SIZE_CLASSES; c++) {
+
+         const bool bit = !!(main_heaps_free_summary[c] & (1u << i));
+         ASSERT_EQ(bit, (1ul << c) <= h->max_free)
+            << "heap: " << i << ", class: " << c;
+      }
+   }
+}
+
+static bool any_main_heap_has_free_block(size_t size)
+{
+   for (int i = 0; i < used_heaps; i++)
+      if (heap_biggest_free_block(heaps[i], 0, heaps[i]->size) >= size)
+         return true;
+
+   return false;
+}
+
+static void print_latency_percentiles(const char *what, vector<u64> &v)
+{
+   sort(v.begin(), v.end());
+
+   printf("[ INFO     ] %-24s p50: %5llu, p90: %5llu, p99: %6llu, max: %7llu\n",
+          what,
+          (unsigned long long)v[v.size() * 50 / 100],
+          (unsigned long long)v[v.size() * 90 / 100],
+          (unsigned long long)v[v.size() * 99 / 100],
+          (unsigned long long)v.back());
+}
+
+TEST_F(kmalloc_test, fragmented_heap_latency)
+{
+   const size_t block_size = 4 * KB;
+   const int iters = 2000;
+   vector<void *> blocks;
+   vector<u64> lat_fail, lat_big, lat_block;
+   void *ptr;
+
+   ASSERT_NO_FATAL_FAILURE(check_main_heaps_free_summary());
+
+   /* Fill all the main heaps with 4 KB blocks */
+   while ((ptr = kmalloc(block_size)))
+      blocks.push_back(ptr);
+
+   ASSERT_GT(blocks.size(), 1000u);
+   ASSERT_NO_FATAL_FAILURE(check_main_heaps_free_summary());
+
+   /* Free every other block: the heaps are now full of 4 KB holes */
+   for (size_t i = 0; i < blocks.size(); i += 2) {
+      kfree2(blocks[i], block_size);
+      blocks[i] = nullptr;
+   }
+
+   ASSERT_NO_FATAL_FAILURE(check_main_heaps_free_summary());
+
+   for (int i = 0; i < iters; i++) {
+
+      u64 start = RDTSC();
+      ptr = kmalloc(256 * KB);
+      lat_fail.push_back(RDTSC() - start);
+
+      /* No false failures, even with the fast path */
+      ASSERT_EQ(ptr == nullptr, !any_main_heap_has_free_block(256 * KB));
+
+      if (ptr)
+         kfree2(ptr, 256 * KB);
+
+      start = RDTSC();
+      ptr = kmalloc(2 * block_size);
+      lat_big.push_back(RDTSC() - start);
+
+      if (ptr)
+         kfree2(ptr, 2 * block_size);
+
+      start = RDTSC();
+      ptr = kmalloc(block_size);
+      lat_block.push_back(RDTSC() - start);
+
+      ASSERT_TRUE(ptr != nullptr);
+      kfree2(ptr, block_size);
+   }
+
+   ASSERT_NO_FATAL_FAILURE(check_main_heaps_free_summary());
+
+   print_latency_percentiles("kmalloc(256 KB) cycles:", lat_fail);
+   print_latency_percentiles("kmalloc(8 KB) cycles:", lat_big);
+   print_latency_percentiles("kmalloc(4 KB) cycles:", lat_block);
+
+   for (void *b : blocks)
+      if (b)
+         kfree2(b, block_size);
+
+   ASSERT_NO_FATAL_FAILURE(check_main_heaps_free_summary());
+
+   /* After the holes are coalesced, big allocations must work again */
+   ptr = kmalloc(8 * MB);
+   ASSERT_TRUE(ptr != nullptr);
+   kfree2(ptr, 8 * MB);
+}
+
+#if KMALLOC_CALLSITE_PROFILER
+
+static vector<kmalloc_site_stats> get_kmalloc_sites()
+{
+   struct kmalloc_prof_info info;
+   vector<kmalloc_site_stats> v;
+
+   debug_kmalloc_prof_get_info(&info);
+   v.resize(info.max_sites + 1);
+   v.resize(debug_kmalloc_prof_get_sites(v.data(), (u32)v.size()));
+   return v;
+}
+
+static NO_INLINE void *callsite_test_alloc(size_t size)
+{
+   return kzmalloc(size);
+}
+
+TEST_F(kmalloc_test, callsite_profiler)
+{
+   const int count = 100;
+   vector<kmalloc_site_stats> before, after;
+   const kmalloc_site_stats *site = nullptr;
+   vector<void *> blocks;
+
+   before = get_kmalloc_sites();
+
+   for (int i = 0; i < count; i++)
+      blocks.push_back(callsite_test_alloc(64));
+
+   after = get_kmalloc_sites();
+
+   /*
+    * Look for our site among the new ones: others might have appeared, like
+    * the one allocating the structs of new small heaps.
+    */
+   for (const auto &s : after) {
+
+      bool found = false;
+
+      for (const auto &b : before)
+         found = found || b.caller == s.caller;
+
+      if (!found && s.tot_allocs == (ulong)count)
+         site = &s;
+   }
+
+   ASSERT_TRUE(site != nullptr);
+   EXPECT_EQ(site->tot_allocs, (ulong)count);
+   EXPECT_EQ(site->live_allocs, (ulong)count);
+   EXPECT_EQ(site->live_bytes, (size_t)count * 64);
+   EXPECT_EQ(site->peak_bytes, (size_t)count * 64);
+
+   const ulong caller = site->caller;
+
+   for (int i = 0; i < count; i += 2)
+      kfree2(blocks[i], 64);
+
+   after = get_kmalloc_sites();
+   site = nullptr;
+
+   for (const auto &s : after)
+      if (s.caller == caller)
+         site = &s;
+
+   ASSERT_TRUE(site != nullptr);
+   EXPECT_EQ(site->live_allocs, (ulong)count / 2);
+   EXPECT_EQ(site->live_bytes, (size_t)count / 2 * 64);
+   EXPECT_EQ(site->peak_bytes, (size_t)count * 64);
+
+   for (int i = 1; i < count; i += 2)
+      kfree(blocks[i]);
+
+   after = get_kmalloc_sites();
+   site = nullptr;
+
+   for (const auto &s : after)
+      if (s.caller == caller)
+         site = &s;
+
+   ASSERT_TRUE(site != nullptr);
+   EXPECT_EQ(site->live_allocs, 0ul);
+   EXPECT_EQ(site->live_bytes, 0u);
+   EXPECT_EQ(site->tot_allocs, (ulong)count);
+}
+
+#endif
+
 #define COLOR_RED           "\033[31m"
 #define COLOR_YELLOW        "\033[93m"
 #define COLOR_BRIGHT_GREEN  "\033[92m"
@@ -491,6 +722,38 @@ TEST_F(kmalloc_test, coalesce_block)
    kmalloc_destroy_heap(&h);
 }
 
+TEST_F(kmalloc_test, coalesce_block_big_leaves)
+{
+   void *ptr;
+   size_t s;
+
+   struct kmalloc_heap h;
+   kmalloc_create_heap(&h,
+                       MB,                           /* vaddr */
+                       KMALLOC_MIN_HEAP_SIZE,        /* heap size */
+                       KMALLOC_MIN_HEAP_SIZE / 16,   /* min block size */
+                       0,    /* alloc block size: 0 because linear_mapping=1 */
+                       true, /* linear mapping */
+                       NULL, NULL, NULL);
+
+   /* Split the block in leaves bigger than min_block_size */
+   s = h.size / 2;
+   ptr = per_heap_kmalloc(&h, &s, KMALLOC_FL_MULTI_STEP | 2 * h.min_block_size);
+   ASSERT_TRUE(ptr != NULL);
+   EXPECT_EQ(h.mem_allocated, h.size / 2);
+
+   /* Free one of them, then the whole block */
+   s = 2 * h.min_block_size;
+   per_heap_kfree(&h, (char *)ptr + s, &s, 0);
+   EXPECT_EQ(h.mem_allocated, h.size / 2 - 2 * h.min_block_size);
+
+   s = h.size / 2;
+   per_heap_kfree(&h, ptr, &s, KFREE_FL_ALLOW_SPLIT);
+   EXPECT_EQ(h.mem_allocated, 0u);
+
+   kmalloc_destroy_heap(&h);
+}
+
 static bool fake_alloc_and_map_func(ulong vaddr, size_t page_count)
 {
    return true;
@@ -810,3 +1073,102 @@ TEST_F(kmalloc_test, partial_free)
 
    kmalloc_destroy_heap(&h);
 }
+
+TEST_F(kmalloc_test, alloc_at)
+{
+   void *ptr;
+   size_t s;
+
+   struct kmalloc_heap h;
+   kmalloc_create_heap(&h,
+                       MB,                           /* vaddr */
+                       KMALLOC_MIN_HEAP_SIZE,        /* heap size */
+                       KMALLOC_MIN_HEAP_SIZE / 16,   /* min block size */
+                       KMALLOC_MIN_HEAP_SIZE / 8,    /* alloc block size */
+                       false,                        /* linear mapping */
+                       NULL,                         /* metadata_nodes */
+                       fake_alloc_and_map_func,
+                       fake_free_and_map_func);
+
+   struct block_node *nodes = (struct block_node *)h.metadata_nodes;
+   const u32 flags = h.min_block_size;
+
+   s = 3 * h.min_block_size;
+   ptr = per_heap_kmalloc(&h, &s, KMALLOC_FL_MULTI_STEP | flags);
+   EXPECT_EQ(ptr, (void *)h.vaddr);
+
+   /* Grow the block "in place" */
+   ptr = (void *)(h.vaddr + 3 * h.min_block_size);
+   ptr = per_heap_kmalloc_at(&h, ptr, 5 * h.min_block_size, flags);
+   EXPECT_EQ(ptr, (void *)(h.vaddr + 3 * h.min_block_size));
+
+   dump_heap_subtree(&h, 0, 5);
+
+   check_metadata(nodes, {
+      "+---------------------------------------------------------------+",
+      "|                              -S-                              |",
+      "+-------------------------------+-------------------------------+",
+      "|              -SF              |              ---              |",
+      "+---------------+---------------+---------------+---------------+",
+      "|      -SF      |      -SF      |      ---      |      ---      |",
+      "+-------+-------+-------+-------+-------+-------+-------+-------+",
+      "|  ASF  |  ASF  |  ASF  |  ASF  |  ---  |  ---  |  ---  |  ---  |",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+",
+      "|--F|--F|--F|--F|--F|--F|--F|--F|---|---|---|---|---|---|---|---|",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+"
+   });
+
+   EXPECT_EQ(h.mem_allocated, 8 * h.min_block_size);
+
+   /* Overlapping ranges must be rejected, without side effects */
+   ptr = (void *)(h.vaddr + 6 * h.min_block_size);
+   ptr = per_heap_kmalloc_at(&h, ptr, 4 * h.min_block_size, flags);
+   EXPECT_EQ(ptr, nullptr);
+
+   ptr = (void *)(h.vaddr + 15 * h.min_block_size);
+   ptr = per_heap_kmalloc_at(&h, ptr, 2 * h.min_block_size, flags);
+   EXPECT_EQ(ptr, nullptr);
+
+   dump_heap_subtree(&h, 0, 5);
+
+   check_metadata(nodes, {
+      "+---------------------------------------------------------------+",
+      "|                              -S-                              |",
+      "+-------------------------------+-------------------------------+",
+      "|              -SF              |              ---              |",
+      "+---------------+---------------+---------------+---------------+",
+      "|      -SF      |      -SF      |      ---      |      ---      |",
+      "+-------+-------+-------+-------+-------+-------+-------+-------+",
+      "|  ASF  |  ASF  |  ASF  |  ASF  |  ---  |  ---  |  ---  |  ---  |",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+",
+      "|--F|--F|--F|--F|--F|--F|--F|--F|---|---|---|---|---|---|---|---|",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+"
+   });
+
+   EXPECT_EQ(h.mem_allocated, 8 * h.min_block_size);
+
+   /* Free a range not aligned at its size */
+   s = 6 * h.min_block_size;
+   ptr = (void *)(h.vaddr + h.min_block_size);
+   per_heap_kfree(&h, ptr, &s, KFREE_FL_MULTI_STEP | KFREE_FL_ALLOW_SPLIT);
+
+   dump_heap_subtree(&h, 0, 5);
+
+   check_metadata(nodes, {
+      "+---------------------------------------------------------------+",
+      "|                              -S-                              |",
+      "+-------------------------------+-------------------------------+",
+      "|              -S-              |              ---              |",
+      "+---------------+---------------+---------------+---------------+",
+      "|      -S-      |      -S-      |      ---      |      ---      |",
+      "+-------+-------+-------+-------+-------+-------+-------+-------+",
+      "|  AS-  |  ---  |  ---  |  AS-  |  ---  |  ---  |  ---  |  ---  |",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+",
+      "|--F|---|---|---|---|---|---|--F|---|---|---|---|---|---|---|---|",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+"
+   });
+
+   EXPECT_EQ(h.mem_allocated, 2 * h.min_block_size);
+
+   kmalloc_destroy_heap(&h);
+}
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <set>
+#include <random>
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "kernel_init_funcs.h"
+
+extern "C" {
+
+   #include <tilck/common/utils.h>
+
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/kmem_cache.h>
+   #include <tilck/kernel/paging.h>
+   #include <tilck/kernel/test/kmem_cache.h>
+}
+
+using namespace std;
+using namespace testing;
+
+class kmem_cache_test : public Test {
+public:
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      kmem_cache_init(&cache, "test", 40, NULL);
+   }
+
+   void TearDown() override {
+      kmem_cache_destroy(&cache);
+   }
+
+   struct kmem_cache cache;
+};
+
+static int count_caches_cb(struct kmem_cache *c, void *arg)
+{
+   (*(int *)arg)++;
+   return 0;
+}
+
+TEST_F(kmem_cache_test, basic)
+{
+   void *a, *b;
+   int count = 0;
+
+   EXPECT_EQ(cache.obj_stride, 40u);
+   EXPECT_EQ(cache.slab_size, (u32)PAGE_SIZE);
+   EXPECT_GE(cache.objs_per_slab, (u32)KMEM_SLAB_MIN_OBJS);
+
+   for_each_kmem_cache(count_caches_cb, &count);
+   EXPECT_EQ(count, 1);
+
+   a = kmem_cache_alloc(&cache);
+   b = kmem_cache_alloc(&cache);
+   ASSERT_TRUE(a != NULL);
+   ASSERT_TRUE(b != NULL);
+
+   /* Objects are allocated in order, from the same slab */
+   EXPECT_EQ((char *)b - (char *)a, 40);
+   EXPECT_EQ(cache.stats.slabs, 1u);
+   EXPECT_EQ(cache.stats.active_objs, 2u);
+
+   kmem_cache_free(&cache, b);
+   kmem_cache_free(&cache, a);
+
+   EXPECT_EQ(cache.stats.active_objs, 0u);
+   EXPECT_EQ(cache.stats.allocs, 2u);
+   EXPECT_EQ(cache.stats.frees, 2u);
+
+   /* The empty slab is kept and re-used */
+   EXPECT_EQ(cache.stats.slabs, 1u);
+   EXPECT_EQ(kmem_cache_alloc(&cache), a);
+   EXPECT_EQ(cache.stats.slab_allocs, 1u);
+   kmem_cache_free(&cache, a);
+}
+
+TEST_F(kmem_cache_test, many_slabs)
+{
+   const u32 n = cache.objs_per_slab * 10 + 3;
+   vector<void *> objs;
+   set<void *> unique;
+
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   for (int round = 0; round < 3; round++) {
+
+      for (u32 i = 0; i < n; i++) {
+         void *obj = kmem_cache_alloc(&cache);
+         ASSERT_TRUE(obj != NULL);
+         memset(obj, (int)i, 40);
+         objs.push_back(obj);
+         unique.insert(obj);
+      }
+
+      ASSERT_EQ(unique.size(), objs.size());
+      EXPECT_EQ(cache.stats.slabs, (ulong)(n / cache.objs_per_slab + 1));
+      EXPECT_EQ(cache.stats.active_objs, (ulong)n);
+      EXPECT_EQ(cache.stats.peak_active_objs, (ulong)n);
+
+      shuffle(objs.begin(), objs.end(), e);
+
+      for (void *obj : objs)
+         kmem_cache_free(&cache, obj);
+
+      objs.clear();
+      unique.clear();
+
+      EXPECT_EQ(cache.stats.active_objs, 0u);
+      EXPECT_EQ(cache.stats.slabs, (ulong)KMEM_CACHE_MAX_FREE_SLABS);
+   }
+}
+
+static int ctor_calls;
+
+static void test_ctor(void *obj)
+{
+   *(u32 *)obj = 0xcafebabe;
+   ctor_calls++;
+}
+
+TEST_F(kmem_cache_test, ctor)
+{
+   struct kmem_cache c;
+   vector<u32 *> objs;
+
+   ctor_calls = 0;
+   kmem_cache_init(&c, "ctor_test", 200, &test_ctor);
+
+   /* The free list link must not be stored in the object */
+   EXPECT_GT(c.obj_stride, 200u);
+
+   for (u32 i = 0; i < c.objs_per_slab + 1; i++) {
+      u32 *obj = (u32 *)kmem_cache_alloc(&c);
+      ASSERT_TRUE(obj != NULL);
+      EXPECT_EQ(*obj, 0xcafebabe);
+      objs.push_back(obj);
+   }
+
+   /* The ctor is called once per object, when its slab is created */
+   EXPECT_EQ(ctor_calls, (int)c.objs_per_slab * 2);
+
+   for (u32 *obj : objs)
+      kmem_cache_free(&c, obj);
+
+   for (u32 i = 0; i < c.objs_per_slab; i++) {
+      u32 *obj = (u32 *)kmem_cache_alloc(&c);
+      EXPECT_EQ(*obj, 0xcafebabe);
+      objs[i] = obj;
+   }
+
+   EXPECT_EQ(ctor_calls, (int)c.objs_per_slab * 2);
+
+   for (u32 i = 0; i < c.objs_per_slab; i++)
+      kmem_cache_free(&c, objs[i]);
+
+   kmem_cache_destroy(&c);
+}
+
+TEST_F(kmem_cache_test, big_objects)
+{
+   struct kmem_cache c;
+   void *obj;
+
+   kmem_cache_init(&c, "big_test", 3000, NULL);
+
+   EXPECT_EQ(c.slab_size, 32 * KB);
+   EXPECT_EQ(c.objs_per_slab, 10u);
+
+   obj = kmem_cache_zalloc(&c);
+   ASSERT_TRUE(obj != NULL);
+   EXPECT_EQ(((ulong)obj & (c.slab_size - 1)) % 8, 0u);
+
+   for (u32 i = 0; i < 3000; i++)
+      ASSERT_EQ(((char *)obj)[i], 0);
+
+   kmem_cache_free(&c, obj);
+   kmem_cache_destroy(&c);
+}
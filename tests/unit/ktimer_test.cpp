@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/kernel/ktimer.h>
+}
+
+using namespace std;
+using namespace testing;
+
+static u64 curr_tick;
+
+struct test_timer {
+
+   struct ktimer t;
+   u64 expected;              /* tick when the timer is expected to fire */
+   u64 fired_at;              /* tick when the timer actually fired */
+   u32 fired_count;
+   u32 period;                /* re-arm the timer from the callback, if > 0 */
+};
+
+static void test_timer_func(struct ktimer *t)
+{
+   struct test_timer *tt = (struct test_timer *)t->arg;
+
+   tt->fired_at = curr_tick;
+   tt->fired_count++;
+
+   if (tt->period)
+      ktimer_start(t, tt->period);
+}
+
+static void do_ticks(u64 n)
+{
+   for (u64 i = 0; i < n; i++) {
+      curr_tick++;
+      ktimer_tick(1);
+   }
+}
+
+class ktimer_test : public Test {
+
+   void SetUp() override {
+      init_ktimers();
+      curr_tick = 0;
+   }
+};
+
+static void start_test_timer(struct test_timer *tt, u32 ticks)
+{
+   ktimer_init(&tt->t, &test_timer_func, tt);
+   tt->expected = curr_tick + ticks;
+   tt->fired_at = 0;
+   tt->fired_count = 0;
+   ktimer_start(&tt->t, ticks);
+}
+
+TEST_F(ktimer_test, fire_exactly_on_time)
+{
+   /* Delays covering the first 3 levels of the wheel */
+   const u32 max_delay = 1u << 17;
+   vector<test_timer> timers(2000);
+   mt19937 e(1234);
+   uniform_int_distribution<u32> dist(1, max_delay);
+
+   /* Some fixed corner cases at the level boundaries */
+   start_test_timer(&timers[0], 1);
+   start_test_timer(&timers[1], 255);
+   start_test_timer(&timers[2], 256);
+   start_test_timer(&timers[3], 257);
+   start_test_timer(&timers[4], 1u << 14);
+   start_test_timer(&timers[5], (1u << 14) + 1);
+
+   for (u32 i = 12; i < timers.size(); i++)
+      start_test_timer(&timers[i], dist(e));
+
+   /* Advance a bit, so that the next insertions are not slot-aligned */
+   do_ticks(123);
+
+   for (u32 i = 6; i < 12; i++)
+      start_test_timer(&timers[i], 250 + i * 1000);
+
+   do_ticks(max_delay + 1);
+
+   for (auto &tt : timers) {
+      ASSERT_EQ(tt.fired_count, 1u);
+      ASSERT_EQ(tt.fired_at, tt.expected);
+      ASSERT_FALSE(ktimer_is_active(&tt.t));
+   }
+}
+
+TEST_F(ktimer_test, cancel)
+{
+   test_timer t1 = {}, t2 = {};
+
+   start_test_timer(&t1, 1000);
+   start_test_timer(&t2, 1000);
+
+   do_ticks(300);
+   ASSERT_EQ(ktimer_get_remaining(&t1.t), 700u);
+   ASSERT_EQ(ktimer_cancel(&t1.t), 700u);
+   ASSERT_EQ(ktimer_cancel(&t1.t), 0u);
+   ASSERT_FALSE(ktimer_is_active(&t1.t));
+
+   do_ticks(1000);
+   ASSERT_EQ(t1.fired_count, 0u);
+   ASSERT_EQ(t2.fired_count, 1u);
+   ASSERT_EQ(ktimer_cancel(&t2.t), 0u);
+}
+
+TEST_F(ktimer_test, restart_and_periodic)
+{
+   test_timer t1 = {}, t2 = {};
+
+   start_test_timer(&t1, 5000);
+   do_ticks(10);
+
+   /* Re-arm an active timer: it must fire just once, at the new time */
+   ktimer_start(&t1.t, 20);
+   do_ticks(5000);
+   ASSERT_EQ(t1.fired_count, 1u);
+   ASSERT_EQ(t1.fired_at, 30u);
+
+   /* A timer re-armed by its own callback */
+   start_test_timer(&t2, 100);
+   t2.period = 100;
+   do_ticks(1000);
+   ASSERT_EQ(t2.fired_count, 10u);
+   ASSERT_EQ(ktimer_cancel(&t2.t), 100u);
+}
+
+TEST_F(ktimer_test, multiple_ticks_at_once)
+{
+   vector<test_timer> timers(500);
+   mt19937 e(4321);
+   uniform_int_distribution<u32> dist(1, 5000);
+
+   for (auto &tt : timers)
+      start_test_timer(&tt, dist(e));
+
+   /* Like the timer IRQ does, after the tick has been stopped for a while */
+   ktimer_tick(5000);
+
+   for (auto &tt : timers)
+      ASSERT_EQ(tt.fired_count, 1u);
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include <tilck/common/basic_defs.h>
+#include <tilck/common/utils.h>
 #include <tilck/kernel/datetime.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
@@ -93,14 +94,26 @@ void __wrap_kmutex_unlock(struct kmutex *m) {
  * with ON_CALL(mock, general_kmalloc).WillByDefault([&mock](...) { ... }),
  * simply because that is too slow for performance measurements. Otherwise, the
  * mocking mechanism with GMock is great.
+ *
+ * NOTE: kmalloc() guarantees that power-of-2 chunks are aligned at their size
+ * (up to KMALLOC_MAX_ALIGN) and the kmem caches rely on that for their slabs.
+ * Keep that guarantee for the page-size and bigger chunks.
  */
 
 void *__wrap_general_kmalloc(size_t *size, u32 flags)
 {
-   if (mock_kmalloc)
+   if (mock_kmalloc) {
+
+      if (*size >= PAGE_SIZE && *size <= KMALLOC_MAX_ALIGN &&
+          roundup_next_power_of_2(*size) == *size)
+      {
+         return aligned_alloc(*size, *size);
+      }
+
       return malloc(*size);
+   }
 
-   return __real_general_kmalloc(size, 0);
+   return __real_general_kmalloc(size, flags);
 }
 
 void __wrap_general_kfree(void *ptr, size_t *size, u32 flags)
@@ -108,7 +121,7 @@ void __wrap_general_kfree(void *ptr, size_t *size, u32 flags)
    if (mock_kmalloc)
       return free(ptr);
 
-   return __real_general_kfree(ptr, size, 0);
+   return __real_general_kfree(ptr, size, flags);
 }
 
 void *__wrap_kmalloc_get_first_heap(size_t *size)
@@ -19,11 +19,14 @@ extern "C" {
 #include <tilck/kernel/system_mmap.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/paging.h>
+#include <tilck/kernel/page_alloc.h>
 #include <tilck/kernel/kmalloc.h>
 #include <kernel/kmalloc/kmalloc_heap_struct.h> // kmalloc private header
 #include <kernel/kmalloc/kmalloc_block_node.h>  // kmalloc private header
 #include <tilck/kernel/test/mem_regions.h>
 #include <tilck/kernel/test/kmalloc.h>
+#include <tilck/kernel/test/kmem_cache.h>
+#include <tilck/kernel/test/shrinker.h>
 
 extern bool suppress_printk;
 
@@ -60,6 +63,12 @@ void init_kmalloc_for_tests()
    bzero(&used_heaps, sizeof(used_heaps));
    bzero(&max_tot_heap_mem_free, sizeof(max_tot_heap_mem_free));
 
+   /* The slabs of the static kmem caches belong to the old heaps */
+   kmem_caches_reset();
+
+   /* Each subsystem registers its shrinker again, when re-initialized */
+   shrinkers_reset();
+
    initialize_test_kernel_heap();
    suppress_printk = true;
    early_init_kmalloc();
@@ -125,6 +134,21 @@ size_t unmap_pages_permissive(pdir_t *pd, void *va, size_t count, bool do_free)
    return count;
 }
 
+void
+unmap_pages_noflush(pdir_t *pdir, void *vaddr, size_t count, bool do_free)
+{
+   for (size_t i = 0; i < count; i++) {
+
+      ulong va = (ulong)vaddr + (i << PAGE_SHIFT);
+      ulong pa = mappings[va];
+
+      if (do_free && pa != INVALID_PADDR)
+         free_page(KERNEL_PA_TO_VA(pa));
+
+      unmap_page(pdir, TO_PTR(va), do_free);
+   }
+}
+
 bool is_mapped(pdir_t *, void *vaddrp)
 {
    ulong vaddr = (ulong)vaddrp & PAGE_MASK;
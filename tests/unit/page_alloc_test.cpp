@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <set>
+#include <random>
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "kernel_init_funcs.h"
+
+extern "C" {
+
+   #include <tilck/common/utils.h>
+
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/paging.h>
+   #include <tilck/kernel/page_alloc.h>
+   #include <tilck/kernel/self_tests.h>
+   #include <tilck/kernel/test/page_alloc.h>
+   #include <tilck/kernel/test/kmalloc.h>
+
+   #include <kernel/kmalloc/kmalloc_heap_struct.h> // kmalloc private header
+}
+
+using namespace std;
+using namespace testing;
+
+#define CHUNK_PAGES     (1u << PAGE_ALLOC_MAX_ORDER)
+
+class page_alloc_test : public Test {
+public:
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      init_page_alloc(256 * MB);
+   }
+
+   void TearDown() override {
+
+      /* kmalloc's heaps will be re-initialized: forget about our chunks */
+      pfa_chunks_table = NULL;
+      pfa_chunks_table_size = 0;
+   }
+};
+
+static struct page_alloc_stats get_stats(void)
+{
+   struct page_alloc_stats s;
+   page_alloc_get_stats(&s);
+   return s;
+}
+
+static ulong free_list_len(u32 order)
+{
+   ulong n = 0;
+
+   for (struct list_node *p = pfa_free_lists[order].first;
+        p != (struct list_node *)&pfa_free_lists[order];
+        p = p->next)
+   {
+      n++;
+   }
+
+   return n;
+}
+
+TEST_F(page_alloc_test, single_page)
+{
+   void *p = alloc_page();
+
+   ASSERT_TRUE(p != NULL);
+   ASSERT_TRUE(IS_PAGE_ALIGNED(p));
+   ASSERT_TRUE(pfa_owns_page(p));
+   ASSERT_EQ(get_stats().chunks, 1u);
+   ASSERT_EQ(get_stats().free_pages, CHUNK_PAGES - 1);
+   ASSERT_EQ(get_stats().fallback_allocs, 0u);
+
+   /* The chunk has been split in one block per order */
+   for (u32 o = 0; o < PAGE_ALLOC_MAX_ORDER; o++)
+      ASSERT_EQ(free_list_len(o), 1u) << "order: " << o;
+
+   ASSERT_EQ(free_list_len(PAGE_ALLOC_MAX_ORDER), 0u);
+
+   free_page(p);
+
+   /* Everything got coalesced back, and the chunk is kept as spare */
+   ASSERT_EQ(get_stats().chunks, 1u);
+   ASSERT_EQ(get_stats().free_pages, CHUNK_PAGES);
+
+   for (u32 o = 0; o < PAGE_ALLOC_MAX_ORDER; o++)
+      ASSERT_EQ(free_list_len(o), 0u) << "order: " << o;
+
+   ASSERT_EQ(free_list_len(PAGE_ALLOC_MAX_ORDER), 1u);
+}
+
+TEST_F(page_alloc_test, kmalloc_pages)
+{
+   void *p = kmalloc(PAGE_SIZE);
+
+   ASSERT_TRUE(p != NULL);
+   ASSERT_FALSE(pfa_owns_page(p));
+
+   /* free_page() must be able to free pages not coming from us */
+   free_page(p);
+   ASSERT_EQ(get_stats().chunks, 0u);
+}
+
+TEST_F(page_alloc_test, whole_chunks)
+{
+   vector<void *> pages;
+   set<ulong> unique;
+   mt19937 e(1234);
+
+   for (u32 i = 0; i < 3 * CHUNK_PAGES; i++) {
+
+      void *p = alloc_page();
+
+      ASSERT_TRUE(p != NULL);
+      ASSERT_TRUE(pfa_owns_page(p));
+      ASSERT_TRUE(unique.insert((ulong)p).second) << "duplicate: " << p;
+      pages.push_back(p);
+   }
+
+   ASSERT_EQ(get_stats().chunks, 3u);
+   ASSERT_EQ(get_stats().free_pages, 0u);
+
+   shuffle(pages.begin(), pages.end(), e);
+
+   for (void *p : pages)
+      free_page(p);
+
+   ASSERT_EQ(get_stats().chunks, (ulong)PAGE_ALLOC_MAX_FREE_CHUNKS);
+   ASSERT_EQ(get_stats().free_pages,
+             (ulong)PAGE_ALLOC_MAX_FREE_CHUNKS * CHUNK_PAGES);
+}
+
+TEST_F(page_alloc_test, chaos)
+{
+   vector<pair<char *, u32>> blocks;
+   uniform_int_distribution<u32> order_dist(0, PAGE_ALLOC_MAX_ORDER);
+   uniform_int_distribution<u32> action_dist(0, 99);
+   mt19937 e(4321);
+
+   for (int i = 0; i < 20000; i++) {
+
+      if (blocks.empty() || action_dist(e) < 55) {
+
+         const u32 order = order_dist(e) / 2;
+         char *p = (char *)pfa_alloc(order);
+         ASSERT_TRUE(p != NULL);
+
+         /* Chunks are aligned at KMALLOC_MAX_ALIGN: check the alignment */
+         if ((PAGE_SIZE << order) <= KMALLOC_MAX_ALIGN) {
+            ASSERT_EQ(KERNEL_VA_TO_PA(p) & ((PAGE_SIZE << order) - 1), 0ul);
+         }
+
+         /* Tag all the pages: overlapping blocks would corrupt the tags */
+         for (u32 j = 0; j < (1u << order); j++)
+            memset(p + (j << PAGE_SHIFT) + sizeof(void *) * 2, i & 0xff, 16);
+
+         blocks.push_back(make_pair(p, order | ((u32)(i & 0xff) << 8)));
+         continue;
+      }
+
+      const size_t idx = uniform_int_distribution<size_t>(
+         0, blocks.size() - 1
+      )(e);
+
+      char *p = blocks[idx].first;
+      const u32 order = blocks[idx].second & 0xff;
+      const u8 tag = (u8)(blocks[idx].second >> 8);
+
+      for (u32 j = 0; j < (1u << order); j++) {
+         for (u32 k = 0; k < 16; k++) {
+            ASSERT_EQ((u8)p[(j << PAGE_SHIFT) + sizeof(void *) * 2 + k], tag);
+         }
+      }
+
+      pfa_free(p, order);
+      blocks[idx] = blocks.back();
+      blocks.pop_back();
+   }
+
+   for (auto &b : blocks)
+      pfa_free(b.first, b.second & 0xff);
+
+   ASSERT_EQ(get_stats().chunks, (ulong)PAGE_ALLOC_MAX_FREE_CHUNKS);
+   ASSERT_EQ(get_stats().free_pages,
+             (ulong)PAGE_ALLOC_MAX_FREE_CHUNKS * CHUNK_PAGES);
+}
+
+static size_t kmalloc_mem_allocated(void)
+{
+   size_t tot = 0;
+
+   for (int i = 0; i < used_heaps; i++)
+      tot += heaps[i]->mem_allocated;
+
+   return tot;
+}
+
+TEST_F(page_alloc_test, aligned_pages)
+{
+   const size_t size = 4 * MB;
+   vector<void *> blocks;
+   size_t mem;
+
+   for (u32 i = 0; i < 8; i++) {
+
+      mem = kmalloc_mem_allocated();
+      void *p = alloc_aligned_pages(size);
+
+      /* Only the aligned block must remain allocated */
+      ASSERT_TRUE(p != NULL);
+      ASSERT_EQ(KERNEL_VA_TO_PA(p) & (size - 1), 0ul);
+      ASSERT_EQ(kmalloc_mem_allocated(), mem + size);
+      blocks.push_back(p);
+
+      /* Make the free memory in kmalloc's heaps less and less aligned */
+      ASSERT_TRUE(kmalloc(i * KMALLOC_MAX_ALIGN + PAGE_SIZE) != NULL);
+   }
+
+   mem = kmalloc_mem_allocated();
+
+   for (u32 i = 0; i < blocks.size(); i++) {
+
+      char *p = (char *)blocks[i];
+
+      if (i % 2) {
+         free_aligned_pages(p, size);
+         continue;
+      }
+
+      /* Free the pages one by one, like after a big page has been split */
+      for (size_t off = size; off > 0; off -= PAGE_SIZE)
+         free_page(p + off - PAGE_SIZE);
+   }
+
+   ASSERT_EQ(kmalloc_mem_allocated(), mem - blocks.size() * size);
+   ASSERT_EQ(get_stats().chunks, 0u);
+}
+
+#if KERNEL_SELFTESTS
+
+TEST_F(page_alloc_test, perf_test)
+{
+   selftest_page_alloc_perf();
+}
+
+#endif
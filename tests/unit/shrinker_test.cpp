@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "kernel_init_funcs.h"
+
+extern "C" {
+
+   #include <tilck/common/utils.h>
+
+   #include <tilck/kernel/interrupts.h>
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/kmalloc_debug.h>
+   #include <tilck/kernel/kmem_cache.h>
+   #include <tilck/kernel/shrinker.h>
+   #include <tilck/kernel/test/kmalloc.h>
+   #include <tilck/kernel/sched.h>
+   #include <tilck/kernel/test/shrinker.h>
+
+   extern ATOMIC(int) __in_irq_count;
+}
+
+using namespace std;
+using namespace testing;
+
+/*
+ * A fake cache: it holds blocks allocated with kmalloc() and it releases them
+ * when its shrinker is asked to.
+ */
+struct fake_cache {
+
+   struct shrinker s;           /* must be the first member */
+   vector<void *> blocks;
+   size_t block_size;
+   bool recurse;
+};
+
+static size_t fake_count(struct shrinker *s)
+{
+   struct fake_cache *fc = (struct fake_cache *)s;
+   return fc->blocks.size() * fc->block_size;
+}
+
+static size_t fake_scan(struct shrinker *s, size_t bytes)
+{
+   struct fake_cache *fc = (struct fake_cache *)s;
+   size_t released = 0;
+
+   if (fc->recurse) {
+      /* Nested calls must not run the shrinkers again */
+      EXPECT_EQ(shrink_caches((size_t)-1), 0u);
+   }
+
+   while (!fc->blocks.empty() && released < bytes) {
+      kfree2(fc->blocks.back(), fc->block_size);
+      fc->blocks.pop_back();
+      released += fc->block_size;
+   }
+
+   return released;
+}
+
+static void fake_cache_init(struct fake_cache *fc, size_t block_size)
+{
+   fc->s.name = "fake";
+   fc->s.count = &fake_count;
+   fc->s.scan = &fake_scan;
+   fc->s.stats = shrinker_stats();
+   list_node_init(&fc->s.node);
+   fc->blocks.clear();
+   fc->block_size = block_size;
+   fc->recurse = false;
+}
+
+class shrinker_test : public Test {
+public:
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+
+      /* Reclaim runs only in task context, with preemption enabled */
+      force_enable_preemption();
+   }
+
+   void TearDown() override {
+
+      for (void *ptr : blocks)
+         kfree2(ptr, block_size);
+
+      blocks.clear();
+
+      /* The other tests run with preemption disabled, as during boot */
+      disable_preemption();
+   }
+
+   /* Allocate blocks of `sz` bytes until kmalloc() fails */
+   size_t fill_memory(size_t sz) {
+
+      size_t n = 0;
+      void *ptr;
+
+      block_size = sz;
+
+      while ((ptr = kmalloc(sz))) {
+         blocks.push_back(ptr);
+         n++;
+      }
+
+      return n;
+   }
+
+   vector<void *> blocks;
+   size_t block_size;
+};
+
+static struct kmalloc_small_heaps_stats get_small_heaps_stats(void)
+{
+   struct debug_kmalloc_stats stats;
+   debug_kmalloc_get_stats(&stats);
+   return stats.small_heaps;
+}
+
+TEST_F(shrinker_test, reclaim_on_oom)
+{
+   struct fake_cache fc;
+   const size_t n = 8;
+
+   fake_cache_init(&fc, 1 * MB);
+   ASSERT_GT(fill_memory(1 * MB), n);
+
+   /* Make the fake cache own the last `n` blocks */
+   for (size_t i = 0; i < n; i++) {
+      fc.blocks.push_back(blocks.back());
+      blocks.pop_back();
+   }
+
+   register_shrinker(&fc.s);
+   EXPECT_EQ(shrinkers_count(), n * MB);
+
+   /* Each allocation makes the cache release just one block */
+   for (size_t i = 0; i < n; i++) {
+
+      void *ptr = kmalloc(1 * MB);
+      ASSERT_TRUE(ptr != NULL);
+      blocks.push_back(ptr);
+
+      EXPECT_EQ(fc.blocks.size(), n - i - 1);
+      EXPECT_EQ(fc.s.stats.scans, i + 1);
+      EXPECT_EQ(fc.s.stats.released, (i + 1) * MB);
+   }
+
+   /* Now there's nothing left to reclaim: kmalloc() has to fail */
+   EXPECT_TRUE(kmalloc(1 * MB) == NULL);
+   EXPECT_EQ(fc.s.stats.scans, n);
+   EXPECT_EQ(shrinkers_count(), 0u);
+
+   unregister_shrinker(&fc.s);
+}
+
+TEST_F(shrinker_test, no_recursion)
+{
+   struct fake_cache fc;
+   void *ptr;
+
+   fake_cache_init(&fc, 64 * KB);
+   fc.recurse = true;
+
+   for (int i = 0; i < 4; i++) {
+      ASSERT_TRUE((ptr = kmalloc(fc.block_size)) != NULL);
+      fc.blocks.push_back(ptr);
+   }
+
+   register_shrinker(&fc.s);
+   EXPECT_EQ(shrink_caches((size_t)-1), 4 * fc.block_size);
+   EXPECT_EQ(fc.s.stats.scans, 1u);
+   EXPECT_TRUE(fc.blocks.empty());
+
+   /* Nothing to reclaim: the shrinker is not even called */
+   EXPECT_EQ(shrink_caches((size_t)-1), 0u);
+   EXPECT_EQ(fc.s.stats.scans, 1u);
+
+   unregister_shrinker(&fc.s);
+}
+
+TEST_F(shrinker_test, no_reclaim_in_irq_context)
+{
+   struct fake_cache fc;
+   const size_t n = 4;
+
+   fake_cache_init(&fc, 1 * MB);
+   ASSERT_GT(fill_memory(1 * MB), n);
+
+   for (size_t i = 0; i < n; i++) {
+      fc.blocks.push_back(blocks.back());
+      blocks.pop_back();
+   }
+
+   register_shrinker(&fc.s);
+
+   /*
+    * In IRQ context, the interrupted task might be using the heaps and the
+    * structures of the shrinkers: the allocation must just fail.
+    */
+   disable_preemption();
+   atomic_store_explicit(&__in_irq_count, 1, mo_relaxed);
+   {
+      EXPECT_TRUE(kmalloc(1 * MB) == NULL);
+      EXPECT_EQ(shrink_caches((size_t)-1), 0u);
+   }
+   atomic_store_explicit(&__in_irq_count, 0, mo_relaxed);
+   enable_preemption();
+
+   EXPECT_EQ(fc.s.stats.scans, 0u);
+   EXPECT_EQ(fc.blocks.size(), n);
+
+   /* The same applies with preemption disabled, in task context */
+   disable_preemption();
+   {
+      EXPECT_TRUE(kmalloc(1 * MB) == NULL);
+   }
+   enable_preemption();
+
+   EXPECT_EQ(fc.s.stats.scans, 0u);
+
+   /* Back in a regular task context, reclaim works again */
+   void *ptr = kmalloc(1 * MB);
+   ASSERT_TRUE(ptr != NULL);
+   blocks.push_back(ptr);
+   EXPECT_EQ(fc.s.stats.scans, 1u);
+
+   unregister_shrinker(&fc.s);
+
+   for (void *obj : fc.blocks)
+      kfree2(obj, fc.block_size);
+}
+
+TEST_F(shrinker_test, empty_small_heaps)
+{
+   vector<void *> objs;
+   struct kmalloc_small_heaps_stats shs;
+   int created;
+   void *ptr;
+
+   /* Create several small heaps and make all of them empty */
+   for (int i = 0; i < 512; i++) {
+      ASSERT_TRUE((ptr = kmalloc(1 * KB)) != NULL);
+      objs.push_back(ptr);
+   }
+
+   shs = get_small_heaps_stats();
+   created = shs.tot_count;
+   ASSERT_GT(created, 1);
+
+   for (void *obj : objs)
+      kfree2(obj, 1 * KB);
+
+   /* Without memory pressure, the empty heaps are all kept */
+   shs = get_small_heaps_stats();
+   EXPECT_EQ(shs.empty_count, created);
+   EXPECT_EQ(shs.tot_count, created);
+   EXPECT_EQ(shrinkers_count(), (size_t)created * SMALL_HEAP_SIZE);
+
+   /*
+    * Under memory pressure, the empty heaps must be destroyed and their
+    * memory re-used for other allocations, instead of failing.
+    */
+   fill_memory(SMALL_HEAP_SIZE);
+
+   shs = get_small_heaps_stats();
+   EXPECT_EQ(shs.empty_count, 0);
+   EXPECT_EQ(shs.tot_count, 0);
+
+   /* All the memory of the destroyed heaps is in use now */
+   EXPECT_EQ(shrinkers_count(), 0u);
+   EXPECT_TRUE(kmalloc(SMALL_HEAP_SIZE) == NULL);
+
+   /* The small heaps still work: a new one gets created */
+   for (int i = 0; i < 2; i++) {
+      kfree2(blocks.back(), block_size);
+      blocks.pop_back();
+   }
+
+   ASSERT_TRUE((ptr = kmalloc(1 * KB)) != NULL);
+   EXPECT_EQ(get_small_heaps_stats().tot_count, 1);
+   kfree2(ptr, 1 * KB);
+}
+
+TEST_F(shrinker_test, kmem_cache_free_slabs)
+{
+   struct kmem_cache c;
+   vector<void *> objs;
+   void *obj;
+
+   kmem_cache_init(&c, "shrink_test", 100, NULL);
+
+   for (u32 i = 0; i < c.objs_per_slab * 3; i++) {
+      ASSERT_TRUE((obj = kmem_cache_alloc(&c)) != NULL);
+      objs.push_back(obj);
+   }
+
+   for (void *ptr : objs)
+      kmem_cache_free(&c, ptr);
+
+   objs.clear();
+
+   /* The cache keeps some free slabs, until there's memory pressure */
+   ASSERT_EQ(c.free_slabs_count, (ulong)KMEM_CACHE_MAX_FREE_SLABS);
+   EXPECT_EQ(shrinkers_count(), KMEM_CACHE_MAX_FREE_SLABS * c.slab_size);
+
+   fill_memory(c.slab_size);
+
+   EXPECT_EQ(c.free_slabs_count, 0u);
+   EXPECT_EQ(c.stats.slabs, 0u);
+
+   /* The cache can still grow, once there's some memory again */
+   kfree2(blocks.back(), block_size);
+   blocks.pop_back();
+
+   ASSERT_TRUE((obj = kmem_cache_alloc(&c)) != NULL);
+   EXPECT_EQ(c.stats.slabs, 1u);
+   kmem_cache_free(&c, obj);
+
+   kmem_cache_destroy(&c);
+}
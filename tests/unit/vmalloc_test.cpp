@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "kernel_init_funcs.h"
+
+extern "C" {
+
+   #include <tilck/common/utils.h>
+
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/paging.h>
+   #include <tilck/kernel/page_alloc.h>
+   #include <tilck/kernel/vmalloc.h>
+   #include <tilck/kernel/test/page_alloc.h>
+   #include <tilck/kernel/test/vmalloc.h>
+}
+
+using namespace std;
+using namespace testing;
+
+#define AREA_PAGES      256u
+
+class vmalloc_test : public Test {
+public:
+
+   void SetUp() override {
+
+      init_kmalloc_for_tests();
+      init_page_alloc(256 * MB);
+
+      /* A fake range, outside of the linear mapping */
+      area_va = LINEAR_MAPPING_END;
+      vmalloc_init_area(area_va, AREA_PAGES << PAGE_SHIFT);
+   }
+
+   void TearDown() override {
+
+      vmalloc_start = vmalloc_end = 0;
+
+      /* kmalloc's heaps will be re-initialized: forget about our chunks */
+      pfa_chunks_table = NULL;
+      pfa_chunks_table_size = 0;
+   }
+
+   ulong area_va;
+};
+
+static struct vmalloc_stats get_stats(void)
+{
+   struct vmalloc_stats s;
+   vmalloc_get_stats(&s);
+   return s;
+}
+
+static bool page_mapped(ulong va)
+{
+   const ulong pa = get_mapping(get_kernel_pdir(), TO_PTR(va));
+   return pa != 0 && pa != INVALID_PADDR;
+}
+
+static void *va_at(ulong base, u32 page)
+{
+   return TO_PTR(base + (page << PAGE_SHIFT));
+}
+
+TEST_F(vmalloc_test, alloc_with_guard_page)
+{
+   void *p, *q;
+
+   ASSERT_TRUE((p = vmalloc_pages(3 * PAGE_SIZE + 1)) != NULL);
+   EXPECT_EQ((ulong)p, area_va);
+   EXPECT_TRUE(is_vmalloc_addr(p));
+
+   for (u32 i = 0; i < 4; i++)
+      EXPECT_TRUE(page_mapped((ulong)va_at(area_va, i)));
+
+   /* The guard page */
+   EXPECT_FALSE(page_mapped((ulong)va_at(area_va, 4)));
+
+   /* The memory is really usable */
+   for (u32 i = 0; i < 4; i++) {
+      ulong pa = get_mapping(get_kernel_pdir(), va_at(area_va, i));
+      memset(KERNEL_PA_TO_VA(pa), 0xaa, PAGE_SIZE);
+   }
+
+   ASSERT_TRUE((q = vmalloc_pages(PAGE_SIZE)) != NULL);
+   EXPECT_EQ(q, va_at(area_va, 5));
+
+   struct vmalloc_stats s = get_stats();
+   EXPECT_EQ(s.areas, 2u);
+   EXPECT_EQ(s.mapped_pages, 5u);
+   EXPECT_EQ(s.used_size, 7u * PAGE_SIZE);
+   EXPECT_EQ(s.gaps, 1u);
+
+   vfree_pages(p, 3 * PAGE_SIZE + 1);
+   vfree_pages(q, PAGE_SIZE);
+}
+
+TEST_F(vmalloc_test, lazy_free_and_purge)
+{
+   void *p, *q;
+
+   ASSERT_TRUE((p = vmalloc_pages(4 * PAGE_SIZE)) != NULL);
+   vfree_pages(p, 4 * PAGE_SIZE);
+
+   /* Unmapped immediately, but not flushed: the range must not be re-used */
+   for (u32 i = 0; i < 4; i++)
+      EXPECT_FALSE(page_mapped((ulong)va_at(area_va, i)));
+
+   struct vmalloc_stats s = get_stats();
+   EXPECT_EQ(s.areas, 0u);
+   EXPECT_EQ(s.mapped_pages, 0u);
+   EXPECT_EQ(s.lazy_pages, 4u);
+   EXPECT_EQ(s.purges, 0u);
+
+   ASSERT_TRUE((q = vmalloc_pages(4 * PAGE_SIZE)) != NULL);
+   EXPECT_NE(p, q);
+   vfree_pages(q, 4 * PAGE_SIZE);
+
+   /* After the purge, all the gaps are merged back together */
+   vmalloc_purge_lazy();
+
+   s = get_stats();
+   EXPECT_EQ(s.lazy_pages, 0u);
+   EXPECT_EQ(s.purges, 1u);
+   EXPECT_EQ(s.full_flushes, 0u);
+   EXPECT_EQ(s.used_size, 0u);
+   EXPECT_EQ(s.gaps, 1u);
+
+   ASSERT_TRUE((q = vmalloc_pages(4 * PAGE_SIZE)) != NULL);
+   EXPECT_EQ(p, q);
+   vfree_pages(q, 4 * PAGE_SIZE);
+}
+
+TEST_F(vmalloc_test, best_fit)
+{
+   void *a, *b, *c, *d, *p;
+
+   ASSERT_TRUE((a = vmalloc_pages(4 * PAGE_SIZE)) != NULL);
+   ASSERT_TRUE((b = vmalloc_pages(1 * PAGE_SIZE)) != NULL);
+   ASSERT_TRUE((c = vmalloc_pages(8 * PAGE_SIZE)) != NULL);
+   ASSERT_TRUE((d = vmalloc_pages(1 * PAGE_SIZE)) != NULL);
+
+   vfree_pages(a, 4 * PAGE_SIZE);
+   vfree_pages(c, 8 * PAGE_SIZE);
+   vmalloc_purge_lazy();
+
+   /* Three gaps: 5 pages, 9 pages and the rest of the area */
+   EXPECT_EQ(get_stats().gaps, 3u);
+
+   /* The smallest gap that fits: `c`'s one, not the first one */
+   ASSERT_TRUE((p = vmalloc_pages(6 * PAGE_SIZE)) != NULL);
+   EXPECT_EQ(p, c);
+   vfree_pages(p, 6 * PAGE_SIZE);
+
+   /* A perfect fit consumes the whole gap */
+   ASSERT_TRUE((p = vmalloc_pages(4 * PAGE_SIZE)) != NULL);
+   EXPECT_EQ(p, a);
+   EXPECT_EQ(get_stats().gaps, 2u);
+   vfree_pages(p, 4 * PAGE_SIZE);
+
+   vfree_pages(b, 1 * PAGE_SIZE);
+   vfree_pages(d, 1 * PAGE_SIZE);
+   vmalloc_purge_lazy();
+   EXPECT_EQ(get_stats().gaps, 1u);
+}
+
+TEST_F(vmalloc_test, purge_on_exhaustion)
+{
+   const size_t sz = (AREA_PAGES / 2 - 1) << PAGE_SHIFT;
+   void *p, *q, *r;
+
+   ASSERT_TRUE((p = vmalloc_pages(sz)) != NULL);
+   ASSERT_TRUE((q = vmalloc_pages(sz)) != NULL);
+   EXPECT_EQ(get_stats().gaps, 0u);
+
+   EXPECT_TRUE(vmalloc_pages(PAGE_SIZE) == NULL);
+   EXPECT_EQ(get_stats().failed_allocs, 1u);
+
+   /* The lazily freed area gets purged, in order to satisfy the request */
+   vfree_pages(p, sz);
+   ASSERT_TRUE((r = vmalloc_pages(sz)) != NULL);
+   EXPECT_EQ(r, p);
+
+   struct vmalloc_stats s = get_stats();
+   EXPECT_EQ(s.purges, 1u);
+   EXPECT_EQ(s.full_flushes, 1u);      /* too many pages for INVLPG */
+   EXPECT_EQ(s.peak_used_size, (ulong)AREA_PAGES << PAGE_SHIFT);
+
+   vfree_pages(q, sz);
+   vfree_pages(r, sz);
+}
+
+TEST_F(vmalloc_test, physically_contiguous_runs)
+{
+   const u32 n = 16;
+   ulong pa0;
+   void *p;
+
+   ASSERT_TRUE((p = vmalloc_pages(n << PAGE_SHIFT)) != NULL);
+   pa0 = get_mapping(get_kernel_pdir(), p);
+
+   /* With plenty of free memory, a single block is used */
+   for (u32 i = 1; i < n; i++) {
+      ulong pa = get_mapping(get_kernel_pdir(), va_at((ulong)p, i));
+      EXPECT_EQ(pa, pa0 + (i << PAGE_SHIFT));
+   }
+
+   vfree_pages(p, n << PAGE_SHIFT);
+}
+
+TEST_F(vmalloc_test, vmalloc_front_end)
+{
+   void *small, *big;
+
+   ASSERT_TRUE((small = vmalloc(100)) != NULL);
+   ASSERT_TRUE((big = vmalloc(VMALLOC_MIN_SIZE)) != NULL);
+
+   EXPECT_FALSE(is_vmalloc_addr(small));
+   EXPECT_TRUE(is_vmalloc_addr(big));
+
+   vfree2(small, 100);
+   vfree2(big, VMALLOC_MIN_SIZE);
+
+   EXPECT_EQ(get_stats().areas, 0u);
+   EXPECT_EQ(get_stats().lazy_pages, VMALLOC_MIN_SIZE / PAGE_SIZE);
+}